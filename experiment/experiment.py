@@ -1,4 +1,6 @@
+import argparse
 import asyncio
+import time
 from bleak import BleakScanner, BleakClient
 
 BT_TARGET_ADDRESS = "C4:A9:B8:F8:47:D4" # out pitpad device
@@ -19,6 +21,42 @@ class PITPADService:
     CHARACTERISTIC_NOTIFY_STATE_UUID = "0000fba2-0000-1000-8000-00805f9b34fb"
 
 
+# Trace format read by the native replay driver, see src/TraceFormat.h
+TRACE_MAGIC = b"PKTR"
+TRACE_VERSION = 1
+TRACE_CHANNEL_STATE = 0
+TRACE_CHANNEL_NOTIFY1 = 1
+
+
+def encode_varint(value):
+    out = bytearray()
+    while value >= 0x80:
+        out.append((value & 0x7F) | 0x80)
+        value >>= 7
+    out.append(value)
+    return bytes(out)
+
+
+class TraceWriter:
+    def __init__(self, path):
+        self._file = open(path, "wb")
+        self._file.write(TRACE_MAGIC + bytes([TRACE_VERSION, 0, 0, 0]))
+        self._start_us = time.monotonic_ns() // 1000
+        self._last_us = 0
+        self.records = 0
+
+    def write(self, channel, data):
+        now_us = time.monotonic_ns() // 1000 - self._start_us
+        self._file.write(encode_varint(now_us - self._last_us) + bytes([channel]) + encode_varint(len(data)) + bytes(data))
+        # flush per record so an interrupted capture loses at most one record
+        self._file.flush()
+        self._last_us = now_us
+        self.records += 1
+
+    def close(self):
+        self._file.close()
+
+
 async def list_characteristics(address):
     async with BleakClient(address) as client:
         if not client.is_connected:
@@ -32,14 +70,14 @@ async def list_characteristics(address):
                 props = ",".join(char.properties)
                 print(f"  CHARACTERISTIC: {char.uuid} [{props}]")
 
-def notification_handler_state(sender, data):
-    print(f"Notification from {sender} (CHARACTERISTIC_NOTIFY_STATE_UUID): {data}")
-    
-            
-async def main():
+async def main(args):
     print("Scanning for BLE devices...")
 
-    if input("Use default target address (n = scan for devices)? (y/n): ").lower() == 'y':
+    trace = TraceWriter(args.capture) if args.capture else None
+
+    if args.address:
+        target_address = args.address
+    elif input("Use default target address (n = scan for devices)? (y/n): ").lower() == 'y':
         target_address = BT_TARGET_ADDRESS
     else:
         devices = await BleakScanner.discover()
@@ -66,9 +104,15 @@ async def main():
         print(f"Connected to {target_address}\n")
 
         def notification_handler1(sender, data):
+            if trace:
+                trace.write(TRACE_CHANNEL_NOTIFY1, data)
             print(f"Notification from {sender} (CHARACTERISTIC_NOTIFY1): {data}")
 
-        
+        def notification_handler_state(sender, data):
+            if trace:
+                trace.write(TRACE_CHANNEL_STATE, data)
+            print(f"Notification from {sender} (CHARACTERISTIC_NOTIFY_STATE_UUID): {data}")
+
 
         await client.start_notify(PITPADService.CHARACTERISTIC_NOTIFY1_UUID, notification_handler1)
         await client.start_notify(PITPADService.CHARACTERISTIC_NOTIFY_STATE_UUID, notification_handler_state)
@@ -77,11 +121,18 @@ async def main():
         try:
             while True:
                 await asyncio.sleep(1)
-        except KeyboardInterrupt:
+        except (KeyboardInterrupt, asyncio.CancelledError):
             print("Stopping notifications...")
+        finally:
+            if trace:
+                trace.close()
+                print(f"Captured {trace.records} notifications to {args.capture}")
 
         await client.stop_notify(PITPADService.CHARACTERISTIC_NOTIFY1_UUID)
         await client.stop_notify(PITPADService.CHARACTERISTIC_NOTIFY_STATE_UUID)
 
 if __name__ == "__main__":
-    asyncio.run(main())
\ No newline at end of file
+    parser = argparse.ArgumentParser(description="Print the treadmill notifications and optionally capture them")
+    parser.add_argument("--address", help="treadmill address, skips the prompt")
+    parser.add_argument("--capture", metavar="FILE", help="record the notifications as a trace for the replay driver (env:replay)")
+    asyncio.run(main(parser.parse_args()))
\ No newline at end of file
@@ -0,0 +1,94 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+#include "TreadmillProtocol.h"
+
+#define DEFAULT_USER_ID 58965456623ULL
+#define DEFAULT_WEIGHT 80
+
+struct CommandFrame
+{
+    uint8_t bytes[COMMAND_FRAME_LENGTH] = {};
+};
+
+// Command frames generated at compile time. Start, pause and stop are fully
+// constant. Speed frames only differ in the speed bytes 6-7 and the checksum, so
+// they are produced by patching a precomputed template and updating the XOR
+// checksum incrementally instead of running the full encoder. User id and weight
+// are template parameters so other models can use their own values.
+template <uint64_t UserId = DEFAULT_USER_ID, uint8_t Weight = DEFAULT_WEIGHT>
+class CommandFrames
+{
+public:
+    // Same layout as TreadmillProtocol::makePacket(), usable in constant expressions
+    static constexpr CommandFrame build(TreadmillProtocol::CommandType type, uint16_t speed)
+    {
+        CommandFrame frame;
+        frame.bytes[0] = FRAME_START_BYTE;
+        frame.bytes[1] = COMMAND_FRAME_LENGTH;
+        frame.bytes[6] = (speed >> 8) & 0xFF;
+        frame.bytes[7] = speed & 0xFF;
+        frame.bytes[8] = (speed != 0) ? 5 : 1;
+        frame.bytes[10] = Weight;
+        frame.bytes[12] = (uint8_t)type & 0xF7; // kph mode (bit 3 = 0)
+        for (int i = 0; i < 8; ++i)
+        {
+            frame.bytes[13 + i] = (UserId >> (56 - i * 8)) & 0xFF;
+        }
+        uint8_t checksum = 0;
+        for (int i = 1; i <= 20; ++i)
+        {
+            checksum ^= frame.bytes[i];
+        }
+        frame.bytes[21] = checksum;
+        frame.bytes[22] = FRAME_END_BYTE;
+        return frame;
+    }
+
+    static constexpr CommandFrame START = build(TreadmillProtocol::CMD_START_SET_SPEED, 0);
+    static constexpr CommandFrame PAUSE = build(TreadmillProtocol::CMD_PAUSE, 0);
+    static constexpr CommandFrame STOP = build(TreadmillProtocol::CMD_STOP, 0);
+
+    // writes the frame for the given command into outPacket (COMMAND_FRAME_LENGTH bytes)
+    static void make(TreadmillProtocol::CommandType type, uint16_t speed, uint8_t *outPacket)
+    {
+        if (type == TreadmillProtocol::CMD_START_SET_SPEED && speed != 0)
+        {
+            makeSpeed(speed, outPacket);
+            return;
+        }
+        const CommandFrame &frame = type == TreadmillProtocol::CMD_PAUSE  ? PAUSE
+                                    : type == TreadmillProtocol::CMD_STOP ? STOP
+                                                                          : START;
+        memcpy(outPacket, frame.bytes, COMMAND_FRAME_LENGTH);
+    }
+
+    // speed must not be 0, use START for that
+    static void makeSpeed(uint16_t speed, uint8_t *outPacket)
+    {
+        uint8_t high = (speed >> 8) & 0xFF;
+        uint8_t low = speed & 0xFF;
+        memcpy(outPacket, SPEED_TEMPLATE.bytes, COMMAND_FRAME_LENGTH);
+        outPacket[6] = high;
+        outPacket[7] = low;
+        // the template has zero speed bytes, so XOR-ing them in updates the checksum
+        outPacket[21] = SPEED_TEMPLATE.bytes[21] ^ high ^ low;
+    }
+
+private:
+    // speed frame with both speed bytes zero but the set_speed marker already applied
+    static constexpr CommandFrame speedTemplate()
+    {
+        CommandFrame frame = build(TreadmillProtocol::CMD_START_SET_SPEED, 0x0100);
+        frame.bytes[21] ^= frame.bytes[6];
+        frame.bytes[6] = 0;
+        return frame;
+    }
+
+    static constexpr CommandFrame SPEED_TEMPLATE = speedTemplate();
+};
+
+typedef CommandFrames<> DefaultCommandFrames;
+
+static_assert(DefaultCommandFrames::STOP.bytes[21] == 0xF5, "unexpected checksum of the stop frame");
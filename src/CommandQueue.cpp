@@ -0,0 +1,57 @@
+#include "CommandQueue.h"
+
+CommandQueue::Result CommandQueue::push(TreadmillProtocol::CommandType type, uint16_t speed, unsigned long nowUs)
+{
+    TreadmillCommand command;
+    command.type = type;
+    command.speed = speed;
+    command.enqueuedUs = nowUs;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (command.isSpeedSetpoint() && m_count > 0)
+    {
+        TreadmillCommand &tail = m_commands[(m_head + m_count - 1) % COMMAND_QUEUE_SIZE];
+        if (tail.isSpeedSetpoint())
+        {
+            // latest wins, the latency is measured from the newest request
+            tail = command;
+            m_coalesced++;
+            return COALESCED;
+        }
+    }
+
+    if (m_count == COMMAND_QUEUE_SIZE)
+    {
+        m_dropped++;
+        return FULL;
+    }
+    m_commands[(m_head + m_count) % COMMAND_QUEUE_SIZE] = command;
+    m_count++;
+    return QUEUED;
+}
+
+bool CommandQueue::pop(TreadmillCommand &command)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_count == 0)
+    {
+        return false;
+    }
+    command = m_commands[m_head];
+    m_head = (m_head + 1) % COMMAND_QUEUE_SIZE;
+    m_count--;
+    return true;
+}
+
+size_t CommandQueue::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_count;
+}
+
+void CommandQueue::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_head = 0;
+    m_count = 0;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <Arduino.h>
+#include <mutex>
+
+#include "TreadmillProtocol.h"
+
+#define COMMAND_QUEUE_SIZE 8
+
+struct TreadmillCommand
+{
+    TreadmillProtocol::CommandType type = TreadmillProtocol::CMD_STOP;
+    uint16_t speed = 0;
+    unsigned long enqueuedUs = 0;
+
+    // speed setpoints can be coalesced, start (speed 0), pause and stop can not
+    bool isSpeedSetpoint() const
+    {
+        return type == TreadmillProtocol::CMD_START_SET_SPEED && speed != 0;
+    }
+};
+
+// Bounded FIFO of treadmill commands between the mqtt callback and the sender
+// task. A speed setpoint replaces a speed setpoint that is still pending at the
+// tail, so a burst of slider updates collapses into the newest value while
+// start/pause/stop keep their order relative to the speeds around them.
+class CommandQueue
+{
+public:
+    enum Result
+    {
+        QUEUED,
+        COALESCED,
+        FULL
+    };
+
+    Result push(TreadmillProtocol::CommandType type, uint16_t speed, unsigned long nowUs);
+    bool pop(TreadmillCommand &command);
+
+    size_t size() const;
+
+    void clear();
+
+    uint32_t getCoalesced() const
+    {
+        return m_coalesced;
+    }
+
+    uint32_t getDropped() const
+    {
+        return m_dropped;
+    }
+
+private:
+    mutable std::mutex m_mutex;
+    TreadmillCommand m_commands[COMMAND_QUEUE_SIZE];
+    size_t m_head = 0; // next command to pop
+    size_t m_count = 0;
+
+    uint32_t m_coalesced = 0;
+    uint32_t m_dropped = 0;
+};
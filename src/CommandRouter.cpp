@@ -0,0 +1,220 @@
+#include "CommandRouter.h"
+
+static bool isSpace(uint8_t c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static uint8_t toLower(uint8_t c)
+{
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+CommandPayload::CommandPayload(const uint8_t *data, size_t length)
+    : m_data(data), m_length(length)
+{
+    while (m_length > 0 && isSpace(m_data[0]))
+    {
+        m_data++;
+        m_length--;
+    }
+    while (m_length > 0 && isSpace(m_data[m_length - 1]))
+    {
+        m_length--;
+    }
+}
+
+bool CommandPayload::equalsIgnoreCase(const char *text) const
+{
+    size_t i = 0;
+    for (; i < m_length; ++i)
+    {
+        if (text[i] == '\0' || toLower(m_data[i]) != toLower(text[i]))
+        {
+            return false;
+        }
+    }
+    return text[i] == '\0';
+}
+
+bool CommandPayload::parseMilli(uint32_t &value) const
+{
+    size_t pos = 0;
+    uint64_t whole = 0;
+    while (pos < m_length && m_data[pos] >= '0' && m_data[pos] <= '9')
+    {
+        whole = whole * 10 + (m_data[pos++] - '0');
+        if (whole > UINT32_MAX / 1000)
+        {
+            return false;
+        }
+    }
+    bool hasDigits = pos > 0;
+    uint32_t fraction = 0;
+    if (pos < m_length && m_data[pos] == '.')
+    {
+        pos++;
+        uint32_t scale = 100;
+        while (pos < m_length && m_data[pos] >= '0' && m_data[pos] <= '9')
+        {
+            fraction += (m_data[pos++] - '0') * scale;
+            scale /= 10;
+            hasDigits = true;
+        }
+    }
+    if (!hasDigits || pos != m_length)
+    {
+        return false;
+    }
+    value = (uint32_t)whole * 1000 + fraction;
+    return true;
+}
+
+bool CommandPayload::parseUInt(uint32_t &value) const
+{
+    size_t pos = 0;
+    uint64_t whole = 0;
+    while (pos < m_length && m_data[pos] >= '0' && m_data[pos] <= '9')
+    {
+        whole = whole * 10 + (m_data[pos++] - '0');
+        if (whole > UINT32_MAX)
+        {
+            return false;
+        }
+    }
+    if (pos == 0)
+    {
+        return false;
+    }
+    if (pos < m_length && m_data[pos] == '.')
+    {
+        pos++;
+        while (pos < m_length && m_data[pos] >= '0' && m_data[pos] <= '9')
+        {
+            pos++;
+        }
+    }
+    if (pos != m_length)
+    {
+        return false;
+    }
+    value = (uint32_t)whole;
+    return true;
+}
+
+CommandRouter::CommandRouter()
+{
+    memset(m_table, 0, sizeof(m_table));
+}
+
+uint32_t CommandRouter::hash(const char *topic, uint32_t seed)
+{
+    // FNV-1a with the seed folded into the basis, finished with the murmur3
+    // mixer so the low bits used as slot index depend on every byte
+    uint32_t h = 2166136261u ^ (seed * 0x9e3779b9u);
+    while (*topic)
+    {
+        h ^= (uint8_t)*topic++;
+        h *= 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+bool CommandRouter::add(const char *topic, CommandHandler handler, uint8_t qos)
+{
+    return addRoute({topic, handler, nullptr, nullptr, qos});
+}
+
+bool CommandRouter::add(const char *topic, ContextCommandHandler handler, void *context, uint8_t qos)
+{
+    return addRoute({topic, nullptr, handler, context, qos});
+}
+
+bool CommandRouter::addRoute(const Route &route)
+{
+    const char *topic = route.topic;
+    if (m_routeCount >= COMMAND_ROUTER_MAX_ROUTES)
+    {
+        log_e("No room for command topic %s", topic);
+        return false;
+    }
+    for (size_t i = 0; i < m_routeCount; ++i)
+    {
+        if (strcmp(m_routes[i].topic, topic) == 0)
+        {
+            log_e("Command topic %s is already registered", topic);
+            return false;
+        }
+    }
+    m_routes[m_routeCount] = route;
+    if (!rebuild(m_routeCount + 1))
+    {
+        log_e("No collision free table for command topic %s", topic);
+        rebuild(m_routeCount);
+        return false;
+    }
+    m_routeCount++;
+    return true;
+}
+
+bool CommandRouter::rebuild(size_t routeCount)
+{
+    for (uint32_t seed = 0; seed < COMMAND_ROUTER_MAX_SEED_TRIES; ++seed)
+    {
+        memset(m_table, 0, sizeof(m_table));
+        bool collision = false;
+        for (size_t i = 0; i < routeCount && !collision; ++i)
+        {
+            uint32_t slot = hash(m_routes[i].topic, seed) & (COMMAND_ROUTER_TABLE_SIZE - 1);
+            collision = m_table[slot] != 0;
+            m_table[slot] = i + 1;
+        }
+        if (!collision)
+        {
+            m_seed = seed;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CommandRouter::subscribeAll(MqttTransport &transport) const
+{
+    bool ok = true;
+    for (size_t i = 0; i < m_routeCount; ++i)
+    {
+        if (!transport.subscribe(m_routes[i].topic, m_routes[i].qos))
+        {
+            log_e("Failed to subscribe to %s", m_routes[i].topic);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+bool CommandRouter::dispatch(const char *topic, const uint8_t *payload, size_t length, unsigned long entryUs)
+{
+    uint8_t entry = m_table[hash(topic, m_seed) & (COMMAND_ROUTER_TABLE_SIZE - 1)];
+    if (entry == 0 || strcmp(m_routes[entry - 1].topic, topic) != 0)
+    {
+        m_unknownTopics++;
+        log_w("No handler for topic %s", topic);
+        return false;
+    }
+    const Route &route = m_routes[entry - 1];
+    if (route.contextHandler)
+    {
+        route.contextHandler(CommandPayload(payload, length), entryUs, route.context);
+    }
+    else
+    {
+        route.handler(CommandPayload(payload, length), entryUs);
+    }
+    m_dispatchLatency.record(micros() - entryUs);
+    return true;
+}
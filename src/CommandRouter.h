@@ -0,0 +1,108 @@
+#pragma once
+#include <Arduino.h>
+
+#include "MqttTransport.h"
+#include "LatencyHistogram.h"
+
+#define COMMAND_ROUTER_MAX_ROUTES 32
+// power of two, large enough that a collision free seed is found after a few tries
+#define COMMAND_ROUTER_TABLE_SIZE 128
+#define COMMAND_ROUTER_MAX_SEED_TRIES 4096
+
+// Read-only view of an mqtt payload. Payloads are not terminated, all parsing
+// stays within length and works in place. Surrounding whitespace is ignored.
+class CommandPayload
+{
+public:
+    CommandPayload(const uint8_t *data, size_t length);
+
+    const uint8_t *getData() const
+    {
+        return m_data;
+    }
+
+    size_t getLength() const
+    {
+        return m_length;
+    }
+
+    bool equalsIgnoreCase(const char *text) const;
+
+    // Parses a non-negative decimal such as "3.5" into thousandths (3500),
+    // digits beyond the third decimal are truncated
+    bool parseMilli(uint32_t &value) const;
+
+    // Parses a non-negative integer, a fractional part (e.g. "32.0") is truncated
+    bool parseUInt(uint32_t &value) const;
+
+private:
+    const uint8_t *m_data;
+    size_t m_length;
+};
+
+// Handlers get the payload and the micros() the message arrived
+typedef void (*CommandHandler)(const CommandPayload &payload, unsigned long entryUs);
+// Same for topics that share a handler, e.g. one per treadmill
+typedef void (*ContextCommandHandler)(const CommandPayload &payload, unsigned long entryUs, void *context);
+
+// Maps subscribed topics to handlers. Topics are looked up through a perfect
+// hash: add() searches a seed for which every registered topic lands in its
+// own table slot, so dispatch() hashes the topic once and compares a single
+// string. Registration is meant for setup, dispatch does not allocate. The
+// time from message arrival to handler return is kept in a histogram.
+class CommandRouter
+{
+public:
+    CommandRouter();
+
+    // The topic string must outlive the router. Returns false if the table is
+    // full or the topic is already registered.
+    bool add(const char *topic, CommandHandler handler, uint8_t qos = 1);
+
+    // context is passed to the handler with every message of this topic
+    bool add(const char *topic, ContextCommandHandler handler, void *context, uint8_t qos = 1);
+
+    // Subscribes every registered topic, returns false if one failed
+    bool subscribeAll(MqttTransport &transport) const;
+
+    // Calls the handler of topic, returns false if there is none
+    bool dispatch(const char *topic, const uint8_t *payload, size_t length, unsigned long entryUs);
+
+    size_t getRouteCount() const
+    {
+        return m_routeCount;
+    }
+
+    uint32_t getUnknownTopics() const
+    {
+        return m_unknownTopics;
+    }
+
+    LatencyHistogram &getDispatchLatency()
+    {
+        return m_dispatchLatency;
+    }
+
+    static uint32_t hash(const char *topic, uint32_t seed);
+
+private:
+    struct Route
+    {
+        const char *topic;
+        CommandHandler handler;
+        ContextCommandHandler contextHandler;
+        void *context;
+        uint8_t qos;
+    };
+
+    bool addRoute(const Route &route);
+    bool rebuild(size_t routeCount);
+
+    Route m_routes[COMMAND_ROUTER_MAX_ROUTES];
+    size_t m_routeCount = 0;
+    // route index + 1 per slot, 0 is empty
+    uint8_t m_table[COMMAND_ROUTER_TABLE_SIZE];
+    uint32_t m_seed = 0;
+    uint32_t m_unknownTopics = 0;
+    LatencyHistogram m_dispatchLatency;
+};
@@ -0,0 +1,125 @@
+#include "ConnectionPolicy.h"
+
+const ConnParams ConnectionPolicy::ACTIVE = {12, 24, 0, 600};
+const ConnParams ConnectionPolicy::IDLE = {80, 100, 4, 600};
+
+const char *linkModeName(LinkMode mode)
+{
+    switch (mode)
+    {
+    case LINK_ACTIVE:
+        return "active";
+    case LINK_IDLE:
+        return "idle";
+    default:
+        return "disconnected";
+    }
+}
+
+void ConnectionPolicy::onConnected(uint16_t interval, uint16_t latency, uint16_t timeout, unsigned long nowMs)
+{
+    m_inFlight = false;
+    m_requestedMode = LINK_ACTIVE;
+    // stays active for the relax delay, the first frames tell the pad state
+    m_padActive = false;
+    m_lastActiveMs = nowMs;
+    setParams(interval, latency, timeout);
+}
+
+void ConnectionPolicy::onDisconnected()
+{
+    m_inFlight = false;
+    m_requestedMode = LINK_DISCONNECTED;
+    m_status.mode = LINK_DISCONNECTED;
+    m_status.version++;
+}
+
+void ConnectionPolicy::onStatus(TreadMillData::Status status, unsigned long nowMs)
+{
+    bool active = status == TreadMillData::RUNNING || status == TreadMillData::COUNTDOWN;
+    if (active || m_padActive)
+    {
+        // the relax delay starts with the first frame the pad is no longer moving
+        m_lastActiveMs = nowMs;
+    }
+    m_padActive = active;
+}
+
+void ConnectionPolicy::onCommand(unsigned long nowMs)
+{
+    m_lastActiveMs = nowMs;
+}
+
+LinkMode ConnectionPolicy::getWantedMode(unsigned long nowMs) const
+{
+    if (m_status.mode == LINK_DISCONNECTED)
+    {
+        return LINK_DISCONNECTED;
+    }
+    if (m_padActive || nowMs - m_lastActiveMs < CONN_RELAX_DELAY_MS)
+    {
+        return LINK_ACTIVE;
+    }
+    return LINK_IDLE;
+}
+
+bool ConnectionPolicy::poll(unsigned long nowMs, ConnParams &request)
+{
+    if (m_inFlight)
+    {
+        if (nowMs - m_requestMs < CONN_UPDATE_TIMEOUT_MS)
+        {
+            return false;
+        }
+        m_inFlight = false;
+        m_status.timeouts++;
+    }
+    LinkMode wanted = getWantedMode(nowMs);
+    if (wanted == LINK_DISCONNECTED || wanted == m_requestedMode)
+    {
+        return false;
+    }
+    m_requestedMode = wanted;
+    if (wanted == m_status.mode)
+    {
+        // back to what the link already runs with
+        return false;
+    }
+    request = wanted == LINK_ACTIVE ? ACTIVE : IDLE;
+    m_inFlight = true;
+    m_requestMs = nowMs;
+    m_status.requests++;
+    return true;
+}
+
+void ConnectionPolicy::onUpdate(bool accepted, uint16_t interval, uint16_t latency, uint16_t timeout)
+{
+    if (m_inFlight)
+    {
+        m_inFlight = false;
+        if (!accepted)
+        {
+            m_status.rejected++;
+        }
+    }
+    if (m_status.mode != LINK_DISCONNECTED)
+    {
+        setParams(interval, latency, timeout);
+    }
+}
+
+void ConnectionPolicy::onRequestFailed()
+{
+    m_inFlight = false;
+    m_status.rejected++;
+}
+
+void ConnectionPolicy::setParams(uint16_t interval, uint16_t latency, uint16_t timeout)
+{
+    m_status.interval = interval;
+    m_status.latency = latency;
+    m_status.timeout = timeout;
+    // the peer may choose anything within the requested range, or start its own update
+    m_status.mode = latency > 0 || interval > ACTIVE.maxInterval ? LINK_IDLE : LINK_ACTIVE;
+    m_status.version++;
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include <Arduino.h>
+
+#include "platform.h"
+
+// the pad has to be stopped or paused this long before the link is relaxed
+#define CONN_RELAX_DELAY_MS 10000
+// a request without an answer of the controller is given up after this
+#define CONN_UPDATE_TIMEOUT_MS 5000
+
+// BLE connection parameters in controller units: intervals of 1.25 ms,
+// latency in connection events the peripheral may skip, timeout of 10 ms
+struct ConnParams
+{
+    uint16_t minInterval;
+    uint16_t maxInterval;
+    uint16_t latency;
+    uint16_t timeout;
+};
+
+enum LinkMode
+{
+    LINK_DISCONNECTED,
+    LINK_ACTIVE, // tight interval while the belt moves
+    LINK_IDLE,   // relaxed, leaves airtime to WiFi
+    LINK_MODE_COUNT,
+};
+
+const char *linkModeName(LinkMode mode);
+
+// Parameters the connection runs with, as accepted by the peer
+struct LinkStatus
+{
+    LinkMode mode = LINK_DISCONNECTED;
+    uint16_t interval = 0;
+    uint16_t latency = 0;
+    uint16_t timeout = 0;
+    uint32_t requests = 0;
+    uint32_t rejected = 0; // refused by the peer or not started by the stack
+    uint32_t timeouts = 0; // no answer in time, may still apply later
+    uint32_t version = 0;  // changes with the parameters
+};
+
+// Picks the connection parameters from the treadmill state. While the belt
+// runs or counts down, or a command was sent recently, the link runs with the
+// connect parameters (ACTIVE); once the pad has been stopped or paused for
+// CONN_RELAX_DELAY_MS it is relaxed (IDLE). The ESP32 shares its radio between
+// BLE and WiFi, every connection event the idle link saves is airtime for MQTT.
+// A rejected request is not repeated until the wanted mode changes.
+class ConnectionPolicy
+{
+public:
+    // 15-30 ms, no latency, 6 s supervision timeout; also used to connect
+    static const ConnParams ACTIVE;
+    // 100-125 ms, the peripheral may skip 4 events, so it answers within 625 ms
+    static const ConnParams IDLE;
+
+    // The connection is up with the given parameters
+    void onConnected(uint16_t interval, uint16_t latency, uint16_t timeout, unsigned long nowMs);
+    void onDisconnected();
+
+    // Feed every frame
+    void onStatus(TreadMillData::Status status, unsigned long nowMs);
+
+    // A command was queued, keeps or makes the link active
+    void onCommand(unsigned long nowMs);
+
+    // Returns true with the parameters to request now
+    bool poll(unsigned long nowMs, ConnParams &request);
+
+    // Result of the update procedure with the parameters the link runs with
+    // afterwards. Also reports updates started by the peer.
+    void onUpdate(bool accepted, uint16_t interval, uint16_t latency, uint16_t timeout);
+
+    // The stack refused to start the requested update
+    void onRequestFailed();
+
+    const LinkStatus &getStatus() const
+    {
+        return m_status;
+    }
+
+    // Mode the policy wants for the current treadmill state
+    LinkMode getWantedMode(unsigned long nowMs) const;
+
+private:
+    void setParams(uint16_t interval, uint16_t latency, uint16_t timeout);
+
+    LinkStatus m_status;
+    // mode of the last request, not repeated after a rejection
+    LinkMode m_requestedMode = LINK_DISCONNECTED;
+    bool m_inFlight = false;
+    unsigned long m_requestMs = 0;
+    bool m_padActive = true;
+    unsigned long m_lastActiveMs = 0;
+};
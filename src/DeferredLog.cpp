@@ -0,0 +1,130 @@
+#include "DeferredLog.h"
+
+static const char LEVEL_LETTERS[] = {'N', 'E', 'W', 'I', 'D', 'V'};
+static const char *const LEVEL_NAMES[] = {"off", "error", "warn", "info", "debug", "verbose"};
+
+DeferredLog &DeferredLog::instance()
+{
+    static DeferredLog log;
+    return log;
+}
+
+bool DeferredLog::addSink(LogSink *sink, uint8_t level)
+{
+    for (SinkSlot &slot : m_sinks)
+    {
+        if (slot.sink == nullptr)
+        {
+            slot.sink = sink;
+            slot.level.store(level, std::memory_order_relaxed);
+            updateMaxLevel();
+            return true;
+        }
+    }
+    return false;
+}
+
+void DeferredLog::setSinkLevel(LogSink *sink, uint8_t level)
+{
+    for (SinkSlot &slot : m_sinks)
+    {
+        if (slot.sink == sink)
+        {
+            slot.level.store(level, std::memory_order_relaxed);
+        }
+    }
+    updateMaxLevel();
+}
+
+uint8_t DeferredLog::getSinkLevel(LogSink *sink) const
+{
+    for (const SinkSlot &slot : m_sinks)
+    {
+        if (slot.sink == sink)
+        {
+            return slot.level.load(std::memory_order_relaxed);
+        }
+    }
+    return DEFERRED_LOG_OFF;
+}
+
+void DeferredLog::updateMaxLevel()
+{
+    uint8_t maxLevel = DEFERRED_LOG_OFF;
+    for (const SinkSlot &slot : m_sinks)
+    {
+        if (slot.sink != nullptr)
+        {
+            uint8_t level = slot.level.load(std::memory_order_relaxed);
+            maxLevel = level > maxLevel ? level : maxLevel;
+        }
+    }
+    m_maxLevel.store(maxLevel, std::memory_order_relaxed);
+}
+
+size_t DeferredLog::format(const LogRecord &record, char *line, size_t size)
+{
+    if (size == 0)
+    {
+        return 0;
+    }
+    uint8_t level = record.level < sizeof(LEVEL_LETTERS) ? record.level : 0;
+    int prefix = snprintf(line, size, "[%6u][%c] ", (unsigned)(record.timestampUs / 1000), LEVEL_LETTERS[level]);
+    if (prefix < 0 || (size_t)prefix >= size)
+    {
+        return strlen(line);
+    }
+    // unused trailing arguments are ignored by snprintf
+    const uintptr_t *a = record.args;
+    int message = snprintf(line + prefix, size - prefix, record.format, a[0], a[1], a[2], a[3], a[4], a[5]);
+    if (message < 0)
+    {
+        line[prefix] = '\0';
+        return prefix;
+    }
+    return strlen(line);
+}
+
+size_t DeferredLog::drain(size_t maxRecords)
+{
+    size_t count = 0;
+    LogRecord record;
+    char line[DEFERRED_LOG_LINE_MAX];
+    while (count < maxRecords && m_ring.pop(record))
+    {
+        count++;
+        size_t length = 0;
+        for (SinkSlot &slot : m_sinks)
+        {
+            if (slot.sink == nullptr || record.level > slot.level.load(std::memory_order_relaxed))
+            {
+                continue;
+            }
+            // formatted once for all sinks that want it
+            if (length == 0)
+            {
+                length = format(record, line, sizeof(line));
+            }
+            slot.sink->write(record.level, line, length);
+        }
+    }
+    return count;
+}
+
+bool DeferredLog::parseLevel(const char *text, size_t length, uint8_t &level)
+{
+    if (length == 1 && text[0] >= '0' && text[0] <= '5')
+    {
+        level = text[0] - '0';
+        return true;
+    }
+    for (uint8_t i = 0; i < sizeof(LEVEL_NAMES) / sizeof(LEVEL_NAMES[0]); ++i)
+    {
+        if (strlen(LEVEL_NAMES[i]) == length && strncasecmp(LEVEL_NAMES[i], text, length) == 0)
+        {
+            level = i;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,139 @@
+#pragma once
+#include <Arduino.h>
+#include <atomic>
+#include <type_traits>
+
+#include "MpscRing.h"
+
+#define DEFERRED_LOG_MAX_ARGS 6
+#define DEFERRED_LOG_RING_SIZE 128
+#define DEFERRED_LOG_MAX_SINKS 3
+// formatted line including the timestamp and level prefix
+#define DEFERRED_LOG_LINE_MAX 160
+
+// Levels follow CORE_DEBUG_LEVEL: 1 error, 2 warning, 3 info, 4 debug, 5 verbose, 0 off
+#define DEFERRED_LOG_OFF 0
+
+// What the caller's task records: the format string itself serves as format
+// id, it has to be a literal. Arguments are kept as raw integers, so only
+// integer, enum and pointer arguments are allowed and %s arguments must point
+// to strings that live forever (literals, stateToString(), ...).
+struct LogRecord
+{
+    uint32_t timestampUs = 0;
+    const char *format = nullptr;
+    uint8_t level = 0;
+    uint8_t argCount = 0;
+    uintptr_t args[DEFERRED_LOG_MAX_ARGS] = {};
+};
+
+// Output of the formatted lines, called from the task that drains the log
+class LogSink
+{
+public:
+    virtual ~LogSink() = default;
+
+    // line is terminated and has no line ending
+    virtual void write(uint8_t level, const char *line, size_t length) = 0;
+};
+
+// Logger for hot paths. record() only copies the format pointer and the raw
+// arguments into a lock-free ring, any task may call it. Formatting and output
+// happen later in drain(), which a low priority task calls on the device. A
+// full ring drops records instead of blocking the caller. Each sink has its
+// own level, which can be changed at runtime; records above the highest sink
+// level are not recorded at all.
+class DeferredLog
+{
+public:
+    static DeferredLog &instance();
+
+    // Returns false if all sink slots are taken
+    bool addSink(LogSink *sink, uint8_t level);
+
+    void setSinkLevel(LogSink *sink, uint8_t level);
+
+    uint8_t getSinkLevel(LogSink *sink) const;
+
+    bool isEnabled(uint8_t level) const
+    {
+        return level <= m_maxLevel.load(std::memory_order_relaxed);
+    }
+
+    template <typename... Args>
+    void record(uint8_t level, const char *format, Args... args)
+    {
+        static_assert(sizeof...(Args) <= DEFERRED_LOG_MAX_ARGS, "too many arguments for a deferred log record");
+        LogRecord record;
+        record.timestampUs = micros();
+        record.format = format;
+        record.level = level;
+        record.argCount = sizeof...(Args);
+        const uintptr_t values[] = {toArg(args)..., 0};
+        for (size_t i = 0; i < sizeof...(Args); ++i)
+        {
+            record.args[i] = values[i];
+        }
+        if (m_ring.push(record))
+        {
+            m_recorded.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Formats up to maxRecords pending records into the sinks, returns how
+    // many were written. Must only be called from one task.
+    size_t drain(size_t maxRecords = SIZE_MAX);
+
+    // Renders "[<ms>][<level>] <message>" into line, returns its length
+    static size_t format(const LogRecord &record, char *line, size_t size);
+
+    // Accepts 0-5 or off, error, warn, info, debug, verbose
+    static bool parseLevel(const char *text, size_t length, uint8_t &level);
+
+    uint32_t getRecorded() const
+    {
+        return m_recorded.load(std::memory_order_relaxed);
+    }
+
+    uint32_t getDropped() const
+    {
+        return m_ring.getOverflows();
+    }
+
+private:
+    template <typename T>
+    static uintptr_t toArg(T value)
+    {
+        static_assert(std::is_integral<T>::value || std::is_enum<T>::value || std::is_pointer<T>::value,
+                      "deferred log arguments must be integers, enums or pointers to static strings");
+        static_assert(sizeof(T) <= sizeof(uintptr_t), "64 bit arguments are not supported by the deferred log");
+        return (uintptr_t)value;
+    }
+
+    void updateMaxLevel();
+
+    struct SinkSlot
+    {
+        LogSink *sink = nullptr;
+        std::atomic<uint8_t> level{DEFERRED_LOG_OFF};
+    };
+
+    MpscRing<LogRecord, DEFERRED_LOG_RING_SIZE> m_ring;
+    SinkSlot m_sinks[DEFERRED_LOG_MAX_SINKS];
+    std::atomic<uint8_t> m_maxLevel{DEFERRED_LOG_OFF};
+    std::atomic<uint32_t> m_recorded{0};
+};
+
+// Drop-in replacements for log_e/w/i/d/v on hot paths, compiled out above CORE_DEBUG_LEVEL
+#define DLOG(level, format, ...)                                                   \
+    do                                                                             \
+    {                                                                              \
+        if (CORE_DEBUG_LEVEL >= level && DeferredLog::instance().isEnabled(level)) \
+            DeferredLog::instance().record(level, format, ##__VA_ARGS__);          \
+    } while (0)
+
+#define dlog_e(format, ...) DLOG(1, format, ##__VA_ARGS__)
+#define dlog_w(format, ...) DLOG(2, format, ##__VA_ARGS__)
+#define dlog_i(format, ...) DLOG(3, format, ##__VA_ARGS__)
+#define dlog_d(format, ...) DLOG(4, format, ##__VA_ARGS__)
+#define dlog_v(format, ...) DLOG(5, format, ##__VA_ARGS__)
@@ -0,0 +1,158 @@
+#include "DiscoveryCache.h"
+#include <ArduinoJson.h>
+
+DiscoveryCache::~DiscoveryCache()
+{
+    release();
+}
+
+void DiscoveryCache::release()
+{
+    free(m_buffer);
+    m_buffer = nullptr;
+    m_size = 0;
+    m_capacity = 0;
+    m_count = 0;
+}
+
+bool DiscoveryCache::append(const char *topic, const char *payload, size_t payloadLength)
+{
+    size_t topicLength = strlen(topic);
+    size_t needed = m_size + topicLength + 1 + payloadLength + 1;
+    if (m_count >= DISCOVERY_MAX_MESSAGES)
+    {
+        log_e("Too many discovery messages");
+        return false;
+    }
+    if (needed > m_capacity)
+    {
+        // grows only while building at boot
+        size_t capacity = max(needed, m_capacity * 2);
+        char *buffer = (char *)realloc(m_buffer, capacity);
+        if (!buffer)
+        {
+            log_e("Out of memory for the discovery cache (%u bytes)", capacity);
+            return false;
+        }
+        m_buffer = buffer;
+        m_capacity = capacity;
+    }
+
+    Message &message = m_messages[m_count++];
+    message.topicOffset = m_size;
+    memcpy(m_buffer + m_size, topic, topicLength + 1);
+    m_size += topicLength + 1;
+    message.payloadOffset = m_size;
+    message.payloadLength = payloadLength;
+    memcpy(m_buffer + m_size, payload, payloadLength);
+    m_buffer[m_size + payloadLength] = '\0';
+    m_size += payloadLength + 1;
+    return true;
+}
+
+bool DiscoveryCache::build(MqttEntity *const *entities, size_t count, const char *deviceId, bool deviceDiscovery)
+{
+    release();
+    if (deviceDiscovery)
+    {
+        return buildDeviceMessage(entities, count, deviceId);
+    }
+
+    char topic[255];
+    for (size_t i = 0; i < count; ++i)
+    {
+        String payload = entities[i]->getHomeAssistantConfigPayload();
+        entities[i]->getHomeAssistantConfigTopic(topic, sizeof(topic));
+        if (!append(topic, payload.c_str(), payload.length()))
+        {
+            return false;
+        }
+        entities[i]->getHomeAssistantConfigTopicAlt(topic, sizeof(topic));
+        if (!append(topic, payload.c_str(), payload.length()))
+        {
+            return false;
+        }
+    }
+    log_i("Cached %u discovery messages in %u bytes", m_count, m_size);
+    return true;
+}
+
+bool DiscoveryCache::buildDeviceMessage(MqttEntity *const *entities, size_t count, const char *deviceId)
+{
+    JsonDocument device;
+    JsonObject components = device["cmps"].to<JsonObject>();
+    char topic[255];
+    char altPrefix[64] = "";
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        JsonDocument entity;
+        String payload = entities[i]->getHomeAssistantConfigPayload();
+        if (deserializeJson(entity, payload))
+        {
+            log_e("Failed to parse discovery payload of %s", entities[i]->getStateTopic());
+            return false;
+        }
+
+        // the shared device block moves to the top level of the message
+        const char *deviceKey = entity["dev"].is<JsonObject>() ? "dev" : "device";
+        if (!device["dev"].is<JsonObject>())
+        {
+            device["dev"] = entity[deviceKey];
+        }
+        entity.remove(deviceKey);
+
+        // the platform is the component part of <prefix>/<component>/.../config
+        entities[i]->getHomeAssistantConfigTopic(topic, sizeof(topic));
+        char *component = strchr(topic, '/');
+        char *componentEnd = component ? strchr(component + 1, '/') : nullptr;
+        if (!componentEnd)
+        {
+            log_e("Unexpected discovery topic %s", topic);
+            return false;
+        }
+        *componentEnd = '\0';
+        entity["p"] = component + 1;
+
+        const char *uniqueId = entity["uniq_id"] | (const char *)nullptr;
+        if (!uniqueId)
+        {
+            uniqueId = entity["unique_id"] | entities[i]->getStateTopic();
+        }
+        components[String(uniqueId)] = entity;
+
+        if (altPrefix[0] == '\0')
+        {
+            entities[i]->getHomeAssistantConfigTopicAlt(topic, sizeof(topic));
+            char *end = strchr(topic, '/');
+            if (end)
+            {
+                *end = '\0';
+                strlcpy(altPrefix, topic, sizeof(altPrefix));
+            }
+        }
+    }
+    device["o"]["name"] = SYSTEM_NAME;
+    device["o"]["sw"] = VERSION;
+
+    size_t length = measureJson(device);
+    char *payload = (char *)malloc(length + 1);
+    if (!payload)
+    {
+        log_e("Out of memory for the device discovery payload (%u bytes)", length);
+        return false;
+    }
+    serializeJson(device, payload, length + 1);
+
+    bool success = true;
+    snprintf(topic, sizeof(topic), "homeassistant/device/%s/config", deviceId);
+    success &= append(topic, payload, length);
+    if (altPrefix[0] != '\0' && strcmp(altPrefix, "homeassistant") != 0)
+    {
+        snprintf(topic, sizeof(topic), "%s/device/%s/config", altPrefix, deviceId);
+        success &= append(topic, payload, length);
+    }
+    free(payload);
+    log_i("Cached device discovery message with %u components, %u bytes", count, length);
+    return success;
+}
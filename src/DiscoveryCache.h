@@ -0,0 +1,61 @@
+#pragma once
+#include <Arduino.h>
+#include <MqttDevice.h>
+
+#define DISCOVERY_MAX_MESSAGES 96
+
+// Home Assistant discovery messages rendered once at boot into a single buffer,
+// so reconnects and "online" messages from Home Assistant only replay bytes.
+// In device mode all entities are folded into one device-level discovery
+// message (homeassistant/device/<id>/config with a "cmps" map) instead of one
+// message per entity.
+class DiscoveryCache
+{
+public:
+    ~DiscoveryCache();
+
+    bool build(MqttEntity *const *entities, size_t count, const char *deviceId, bool deviceDiscovery);
+
+    size_t getMessageCount() const
+    {
+        return m_count;
+    }
+
+    const char *getTopic(size_t index) const
+    {
+        return m_buffer + m_messages[index].topicOffset;
+    }
+
+    const char *getPayload(size_t index) const
+    {
+        return m_buffer + m_messages[index].payloadOffset;
+    }
+
+    size_t getPayloadLength(size_t index) const
+    {
+        return m_messages[index].payloadLength;
+    }
+
+    size_t getSize() const
+    {
+        return m_size;
+    }
+
+private:
+    struct Message
+    {
+        size_t topicOffset;
+        size_t payloadOffset;
+        size_t payloadLength;
+    };
+
+    bool buildDeviceMessage(MqttEntity *const *entities, size_t count, const char *deviceId);
+    bool append(const char *topic, const char *payload, size_t payloadLength);
+    void release();
+
+    char *m_buffer = nullptr;
+    size_t m_size = 0;
+    size_t m_capacity = 0;
+    Message m_messages[DISCOVERY_MAX_MESSAGES];
+    size_t m_count = 0;
+};
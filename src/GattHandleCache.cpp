@@ -0,0 +1,92 @@
+#include "GattHandleCache.h"
+#include <Preferences.h>
+
+static const char *NVS_NAMESPACE = "gattcache";
+// bump when the layout of the stored record changes
+static const uint8_t RECORD_VERSION = 2;
+
+// bits of GattHandleRecord::flags
+static const uint8_t FLAG_WRITE_NO_RESPONSE = 0x01;
+
+struct GattHandleRecord
+{
+    uint8_t version;
+    uint8_t fwVersion;
+    uint16_t writeHandle;
+    uint16_t notifyHandle;
+    uint16_t notifyCccdHandle;
+    uint8_t flags;
+};
+
+void GattHandleCache::makeKey(const NimBLEAddress &address, char *key, size_t size)
+{
+    const uint8_t *value = address.getVal();
+    snprintf(key, size, "h%02x%02x%02x%02x%02x%02x",
+             value[5], value[4], value[3], value[2], value[1], value[0]);
+}
+
+bool GattHandleCache::load(const NimBLEAddress &address, GattHandles &handles)
+{
+    char key[16];
+    makeKey(address, key, sizeof(key));
+
+    Preferences prefs;
+    if (!prefs.begin(NVS_NAMESPACE, true))
+    {
+        return false;
+    }
+    GattHandleRecord record;
+    size_t length = prefs.getBytes(key, &record, sizeof(record));
+    prefs.end();
+
+    if (length != sizeof(record) || record.version != RECORD_VERSION)
+    {
+        return false;
+    }
+    handles.writeHandle = record.writeHandle;
+    handles.notifyHandle = record.notifyHandle;
+    handles.notifyCccdHandle = record.notifyCccdHandle;
+    handles.fwVersion = record.fwVersion;
+    handles.writeNoResponse = record.flags & FLAG_WRITE_NO_RESPONSE;
+    return handles.isValid();
+}
+
+void GattHandleCache::store(const NimBLEAddress &address, const GattHandles &handles)
+{
+    char key[16];
+    makeKey(address, key, sizeof(key));
+
+    GattHandleRecord record;
+    record.version = RECORD_VERSION;
+    record.fwVersion = handles.fwVersion;
+    record.writeHandle = handles.writeHandle;
+    record.notifyHandle = handles.notifyHandle;
+    record.notifyCccdHandle = handles.notifyCccdHandle;
+    record.flags = handles.writeNoResponse ? FLAG_WRITE_NO_RESPONSE : 0;
+
+    Preferences prefs;
+    if (!prefs.begin(NVS_NAMESPACE, false))
+    {
+        log_e("Failed to open NVS namespace %s", NVS_NAMESPACE);
+        return;
+    }
+    prefs.putBytes(key, &record, sizeof(record));
+    prefs.end();
+    log_i("Cached GATT handles for %s: write 0x%04x, notify 0x%04x, cccd 0x%04x, fw %u, no-response %d",
+          address.toString().c_str(), handles.writeHandle, handles.notifyHandle, handles.notifyCccdHandle, handles.fwVersion,
+          handles.writeNoResponse);
+}
+
+void GattHandleCache::invalidate(const NimBLEAddress &address)
+{
+    char key[16];
+    makeKey(address, key, sizeof(key));
+
+    Preferences prefs;
+    if (!prefs.begin(NVS_NAMESPACE, false))
+    {
+        return;
+    }
+    prefs.remove(key);
+    prefs.end();
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <Arduino.h>
+#include <NimBLEDevice.h>
+
+// Attribute handles of the pad service as discovered on a previous connection
+struct GattHandles
+{
+    uint16_t writeHandle = 0;
+    uint16_t notifyHandle = 0;
+    uint16_t notifyCccdHandle = 0;
+    uint8_t fwVersion = 0;
+    // the write characteristic accepts write-without-response
+    bool writeNoResponse = false;
+
+    bool isValid() const
+    {
+        return writeHandle != 0 && notifyHandle != 0 && notifyCccdHandle != 0;
+    }
+};
+
+// Persists GattHandles in NVS keyed by the peer address. The firmware version
+// reported in the status frames is stored alongside, an entry whose version no
+// longer matches the device is invalidated so the next connect rediscovers.
+class GattHandleCache
+{
+public:
+    bool load(const NimBLEAddress &address, GattHandles &handles);
+    void store(const NimBLEAddress &address, const GattHandles &handles);
+    void invalidate(const NimBLEAddress &address);
+
+private:
+    // NVS keys are limited to 15 characters, "h" + 12 hex digits of the address
+    void makeKey(const NimBLEAddress &address, char *key, size_t size);
+};
@@ -0,0 +1,100 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+// Fixed-bucket log-scale histogram of latencies in microseconds. Every power of
+// two is split into 4 linear sub-buckets, which keeps the relative error of the
+// reported percentiles below 25% over the whole 32 bit range in under 512 bytes.
+// record() is meant to be called from a single task; reading and reset() from
+// another task may miss samples recorded concurrently, which is fine for
+// diagnostics.
+class LatencyHistogram
+{
+public:
+    static const int SUB_BUCKET_BITS = 2;
+    static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static const int BUCKETS = (32 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    void record(uint32_t us)
+    {
+        m_buckets[bucketIndex(us)]++;
+        m_count++;
+        if (us > m_max)
+        {
+            m_max = us;
+        }
+    }
+
+    // Upper bound of the bucket holding the given percentile (0-100), clamped to the max
+    uint32_t percentile(uint8_t percent) const
+    {
+        uint32_t count = m_count;
+        if (count == 0)
+        {
+            return 0;
+        }
+        uint64_t rank = ((uint64_t)count * percent + 99) / 100;
+        if (rank == 0)
+        {
+            rank = 1;
+        }
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; ++i)
+        {
+            seen += m_buckets[i];
+            if (seen >= rank)
+            {
+                uint32_t upper = bucketUpperBound(i);
+                return upper < m_max ? upper : m_max;
+            }
+        }
+        return m_max;
+    }
+
+    uint32_t getMax() const
+    {
+        return m_max;
+    }
+
+    uint32_t getCount() const
+    {
+        return m_count;
+    }
+
+    void reset()
+    {
+        memset((void *)m_buckets, 0, sizeof(m_buckets));
+        m_count = 0;
+        m_max = 0;
+    }
+
+    static int bucketIndex(uint32_t us)
+    {
+        if (us < SUB_BUCKETS)
+        {
+            return us;
+        }
+        int log2 = 31 - __builtin_clz(us);
+        int shift = log2 - SUB_BUCKET_BITS;
+        int sub = (us >> shift) & (SUB_BUCKETS - 1);
+        return (shift + 1) * SUB_BUCKETS + sub;
+    }
+
+    static uint32_t bucketUpperBound(int index)
+    {
+        if (index < SUB_BUCKETS)
+        {
+            return index;
+        }
+        int shift = index / SUB_BUCKETS - 1;
+        int sub = index % SUB_BUCKETS;
+        uint64_t lower = (uint64_t)(SUB_BUCKETS + sub) << shift;
+        uint64_t upper = lower + ((uint64_t)1 << shift) - 1;
+        return upper > UINT32_MAX ? UINT32_MAX : (uint32_t)upper;
+    }
+
+private:
+    volatile uint32_t m_buckets[BUCKETS] = {};
+    volatile uint32_t m_count = 0;
+    volatile uint32_t m_max = 0;
+};
@@ -0,0 +1,107 @@
+#include "LittleFsOutboxSpill.h"
+
+bool LittleFsOutboxSpill::begin()
+{
+    File file = LittleFS.open(OUTBOX_SPILL_PATH);
+    if (!file)
+    {
+        return true;
+    }
+    m_fileSize = file.size();
+    uint8_t header[RECORD_HEADER_LENGTH];
+    size_t offset = 0;
+    while (file.read(header, sizeof(header)) == sizeof(header))
+    {
+        uint16_t length = header[4] | (header[5] << 8);
+        if (offset + sizeof(header) + length > m_fileSize)
+        {
+            break;
+        }
+        // records are in sequence order
+        memcpy(&m_lastSeq, header, 4);
+        offset += sizeof(header) + length;
+        file.seek(offset);
+        m_count++;
+    }
+    file.close();
+    log_i("Outbox spill holds %u messages from before the restart, last seq %u", m_count, m_lastSeq);
+    return true;
+}
+
+bool LittleFsOutboxSpill::pushBatch(const OutboxMessage *messages, size_t count)
+{
+    size_t bytes = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        bytes += RECORD_HEADER_LENGTH + messages[i].length;
+    }
+    if (m_fileSize + bytes > OUTBOX_SPILL_MAX_BYTES)
+    {
+        return false;
+    }
+    File file = LittleFS.open(OUTBOX_SPILL_PATH, FILE_APPEND);
+    if (!file)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint8_t header[RECORD_HEADER_LENGTH];
+        uint32_t seq = messages[i].seq;
+        memcpy(header, &seq, 4);
+        header[4] = messages[i].length & 0xFF;
+        header[5] = messages[i].length >> 8;
+        file.write(header, sizeof(header));
+        file.write((const uint8_t *)messages[i].payload, messages[i].length);
+    }
+    file.close();
+    m_fileSize += bytes;
+    m_count += count;
+    if (count > 0)
+    {
+        m_lastSeq = messages[count - 1].seq;
+    }
+    return true;
+}
+
+size_t LittleFsOutboxSpill::popBatch(OutboxMessage *messages, size_t count)
+{
+    if (m_count == 0)
+    {
+        return 0;
+    }
+    File file = LittleFS.open(OUTBOX_SPILL_PATH);
+    if (!file || !file.seek(m_readOffset))
+    {
+        return 0;
+    }
+    size_t taken = 0;
+    while (taken < count && m_count > 0)
+    {
+        uint8_t header[RECORD_HEADER_LENGTH];
+        if (file.read(header, sizeof(header)) != sizeof(header))
+        {
+            break;
+        }
+        OutboxMessage &message = messages[taken];
+        memcpy(&message.seq, header, 4);
+        message.length = header[4] | (header[5] << 8);
+        if (message.length > OUTBOX_PAYLOAD_MAX || file.read((uint8_t *)message.payload, message.length) != message.length)
+        {
+            log_e("Outbox spill is corrupt, discarding %u messages", m_count);
+            m_count = 0;
+            break;
+        }
+        m_readOffset += sizeof(header) + message.length;
+        m_count--;
+        taken++;
+    }
+    file.close();
+    if (m_count == 0)
+    {
+        LittleFS.remove(OUTBOX_SPILL_PATH);
+        m_fileSize = 0;
+        m_readOffset = 0;
+    }
+    return taken;
+}
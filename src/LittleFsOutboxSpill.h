@@ -0,0 +1,40 @@
+#pragma once
+#include <Arduino.h>
+#include <LittleFS.h>
+
+#include "MqttOutbox.h"
+
+#define OUTBOX_SPILL_PATH "/outbox.bin"
+#define OUTBOX_SPILL_MAX_BYTES (128 * 1024)
+
+// Outbox spill in a LittleFS file of seq (u32) | length (u16) | payload
+// records. The file is deleted once everything was read back. Survives a
+// restart, messages read but not yet deleted may then be sent twice, the
+// sequence number tells the duplicates apart.
+class LittleFsOutboxSpill : public OutboxSpill
+{
+public:
+    // LittleFS must be mounted
+    bool begin();
+
+    bool pushBatch(const OutboxMessage *messages, size_t count) override;
+    size_t popBatch(OutboxMessage *messages, size_t count) override;
+
+    uint32_t size() const override
+    {
+        return m_count;
+    }
+
+    uint32_t getLastSeq() const override
+    {
+        return m_lastSeq;
+    }
+
+private:
+    size_t m_fileSize = 0;
+    size_t m_readOffset = 0;
+    uint32_t m_count = 0;
+    uint32_t m_lastSeq = 0;
+
+    static const size_t RECORD_HEADER_LENGTH = 6;
+};
@@ -0,0 +1,45 @@
+#include "LogSinks.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// the console is slow, the task drains in bursts and sleeps in between
+static const uint32_t LOG_DRAIN_INTERVAL_MS = 20;
+
+void SerialLogSink::write(uint8_t, const char *line, size_t length)
+{
+    Serial.write((const uint8_t *)line, length);
+    Serial.write("\r\n");
+}
+
+void UdpLogSink::setTarget(IPAddress address, uint16_t port)
+{
+    m_address.store((uint32_t)address, std::memory_order_relaxed);
+    m_port.store(port, std::memory_order_relaxed);
+}
+
+void UdpLogSink::write(uint8_t, const char *line, size_t length)
+{
+    uint16_t port = m_port.load(std::memory_order_relaxed);
+    if (port == 0)
+    {
+        return;
+    }
+    m_udp.beginPacket(IPAddress(m_address.load(std::memory_order_relaxed)), port);
+    m_udp.write((const uint8_t *)line, length);
+    m_udp.endPacket();
+}
+
+static void deferredLogTask(void *arg)
+{
+    while (true)
+    {
+        DeferredLog::instance().drain();
+        vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_INTERVAL_MS));
+    }
+}
+
+void startDeferredLogTask()
+{
+    // idle priority, it only runs when the main loop and the BLE host have nothing to do
+    xTaskCreate(deferredLogTask, "logdrain", 3072, nullptr, tskIDLE_PRIORITY, nullptr);
+}
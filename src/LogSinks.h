@@ -0,0 +1,31 @@
+#pragma once
+#include <Arduino.h>
+#include <WiFiUdp.h>
+#include <atomic>
+
+#include "DeferredLog.h"
+
+// Writes the deferred log lines to the USB/UART console
+class SerialLogSink : public LogSink
+{
+public:
+    void write(uint8_t level, const char *line, size_t length) override;
+};
+
+// Sends every line as one datagram, e.g. to `nc -ul 5140` or a syslog collector
+class UdpLogSink : public LogSink
+{
+public:
+    // Safe to call while the drain task writes, the target takes effect with the next line
+    void setTarget(IPAddress address, uint16_t port);
+
+    void write(uint8_t level, const char *line, size_t length) override;
+
+private:
+    WiFiUDP m_udp;
+    std::atomic<uint32_t> m_address{0};
+    std::atomic<uint16_t> m_port{0};
+};
+
+// Starts the low priority task that formats and writes the deferred log
+void startDeferredLogTask();
@@ -0,0 +1,82 @@
+#include "LoopEvents.h"
+#include <lwip/sockets.h>
+
+// select() timeout of the watcher, bounds how long a socket change takes to be picked up
+const uint32_t SOCKET_WATCH_TIMEOUT_MS = 500;
+
+void LoopEvents::begin()
+{
+    if (m_events != nullptr)
+    {
+        return;
+    }
+    m_events = xEventGroupCreate();
+    xTaskCreate(socketWatcherTask, "sockwatch", 2048, this, 1, &m_watcherTask);
+}
+
+void LoopEvents::notify(EventBits_t bits)
+{
+    if (m_events)
+    {
+        xEventGroupSetBits(m_events, bits);
+    }
+}
+
+EventBits_t LoopEvents::wait(uint32_t timeoutMs)
+{
+    if (!m_events)
+    {
+        delay(timeoutMs);
+        return 0;
+    }
+    // clear on exit, wait for any bit
+    return xEventGroupWaitBits(m_events, LOOP_EVENT_ALL, pdTRUE, pdFALSE, pdMS_TO_TICKS(timeoutMs)) & LOOP_EVENT_ALL;
+}
+
+void LoopEvents::watchSocket(int fd)
+{
+    m_socketFd = fd;
+    socketServiced();
+}
+
+void LoopEvents::socketServiced()
+{
+    m_socketPending = false;
+    if (m_watcherTask)
+    {
+        xTaskNotifyGive(m_watcherTask);
+    }
+}
+
+void LoopEvents::socketWatcherTask(void *arg)
+{
+    LoopEvents *self = static_cast<LoopEvents *>(arg);
+    while (true)
+    {
+        int fd = self->m_socketFd;
+        if (fd < 0 || self->m_socketPending)
+        {
+            // nothing to watch or the loop did not read the pending data yet
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SOCKET_WATCH_TIMEOUT_MS));
+            continue;
+        }
+
+        fd_set readFds;
+        FD_ZERO(&readFds);
+        FD_SET(fd, &readFds);
+        struct timeval timeout;
+        timeout.tv_sec = 0;
+        timeout.tv_usec = SOCKET_WATCH_TIMEOUT_MS * 1000;
+        int ready = select(fd + 1, &readFds, nullptr, nullptr, &timeout);
+        if (ready > 0 && fd == self->m_socketFd)
+        {
+            self->m_socketPending = true;
+            self->notify(LOOP_EVENT_MQTT_RX);
+        }
+        else if (ready < 0)
+        {
+            // socket was closed under us, wait for the next watchSocket()
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SOCKET_WATCH_TIMEOUT_MS));
+        }
+    }
+}
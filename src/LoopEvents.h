@@ -0,0 +1,43 @@
+#pragma once
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <freertos/task.h>
+
+// Wake-up sources of the main loop
+#define LOOP_EVENT_BLE_FRAME BIT0 // a parsed frame was queued by the NimBLE host task
+#define LOOP_EVENT_MQTT_RX BIT1   // the mqtt socket has data to read
+#define LOOP_EVENT_WAKE BIT2      // generic wake-up, e.g. a timer expired
+#define LOOP_EVENT_ALL (LOOP_EVENT_BLE_FRAME | LOOP_EVENT_MQTT_RX | LOOP_EVENT_WAKE)
+
+// Lets loop() sleep on a FreeRTOS event group instead of polling with delay().
+// Other tasks set event bits to wake it up immediately; a small helper task
+// watches the mqtt socket with select() and raises LOOP_EVENT_MQTT_RX when the
+// broker sent something, so commands are picked up within milliseconds.
+class LoopEvents
+{
+public:
+    void begin();
+
+    // Safe to call from any task
+    void notify(EventBits_t bits);
+
+    // Blocks until one of the event bits is set or timeoutMs passed, returns
+    // and clears the bits that were set
+    EventBits_t wait(uint32_t timeoutMs);
+
+    // Sets the socket to watch for readability, -1 to stop watching
+    void watchSocket(int fd);
+
+    // Must be called after the socket was serviced (client.loop()) so the
+    // watcher re-arms instead of spinning on unread data
+    void socketServiced();
+
+private:
+    static void socketWatcherTask(void *arg);
+
+    EventGroupHandle_t m_events = nullptr;
+    TaskHandle_t m_watcherTask = nullptr;
+    volatile int m_socketFd = -1;
+    volatile bool m_socketPending = false;
+};
@@ -0,0 +1,104 @@
+#include "LoopProfiler.h"
+
+const char *loopSectionName(LoopSection section)
+{
+    switch (section)
+    {
+    case SECTION_WIFI:
+        return "wifi";
+    case SECTION_OTA:
+        return "ota";
+    case SECTION_MQTT_CONNECT:
+        return "mqtt_connect";
+    case SECTION_MQTT_LOOP:
+        return "mqtt_loop";
+    case SECTION_DISCOVERY:
+        return "discovery";
+    case SECTION_TREADMILL:
+        return "treadmill";
+    case SECTION_OUTBOX:
+        return "outbox";
+    case SECTION_DIAGNOSTICS:
+        return "diagnostics";
+    default:
+        return "none";
+    }
+}
+
+void LoopProfiler::beginIteration()
+{
+    m_iterationStart = micros();
+    memset(m_iterationSectionUs, 0, sizeof(m_iterationSectionUs));
+}
+
+void LoopProfiler::endIteration()
+{
+    if (m_currentSection != SECTION_NONE)
+    {
+        endSection();
+    }
+    uint32_t elapsed = micros() - m_iterationStart;
+    m_iterations++;
+    m_totalIterationUs += elapsed;
+    if (elapsed > m_maxIterationUs)
+    {
+        m_maxIterationUs = elapsed;
+    }
+    if (elapsed < m_stallThresholdUs)
+    {
+        return;
+    }
+
+    LoopSection slowest = SECTION_NONE;
+    for (int i = SECTION_NONE + 1; i < SECTION_COUNT; ++i)
+    {
+        if (m_iterationSectionUs[i] > m_iterationSectionUs[slowest])
+        {
+            slowest = (LoopSection)i;
+        }
+    }
+    m_stalls++;
+    m_sections[slowest].stalls++;
+    m_lastStallSection = slowest;
+    m_lastStallUs = elapsed;
+    log_w("Loop stalled for %u ms, mostly in %s (%u ms)", elapsed / 1000, loopSectionName(slowest), m_iterationSectionUs[slowest] / 1000);
+}
+
+void LoopProfiler::beginSection(LoopSection section)
+{
+    if (m_currentSection != SECTION_NONE)
+    {
+        endSection();
+    }
+    m_currentSection = section;
+    m_sectionStart = micros();
+    setMarker(section);
+}
+
+void LoopProfiler::endSection()
+{
+    uint32_t elapsed = micros() - m_sectionStart;
+    SectionStats &stats = m_sections[m_currentSection];
+    stats.totalUs += elapsed;
+    if (elapsed > stats.maxUs)
+    {
+        stats.maxUs = elapsed;
+    }
+    m_iterationSectionUs[m_currentSection] += elapsed;
+    m_currentSection = SECTION_NONE;
+    setMarker(SECTION_NONE);
+}
+
+void LoopProfiler::reset()
+{
+    m_iterations = 0;
+    m_maxIterationUs = 0;
+    m_totalIterationUs = 0;
+    m_stalls = 0;
+    m_lastStallSection = SECTION_NONE;
+    m_lastStallUs = 0;
+    for (int i = 0; i < SECTION_COUNT; ++i)
+    {
+        m_sections[i] = SectionStats();
+    }
+}
@@ -0,0 +1,133 @@
+#pragma once
+#include <Arduino.h>
+
+// Sections of loop() that are timed individually
+enum LoopSection : uint8_t
+{
+    SECTION_NONE = 0,
+    SECTION_WIFI,
+    SECTION_OTA,
+    SECTION_MQTT_CONNECT,
+    SECTION_MQTT_LOOP,
+    SECTION_DISCOVERY,
+    SECTION_TREADMILL,
+    SECTION_OUTBOX,
+    SECTION_DIAGNOSTICS,
+    SECTION_COUNT
+};
+
+const char *loopSectionName(LoopSection section);
+
+struct SectionStats
+{
+    uint32_t maxUs = 0;
+    uint64_t totalUs = 0;
+    uint32_t stalls = 0; // stalls attributed to this section
+};
+
+// Measures the busy time of every loop() iteration (the sleep at the end is not
+// part of it) and of named sections within. An iteration longer than the stall
+// threshold is counted as a stall and attributed to its slowest section.
+class LoopProfiler
+{
+public:
+    explicit LoopProfiler(uint32_t stallThresholdUs = 500000)
+        : m_stallThresholdUs(stallThresholdUs)
+    {
+    }
+
+    void beginIteration();
+    void endIteration();
+
+    void beginSection(LoopSection section);
+    void endSection();
+
+    // Optional byte (e.g. in RTC memory) that always holds the running section,
+    // so a watchdog reset can be attributed after the reboot
+    void setSectionMarker(volatile uint8_t *marker)
+    {
+        m_sectionMarker = marker;
+    }
+
+    void reset();
+
+    uint32_t getIterations() const
+    {
+        return m_iterations;
+    }
+
+    uint32_t getMaxIterationUs() const
+    {
+        return m_maxIterationUs;
+    }
+
+    uint32_t getAverageIterationUs() const
+    {
+        return m_iterations ? m_totalIterationUs / m_iterations : 0;
+    }
+
+    uint32_t getStalls() const
+    {
+        return m_stalls;
+    }
+
+    LoopSection getLastStallSection() const
+    {
+        return m_lastStallSection;
+    }
+
+    uint32_t getLastStallUs() const
+    {
+        return m_lastStallUs;
+    }
+
+    const SectionStats &getSectionStats(LoopSection section) const
+    {
+        return m_sections[section];
+    }
+
+private:
+    void setMarker(LoopSection section)
+    {
+        if (m_sectionMarker)
+        {
+            *m_sectionMarker = section;
+        }
+    }
+
+    uint32_t m_stallThresholdUs;
+    volatile uint8_t *m_sectionMarker = nullptr;
+
+    unsigned long m_iterationStart = 0;
+    unsigned long m_sectionStart = 0;
+    LoopSection m_currentSection = SECTION_NONE;
+    // per section time of the running iteration
+    uint32_t m_iterationSectionUs[SECTION_COUNT] = {};
+
+    uint32_t m_iterations = 0;
+    uint32_t m_maxIterationUs = 0;
+    uint64_t m_totalIterationUs = 0;
+    uint32_t m_stalls = 0;
+    LoopSection m_lastStallSection = SECTION_NONE;
+    uint32_t m_lastStallUs = 0;
+    SectionStats m_sections[SECTION_COUNT];
+};
+
+// Times a section for the lifetime of the object
+class ProfileScope
+{
+public:
+    ProfileScope(LoopProfiler &profiler, LoopSection section)
+        : m_profiler(profiler)
+    {
+        m_profiler.beginSection(section);
+    }
+
+    ~ProfileScope()
+    {
+        m_profiler.endSection();
+    }
+
+private:
+    LoopProfiler &m_profiler;
+};
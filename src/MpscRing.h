@@ -0,0 +1,95 @@
+#pragma once
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Fixed-size lock-free multi-producer/single-consumer ring buffer (bounded
+// queue after Dmitry Vyukov). Every cell carries a sequence number that tells
+// producers whether the cell is free for their position and the consumer
+// whether it was published. Producers claim a position with one CAS and never
+// block, a full ring drops the new element and counts it as an overflow.
+// pop() must only be called from one task.
+template <typename T, size_t N>
+class MpscRing
+{
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "MpscRing capacity must be a power of two");
+
+public:
+    MpscRing()
+    {
+        for (size_t i = 0; i < N; ++i)
+        {
+            m_cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool push(const T &item)
+    {
+        size_t pos = m_head.load(std::memory_order_relaxed);
+        Cell *cell;
+        while (true)
+        {
+            cell = &m_cells[pos & (N - 1)];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0)
+            {
+                if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                // the consumer has not freed this cell yet
+                m_overflows.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            else
+            {
+                pos = m_head.load(std::memory_order_relaxed);
+            }
+        }
+        cell->item = item;
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &item)
+    {
+        Cell &cell = m_cells[m_tail & (N - 1)];
+        size_t seq = cell.seq.load(std::memory_order_acquire);
+        if ((intptr_t)seq - (intptr_t)(m_tail + 1) < 0)
+        {
+            return false;
+        }
+        item = cell.item;
+        cell.seq.store(m_tail + N, std::memory_order_release);
+        m_tail++;
+        return true;
+    }
+
+    constexpr size_t capacity() const
+    {
+        return N;
+    }
+
+    // Number of elements dropped because the ring was full
+    uint32_t getOverflows() const
+    {
+        return m_overflows.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> seq;
+        T item;
+    };
+
+    Cell m_cells[N];
+    std::atomic<size_t> m_head{0};
+    // only touched by the consumer
+    size_t m_tail = 0;
+    std::atomic<uint32_t> m_overflows{0};
+};
@@ -0,0 +1,50 @@
+#include "MqttLogSink.h"
+
+void MqttLogSink::begin(MqttTransport *transport, const char *topic)
+{
+    m_transport = transport;
+    m_topic = topic;
+}
+
+void MqttLogSink::write(uint8_t, const char *line, size_t length)
+{
+    Line entry;
+    entry.length = length < sizeof(entry.text) ? length : sizeof(entry.text) - 1;
+    memcpy(entry.text, line, entry.length);
+    m_lines.push(entry);
+}
+
+void MqttLogSink::flush()
+{
+    if (m_transport == nullptr || !m_transport->connected())
+    {
+        return;
+    }
+    char message[MQTT_LOG_MESSAGE_MAX];
+    size_t length = 0;
+    size_t lines = 0;
+    Line entry;
+    while (m_lines.pop(entry))
+    {
+        if (length + 1 + entry.length > sizeof(message))
+        {
+            if (!m_transport->publish(m_topic, (const uint8_t *)message, length, false))
+            {
+                m_failed += lines;
+            }
+            length = 0;
+            lines = 0;
+        }
+        if (length > 0)
+        {
+            message[length++] = '\n';
+        }
+        memcpy(message + length, entry.text, entry.length);
+        length += entry.length;
+        lines++;
+    }
+    if (length > 0 && !m_transport->publish(m_topic, (const uint8_t *)message, length, false))
+    {
+        m_failed += lines;
+    }
+}
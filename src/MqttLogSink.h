@@ -0,0 +1,46 @@
+#pragma once
+#include <Arduino.h>
+
+#include "DeferredLog.h"
+#include "MqttTransport.h"
+#include "SpscRing.h"
+
+#define MQTT_LOG_LINES 16
+// lines are joined with '\n' into messages of at most this size
+#define MQTT_LOG_MESSAGE_MAX 1024
+
+// Log sink for <client id>/log. The mqtt client belongs to the main loop, so
+// write() only queues the line and flush(), called from the main loop, joins
+// the queued lines into as few messages as possible.
+class MqttLogSink : public LogSink
+{
+public:
+    void begin(MqttTransport *transport, const char *topic);
+
+    void write(uint8_t level, const char *line, size_t length) override;
+
+    // Publishes queued lines while the broker is reachable
+    void flush();
+
+    bool hasPending() const
+    {
+        return !m_lines.empty();
+    }
+
+    uint32_t getDropped() const
+    {
+        return m_lines.getOverflows() + m_failed;
+    }
+
+private:
+    struct Line
+    {
+        uint16_t length;
+        char text[DEFERRED_LOG_LINE_MAX];
+    };
+
+    MqttTransport *m_transport = nullptr;
+    const char *m_topic = nullptr;
+    SpscRing<Line, MQTT_LOG_LINES> m_lines;
+    uint32_t m_failed = 0;
+};
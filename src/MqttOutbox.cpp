@@ -0,0 +1,198 @@
+#include "MqttOutbox.h"
+#ifdef ESP32
+#include <esp_heap_caps.h>
+#endif
+
+static void *allocateOutbox(size_t size)
+{
+#ifdef ESP32
+    // the queue is large and not latency critical, prefer PSRAM
+    void *memory = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (memory)
+    {
+        return memory;
+    }
+#endif
+    return malloc(size);
+}
+
+MqttOutbox::MqttOutbox()
+{
+    m_ram = (OutboxMessage *)allocateOutbox(sizeof(OutboxMessage) * OUTBOX_RAM_MESSAGES);
+    m_replay = (OutboxMessage *)allocateOutbox(sizeof(OutboxMessage) * OUTBOX_REPLAY_BATCH);
+}
+
+MqttOutbox::~MqttOutbox()
+{
+    free(m_ram);
+    free(m_replay);
+}
+
+void MqttOutbox::begin(MqttTransport *transport, const char *topic, OutboxSpill *spill)
+{
+    m_transport = transport;
+    m_topic = topic;
+    m_spill = spill;
+    if (m_spill && m_spill->getLastSeq() >= m_nextSeq)
+    {
+        m_nextSeq = m_spill->getLastSeq() + 1;
+    }
+    updateDepth();
+}
+
+bool MqttOutbox::push(const char *payload, size_t length)
+{
+    OutboxMessage message;
+    message.seq = m_nextSeq++;
+    if (length < 2 || payload[length - 1] != '}' || length + 24 > OUTBOX_PAYLOAD_MAX)
+    {
+        log_e("Outbox payload is not a JSON object or too long, dropped");
+        m_stats.dropped++;
+        return false;
+    }
+    memcpy(message.payload, payload, length - 1);
+    message.length = length - 1;
+    message.length += snprintf(message.payload + message.length, OUTBOX_PAYLOAD_MAX - message.length, ",\"seq\":%u}", message.seq);
+
+    // live path, nothing older is waiting
+    if (!hasBacklog() && publish(message))
+    {
+        return true;
+    }
+    enqueue(message);
+    return false;
+}
+
+bool MqttOutbox::publish(const OutboxMessage &message)
+{
+    if (!m_transport || !m_transport->connected() ||
+        !m_transport->publish(m_topic, (const uint8_t *)message.payload, message.length, false))
+    {
+        return false;
+    }
+    m_stats.published++;
+    return true;
+}
+
+void MqttOutbox::enqueue(const OutboxMessage &message)
+{
+    m_stats.queued++;
+    if (m_ramCount == OUTBOX_RAM_MESSAGES)
+    {
+        m_stats.overflows++;
+        spillOldest(OUTBOX_RAM_MESSAGES / 2);
+    }
+    if (m_ramCount == OUTBOX_RAM_MESSAGES)
+    {
+        // flash is full or missing, the oldest message in RAM is lost
+        m_ramHead = (m_ramHead + 1) % OUTBOX_RAM_MESSAGES;
+        m_ramCount--;
+        m_stats.dropped++;
+    }
+    m_ram[(m_ramHead + m_ramCount) % OUTBOX_RAM_MESSAGES] = message;
+    m_ramCount++;
+    updateDepth();
+}
+
+void MqttOutbox::spillOldest(size_t count)
+{
+    if (!m_spill || count == 0)
+    {
+        return;
+    }
+    // the ring may wrap, spill in up to two contiguous batches
+    while (count > 0 && m_ramCount > 0)
+    {
+        size_t contiguous = std::min(count, std::min(m_ramCount, (size_t)OUTBOX_RAM_MESSAGES - m_ramHead));
+        if (!m_spill->pushBatch(m_ram + m_ramHead, contiguous))
+        {
+            log_w("Outbox flash spill is full");
+            return;
+        }
+        m_ramHead = (m_ramHead + contiguous) % OUTBOX_RAM_MESSAGES;
+        m_ramCount -= contiguous;
+        m_stats.spilled += contiguous;
+        count -= contiguous;
+    }
+}
+
+void MqttOutbox::spillAll()
+{
+    spillOldest(m_ramCount);
+}
+
+void MqttOutbox::service(unsigned long now)
+{
+    if (!hasBacklog() || !m_transport || !m_transport->connected() || (long)(now - m_nextReplay) < 0)
+    {
+        return;
+    }
+
+    if (m_replayHead == m_replayCount && m_spill && m_spill->size() > 0)
+    {
+        m_replayHead = 0;
+        m_replayCount = m_spill->popBatch(m_replay, OUTBOX_REPLAY_BATCH);
+    }
+
+    const OutboxMessage &message = m_replayHead < m_replayCount ? m_replay[m_replayHead] : m_ram[m_ramHead];
+    if (!publish(message))
+    {
+        return;
+    }
+    if (m_replayHead < m_replayCount)
+    {
+        m_replayHead++;
+    }
+    else
+    {
+        m_ramHead = (m_ramHead + 1) % OUTBOX_RAM_MESSAGES;
+        m_ramCount--;
+    }
+    m_stats.replayed++;
+    m_nextReplay = now + REPLAY_PACE_MS;
+    updateDepth();
+    if (!hasBacklog())
+    {
+        log_i("Outbox replay complete, %u messages replayed in total", m_stats.replayed);
+    }
+}
+
+uint32_t MqttOutbox::getMsUntilService(unsigned long now) const
+{
+    if (!hasBacklog())
+    {
+        return UINT32_MAX;
+    }
+    long remaining = (long)(m_nextReplay - now);
+    return remaining > 0 ? remaining : 0;
+}
+
+void MqttOutbox::updateDepth()
+{
+    m_stats.depth = m_ramCount + (m_replayCount - m_replayHead) + (m_spill ? m_spill->size() : 0);
+}
+
+bool MemoryOutboxSpill::pushBatch(const OutboxMessage *messages, size_t count)
+{
+    if (m_messages.size() + count > m_capacity)
+    {
+        return false;
+    }
+    m_messages.insert(m_messages.end(), messages, messages + count);
+    if (count > 0)
+    {
+        m_lastSeq = messages[count - 1].seq;
+    }
+    return true;
+}
+
+size_t MemoryOutboxSpill::popBatch(OutboxMessage *messages, size_t count)
+{
+    size_t taken = 0;
+    while (taken < count && !m_messages.empty())
+    {
+        messages[taken++] = m_messages.front();
+        m_messages.pop_front();
+    }
+    return taken;
+}
@@ -0,0 +1,144 @@
+#pragma once
+#include <Arduino.h>
+
+#include "MqttTransport.h"
+#include "StateSerializer.h"
+#include <deque>
+
+#define OUTBOX_RAM_MESSAGES 32
+#define OUTBOX_REPLAY_BATCH 8
+// state document plus the ,"seq":<n> field
+#define OUTBOX_PAYLOAD_MAX (STATE_JSON_MAX_LENGTH + 24)
+
+struct OutboxMessage
+{
+    uint32_t seq = 0;
+    uint16_t length = 0;
+    char payload[OUTBOX_PAYLOAD_MAX];
+};
+
+struct OutboxStats
+{
+    uint32_t queued = 0;    // messages that had to wait for the broker
+    uint32_t published = 0; // all messages published, live and replayed
+    uint32_t replayed = 0;  // published from the backlog after a reconnect
+    uint32_t spilled = 0;   // moved from RAM to flash
+    uint32_t overflows = 0; // times the RAM queue was full
+    uint32_t dropped = 0;   // lost because RAM and flash were full
+    uint32_t depth = 0;     // waiting in RAM and flash
+};
+
+// Flash backing of the outbox, holds the oldest messages in order
+class OutboxSpill
+{
+public:
+    virtual ~OutboxSpill() = default;
+
+    // Appends messages in one write, returns false if they do not fit
+    virtual bool pushBatch(const OutboxMessage *messages, size_t count) = 0;
+
+    // Removes up to count of the oldest messages into messages, returns how many
+    virtual size_t popBatch(OutboxMessage *messages, size_t count) = 0;
+
+    virtual uint32_t size() const = 0;
+
+    // Highest sequence number pushed, also from before a restart, 0 if none
+    virtual uint32_t getLastSeq() const = 0;
+};
+
+// Store-and-forward queue for the state topic. Messages get a sequence number
+// (the "seq" field of the document) and go out right away while the broker is
+// reachable. Otherwise they wait in RAM (PSRAM if present); a full RAM queue
+// moves its older half to flash in one write. After a reconnect the backlog is
+// replayed in order, one message per replay interval, before live messages
+// that arrived meanwhile.
+class MqttOutbox
+{
+public:
+    MqttOutbox();
+    ~MqttOutbox();
+
+    // Sequence numbers continue after the messages a spill kept over a restart
+    void begin(MqttTransport *transport, const char *topic, OutboxSpill *spill = nullptr);
+
+    // Adds the sequence number to the JSON document and publishes or queues
+    // it, returns true if it was published right away
+    bool push(const char *payload, size_t length);
+
+    // Publishes the backlog, call from the main loop
+    void service(unsigned long now);
+
+    // Moves everything queued in RAM to flash, e.g. before a restart
+    void spillAll();
+
+    uint32_t getMsUntilService(unsigned long now) const;
+
+    const OutboxStats &getStats() const
+    {
+        return m_stats;
+    }
+
+    uint32_t getNextSeq() const
+    {
+        return m_nextSeq;
+    }
+
+    static const uint32_t REPLAY_PACE_MS = 50;
+
+private:
+    bool hasBacklog() const
+    {
+        return m_replayCount > m_replayHead || m_ramCount > 0 || (m_spill && m_spill->size() > 0);
+    }
+
+    bool publish(const OutboxMessage &message);
+    void enqueue(const OutboxMessage &message);
+    void spillOldest(size_t count);
+    void updateDepth();
+
+    MqttTransport *m_transport = nullptr;
+    const char *m_topic = nullptr;
+    OutboxSpill *m_spill = nullptr;
+
+    // ring of the newest queued messages
+    OutboxMessage *m_ram = nullptr;
+    size_t m_ramHead = 0;
+    size_t m_ramCount = 0;
+
+    // messages taken back from flash, older than everything in RAM
+    OutboxMessage *m_replay = nullptr;
+    size_t m_replayHead = 0;
+    size_t m_replayCount = 0;
+
+    uint32_t m_nextSeq = 1;
+    unsigned long m_nextReplay = 0;
+    OutboxStats m_stats;
+};
+
+// Spill that keeps the messages in RAM, used by the host tests and the simulator
+class MemoryOutboxSpill : public OutboxSpill
+{
+public:
+    explicit MemoryOutboxSpill(size_t capacity)
+        : m_capacity(capacity)
+    {
+    }
+
+    bool pushBatch(const OutboxMessage *messages, size_t count) override;
+    size_t popBatch(OutboxMessage *messages, size_t count) override;
+
+    uint32_t size() const override
+    {
+        return m_messages.size();
+    }
+
+    uint32_t getLastSeq() const override
+    {
+        return m_lastSeq;
+    }
+
+private:
+    size_t m_capacity;
+    std::deque<OutboxMessage> m_messages;
+    uint32_t m_lastSeq = 0;
+};
@@ -0,0 +1,24 @@
+#pragma once
+#include <Arduino.h>
+
+// Publish side of the mqtt connection used by MqttView. PubSubTransport
+// implements it on the device, the simulator with an in-process broker.
+class MqttTransport
+{
+public:
+    virtual ~MqttTransport() = default;
+
+    virtual bool connected() = 0;
+
+    virtual bool publish(const char *topic, const uint8_t *payload, size_t length, bool retained) = 0;
+
+    bool publish(const char *topic, const char *payload, bool retained = false)
+    {
+        return publish(topic, (const uint8_t *)payload, strlen(payload), retained);
+    }
+
+    virtual bool subscribe(const char *topic, uint8_t qos = 0) = 0;
+
+    // Services the connection and delivers received messages
+    virtual bool loop() = 0;
+};
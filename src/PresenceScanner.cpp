@@ -0,0 +1,207 @@
+#include "PresenceScanner.h"
+
+PresenceScanner::ScanDispatcher PresenceScanner::s_dispatcher;
+PresenceScanner *PresenceScanner::s_scanners[TREADMILL_MAX_DEVICES] = {};
+size_t PresenceScanner::s_scannerCount = 0;
+std::atomic<bool> PresenceScanner::s_scanActive{false};
+bool PresenceScanner::s_scanHeld = false;
+bool PresenceScanner::s_initialized = false;
+
+void PresenceScanner::begin(const NimBLEAddress &target)
+{
+    m_target = target;
+    m_seenAddress = target;
+    for (size_t i = 0; i < s_scannerCount; ++i)
+    {
+        if (s_scanners[i] == this)
+        {
+            return;
+        }
+    }
+    if (s_scannerCount < TREADMILL_MAX_DEVICES)
+    {
+        s_scanners[s_scannerCount++] = this;
+    }
+    else
+    {
+        log_e("No room for the scanner of %s", target.toString().c_str());
+    }
+}
+
+void PresenceScanner::startScan()
+{
+    if (!m_scanning)
+    {
+        m_scanning = true;
+        m_deviceSeen = false;
+        m_scanStartedAt = millis();
+        log_i("Scanning for treadmill %s", m_target.toString().c_str());
+    }
+    // the shared scan may have ended for a connect of another scanner
+    updateScan();
+}
+
+void PresenceScanner::stopScan()
+{
+    if (!m_scanning)
+    {
+        return;
+    }
+    m_scanning = false;
+    m_scanTimeMs += millis() - m_scanStartedAt;
+    updateScan();
+}
+
+void PresenceScanner::holdScan()
+{
+    s_scanHeld = true;
+    updateScan();
+}
+
+void PresenceScanner::releaseScan()
+{
+    s_scanHeld = false;
+    updateScan();
+}
+
+void PresenceScanner::updateScan()
+{
+    bool wanted = false;
+    for (size_t i = 0; i < s_scannerCount; ++i)
+    {
+        wanted |= s_scanners[i]->m_scanning;
+    }
+    wanted &= !s_scanHeld;
+    if (wanted == s_scanActive)
+    {
+        return;
+    }
+
+    NimBLEScan *pScan = NimBLEDevice::getScan();
+    if (!wanted)
+    {
+        s_scanActive = false;
+        pScan->stop();
+        return;
+    }
+    if (!s_initialized)
+    {
+        pScan->setScanCallbacks(&s_dispatcher, false);
+        pScan->setActiveScan(false); // passive, the name is in the advertisement data
+        pScan->setInterval(SCAN_INTERVAL_MS);
+        pScan->setWindow(SCAN_WINDOW_MS);
+        pScan->setDuplicateFilter(false);
+        s_initialized = true;
+    }
+    // duration 0 scans until stopped
+    if (pScan->start(0, false, true))
+    {
+        s_scanActive = true;
+    }
+    else
+    {
+        log_e("Failed to start BLE scan");
+    }
+}
+
+bool PresenceScanner::isConnectAllowed(unsigned long now) const
+{
+    return m_deviceSeen && now - m_lastAttempt >= m_backoffMs;
+}
+
+uint32_t PresenceScanner::getMsUntilConnectAllowed(unsigned long now) const
+{
+    if (!m_deviceSeen)
+    {
+        return UINT32_MAX; // woken up by the seen callback
+    }
+    unsigned long elapsed = now - m_lastAttempt;
+    return elapsed >= m_backoffMs ? 0 : m_backoffMs - elapsed;
+}
+
+void PresenceScanner::onConnectAttempt(bool success, unsigned long now)
+{
+    m_connectAttempts++;
+    m_lastAttempt = now;
+    if (success)
+    {
+        m_backoffMs = 0;
+        return;
+    }
+    m_connectFailures++;
+    m_backoffMs = m_backoffMs == 0 ? BACKOFF_MIN_MS : min(m_backoffMs * 2, BACKOFF_MAX_MS);
+    // only retry once the device advertises again
+    m_deviceSeen = false;
+    log_w("Connect attempt failed, next attempt after advertisement and %u ms backoff", m_backoffMs);
+}
+
+PresenceStats PresenceScanner::getStats() const
+{
+    PresenceStats stats;
+    stats.advertsSeen = m_advertsSeen;
+    stats.connectAttempts = m_connectAttempts;
+    stats.connectFailures = m_connectFailures;
+    stats.configuredDutyCycle = SCAN_WINDOW_MS * 100 / SCAN_INTERVAL_MS;
+    unsigned long scanTime = m_scanTimeMs + (m_scanning ? millis() - m_scanStartedAt : 0);
+    unsigned long uptime = millis();
+    // the radio only listens during the scan window
+    stats.scanningPercent = uptime ? (uint64_t)scanTime * stats.configuredDutyCycle / uptime : 0;
+    return stats;
+}
+
+void PresenceScanner::onResult(const NimBLEAdvertisedDevice *advertisedDevice)
+{
+    if (!m_scanning)
+    {
+        return;
+    }
+    bool match;
+    if (m_target.isNull())
+    {
+        match = advertisedDevice->getName() == TREADMILL_ADVERTISED_NAME;
+    }
+    else
+    {
+        match = advertisedDevice->getAddress() == m_target;
+    }
+    if (!match)
+    {
+        return;
+    }
+
+    m_advertsSeen++;
+    if (m_deviceSeen)
+    {
+        return;
+    }
+    m_seenAddress = advertisedDevice->getAddress();
+    m_deviceSeen = true;
+    log_i("Treadmill %s is advertising", m_seenAddress.toString().c_str());
+    if (m_onSeen)
+    {
+        m_onSeen();
+    }
+}
+
+void PresenceScanner::ScanDispatcher::onResult(const NimBLEAdvertisedDevice *advertisedDevice)
+{
+    // a configured address is not claimed by the scanners matching by name
+    for (size_t i = 0; i < s_scannerCount; ++i)
+    {
+        if (s_scanners[i]->m_target == advertisedDevice->getAddress())
+        {
+            s_scanners[i]->onResult(advertisedDevice);
+            return;
+        }
+    }
+    for (size_t i = 0; i < s_scannerCount; ++i)
+    {
+        s_scanners[i]->onResult(advertisedDevice);
+    }
+}
+
+void PresenceScanner::ScanDispatcher::onScanEnd(const NimBLEScanResults &results, int reason)
+{
+    // the scanners keep wanting it, the next startScan() restarts the scan
+    s_scanActive = false;
+}
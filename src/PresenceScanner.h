@@ -0,0 +1,103 @@
+#pragma once
+#include <Arduino.h>
+#include <NimBLEDevice.h>
+#include <atomic>
+
+#include "platform.h"
+
+#define TREADMILL_ADVERTISED_NAME "PitPat-T01"
+
+struct PresenceStats
+{
+    uint32_t advertsSeen = 0;
+    uint32_t connectAttempts = 0;
+    uint32_t connectFailures = 0;
+    uint8_t configuredDutyCycle = 0; // scan window / interval in percent
+    uint8_t scanningPercent = 0;     // share of uptime spent scanning
+};
+
+// Duty-cycled passive scanner that reports when the treadmill is advertising.
+// It matches the configured address, or the advertised name if no address is
+// configured. Connect attempts are gated on a fresh advertisement and spaced
+// with an exponential backoff after failures. The scanners of several
+// treadmills share the NimBLE scan: it runs while any of them wants it and
+// every advertisement is offered to all of them.
+class PresenceScanner
+{
+public:
+    void begin(const NimBLEAddress &target);
+
+    // Starts scanning if it is not running yet
+    void startScan();
+    void stopScan();
+
+    // Stops the shared scan while a connect is in progress, NimBLE cannot
+    // connect while scanning. releaseScan() resumes it for the others.
+    static void holdScan();
+    static void releaseScan();
+
+    // True once a matching advertisement was received and the backoff passed
+    bool isConnectAllowed(unsigned long now) const;
+
+    // Time until isConnectAllowed() may change without a new advertisement
+    uint32_t getMsUntilConnectAllowed(unsigned long now) const;
+
+    void onConnectAttempt(bool success, unsigned long now);
+
+    // Address of the device that was seen, differs from the target if matched by name
+    NimBLEAddress getSeenAddress() const
+    {
+        return m_seenAddress;
+    }
+
+    // Invoked from the NimBLE host task when the device shows up
+    void setSeenCallback(std::function<void()> callback)
+    {
+        m_onSeen = callback;
+    }
+
+    PresenceStats getStats() const;
+
+private:
+    // forwards the results of the shared scan to the registered scanners
+    class ScanDispatcher : public NimBLEScanCallbacks
+    {
+        void onResult(const NimBLEAdvertisedDevice *advertisedDevice) override;
+        void onScanEnd(const NimBLEScanResults &results, int reason) override;
+    };
+
+    void onResult(const NimBLEAdvertisedDevice *advertisedDevice);
+    // starts or stops the shared scan to match what the scanners want
+    static void updateScan();
+
+    static ScanDispatcher s_dispatcher;
+    static PresenceScanner *s_scanners[TREADMILL_MAX_DEVICES];
+    static size_t s_scannerCount;
+    // cleared by the NimBLE host task when a scan ends
+    static std::atomic<bool> s_scanActive;
+    static bool s_scanHeld;
+    static bool s_initialized;
+
+    NimBLEAddress m_target;
+    NimBLEAddress m_seenAddress;
+    std::atomic<bool> m_deviceSeen{false};
+    std::atomic<uint32_t> m_advertsSeen{0};
+    bool m_scanning = false; // this scanner wants the shared scan
+
+    uint32_t m_backoffMs = 0;
+    unsigned long m_lastAttempt = 0;
+    uint32_t m_connectAttempts = 0;
+    uint32_t m_connectFailures = 0;
+
+    // accumulated scanning time for the duty cycle diagnostics
+    unsigned long m_scanStartedAt = 0;
+    unsigned long m_scanTimeMs = 0;
+
+    std::function<void()> m_onSeen = nullptr;
+
+    // 30 ms window every 300 ms, 10% radio duty cycle
+    const uint16_t SCAN_INTERVAL_MS = 300;
+    const uint16_t SCAN_WINDOW_MS = 30;
+    const uint32_t BACKOFF_MIN_MS = 1000;
+    const uint32_t BACKOFF_MAX_MS = 60000;
+};
@@ -0,0 +1,50 @@
+#pragma once
+#include <Arduino.h>
+#include <PubSubClient.h>
+
+#include "MqttTransport.h"
+
+class PubSubTransport : public MqttTransport
+{
+public:
+    explicit PubSubTransport(PubSubClient &client)
+        : m_client(client)
+    {
+    }
+
+    bool connected() override
+    {
+        return m_client.connected();
+    }
+
+    bool publish(const char *topic, const uint8_t *payload, size_t length, bool retained) override
+    {
+        // mqtt fixed header (up to 5 bytes) and the topic length prefix share the buffer
+        if (length + strlen(topic) + 7 <= m_client.getBufferSize())
+        {
+            return m_client.publish(topic, payload, length, retained);
+        }
+        // larger payloads are streamed to the socket instead of copied into the client buffer
+        return m_client.beginPublish(topic, length, retained) &&
+               m_client.write(payload, length) == length &&
+               m_client.endPublish();
+    }
+
+    bool subscribe(const char *topic, uint8_t qos) override
+    {
+        return m_client.subscribe(topic, qos);
+    }
+
+    bool loop() override
+    {
+        return m_client.loop();
+    }
+
+    PubSubClient &getClient()
+    {
+        return m_client;
+    }
+
+private:
+    PubSubClient &m_client;
+};
@@ -0,0 +1,51 @@
+#include "PublishPolicy.h"
+
+static uint32_t absDiff(uint32_t a, uint32_t b)
+{
+    return a > b ? a - b : b - a;
+}
+
+bool PublishPolicy::shouldPublish(const TreadMillData &data, unsigned long now)
+{
+    m_framesReceived++;
+
+    bool publish = false;
+    if (!m_hasPublished ||
+        data.status != m_lastPublished.status ||
+        data.fwVersion != m_lastPublished.fwVersion ||
+        data.speedMaxMilli != m_lastPublished.speedMaxMilli)
+    {
+        publish = true;
+    }
+    else if (now - m_lastPublishTime >= m_config.heartbeatMs)
+    {
+        publish = true;
+    }
+    else if (now - m_lastPublishTime >= m_config.minIntervalMs)
+    {
+        publish = exceedsDeadband(data);
+    }
+
+    if (publish)
+    {
+        markPublished(data, now);
+    }
+    return publish;
+}
+
+void PublishPolicy::markPublished(const TreadMillData &data, unsigned long now)
+{
+    m_lastPublished = data;
+    m_lastPublishTime = now;
+    m_hasPublished = true;
+    m_messagesPublished++;
+}
+
+bool PublishPolicy::exceedsDeadband(const TreadMillData &data) const
+{
+    return absDiff(data.speedCmdMilli, m_lastPublished.speedCmdMilli) >= m_config.speedDeadbandMilli ||
+           absDiff(data.speedFeedbackMilli, m_lastPublished.speedFeedbackMilli) >= m_config.speedDeadbandMilli ||
+           absDiff(data.distanceMilli, m_lastPublished.distanceMilli) >= m_config.distanceDeadbandMilli ||
+           absDiff(data.durationMs, m_lastPublished.durationMs) >= m_config.durationDeadbandMs ||
+           absDiff(data.calories, m_lastPublished.calories) >= m_config.caloriesDeadband;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <Arduino.h>
+
+#include "platform.h"
+
+// Decides which treadmill frames are worth a state publish. Frames are compared
+// against the last published state with per-field deadbands, changes are rate
+// limited and a heartbeat republishes the state even if nothing changed.
+// Status, firmware and max speed changes are always published immediately.
+class PublishPolicy
+{
+public:
+    struct Config
+    {
+        uint16_t speedDeadbandMilli = 50;    // km/h * 1000, commanded and feedback speed
+        uint32_t distanceDeadbandMilli = 10; // km * 1000
+        uint32_t durationDeadbandMs = 5000;  // ms
+        uint16_t caloriesDeadband = 1;       // cal
+        unsigned long minIntervalMs = 1000;  // max publish rate for deadband changes
+        unsigned long heartbeatMs = 60000;   // forced publish interval
+    };
+
+    PublishPolicy() = default;
+    explicit PublishPolicy(const Config &config)
+        : m_config(config)
+    {
+    }
+
+    // Counts the frame and returns true if it should be published, in which
+    // case it becomes the new reference state
+    bool shouldPublish(const TreadMillData &data, unsigned long now);
+
+    // Records a publish that bypassed the policy (e.g. after a reconnect)
+    void markPublished(const TreadMillData &data, unsigned long now);
+
+    // Forces the next frame to be published
+    void invalidate()
+    {
+        m_hasPublished = false;
+    }
+
+    uint32_t getFramesReceived() const
+    {
+        return m_framesReceived;
+    }
+
+    uint32_t getMessagesPublished() const
+    {
+        return m_messagesPublished;
+    }
+
+    const Config &getConfig() const
+    {
+        return m_config;
+    }
+
+private:
+    bool exceedsDeadband(const TreadMillData &data) const;
+
+    Config m_config;
+    TreadMillData m_lastPublished;
+    unsigned long m_lastPublishTime = 0;
+    bool m_hasPublished = false;
+
+    uint32_t m_framesReceived = 0;
+    uint32_t m_messagesPublished = 0;
+};
@@ -0,0 +1,45 @@
+#include "ResourceMonitor.h"
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// tasks that run our code: arduino loop, command sender, mqtt socket watcher, the NimBLE host (callbacks),
+// the deferred log drain and the esp_timer task (workout setpoints)
+static const char *const MONITORED_TASKS[RESOURCE_MAX_TASKS] = {"loopTask", "tmsend", "sockwatch", "nimble_host", "logdrain", "esp_timer"};
+
+const TaskStackUsage *ResourceSnapshot::getTightestStack() const
+{
+    const TaskStackUsage *tightest = nullptr;
+    for (size_t i = 0; i < taskCount; ++i)
+    {
+        if (tasks[i].freeBytes != UINT32_MAX && (tightest == nullptr || tasks[i].freeBytes < tightest->freeBytes))
+        {
+            tightest = &tasks[i];
+        }
+    }
+    return tightest;
+}
+
+ResourceSnapshot ResourceMonitor::sample() const
+{
+    ResourceSnapshot snapshot;
+    // MALLOC_CAP_8BIT would include PSRAM, internal RAM is what runs out first
+    snapshot.freeHeap = heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    snapshot.minFreeHeap = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    snapshot.largestFreeBlock = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    snapshot.freePsram = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+    if (snapshot.freeHeap > 0)
+    {
+        snapshot.fragmentationPercent = 100 - (uint8_t)((uint64_t)snapshot.largestFreeBlock * 100 / snapshot.freeHeap);
+    }
+
+    for (size_t i = 0; i < RESOURCE_MAX_TASKS; ++i)
+    {
+        TaskStackUsage &usage = snapshot.tasks[snapshot.taskCount++];
+        usage.name = MONITORED_TASKS[i];
+        TaskHandle_t handle = xTaskGetHandle(MONITORED_TASKS[i]);
+        // the high-water mark is reported in bytes on ESP-IDF
+        usage.freeBytes = handle ? uxTaskGetStackHighWaterMark(handle) : UINT32_MAX;
+    }
+    return snapshot;
+}
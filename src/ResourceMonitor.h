@@ -0,0 +1,33 @@
+#pragma once
+#include <Arduino.h>
+
+#define RESOURCE_MAX_TASKS 6
+
+struct TaskStackUsage
+{
+    const char *name;
+    uint32_t freeBytes; // stack high-water mark, UINT32_MAX if the task does not exist
+};
+
+// Heap figures are internal RAM only, PSRAM is reported on its own
+struct ResourceSnapshot
+{
+    uint32_t freeHeap = 0;
+    uint32_t minFreeHeap = 0;
+    uint32_t largestFreeBlock = 0;
+    uint8_t fragmentationPercent = 0; // 100 - largest block / free heap
+    uint32_t freePsram = 0;           // 0 without PSRAM
+    TaskStackUsage tasks[RESOURCE_MAX_TASKS] = {};
+    size_t taskCount = 0;
+
+    // Task with the least stack left, nullptr if none was found
+    const TaskStackUsage *getTightestStack() const;
+};
+
+// Samples heap and task stack usage, the long-term slope of these is what
+// normally ends in a watchdog or out of memory reset
+class ResourceMonitor
+{
+public:
+    ResourceSnapshot sample() const;
+};
@@ -0,0 +1,51 @@
+#include "RoundTripProbe.h"
+
+void RoundTripProbe::handle(unsigned long nowMs, unsigned long nowUs, LinkMode mode)
+{
+    if (m_transport == nullptr || getMsUntilProbe(nowMs) > 0)
+    {
+        return;
+    }
+    if (m_outstanding)
+    {
+        m_lost++;
+    }
+    char payload[12];
+    int length = snprintf(payload, sizeof(payload), "%u", (unsigned)++m_sequence);
+    m_sent = true;
+    m_sentMs = nowMs;
+    m_sentUs = nowUs;
+    m_mode = mode;
+    m_outstanding = m_transport->publish(m_topic, (const uint8_t *)payload, length, false);
+}
+
+void RoundTripProbe::onEcho(const CommandPayload &payload, unsigned long entryUs)
+{
+    uint32_t sequence;
+    // late echoes of older probes are not counted, they were already lost
+    if (!m_outstanding || !payload.parseUInt(sequence) || sequence != m_sequence)
+    {
+        return;
+    }
+    m_outstanding = false;
+    m_roundTrip[m_mode].record(entryUs - m_sentUs);
+}
+
+uint32_t RoundTripProbe::getMsUntilProbe(unsigned long nowMs) const
+{
+    if (!m_sent)
+    {
+        return 0;
+    }
+    unsigned long elapsed = nowMs - m_sentMs;
+    return elapsed >= RTT_PROBE_INTERVAL_MS ? 0 : RTT_PROBE_INTERVAL_MS - elapsed;
+}
+
+void RoundTripProbe::reset()
+{
+    for (LatencyHistogram &histogram : m_roundTrip)
+    {
+        histogram.reset();
+    }
+    m_lost = 0;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <Arduino.h>
+
+#include "MqttTransport.h"
+#include "CommandRouter.h"
+#include "LatencyHistogram.h"
+#include "ConnectionPolicy.h"
+
+#define RTT_PROBE_INTERVAL_MS 5000
+
+// Measures the MQTT round trip: a sequence number is published to a topic the
+// bridge subscribes itself, the time until it comes back is recorded per link
+// mode of the treadmills at sending. Comparing the modes shows how much
+// airtime the BLE connection takes from WiFi. A probe that did not return
+// before the next one is due counts as lost.
+class RoundTripProbe
+{
+public:
+    void begin(MqttTransport *transport, const char *topic)
+    {
+        m_transport = transport;
+        m_topic = topic;
+    }
+
+    // Sends a probe when one is due
+    void handle(unsigned long nowMs, unsigned long nowUs, LinkMode mode);
+
+    // Feed the messages of the probe topic, entryUs as passed by the router
+    void onEcho(const CommandPayload &payload, unsigned long entryUs);
+
+    uint32_t getMsUntilProbe(unsigned long nowMs) const;
+
+    const LatencyHistogram &getRoundTrip(LinkMode mode) const
+    {
+        return m_roundTrip[mode];
+    }
+
+    uint32_t getLost() const
+    {
+        return m_lost;
+    }
+
+    void reset();
+
+private:
+    MqttTransport *m_transport = nullptr;
+    const char *m_topic = nullptr;
+    LatencyHistogram m_roundTrip[LINK_MODE_COUNT];
+    uint32_t m_lost = 0;
+
+    uint32_t m_sequence = 0;
+    bool m_outstanding = false;
+    bool m_sent = false;
+    LinkMode m_mode = LINK_DISCONNECTED;
+    unsigned long m_sentMs = 0;
+    unsigned long m_sentUs = 0;
+};
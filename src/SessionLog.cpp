@@ -0,0 +1,148 @@
+#include "SessionLog.h"
+
+static uint64_t zigzag(int64_t value)
+{
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value)
+{
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+size_t SessionEncoder::writeHeader(uint8_t fwVersion, uint32_t startUnixTime, uint8_t *out)
+{
+    memset(out, 0, SESSION_HEADER_LENGTH);
+    memcpy(out, SESSION_MAGIC, 4);
+    out[4] = SESSION_VERSION;
+    out[5] = fwVersion;
+    for (int i = 0; i < 4; ++i)
+    {
+        out[8 + i] = (startUnixTime >> (8 * i)) & 0xFF;
+    }
+    return SESSION_HEADER_LENGTH;
+}
+
+size_t SessionEncoder::encode(const SessionSample &sample, uint8_t *out)
+{
+    const TreadMillData &data = sample.data;
+    const TreadMillData &last = m_last.data;
+    size_t length = 0;
+    length += encodeVarint(sample.timeMs - m_last.timeMs, out + length);
+    length += encodeVarint(data.status, out + length);
+    length += encodeVarint(zigzag((int64_t)data.speedFeedbackMilli - last.speedFeedbackMilli), out + length);
+    length += encodeVarint(zigzag((int64_t)data.speedCmdMilli - last.speedCmdMilli), out + length);
+    length += encodeVarint(zigzag((int64_t)data.distanceMilli - last.distanceMilli), out + length);
+    length += encodeVarint(zigzag((int64_t)data.steps - last.steps), out + length);
+    length += encodeVarint(zigzag((int64_t)data.calories - last.calories), out + length);
+    length += encodeVarint(zigzag((int64_t)data.durationMs - last.durationMs), out + length);
+    m_last = sample;
+    return length;
+}
+
+SessionDecoder::SessionDecoder(const uint8_t *data, size_t length)
+    : m_data(data), m_length(length)
+{
+    m_valid = length >= SESSION_HEADER_LENGTH && memcmp(data, SESSION_MAGIC, 4) == 0 && data[4] == SESSION_VERSION;
+    m_last.data.fwVersion = getFwVersion();
+}
+
+uint32_t SessionDecoder::getStartUnixTime() const
+{
+    if (!m_valid)
+    {
+        return 0;
+    }
+    return (uint32_t)m_data[8] | ((uint32_t)m_data[9] << 8) | ((uint32_t)m_data[10] << 16) | ((uint32_t)m_data[11] << 24);
+}
+
+bool SessionDecoder::next(SessionSample &sample)
+{
+    if (!m_valid)
+    {
+        return false;
+    }
+    uint64_t fields[8];
+    size_t pos = m_pos;
+    for (int i = 0; i < 8; ++i)
+    {
+        if (!decodeVarint(m_data, m_length, pos, fields[i]))
+        {
+            return false;
+        }
+    }
+    m_pos = pos;
+    TreadMillData &data = m_last.data;
+    m_last.timeMs += fields[0];
+    data.status = (TreadMillData::Status)fields[1];
+    data.speedFeedbackMilli += unzigzag(fields[2]);
+    data.speedCmdMilli += unzigzag(fields[3]);
+    data.distanceMilli += unzigzag(fields[4]);
+    data.steps += unzigzag(fields[5]);
+    data.calories += unzigzag(fields[6]);
+    data.durationMs += unzigzag(fields[7]);
+    sample = m_last;
+    return true;
+}
+
+void SessionRecorder::onData(const TreadMillData &data, unsigned long nowMs, uint32_t startUnixTime)
+{
+    if (!m_recording)
+    {
+        if (data.status != TreadMillData::RUNNING)
+        {
+            return;
+        }
+        if (!m_storage.beginSession())
+        {
+            m_stats.writeErrors++;
+            return;
+        }
+        m_recording = true;
+        m_startMs = nowMs;
+        m_encoder.reset();
+        uint8_t header[SESSION_HEADER_LENGTH];
+        write(header, SessionEncoder::writeHeader(data.fwVersion, startUnixTime, header));
+        m_lastStatus = data.status;
+        m_stats.sessions++;
+        log_i("Recording session %u", m_stats.sessions);
+    }
+
+    if (data.status == TreadMillData::STOPPED || data.status == TreadMillData::DISCONNECTED)
+    {
+        close();
+        return;
+    }
+    // paused or counting down only the change is of interest
+    if (data.status != TreadMillData::RUNNING && data.status == m_lastStatus)
+    {
+        return;
+    }
+    m_lastStatus = data.status;
+
+    SessionSample sample;
+    sample.timeMs = nowMs - m_startMs;
+    sample.data = data;
+    uint8_t record[SESSION_RECORD_MAX_LENGTH];
+    write(record, m_encoder.encode(sample, record));
+    m_stats.samples++;
+}
+
+void SessionRecorder::write(const uint8_t *data, size_t length)
+{
+    if (m_storage.append(data, length))
+    {
+        m_stats.bytesWritten += length;
+    }
+    else
+    {
+        m_stats.writeErrors++;
+    }
+}
+
+void SessionRecorder::close()
+{
+    m_storage.endSession();
+    m_recording = false;
+    log_i("Session closed, %u samples and %u bytes recorded in total", m_stats.samples, m_stats.bytesWritten);
+}
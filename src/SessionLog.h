@@ -0,0 +1,126 @@
+#pragma once
+#include <Arduino.h>
+
+#include "platform.h"
+#include "TraceFormat.h"
+
+// Session files recorded while the treadmill runs.
+//
+// header (16 bytes): "PKSS" | version | firmware | 2 reserved |
+//                    start unix time (u32 LE, 0 if unknown) | 4 reserved
+// record: every field as varint in this order, so each record has the same
+//         layout: ms since the previous sample, status, then the zigzag
+//         encoded deltas of speed feedback, speed command, distance, steps,
+//         calories and duration against the previous sample.
+//
+// A sample every 200 ms while walking at constant speed takes about 10 bytes.
+#define SESSION_MAGIC "PKSS"
+#define SESSION_VERSION 1
+#define SESSION_HEADER_LENGTH 16
+#define SESSION_RECORD_MAX_LENGTH (8 * TRACE_VARINT_MAX_LENGTH)
+
+struct SessionSample
+{
+    uint32_t timeMs = 0; // since the start of the session
+    TreadMillData data;
+};
+
+class SessionEncoder
+{
+public:
+    static size_t writeHeader(uint8_t fwVersion, uint32_t startUnixTime, uint8_t *out);
+
+    void reset()
+    {
+        m_last = SessionSample();
+    }
+
+    // out must hold SESSION_RECORD_MAX_LENGTH bytes, returns the bytes written
+    size_t encode(const SessionSample &sample, uint8_t *out);
+
+private:
+    SessionSample m_last;
+};
+
+class SessionDecoder
+{
+public:
+    SessionDecoder(const uint8_t *data, size_t length);
+
+    bool isValid() const
+    {
+        return m_valid;
+    }
+
+    uint8_t getFwVersion() const
+    {
+        return m_valid ? m_data[5] : 0;
+    }
+
+    uint32_t getStartUnixTime() const;
+
+    // Returns false at the end or if the last record is cut off
+    bool next(SessionSample &sample);
+
+private:
+    const uint8_t *m_data;
+    size_t m_length;
+    size_t m_pos = SESSION_HEADER_LENGTH;
+    bool m_valid = false;
+    SessionSample m_last;
+};
+
+// Where recorded sessions go, LittleFS on the device. append() gets the
+// header and then every record on its own, the storage batches the flash writes.
+class SessionStorage
+{
+public:
+    virtual ~SessionStorage() = default;
+
+    virtual bool beginSession() = 0;
+    virtual bool append(const uint8_t *data, size_t length) = 0;
+    virtual void endSession() = 0;
+};
+
+struct SessionRecorderStats
+{
+    uint32_t sessions = 0;
+    uint32_t samples = 0;
+    uint32_t bytesWritten = 0;
+    uint32_t writeErrors = 0;
+};
+
+// Opens a session when the treadmill starts running, records every running
+// frame and status changes and closes the session on STOPPED or DISCONNECTED.
+class SessionRecorder
+{
+public:
+    explicit SessionRecorder(SessionStorage &storage)
+        : m_storage(storage)
+    {
+    }
+
+    // Call for every frame, startUnixTime is stored in the header of a new session
+    void onData(const TreadMillData &data, unsigned long nowMs, uint32_t startUnixTime = 0);
+
+    bool isRecording() const
+    {
+        return m_recording;
+    }
+
+    const SessionRecorderStats &getStats() const
+    {
+        return m_stats;
+    }
+
+private:
+    void write(const uint8_t *data, size_t length);
+    void close();
+
+    SessionStorage &m_storage;
+    SessionEncoder m_encoder;
+    bool m_recording = false;
+    unsigned long m_startMs = 0;
+    TreadMillData::Status m_lastStatus = TreadMillData::STOPPED;
+    SessionRecorderStats m_stats;
+};
@@ -0,0 +1,220 @@
+#include "SessionStore.h"
+
+bool SessionStore::begin()
+{
+    if (!LittleFS.begin(true))
+    {
+        log_e("Failed to mount LittleFS, sessions are not recorded");
+        return false;
+    }
+    m_mounted = true;
+    if (!LittleFS.exists(SESSION_DIR))
+    {
+        LittleFS.mkdir(SESSION_DIR);
+    }
+
+    File dir = LittleFS.open(SESSION_DIR);
+    File entry;
+    while ((entry = dir.openNextFile()))
+    {
+        uint32_t index = strtoul(entry.name(), nullptr, 10);
+        if (index > 0)
+        {
+            m_nextIndex = max(m_nextIndex, index + 1);
+            m_firstIndex = m_firstIndex == 0 ? index : min(m_firstIndex, index);
+        }
+        entry.close();
+    }
+    log_i("Session store: sessions %u to %u, %u of %u bytes used", m_firstIndex, m_nextIndex - 1,
+          LittleFS.usedBytes(), LittleFS.totalBytes());
+    return true;
+}
+
+void SessionStore::formatPath(uint32_t index, char *path, size_t size)
+{
+    snprintf(path, size, SESSION_DIR "/%05u.pks", index);
+}
+
+void SessionStore::enforceRetention()
+{
+    while (m_firstIndex != 0 && m_firstIndex < m_nextIndex &&
+           (m_nextIndex - m_firstIndex >= SESSION_MAX_FILES ||
+            LittleFS.totalBytes() - LittleFS.usedBytes() < SESSION_MIN_FREE_BYTES))
+    {
+        char path[32];
+        formatPath(m_firstIndex, path, sizeof(path));
+        if (LittleFS.exists(path))
+        {
+            log_i("Deleting old session %s", path);
+            LittleFS.remove(path);
+        }
+        m_firstIndex++;
+    }
+    if (m_firstIndex >= m_nextIndex)
+    {
+        m_firstIndex = 0;
+    }
+}
+
+bool SessionStore::beginSession()
+{
+    if (!m_mounted)
+    {
+        return false;
+    }
+    enforceRetention();
+    char path[32];
+    formatPath(m_nextIndex, path, sizeof(path));
+    m_file = LittleFS.open(path, FILE_WRITE);
+    if (!m_file)
+    {
+        log_e("Failed to create %s", path);
+        return false;
+    }
+    if (m_firstIndex == 0)
+    {
+        m_firstIndex = m_nextIndex;
+    }
+    m_nextIndex++;
+    m_blockLength = 0;
+    return true;
+}
+
+bool SessionStore::append(const uint8_t *data, size_t length)
+{
+    if (!m_file)
+    {
+        return false;
+    }
+    while (length > 0)
+    {
+        size_t part = min(length, SESSION_BLOCK_SIZE - m_blockLength);
+        memcpy(m_block + m_blockLength, data, part);
+        m_blockLength += part;
+        data += part;
+        length -= part;
+        if (m_blockLength < SESSION_BLOCK_SIZE)
+        {
+            break;
+        }
+        // commit the full block, a crash loses at most the block in RAM
+        bool written = m_file.write(m_block, m_blockLength) == m_blockLength;
+        m_blockLength = 0;
+        if (!written)
+        {
+            return false;
+        }
+        m_file.flush();
+    }
+    return true;
+}
+
+void SessionStore::sync()
+{
+    if (!m_file || m_blockLength == 0)
+    {
+        return;
+    }
+    if (m_file.write(m_block, m_blockLength) != m_blockLength)
+    {
+        log_e("Failed to write %u buffered session bytes", (unsigned)m_blockLength);
+    }
+    m_blockLength = 0;
+    m_file.flush();
+}
+
+void SessionStore::endSession()
+{
+    if (m_file)
+    {
+        sync();
+        m_file.close();
+    }
+}
+
+bool SessionStore::publishList(MqttTransport &transport, const char *topic)
+{
+    String list = "[";
+    for (uint32_t index = m_firstIndex; m_firstIndex != 0 && index < m_nextIndex; ++index)
+    {
+        char path[32];
+        formatPath(index, path, sizeof(path));
+        File file = LittleFS.open(path);
+        if (!file)
+        {
+            continue;
+        }
+        uint8_t header[SESSION_HEADER_LENGTH];
+        size_t headerLength = file.read(header, sizeof(header));
+        SessionDecoder decoder(header, headerLength);
+        char entry[96];
+        snprintf(entry, sizeof(entry), "%s{\"index\":%u,\"bytes\":%u,\"start\":%u}", list.length() > 1 ? "," : "",
+                 index, (unsigned)file.size(), decoder.getStartUnixTime());
+        list += entry;
+        file.close();
+    }
+    list += "]";
+    return transport.publish(topic, list.c_str());
+}
+
+bool SessionStore::startFetch(uint32_t index)
+{
+    if (m_fetchFile)
+    {
+        m_fetchFile.close();
+    }
+    char path[32];
+    formatPath(index, path, sizeof(path));
+    if (index == m_nextIndex - 1 && m_file)
+    {
+        log_w("Session %u is still being recorded", index);
+        return false;
+    }
+    m_fetchFile = LittleFS.open(path);
+    if (!m_fetchFile)
+    {
+        log_w("Session %u does not exist", index);
+        return false;
+    }
+    m_fetchIndex = index;
+    m_nextFetchChunk = 0;
+    return true;
+}
+
+void SessionStore::handleFetch(MqttTransport &transport, const char *topicBase, unsigned long now)
+{
+    if (!m_fetchFile || (long)(now - m_nextFetchChunk) < 0)
+    {
+        return;
+    }
+    char topic[128];
+    uint8_t chunk[SESSION_FETCH_CHUNK];
+    size_t offset = m_fetchFile.position();
+    size_t length = m_fetchFile.read(chunk, sizeof(chunk));
+    if (length == 0)
+    {
+        snprintf(topic, sizeof(topic), "%s/%u/end", topicBase, m_fetchIndex);
+        char size[16];
+        snprintf(size, sizeof(size), "%u", (unsigned)offset);
+        transport.publish(topic, size);
+        m_fetchFile.close();
+        return;
+    }
+    snprintf(topic, sizeof(topic), "%s/%u/%u", topicBase, m_fetchIndex, (unsigned)offset);
+    if (!transport.publish(topic, chunk, length, false))
+    {
+        // retry the chunk on the next call
+        m_fetchFile.seek(offset);
+    }
+    m_nextFetchChunk = now + FETCH_PACE_MS;
+}
+
+uint32_t SessionStore::getMsUntilFetch(unsigned long now) const
+{
+    if (!m_fetchFile)
+    {
+        return UINT32_MAX;
+    }
+    long remaining = (long)(m_nextFetchChunk - now);
+    return remaining > 0 ? remaining : 0;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <Arduino.h>
+#include <LittleFS.h>
+
+#include "SessionLog.h"
+#include "MqttTransport.h"
+
+#define SESSION_DIR "/sessions"
+#define SESSION_MAX_FILES 32
+// oldest sessions are deleted to keep this much of the file system free
+#define SESSION_MIN_FREE_BYTES (32 * 1024)
+#define SESSION_FETCH_CHUNK 1024
+// appends are collected and written a LittleFS block at a time, a partial
+// block stays in RAM until sync() or endSession()
+#define SESSION_BLOCK_SIZE 4096
+
+// Session files on LittleFS, numbered /sessions/00001.pks, ... Sessions are
+// listed and fetched over mqtt: <base>/list answers on <base> with a JSON
+// array, <base>/fetch with an index publishes the raw file in chunks to
+// <base>/<index>/<offset> followed by <base>/<index>/end with the size.
+class SessionStore : public SessionStorage
+{
+public:
+    bool begin();
+
+    bool beginSession() override;
+    bool append(const uint8_t *data, size_t length) override;
+    void endSession() override;
+
+    // Writes out the buffered part of the running session, call before a restart
+    void sync();
+
+    // Publishes the list of stored sessions to topic
+    bool publishList(MqttTransport &transport, const char *topic);
+
+    // Starts sending session index, the chunks follow in handleFetch()
+    bool startFetch(uint32_t index);
+
+    // Publishes the next chunk of a running fetch, call from the main loop
+    void handleFetch(MqttTransport &transport, const char *topicBase, unsigned long now);
+
+    uint32_t getMsUntilFetch(unsigned long now) const;
+
+private:
+    static void formatPath(uint32_t index, char *path, size_t size);
+    void enforceRetention();
+
+    bool m_mounted = false;
+    uint32_t m_firstIndex = 0; // oldest stored session, 0 if none
+    uint32_t m_nextIndex = 1;
+    File m_file;
+    uint8_t m_block[SESSION_BLOCK_SIZE];
+    size_t m_blockLength = 0;
+
+    File m_fetchFile;
+    uint32_t m_fetchIndex = 0;
+    unsigned long m_nextFetchChunk = 0;
+
+    const uint32_t FETCH_PACE_MS = 20;
+};
@@ -0,0 +1,83 @@
+#pragma once
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Fixed-size lock-free single-producer/single-consumer ring buffer.
+// push() must only be called from one task (e.g. the NimBLE host task) and
+// pop() only from another one (the main loop). When the ring is full the new
+// element is dropped and counted as an overflow, the producer never blocks.
+template <typename T, size_t N>
+class SpscRing
+{
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscRing capacity must be a power of two");
+
+public:
+    bool push(const T &item)
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        const size_t tail = m_tail.load(std::memory_order_acquire);
+        const size_t used = head - tail;
+        if (used >= N)
+        {
+            m_overflows.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        m_items[head & (N - 1)] = item;
+        m_head.store(head + 1, std::memory_order_release);
+
+        if (used + 1 > m_highWater.load(std::memory_order_relaxed))
+        {
+            m_highWater.store(used + 1, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    bool pop(T &item)
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        const size_t head = m_head.load(std::memory_order_acquire);
+        if (head == tail)
+        {
+            return false;
+        }
+        item = m_items[tail & (N - 1)];
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const
+    {
+        return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    constexpr size_t capacity() const
+    {
+        return N;
+    }
+
+    // Number of elements dropped because the ring was full
+    uint32_t getOverflows() const
+    {
+        return m_overflows.load(std::memory_order_relaxed);
+    }
+
+    // Highest fill level observed by the producer
+    size_t getHighWater() const
+    {
+        return m_highWater.load(std::memory_order_relaxed);
+    }
+
+private:
+    T m_items[N];
+    // head and tail are free-running counters, the index is masked on access
+    std::atomic<size_t> m_head{0};
+    std::atomic<size_t> m_tail{0};
+    std::atomic<uint32_t> m_overflows{0};
+    std::atomic<size_t> m_highWater{0};
+};
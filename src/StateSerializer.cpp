@@ -0,0 +1,214 @@
+#include "StateSerializer.h"
+
+const char *stateToString(TreadMillData::Status status)
+{
+    switch (status)
+    {
+    case TreadMillData::COUNTDOWN:
+        return "countdown";
+    case TreadMillData::RUNNING:
+        return "running";
+    case TreadMillData::PAUSED:
+        return "paused";
+    case TreadMillData::STOPPED:
+        return "stopped";
+    case TreadMillData::DISCONNECTED:
+        return "disconnected";
+    default:
+        return "unknown";
+    }
+}
+
+// Bounded writer into a caller provided buffer, remembers overflows so the
+// serializer can bail out once at the end
+class JsonBufferWriter
+{
+public:
+    JsonBufferWriter(char *buffer, size_t size)
+        : m_buffer(buffer), m_end(buffer + size), m_pos(buffer)
+    {
+    }
+
+    void append(const char *str)
+    {
+        while (*str)
+        {
+            put(*str++);
+        }
+    }
+
+    void appendUInt(uint32_t value)
+    {
+        char digits[10];
+        int count = 0;
+        do
+        {
+            digits[count++] = '0' + value % 10;
+            value /= 10;
+        } while (value);
+        while (count)
+        {
+            put(digits[--count]);
+        }
+    }
+
+    // writes value / 1000 as a decimal without trailing zeros, e.g. 3500 -> 3.5, 6000 -> 6
+    void appendMilli(uint32_t value)
+    {
+        appendUInt(value / 1000);
+        uint32_t fraction = value % 1000;
+        if (fraction == 0)
+        {
+            return;
+        }
+        put('.');
+        char digits[3] = {
+            (char)('0' + fraction / 100),
+            (char)('0' + fraction / 10 % 10),
+            (char)('0' + fraction % 10)};
+        int count = 3;
+        while (digits[count - 1] == '0')
+        {
+            count--;
+        }
+        for (int i = 0; i < count; ++i)
+        {
+            put(digits[i]);
+        }
+    }
+
+    size_t finish()
+    {
+        if (m_pos >= m_end)
+        {
+            return 0;
+        }
+        *m_pos = '\0';
+        return m_pos - m_buffer;
+    }
+
+private:
+    void put(char c)
+    {
+        if (m_pos < m_end)
+        {
+            *m_pos = c;
+        }
+        // keep counting past the end so finish() detects the overflow
+        m_pos++;
+    }
+
+    char *m_buffer;
+    char *m_end;
+    char *m_pos;
+};
+
+size_t serializeState(const TreadMillData &data, char *buffer, size_t size)
+{
+    JsonBufferWriter writer(buffer, size);
+    writer.append("{\"speed_cmd\":");
+    writer.appendMilli(data.speedCmdMilli);
+    writer.append(",\"speed_feedback\":");
+    writer.appendMilli(data.speedFeedbackMilli);
+    writer.append(",\"speed_max\":");
+    writer.appendMilli(data.speedMaxMilli);
+    writer.append(",\"distance_km\":");
+    writer.appendMilli(data.distanceMilli);
+    writer.append(",\"duration_sec\":");
+    writer.appendUInt(data.durationMs / 1000);
+    writer.append(",\"calories\":");
+    writer.appendUInt(data.calories);
+    writer.append(",\"steps\":");
+    writer.appendUInt(data.steps);
+    writer.append(",\"fw\":");
+    writer.appendUInt(data.fwVersion);
+    writer.append(",\"state\":\"");
+    writer.append(stateToString(data.status));
+    writer.append("\"}");
+    return writer.finish();
+}
+
+// Bounded MessagePack writer, same overflow handling as JsonBufferWriter
+class MsgPackBufferWriter
+{
+public:
+    MsgPackBufferWriter(uint8_t *buffer, size_t size)
+        : m_buffer(buffer), m_end(buffer + size), m_pos(buffer)
+    {
+    }
+
+    void appendMapHeader(uint8_t count)
+    {
+        // fixmap, up to 15 entries
+        put(0x80 | count);
+    }
+
+    void appendUInt(uint32_t value)
+    {
+        if (value < 0x80)
+        {
+            // positive fixint
+            put(value);
+        }
+        else if (value <= 0xFF)
+        {
+            put(0xcc);
+            put(value);
+        }
+        else if (value <= 0xFFFF)
+        {
+            put(0xcd);
+            put(value >> 8);
+            put(value & 0xFF);
+        }
+        else
+        {
+            put(0xce);
+            put(value >> 24);
+            put((value >> 16) & 0xFF);
+            put((value >> 8) & 0xFF);
+            put(value & 0xFF);
+        }
+    }
+
+    void appendEntry(StateKey key, uint32_t value)
+    {
+        put(key);
+        appendUInt(value);
+    }
+
+    size_t finish()
+    {
+        return m_pos > m_end ? 0 : m_pos - m_buffer;
+    }
+
+private:
+    void put(uint8_t c)
+    {
+        if (m_pos < m_end)
+        {
+            *m_pos = c;
+        }
+        m_pos++;
+    }
+
+    uint8_t *m_buffer;
+    uint8_t *m_end;
+    uint8_t *m_pos;
+};
+
+size_t serializeStateMsgPack(const TreadMillData &data, uint8_t *buffer, size_t size)
+{
+    MsgPackBufferWriter writer(buffer, size);
+    writer.appendMapHeader(STATE_KEY_COUNT);
+    writer.appendEntry(STATE_KEY_STATUS, data.status);
+    writer.appendEntry(STATE_KEY_SPEED_CMD, data.speedCmdMilli);
+    writer.appendEntry(STATE_KEY_SPEED_FEEDBACK, data.speedFeedbackMilli);
+    writer.appendEntry(STATE_KEY_SPEED_MAX, data.speedMaxMilli);
+    writer.appendEntry(STATE_KEY_DISTANCE, data.distanceMilli);
+    writer.appendEntry(STATE_KEY_DURATION, data.durationMs);
+    writer.appendEntry(STATE_KEY_CALORIES, data.calories);
+    writer.appendEntry(STATE_KEY_STEPS, data.steps);
+    writer.appendEntry(STATE_KEY_FW, data.fwVersion);
+    return writer.finish();
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <Arduino.h>
+
+#include "platform.h"
+
+// Largest state document we produce, fits comfortably in the mqtt buffer
+#define STATE_JSON_MAX_LENGTH 256
+// MessagePack map of 9 integer keys with at most 5 byte values
+#define STATE_MSGPACK_MAX_LENGTH 64
+
+// Integer keys of the MessagePack state, values are the raw integer units of
+// TreadMillData (milli km/h, m, ms), the state is the TreadMillData::Status code
+enum StateKey
+{
+    STATE_KEY_STATUS = 0,
+    STATE_KEY_SPEED_CMD = 1,
+    STATE_KEY_SPEED_FEEDBACK = 2,
+    STATE_KEY_SPEED_MAX = 3,
+    STATE_KEY_DISTANCE = 4,
+    STATE_KEY_DURATION = 5,
+    STATE_KEY_CALORIES = 6,
+    STATE_KEY_STEPS = 7,
+    STATE_KEY_FW = 8,
+    STATE_KEY_COUNT
+};
+
+const char *stateToString(TreadMillData::Status status);
+
+// Serializes the state document published on the state topic into buffer,
+// returns the number of bytes written excluding the terminator (0 if the buffer
+// was too small). Milli-unit fields are formatted as fixed-point decimals with
+// trailing zeros stripped, which is the same text ArduinoJson produced for the
+// former float fields, so existing value_json templates keep working. Does not
+// allocate.
+size_t serializeState(const TreadMillData &data, char *buffer, size_t size);
+
+// Serializes the state as a MessagePack map with StateKey keys into buffer,
+// returns the number of bytes written (0 if the buffer was too small). Every
+// value uses the shortest unsigned integer encoding. Does not allocate.
+size_t serializeStateMsgPack(const TreadMillData &data, uint8_t *buffer, size_t size);
@@ -0,0 +1,156 @@
+#include "TelemetryBatcher.h"
+
+static void putU16(uint8_t *out, uint16_t value)
+{
+    out[0] = value & 0xFF;
+    out[1] = value >> 8;
+}
+
+static void putU32(uint8_t *out, uint32_t value)
+{
+    out[0] = value & 0xFF;
+    out[1] = (value >> 8) & 0xFF;
+    out[2] = (value >> 16) & 0xFF;
+    out[3] = value >> 24;
+}
+
+static uint16_t getU16(const uint8_t *in)
+{
+    return (uint16_t)in[0] | ((uint16_t)in[1] << 8);
+}
+
+static uint32_t getU32(const uint8_t *in)
+{
+    return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+void TelemetryBatcher::begin(MqttTransport *transport, const char *topic)
+{
+    m_transport = transport;
+    m_topic = topic;
+}
+
+TelemetryBatcher::Config TelemetryBatcher::clampConfig(const Config &config)
+{
+    Config clamped = config;
+    if (clamped.batchSize < 1)
+    {
+        clamped.batchSize = 1;
+    }
+    if (clamped.batchSize > TELEMETRY_MAX_BATCH)
+    {
+        clamped.batchSize = TELEMETRY_MAX_BATCH;
+    }
+    if (clamped.flushIntervalMs < TELEMETRY_MIN_FLUSH_MS)
+    {
+        clamped.flushIntervalMs = TELEMETRY_MIN_FLUSH_MS;
+    }
+    if (clamped.flushIntervalMs > TELEMETRY_MAX_FLUSH_MS)
+    {
+        clamped.flushIntervalMs = TELEMETRY_MAX_FLUSH_MS;
+    }
+    return clamped;
+}
+
+void TelemetryBatcher::setConfig(const Config &config)
+{
+    flush();
+    m_config = clampConfig(config);
+    log_i("Raw telemetry %s, %u samples or %u ms per batch",
+          m_config.enabled ? "enabled" : "disabled", m_config.batchSize, m_config.flushIntervalMs);
+}
+
+void TelemetryBatcher::add(const TreadMillData &data, unsigned long now)
+{
+    if (!m_config.enabled)
+    {
+        return;
+    }
+    if (m_count == 0)
+    {
+        m_firstUs = data.receivedUs;
+        m_firstMs = now;
+    }
+
+    uint8_t *sample = m_buffer + TELEMETRY_HEADER_LENGTH + m_count * TELEMETRY_SAMPLE_LENGTH;
+    putU32(sample, data.receivedUs - m_firstUs);
+    putU16(sample + 4, data.speedFeedbackMilli);
+    putU16(sample + 6, data.speedCmdMilli);
+    putU32(sample + 8, data.distanceMilli);
+    putU32(sample + 12, data.steps);
+    putU16(sample + 16, data.calories);
+    putU32(sample + 18, data.durationMs);
+    sample[22] = (uint8_t)data.status;
+    sample[23] = 0;
+    m_count++;
+    m_stats.samples++;
+
+    if (m_count >= m_config.batchSize)
+    {
+        flush();
+    }
+}
+
+void TelemetryBatcher::handle(unsigned long now)
+{
+    if (m_count > 0 && now - m_firstMs >= m_config.flushIntervalMs)
+    {
+        flush();
+    }
+}
+
+void TelemetryBatcher::flush()
+{
+    if (m_count == 0)
+    {
+        return;
+    }
+    m_buffer[0] = TELEMETRY_VERSION;
+    m_buffer[1] = (uint8_t)m_count;
+    m_buffer[2] = 0;
+    m_buffer[3] = 0;
+    putU32(m_buffer + 4, m_sequence++);
+    putU32(m_buffer + 8, m_firstUs);
+
+    size_t length = TELEMETRY_HEADER_LENGTH + m_count * TELEMETRY_SAMPLE_LENGTH;
+    // raw telemetry is best effort, the session recording keeps the full history
+    if (m_transport != nullptr && m_transport->connected() && m_transport->publish(m_topic, m_buffer, length, false))
+    {
+        m_stats.batches++;
+    }
+    else
+    {
+        m_stats.dropped += m_count;
+    }
+    m_count = 0;
+}
+
+uint32_t TelemetryBatcher::getMsUntilFlush(unsigned long now) const
+{
+    if (m_count == 0)
+    {
+        return UINT32_MAX;
+    }
+    unsigned long age = now - m_firstMs;
+    return age >= m_config.flushIntervalMs ? 0 : m_config.flushIntervalMs - age;
+}
+
+bool TelemetryBatcher::decodeSample(const uint8_t *batch, size_t length, size_t index, uint32_t &offsetUs, TreadMillData &data)
+{
+    if (length < TELEMETRY_HEADER_LENGTH || batch[0] != TELEMETRY_VERSION || index >= batch[1] ||
+        length < TELEMETRY_HEADER_LENGTH + (index + 1) * TELEMETRY_SAMPLE_LENGTH)
+    {
+        return false;
+    }
+    const uint8_t *sample = batch + TELEMETRY_HEADER_LENGTH + index * TELEMETRY_SAMPLE_LENGTH;
+    offsetUs = getU32(sample);
+    data.speedFeedbackMilli = getU16(sample + 4);
+    data.speedCmdMilli = getU16(sample + 6);
+    data.distanceMilli = getU32(sample + 8);
+    data.steps = getU32(sample + 12);
+    data.calories = getU16(sample + 16);
+    data.durationMs = getU32(sample + 18);
+    data.status = (TreadMillData::Status)sample[22];
+    data.receivedUs = getU32(batch + 8) + offsetUs;
+    return true;
+}
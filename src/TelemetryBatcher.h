@@ -0,0 +1,91 @@
+#pragma once
+#include <Arduino.h>
+
+#include "platform.h"
+#include "MqttTransport.h"
+
+// Raw telemetry batches, one message carries up to TELEMETRY_MAX_BATCH frames.
+// All integers are little endian.
+//
+// header (12 bytes): version | sample count | 2 reserved |
+//                    batch sequence (u32) | micros() of the first sample (u32)
+// sample (24 bytes): µs since the first sample (u32) | speed feedback (u16) |
+//                    speed command (u16) | distance (u32) | steps (u32) |
+//                    calories (u16) | duration ms (u32) | status | reserved
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_HEADER_LENGTH 12
+#define TELEMETRY_SAMPLE_LENGTH 24
+#define TELEMETRY_MAX_BATCH 64
+#define TELEMETRY_MIN_FLUSH_MS 100
+#define TELEMETRY_MAX_FLUSH_MS 60000
+
+struct TelemetryStats
+{
+    uint32_t samples = 0; // frames added to a batch
+    uint32_t batches = 0; // messages published
+    uint32_t dropped = 0; // samples lost because the publish failed
+};
+
+// Packs every treadmill frame into binary batches on a topic of its own,
+// separate from the deduplicated Home Assistant state. A batch is published
+// when it holds batchSize samples or its first sample is flushIntervalMs old,
+// whichever comes first. Disabled by default.
+class TelemetryBatcher
+{
+public:
+    struct Config
+    {
+        bool enabled = false;
+        uint8_t batchSize = 32;
+        uint32_t flushIntervalMs = 2000;
+    };
+
+    void begin(MqttTransport *transport, const char *topic);
+
+    // Publishes the pending batch first, values are clamped to the supported range
+    void setConfig(const Config &config);
+
+    const Config &getConfig() const
+    {
+        return m_config;
+    }
+
+    // Appends a frame, publishes the batch when it is full
+    void add(const TreadMillData &data, unsigned long now);
+
+    // Publishes the batch when its flush interval is over
+    void handle(unsigned long now);
+
+    // Publishes what is pending regardless of size and age
+    void flush();
+
+    // Time until handle() has work to do
+    uint32_t getMsUntilFlush(unsigned long now) const;
+
+    size_t getPendingSamples() const
+    {
+        return m_count;
+    }
+
+    const TelemetryStats &getStats() const
+    {
+        return m_stats;
+    }
+
+    static Config clampConfig(const Config &config);
+
+    // Reads sample index of a batch back, for tests and host tools
+    static bool decodeSample(const uint8_t *batch, size_t length, size_t index, uint32_t &offsetUs, TreadMillData &data);
+
+private:
+    MqttTransport *m_transport = nullptr;
+    const char *m_topic = nullptr;
+    Config m_config;
+
+    uint8_t m_buffer[TELEMETRY_HEADER_LENGTH + TELEMETRY_MAX_BATCH * TELEMETRY_SAMPLE_LENGTH];
+    size_t m_count = 0;
+    uint32_t m_firstUs = 0;
+    unsigned long m_firstMs = 0;
+    uint32_t m_sequence = 0;
+    TelemetryStats m_stats;
+};
@@ -0,0 +1,87 @@
+#include "TraceFormat.h"
+
+size_t encodeVarint(uint64_t value, uint8_t *out)
+{
+    size_t length = 0;
+    while (value >= 0x80)
+    {
+        out[length++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    out[length++] = value;
+    return length;
+}
+
+bool decodeVarint(const uint8_t *data, size_t length, size_t &pos, uint64_t &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64 && pos < length; shift += 7)
+    {
+        uint8_t byte = data[pos++];
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t TraceWriter::writeHeader(uint8_t *out)
+{
+    memcpy(out, TRACE_MAGIC, 4);
+    out[4] = TRACE_VERSION;
+    out[5] = out[6] = out[7] = 0;
+    return TRACE_HEADER_LENGTH;
+}
+
+size_t TraceWriter::writeRecord(uint64_t timeUs, TraceChannel channel, const uint8_t *data, size_t length, uint8_t *out, size_t capacity)
+{
+    uint8_t header[2 * TRACE_VARINT_MAX_LENGTH + 1];
+    size_t headerLength = encodeVarint(timeUs - m_lastTimeUs, header);
+    header[headerLength++] = channel;
+    headerLength += encodeVarint(length, header + headerLength);
+    if (headerLength + length > capacity)
+    {
+        return 0;
+    }
+    memcpy(out, header, headerLength);
+    memcpy(out + headerLength, data, length);
+    m_lastTimeUs = timeUs;
+    return headerLength + length;
+}
+
+TraceReader::TraceReader(const uint8_t *data, size_t length)
+    : m_data(data), m_length(length)
+{
+    m_valid = length >= TRACE_HEADER_LENGTH && memcmp(data, TRACE_MAGIC, 4) == 0 && data[4] == TRACE_VERSION;
+}
+
+bool TraceReader::next(TraceRecord &record)
+{
+    if (!m_valid || m_pos >= m_length)
+    {
+        return false;
+    }
+    size_t pos = m_pos;
+    uint64_t delta;
+    uint64_t length;
+    if (!decodeVarint(m_data, m_length, pos, delta) || pos >= m_length)
+    {
+        m_truncated = true;
+        return false;
+    }
+    uint8_t channel = m_data[pos++];
+    if (!decodeVarint(m_data, m_length, pos, length) || length > m_length - pos)
+    {
+        m_truncated = true;
+        return false;
+    }
+    m_timeUs += delta;
+    record.timeUs = m_timeUs;
+    record.channel = (TraceChannel)channel;
+    record.data = m_data + pos;
+    record.length = length;
+    m_pos = pos + length;
+    return true;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <Arduino.h>
+
+// Notification traces, as captured by experiment/experiment.py --capture.
+//
+// header: "PKTR" | version (1 byte) | 3 reserved bytes
+// record: delta to the previous record in us (varint) | channel (1 byte) |
+//         payload length (varint) | payload
+//
+// Varints are LEB128, 7 bits per byte with the low group first. A 31-byte
+// status frame every 200 ms takes 36 bytes per record.
+#define TRACE_MAGIC "PKTR"
+#define TRACE_VERSION 1
+#define TRACE_HEADER_LENGTH 8
+#define TRACE_VARINT_MAX_LENGTH 10
+
+enum TraceChannel : uint8_t
+{
+    TRACE_CHANNEL_STATE = 0,   // CHARACTERISTIC_NOTIFY_STATE_UUID (fba2)
+    TRACE_CHANNEL_NOTIFY1 = 1, // 2b10 of the vendor service
+    TRACE_CHANNEL_COMMAND = 2  // frames written to CHARACTERISTIC_WRITE_UUID
+};
+
+struct TraceRecord
+{
+    uint64_t timeUs = 0; // since the start of the trace
+    TraceChannel channel = TRACE_CHANNEL_STATE;
+    const uint8_t *data = nullptr;
+    size_t length = 0;
+};
+
+// Writes value to out (at least TRACE_VARINT_MAX_LENGTH bytes), returns the bytes written
+size_t encodeVarint(uint64_t value, uint8_t *out);
+
+// Reads a varint at pos and advances pos, returns false if the data ends inside it
+bool decodeVarint(const uint8_t *data, size_t length, size_t &pos, uint64_t &value);
+
+// Encodes records into caller provided buffers
+class TraceWriter
+{
+public:
+    // out must hold TRACE_HEADER_LENGTH bytes
+    static size_t writeHeader(uint8_t *out);
+
+    // Returns the encoded size or 0 if the record does not fit into capacity.
+    // Records must be written in time order.
+    size_t writeRecord(uint64_t timeUs, TraceChannel channel, const uint8_t *data, size_t length, uint8_t *out, size_t capacity);
+
+private:
+    uint64_t m_lastTimeUs = 0;
+};
+
+// Iterates the records of a trace held in memory, payloads point into it
+class TraceReader
+{
+public:
+    TraceReader(const uint8_t *data, size_t length);
+
+    // False if the header is missing or of another version
+    bool isValid() const
+    {
+        return m_valid;
+    }
+
+    bool next(TraceRecord &record);
+
+    // True if the trace ended in the middle of a record, e.g. an interrupted capture
+    bool isTruncated() const
+    {
+        return m_truncated;
+    }
+
+private:
+    const uint8_t *m_data;
+    size_t m_length;
+    size_t m_pos = TRACE_HEADER_LENGTH;
+    uint64_t m_timeUs = 0;
+    bool m_valid = false;
+    bool m_truncated = false;
+};
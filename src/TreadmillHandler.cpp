@@ -1,20 +1,7 @@
 #include "TreadmillHandler.h"
+#include "DeferredLog.h"
 
-// --- Helper functions to read uint16 and uint32 from bytes ---
-uint16_t readU16(uint8_t *data, int offset)
-{
-    // TODO: really needed or can we just use memcpy?
-    return ((uint16_t)data[offset] << 8) | data[offset + 1];
-}
-
-uint32_t readU32(uint8_t *data, int offset)
-{
-    // TODO: really needed or can we just use memcpy?
-    return ((uint32_t)data[offset] << 24) |
-           ((uint32_t)data[offset + 1] << 16) |
-           ((uint32_t)data[offset + 2] << 8) |
-           ((uint32_t)data[offset + 3]);
-}
+TreadmillHandler *TreadmillHandler::s_instances[TREADMILL_MAX_DEVICES] = {};
 
 TreadmillHandler::TreadmillHandler()
 {
@@ -22,10 +9,29 @@ TreadmillHandler::TreadmillHandler()
     m_pNotifyCharacteristic = nullptr;
     m_pWriteCharacteristic = nullptr;
     m_doConnect = false;
+    m_writeMutex = xSemaphoreCreateMutex();
+    m_writeDone = xSemaphoreCreateBinary();
+    for (TreadmillHandler *&instance : s_instances)
+    {
+        if (instance == nullptr)
+        {
+            instance = this;
+            break;
+        }
+    }
+    m_session.setCallback([this](const TreadMillData &data)
+                          { onData(data); });
 }
 
 TreadmillHandler::~TreadmillHandler()
 {
+    for (TreadmillHandler *&instance : s_instances)
+    {
+        if (instance == this)
+        {
+            instance = nullptr;
+        }
+    }
     if (m_pClient)
     {
         m_pClient->disconnect();
@@ -34,88 +40,213 @@ TreadmillHandler::~TreadmillHandler()
     }
 }
 
-void TreadmillHandler::setSpeed(uint16_t speed)
+void TreadmillHandler::setSpeed(uint16_t speed, unsigned long requestUs)
 {
-    uint8_t packet[23];
-    this->makePacket(CMD_START_SET_SPEED, speed, packet);
-    this->sendCommand(packet, sizeof(packet));
+    queueCommand(TreadmillProtocol::CMD_START_SET_SPEED, speed, requestUs);
 }
 
-void TreadmillHandler::start()
+void TreadmillHandler::start(unsigned long requestUs)
 {
-    uint8_t packet[23];
-    this->makePacket(CMD_START_SET_SPEED, 0, packet);
-    this->sendCommand(packet, sizeof(packet));
+    queueCommand(TreadmillProtocol::CMD_START_SET_SPEED, 0, requestUs);
 }
 
-void TreadmillHandler::stop()
+void TreadmillHandler::stop(unsigned long requestUs)
 {
-    uint8_t packet[23];
-    this->makePacket(CMD_STOP, 0, packet);
-    this->sendCommand(packet, sizeof(packet));
+    queueCommand(TreadmillProtocol::CMD_STOP, 0, requestUs);
 }
 
-void TreadmillHandler::pause()
+void TreadmillHandler::pause(unsigned long requestUs)
 {
-    uint8_t packet[23];
-    this->makePacket(CMD_PAUSE, 0, packet);
-    this->sendCommand(packet, sizeof(packet));
+    queueCommand(TreadmillProtocol::CMD_PAUSE, 0, requestUs);
+}
+
+void TreadmillHandler::queueCommand(TreadmillProtocol::CommandType type, uint16_t speed, unsigned long requestUs)
+{
+    if (!m_session.queueCommand(type, speed, requestUs))
+    {
+        return;
+    }
+    m_commandQueued = true;
+    if (m_senderTask)
+    {
+        xTaskNotifyGive(m_senderTask);
+    }
 }
 
 void TreadmillHandler::begin(NimBLEAddress address)
 {
     m_targetAddress = address;
     m_doConnect = true;
+    m_scanner.begin(address);
+    m_scanner.setSeenCallback([this]()
+                              {
+        if (m_onWakeup)
+        {
+            m_onWakeup();
+        } });
 }
 
 // Send data to the write characteristic
-bool TreadmillHandler::sendCommand(const uint8_t *data, size_t length)
+bool TreadmillHandler::writeCommand(const uint8_t *data, size_t length, bool writeWithResponse)
 {
-    if (!m_pWriteCharacteristic || !m_pClient->isConnected())
+    // held by the main loop while a reconnect replaces the attributes, the
+    // characteristic must not be used meanwhile
+    if (xSemaphoreTake(m_writeMutex, 0) != pdTRUE)
+    {
+        log_e("Cannot write, reconnecting");
+        return false;
+    }
+    bool success = writeLocked(data, length, writeWithResponse);
+    xSemaphoreGive(m_writeMutex);
+    return success;
+}
+
+bool TreadmillHandler::writeLocked(const uint8_t *data, size_t length, bool writeWithResponse)
+{
+    if (!m_pClient || !m_pClient->isConnected() || (!m_pWriteCharacteristic && !m_usingCachedHandles))
     {
         log_e("Cannot write, characteristic not ready or client disconnected");
         return false;
     }
 
-    bool success = m_pWriteCharacteristic->writeValue(data, length, true); // false = write without response
+    // write with response blocks until the treadmill acknowledged the write
+    bool success;
+    if (m_usingCachedHandles)
+    {
+        bool withResponse = writeWithResponse || !m_handles.writeNoResponse;
+        success = writeByHandle(m_handles.writeHandle, data, length, withResponse);
+    }
+    else
+    {
+        bool withResponse = writeWithResponse || !m_pWriteCharacteristic->canWriteNoResponse();
+        success = m_pWriteCharacteristic->writeValue(data, length, withResponse);
+    }
     if (!success)
     {
         log_e("Failed to write to treadmill");
         return false;
     }
 
-    log_d("Wrote %d bytes to treadmill", length);
+    dlog_d("Wrote %d bytes to treadmill", (int)length);
     return true;
 }
 
-void TreadmillHandler::handle()
+void TreadmillHandler::onData(const TreadMillData &data)
+{
+    m_connPolicy.onStatus(data.status, millis());
+    if (m_awaitingFirstFrame && data.status != TreadMillData::DISCONNECTED)
+    {
+        m_awaitingFirstFrame = false;
+        log_i("Connect to first notification: %lu ms (%s)", millis() - m_connectStartMs,
+              m_usingCachedHandles ? "cached handles" : "discovery");
+        if (!m_usingCachedHandles && m_handles.isValid())
+        {
+            m_handles.fwVersion = data.fwVersion;
+            m_handleCache.store(m_targetAddress, m_handles);
+        }
+        else if (m_handles.fwVersion != data.fwVersion)
+        {
+            log_w("Firmware changed from %u to %u, dropping cached GATT handles", m_handles.fwVersion, data.fwVersion);
+            m_handleCache.invalidate(m_targetAddress);
+        }
+    }
+    if (m_onDataUpdate)
+    {
+        m_onDataUpdate(data);
+    }
+}
+
+bool TreadmillHandler::handle(bool connectAllowed)
 {
-    // handles reconnection
-    if (m_doConnect && (millis() - m_lastConnectAttempt > 5000) && m_autoReconnect)
+    // drains frames queued by the notification callback and checks the data timeout
+    m_session.handle();
+    updateConnParams();
+
+    // handles reconnection, scan until the treadmill advertises, then connect
+    if (m_doConnect && m_autoReconnect)
     {
-        m_lastConnectAttempt = millis();
-        if (this->connectToDevice())
+        if (!m_scanner.isConnectAllowed(millis()))
         {
-            log_i("Connection successful.");
-            m_doConnect = false;
+            m_scanner.startScan();
         }
-        else
+        else if (connectAllowed)
         {
-            log_e("Failed to connect - Retrying in 5 seconds...");
+            m_scanner.stopScan();
+            if (m_targetAddress.isNull())
+            {
+                // no address configured, use the first treadmill found by name
+                m_targetAddress = m_scanner.getSeenAddress();
+            }
+            PresenceScanner::holdScan();
+            bool connected = this->connectToDevice();
+            PresenceScanner::releaseScan();
+            m_scanner.onConnectAttempt(connected, millis());
+            if (connected)
+            {
+                PresenceStats stats = m_scanner.getStats();
+                log_i("Connection successful after %u attempts (%u failed), scan duty cycle %u%%, scanning %u%% of uptime",
+                      stats.connectAttempts, stats.connectFailures, stats.configuredDutyCycle, stats.scanningPercent);
+                NimBLEConnInfo info = m_pClient->getConnInfo();
+                m_connPolicy.onConnected(info.getConnInterval(), info.getConnLatency(), info.getConnTimeout(), millis());
+                m_doConnect = false;
+            }
+            else
+            {
+                log_e("Failed to connect - waiting for the next advertisement");
+            }
+            return true;
         }
     }
+    else
+    {
+        m_scanner.stopScan();
+    }
+    return false;
+}
 
-    // Check for connection timeout and send state updates if needed
-    if (millis() - m_lastDataTimestamp > CONNECTION_TIMEOUT * 1000)
+void TreadmillHandler::updateConnParams()
+{
+    if (!isConnected())
     {
-        log_w("No data received from treadmill for %d seconds, marking as disconnected.", CONNECTION_TIMEOUT);
-        m_lastData.status = TreadMillData::DISCONNECTED;
-        m_lastDataTimestamp = millis(); // prevent repeated updates
-        if (m_onDataUpdate)
+        if (m_connPolicy.getStatus().mode != LINK_DISCONNECTED)
         {
-            m_onDataUpdate(m_lastData); 
+            m_connPolicy.onDisconnected();
         }
+        return;
+    }
+    if (m_commandQueued.exchange(false))
+    {
+        m_connPolicy.onCommand(millis());
+    }
+    if (m_connUpdated.exchange(false))
+    {
+        NimBLEConnInfo info = m_pClient->getConnInfo();
+        m_connPolicy.onUpdate(m_connUpdateStatus == 0, info.getConnInterval(), info.getConnLatency(), info.getConnTimeout());
+        log_i("Connection parameters %s: interval %u x 1.25 ms, latency %u, timeout %u x 10 ms",
+              m_connUpdateStatus == 0 ? "updated" : "rejected", info.getConnInterval(), info.getConnLatency(), info.getConnTimeout());
+    }
+
+    ConnParams request;
+    if (!m_connPolicy.poll(millis(), request))
+    {
+        return;
+    }
+    log_i("Requesting %s connection parameters", linkModeName(m_connPolicy.getWantedMode(millis())));
+    if (!m_pClient->updateConnParams(request.minInterval, request.maxInterval, request.latency, request.timeout))
+    {
+        log_w("Connection parameter update not started");
+        m_connPolicy.onRequestFailed();
+    }
+}
+
+uint32_t TreadmillHandler::getMsUntilNextTimer() const
+{
+    uint32_t next = UINT32_MAX;
+    if (m_doConnect && m_autoReconnect)
+    {
+        next = m_scanner.getMsUntilConnectAllowed(millis());
     }
+    return min(next, m_session.getMsUntilNextTimer());
 }
 
 bool TreadmillHandler::connectToDevice()
@@ -125,18 +256,58 @@ bool TreadmillHandler::connectToDevice()
         m_pClient = BLEDevice::createClient();
         m_pClient->setDataLen(64); // Set data length to fit packats from device
         m_pClient->setClientCallbacks(this, false);
-        m_pClient->setConnectionParams(12, 24, 0, 600); // 15ms to 30ms interval, no latency, 6s timeout
+        const ConnParams &params = ConnectionPolicy::ACTIVE;
+        m_pClient->setConnectionParams(params.minInterval, params.maxInterval, params.latency, params.timeout);
         // m_pClient->setConnectTimeout(20);
+        NimBLEDevice::setCustomGapHandler(gapEventHandler);
     }
 
     log_i("Connecting to %s", m_targetAddress.toString().c_str());
+    m_connectStartMs = millis();
+    m_session.resetDecoder();
 
-    if (!m_pClient->isConnected() && !m_pClient->connect(m_targetAddress, true, true))
+    // connect() deletes the attributes of the last connection, keep the
+    // sender task away from the old characteristic until it is forgotten
+    xSemaphoreTake(m_writeMutex, portMAX_DELAY);
+    m_usingCachedHandles = false;
+    m_pWriteCharacteristic = nullptr;
+    m_pNotifyCharacteristic = nullptr;
+    bool connected = m_pClient->isConnected() || m_pClient->connect(m_targetAddress, true, true);
+    xSemaphoreGive(m_writeMutex);
+    if (!connected)
     {
         log_e("Failed to connect to treadmill at %s", m_targetAddress.toString().c_str());
         return false;
     }
 
+    GattHandles cached;
+    if (m_handleCache.load(m_targetAddress, cached))
+    {
+        if (subscribeByHandle(cached))
+        {
+            log_i("Subscribed by cached handles in %lu ms", millis() - m_connectStartMs);
+            m_handles = cached;
+            m_usingCachedHandles = true;
+            m_pWriteCharacteristic = nullptr;
+            m_pNotifyCharacteristic = nullptr;
+            m_awaitingFirstFrame = true;
+            return true;
+        }
+        log_w("Cached GATT handles rejected, falling back to discovery");
+        m_handleCache.invalidate(m_targetAddress);
+    }
+
+    if (!discoverAndSubscribe())
+    {
+        return false;
+    }
+    log_i("Discovered and subscribed in %lu ms", millis() - m_connectStartMs);
+    m_awaitingFirstFrame = true;
+    return true;
+}
+
+bool TreadmillHandler::discoverAndSubscribe()
+{
     NimBLERemoteService *pService = m_pClient->getService(SERVICE_PAD_UUID);
     if (!pService)
     {
@@ -182,56 +353,122 @@ bool TreadmillHandler::connectToDevice()
         return false;
     }
 
+    // remember the handles for the next connect, stored once the first frame tells us the firmware version
+    m_handles = GattHandles();
+    m_handles.writeHandle = m_pWriteCharacteristic->getHandle();
+    m_handles.notifyHandle = m_pNotifyCharacteristic->getHandle();
+    m_handles.writeNoResponse = m_pWriteCharacteristic->canWriteNoResponse();
+    NimBLERemoteDescriptor *pCccd = m_pNotifyCharacteristic->getDescriptor(NimBLEUUID((uint16_t)0x2902));
+    if (pCccd)
+    {
+        m_handles.notifyCccdHandle = pCccd->getHandle();
+    }
     return true;
 }
 
-// Generates a 23-byte command packet for the treadmill
-void TreadmillHandler::makePacket(CommandType type, uint16_t speed, uint8_t *outPacket)
+bool TreadmillHandler::subscribeByHandle(const GattHandles &handles)
 {
-    // type: "start", "pause", "stop", "set_speed"
-    // outPacket must be at least 23 bytes
-
-    // --- START / HEADER ---
-    outPacket[0] = 0x6A; // START_BYTE
-    outPacket[1] = 0x17; // LENGTH
-
-    // Bytes 2-5 are reserved (0)
-    for (int i = 2; i <= 5; ++i)
-        outPacket[i] = 0;
-
-    // --- Speed ---
-    outPacket[6] = (speed >> 8) & 0xFF;
-    outPacket[7] = speed & 0xFF;
-
-    // Magical byte: 5 for set_speed, 1 for others
-    outPacket[8] = (speed != 0) ? 5 : 1;
+    // enabling notifications on the cached CCCD validates the handles, the
+    // write fails with an ATT error if the attribute table changed
+    const uint8_t enableNotify[2] = {0x01, 0x00};
+    xSemaphoreTake(m_writeMutex, portMAX_DELAY);
+    bool success = writeByHandle(handles.notifyCccdHandle, enableNotify, sizeof(enableNotify), true);
+    xSemaphoreGive(m_writeMutex);
+    return success;
+}
 
-    outPacket[9] = 0;   // incline
-    outPacket[10] = 80; // weight default
-    outPacket[11] = 0;  // reserved
+bool TreadmillHandler::writeByHandle(uint16_t handle, const uint8_t *data, size_t length, bool withResponse)
+{
+    uint16_t connHandle = m_pClient->getConnHandle();
+    if (!withResponse)
+    {
+        return ble_gattc_write_no_rsp_flat(connHandle, handle, data, length) == 0;
+    }
 
-    // Command byte
-    uint8_t cmd = type; // default start/set_speed
+    xSemaphoreTake(m_writeDone, 0); // clear a stale completion
+    bool success = false;
+    int rc = ble_gattc_write_flat(connHandle, handle, data, length, onWriteComplete, this);
+    if (rc != 0)
+    {
+        log_e("Write to handle 0x%04x failed, rc=%d", handle, rc);
+    }
+    else if (xSemaphoreTake(m_writeDone, pdMS_TO_TICKS(WRITE_TIMEOUT_MS)) != pdTRUE)
+    {
+        log_e("Write to handle 0x%04x timed out", handle);
+    }
+    else
+    {
+        success = m_writeStatus == 0;
+        if (!success)
+        {
+            log_e("Write to handle 0x%04x rejected, status=%d", handle, m_writeStatus);
+        }
+    }
+    return success;
+}
 
-    outPacket[12] = cmd & 0xF7; // kph mode (bit 3 = 0)
+int TreadmillHandler::onWriteComplete(uint16_t connHandle, const ble_gatt_error *error, ble_gatt_attr *attr, void *arg)
+{
+    TreadmillHandler *self = static_cast<TreadmillHandler *>(arg);
+    self->m_writeStatus = error->status;
+    xSemaphoreGive(self->m_writeDone);
+    return 0;
+}
 
-    // User ID 8 bytes (default 58965456623)
-    uint64_t userId = 58965456623ULL;
-    for (int i = 0; i < 8; ++i)
+int TreadmillHandler::gapEventHandler(ble_gap_event *event, void *arg)
+{
+    uint16_t connHandle;
+    if (event->type == BLE_GAP_EVENT_NOTIFY_RX)
+    {
+        connHandle = event->notify_rx.conn_handle;
+    }
+    else if (event->type == BLE_GAP_EVENT_CONN_UPDATE)
+    {
+        connHandle = event->conn_update.conn_handle;
+    }
+    else
+    {
+        return 0;
+    }
+    TreadmillHandler *self = nullptr;
+    for (TreadmillHandler *instance : s_instances)
+    {
+        if (instance && instance->m_pClient && connHandle == instance->m_pClient->getConnHandle())
+        {
+            self = instance;
+            break;
+        }
+    }
+    if (!self)
     {
-        outPacket[13 + i] = (userId >> (56 - i * 8)) & 0xFF;
+        return 0;
     }
 
-    // --- Checksum ---
-    uint8_t checksum = 0;
-    for (int i = 1; i <= 20; ++i)
+    if (event->type == BLE_GAP_EVENT_CONN_UPDATE)
     {
-        checksum ^= outPacket[i];
+        // the accepted parameters are read in handle()
+        self->m_connUpdateStatus = event->conn_update.status;
+        self->m_connUpdated = true;
+        if (self->m_onWakeup)
+        {
+            self->m_onWakeup();
+        }
+        return 0;
+    }
+    if (!self->m_usingCachedHandles || event->notify_rx.attr_handle != self->m_handles.notifyHandle)
+    {
+        return 0;
     }
-    outPacket[21] = checksum;
 
-    // END_BYTE
-    outPacket[22] = 0x43;
+    uint8_t buffer[64];
+    uint16_t length = OS_MBUF_PKTLEN(event->notify_rx.om);
+    if (length > sizeof(buffer))
+    {
+        length = sizeof(buffer);
+    }
+    os_mbuf_copydata(event->notify_rx.om, 0, length, buffer);
+    self->notifyCallback(nullptr, buffer, length, !event->notify_rx.indication);
+    return 0;
 }
 
 // --- Notification callback ---
@@ -241,85 +478,5 @@ void TreadmillHandler::notifyCallback(
     size_t length,
     bool isNotify)
 {
-    log_d("Notification received, length: %d", length);
-
-    // Log payload as hex
-    /**
-    Serial.print("Payload (hex): ");
-    for (size_t i = 0; i < length; i++)
-    {
-        if (pData[i] < 16)
-            Serial.print("0");
-        Serial.print(pData[i], HEX);
-        Serial.print(" ");
-    }
-    Serial.println();
-     */
-    if (length < 31)
-    {
-        log_e("Invalid treadmill packet (too short).");
-        // Here you could trigger a 'stopped/disconnected' state if needed
-        return;
-    }
-
-    // Parse treadmill fields
-    uint16_t current_speed = readU16(pData, 3);
-    uint16_t target_speed = readU16(pData, 5);
-
-    uint32_t distance = readU32(pData, 7);
-    
-    // TODO: validate version
-    uint8_t fw_version = pData[25];
-
-    //uint16_t calories = ((uint16_t)pData[18] << 8) | pData[19];
-    uint16_t calories = readU16(pData, 18);
-    uint32_t steps = readU32(pData, 14);
-    uint32_t duration = readU32(pData, 20);
-    uint8_t flags = pData[26];
-
-    uint16_t maxRunSpeed = readU16(pData, 27);
-
-    uint8_t unit_mode = (flags & 128) ? 1 : 0;
-    uint8_t running_state_bits = flags & 24;
-
-    TreadMillData::Status running_state = TreadMillData::STOPPED; // Default stopped
-    if (running_state_bits == 24)
-        running_state = TreadMillData::COUNTDOWN;
-    else if (running_state_bits == 8)
-        running_state = TreadMillData::RUNNING;
-    else if (running_state_bits == 16)
-        running_state = TreadMillData::PAUSED;
-
-    const char *statusArr[] = {"Countdown", "Running", "Paused", "Stopped"};
-    const char *speed_unit = (unit_mode == 1) ? "mph" : "kph";
-    const char *distance_unit = (unit_mode == 1) ? "mi" : "km";   
-
-    // log_i("--- Treadmill Data ---");
-    // log_i("Speed: %.2f %s", (float)current_speed / 1000.0, speed_unit);
-    // log_i("Distance: %.2f %s", (float)distance / 1000.0, distance_unit);
-    // log_i("Calories: %d kcal", calories);
-    // log_i("Steps: %d", steps);
-    // log_i("Duration (s): %d", duration / 1000);
-    // log_i("Status: %s", statusArr[running_state]);
-    // log_i("---------------------");
-
-    TreadMillData data;
-    data.speedCmd = (float)target_speed / 1000.0;
-    data.speedFeedback = (float)current_speed / 1000.0;
-    data.distanceKm = (float)distance / 1000.0;
-    data.calories = calories;
-    data.steps = steps;
-    data.durationSec = duration / 1000;
-    data.status = running_state;
-    data.fwVersion = fw_version;
-    data.speedMax = (float)maxRunSpeed / 1000.0;
-
-    log_d("Max run speed: %.2f %s, FW version: %d", (float)maxRunSpeed / 1000.0, speed_unit, fw_version);
-
-    m_lastData = data;
-    m_lastDataTimestamp = millis();
-    if (m_onDataUpdate)
-    {
-        m_onDataUpdate(data);
-    }
+    m_session.onNotification(pData, length);
 }
@@ -1,21 +1,105 @@
 #pragma once
 #include <Arduino.h>
 #include <NimBLEDevice.h>
+#include <atomic>
 
 #include "platform.h"
-
-class TreadmillHandler : public NimBLEClientCallbacks
+#include "TreadmillSession.h"
+#include "GattHandleCache.h"
+#include "PresenceScanner.h"
+#include "ConnectionPolicy.h"
+
+// NimBLE transport of the treadmill connection: scanning, connecting, GATT
+// handles and writes. Frame handling and commands live in TreadmillSession.
+class TreadmillHandler : public NimBLEClientCallbacks, public TreadmillLink
 {
 public:
+    typedef TreadmillSession::CommandKind CommandKind;
+
     TreadmillHandler();
     ~TreadmillHandler();
     void begin(NimBLEAddress address);
-    void setSpeed(uint16_t speed);
-    void start();
-    void pause();
-    void stop();
 
-    void handle();
+    // Commands are queued and written by the sender task of the
+    // TreadmillRegistry, the calls return immediately. Pending speed setpoints are coalesced. requestUs is
+    // the micros() timestamp the request arrived at, 0 for now.
+    void setSpeed(uint16_t speed, unsigned long requestUs = 0);
+    void start(unsigned long requestUs = 0);
+    void pause(unsigned long requestUs = 0);
+    void stop(unsigned long requestUs = 0);
+
+    // Acknowledged writes if enabled, otherwise write-without-response where
+    // the characteristic supports it
+    void setWriteWithResponse(const bool enable)
+    {
+        m_session.setWriteWithResponse(enable);
+    }
+
+    const CommandLatency &getCommandLatency(CommandKind kind) const
+    {
+        return m_session.getCommandLatency(kind);
+    }
+
+    // clears the per kind stats and the command histogram
+    void resetCommandLatency()
+    {
+        m_session.resetCommandLatency();
+    }
+
+    const FrameDecoderStats &getFrameDecoderStats() const
+    {
+        return m_session.getFrameDecoderStats();
+    }
+
+    PresenceStats getPresenceStats() const
+    {
+        return m_scanner.getStats();
+    }
+
+    // Connection parameters the treadmill accepted, see ConnectionPolicy
+    const LinkStatus &getLinkStatus() const
+    {
+        return m_connPolicy.getStatus();
+    }
+
+    // notification arrival to parsed frame, recorded in the NimBLE host task
+    LatencyHistogram &getParseLatency()
+    {
+        return m_session.getParseLatency();
+    }
+
+    // command request to treadmill ack, recorded in the sender task
+    LatencyHistogram &getCommandLatencyHistogram()
+    {
+        return m_session.getCommandLatencyHistogram();
+    }
+
+    const CommandQueue &getCommandQueue() const
+    {
+        return m_session.getCommandQueue();
+    }
+
+    // Returns true if a connect was attempted. With connectAllowed false a
+    // treadmill that is ready to connect waits for its turn.
+    bool handle(bool connectAllowed = true);
+
+    // Task notified when a command was queued
+    void setSenderTask(TaskHandle_t task)
+    {
+        m_senderTask = task;
+    }
+
+    // Writes one queued command, called from the sender task
+    bool sendNextCommand()
+    {
+        return m_session.sendNextCommand(*this);
+    }
+
+    // Configured address, or the treadmill found by name once connected
+    NimBLEAddress getAddress() const
+    {
+        return m_targetAddress;
+    }
 
     void setAutoReconnect(const bool enable)
     {
@@ -27,33 +111,60 @@ public:
         return m_autoReconnect;
     }
 
-    bool isConnected() const
+    bool isConnected() const override
     {
         return m_pClient && m_pClient->isConnected();
     }
 
-    enum CommandType
-    {
-        CMD_START_SET_SPEED = 4,
-        CMD_PAUSE = 2,
-        CMD_STOP = 0
-    };
+    bool writeCommand(const uint8_t *data, size_t length, bool withResponse) override;
 
     TreadMillData getLastData() const
     {
-        return m_lastData;
+        return m_session.getLastData();
     }
 
+    // The callback is invoked from handle(), i.e. in the context of the main loop
     void setCallback(std::function<void(const TreadMillData&)> callback)
     {
         m_onDataUpdate = callback;
     }
-    
+
+    // Invoked from the NimBLE host task whenever a frame was queued, used to
+    // wake up the main loop so handle() runs right away
+    void setWakeupCallback(std::function<void()> callback)
+    {
+        m_onWakeup = callback;
+        m_session.setWakeupCallback(callback);
+    }
+
+    // Time until handle() has to run again for reconnects and the data timeout
+    uint32_t getMsUntilNextTimer() const;
+
+    // Frames dropped because the main loop did not drain the queue in time
+    uint32_t getQueueOverflows() const
+    {
+        return m_session.getQueueOverflows();
+    }
+
+    size_t getQueueHighWater() const
+    {
+        return m_session.getQueueHighWater();
+    }
 
 private:
-    bool sendCommand(const uint8_t *data, size_t length);
-    void makePacket(CommandType command, uint16_t speed, uint8_t *outPacket);
+    void queueCommand(TreadmillProtocol::CommandType type, uint16_t speed, unsigned long requestUs);
+    void onData(const TreadMillData &data);
+    // renegotiates the connection parameters when the policy asks for it
+    void updateConnParams();
     bool connectToDevice();
+    bool discoverAndSubscribe();
+    bool subscribeByHandle(const GattHandles &handles);
+    // writeCommand() with m_writeMutex held
+    bool writeLocked(const uint8_t *data, size_t length, bool writeWithResponse);
+    // call with m_writeMutex held
+    bool writeByHandle(uint16_t handle, const uint8_t *data, size_t length, bool withResponse);
+    static int onWriteComplete(uint16_t connHandle, const ble_gatt_error *error, ble_gatt_attr *attr, void *arg);
+    static int gapEventHandler(ble_gap_event *event, void *arg);
     void notifyCallback(
         NimBLERemoteCharacteristic *pBLERemoteCharacteristic,
         uint8_t *pData,
@@ -67,10 +178,31 @@ private:
     bool m_doConnect = false;
     bool m_autoReconnect = true;
 
-    long m_lastConnectAttempt = 0;
+    // connects are only attempted while the treadmill advertises
+    PresenceScanner m_scanner;
+
+    // interval and latency follow the treadmill state, run from the main loop
+    ConnectionPolicy m_connPolicy;
+    // set from the sender, timer and NimBLE host tasks, consumed in handle()
+    std::atomic<bool> m_commandQueued{false};
+    std::atomic<bool> m_connUpdated{false};
+    volatile int m_connUpdateStatus = 0;
+
+    TreadmillSession m_session;
+
+    // handles of the current connection, taken from the cache or discovery
+    GattHandleCache m_handleCache;
+    GattHandles m_handles;
+    bool m_usingCachedHandles = false;
+    bool m_awaitingFirstFrame = false;
+    unsigned long m_connectStartMs = 0;
+    SemaphoreHandle_t m_writeMutex = nullptr;
+    SemaphoreHandle_t m_writeDone = nullptr;
+    volatile int m_writeStatus = 0;
+    // receive notifications by handle when the services were not discovered
+    static TreadmillHandler *s_instances[TREADMILL_MAX_DEVICES];
 
-    long m_lastDataTimestamp = 0;
-    TreadMillData m_lastData;
+    TaskHandle_t m_senderTask = nullptr;
 
 
     void onConnect(BLEClient *pClient) override
@@ -85,6 +217,7 @@ private:
     }
 
     std::function<void(const TreadMillData&)> m_onDataUpdate = nullptr;
+    std::function<void()> m_onWakeup = nullptr;
 
-    const uint8_t CONNECTION_TIMEOUT = 30;
+    const uint32_t WRITE_TIMEOUT_MS = 2000;
 };
\ No newline at end of file
@@ -0,0 +1,16 @@
+#pragma once
+#include <Arduino.h>
+
+// Write side of the connection to the treadmill. TreadmillHandler implements
+// it on top of NimBLE, the simulator with a virtual treadmill. Notifications
+// travel the other way through TreadmillSession::onNotification().
+class TreadmillLink
+{
+public:
+    virtual ~TreadmillLink() = default;
+
+    virtual bool isConnected() const = 0;
+
+    // Writes one command frame, with response blocks until the treadmill acknowledged it
+    virtual bool writeCommand(const uint8_t *data, size_t length, bool withResponse) = 0;
+};
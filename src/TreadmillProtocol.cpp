@@ -0,0 +1,172 @@
+#include "TreadmillProtocol.h"
+
+void TreadmillProtocol::makePacket(CommandType type, uint16_t speed, uint8_t *outPacket)
+{
+    // type: "start", "pause", "stop", "set_speed"
+    // outPacket must be at least 23 bytes
+
+    // --- START / HEADER ---
+    outPacket[0] = FRAME_START_BYTE;
+    outPacket[1] = COMMAND_FRAME_LENGTH;
+
+    // Bytes 2-5 are reserved (0)
+    for (int i = 2; i <= 5; ++i)
+        outPacket[i] = 0;
+
+    // --- Speed ---
+    outPacket[6] = (speed >> 8) & 0xFF;
+    outPacket[7] = speed & 0xFF;
+
+    // Magical byte: 5 for set_speed, 1 for others
+    outPacket[8] = (speed != 0) ? 5 : 1;
+
+    outPacket[9] = 0;   // incline
+    outPacket[10] = 80; // weight default
+    outPacket[11] = 0;  // reserved
+
+    // Command byte
+    uint8_t cmd = type; // default start/set_speed
+
+    outPacket[12] = cmd & 0xF7; // kph mode (bit 3 = 0)
+
+    // User ID 8 bytes (default 58965456623)
+    uint64_t userId = 58965456623ULL;
+    for (int i = 0; i < 8; ++i)
+    {
+        outPacket[13 + i] = (userId >> (56 - i * 8)) & 0xFF;
+    }
+
+    // --- Checksum ---
+    uint8_t checksum = 0;
+    for (int i = 1; i <= 20; ++i)
+    {
+        checksum ^= outPacket[i];
+    }
+    outPacket[21] = checksum;
+
+    outPacket[22] = FRAME_END_BYTE;
+}
+
+bool TreadmillProtocol::parseStatus(const uint8_t *pData, size_t length, TreadMillData &data)
+{
+    if (length < STATUS_FRAME_LENGTH)
+    {
+        return false;
+    }
+
+    // Parse treadmill fields
+    uint16_t current_speed = readU16(pData, 3);
+    uint16_t target_speed = readU16(pData, 5);
+
+    uint32_t distance = readU32(pData, 7);
+
+    // TODO: validate version
+    uint8_t fw_version = pData[25];
+
+    uint16_t calories = readU16(pData, 18);
+    uint32_t steps = readU32(pData, 14);
+    uint32_t duration = readU32(pData, 20);
+    uint8_t flags = pData[26];
+
+    uint16_t maxRunSpeed = readU16(pData, 27);
+
+    uint8_t running_state_bits = flags & 24;
+
+    TreadMillData::Status running_state = TreadMillData::STOPPED; // Default stopped
+    if (running_state_bits == 24)
+        running_state = TreadMillData::COUNTDOWN;
+    else if (running_state_bits == 8)
+        running_state = TreadMillData::RUNNING;
+    else if (running_state_bits == 16)
+        running_state = TreadMillData::PAUSED;
+
+    data.speedCmdMilli = target_speed;
+    data.speedFeedbackMilli = current_speed;
+    data.distanceMilli = distance;
+    data.calories = calories;
+    data.steps = steps;
+    data.durationMs = duration;
+    data.status = running_state;
+    data.fwVersion = fw_version;
+    data.speedMaxMilli = maxRunSpeed;
+    return true;
+}
+
+void TreadmillProtocol::makeStatus(const TreadMillData &data, uint8_t *outFrame)
+{
+    memset(outFrame, 0, STATUS_FRAME_LENGTH);
+    outFrame[0] = FRAME_START_BYTE;
+    outFrame[1] = STATUS_FRAME_LENGTH;
+    writeU16(outFrame, 3, data.speedFeedbackMilli);
+    writeU16(outFrame, 5, data.speedCmdMilli);
+    writeU32(outFrame, 7, data.distanceMilli);
+    writeU32(outFrame, 14, data.steps);
+    writeU16(outFrame, 18, data.calories);
+    writeU32(outFrame, 20, data.durationMs);
+    outFrame[25] = data.fwVersion;
+
+    uint8_t flags = 0;
+    if (data.status == TreadMillData::COUNTDOWN)
+        flags = 24;
+    else if (data.status == TreadMillData::RUNNING)
+        flags = 8;
+    else if (data.status == TreadMillData::PAUSED)
+        flags = 16;
+    outFrame[26] = flags;
+    writeU16(outFrame, 27, data.speedMaxMilli);
+
+    uint8_t checksum = 0;
+    for (int i = 1; i < STATUS_FRAME_LENGTH - 2; ++i)
+    {
+        checksum ^= outFrame[i];
+    }
+    outFrame[STATUS_FRAME_LENGTH - 2] = checksum;
+    outFrame[STATUS_FRAME_LENGTH - 1] = FRAME_END_BYTE;
+}
+
+bool TreadmillProtocol::parseCommand(const uint8_t *pData, size_t length, CommandType &type, uint16_t &speed)
+{
+    if (length < COMMAND_FRAME_LENGTH || pData[0] != FRAME_START_BYTE || pData[COMMAND_FRAME_LENGTH - 1] != FRAME_END_BYTE)
+    {
+        return false;
+    }
+    uint8_t checksum = 0;
+    for (int i = 1; i < COMMAND_FRAME_LENGTH - 2; ++i)
+    {
+        checksum ^= pData[i];
+    }
+    if (checksum != pData[COMMAND_FRAME_LENGTH - 2])
+    {
+        return false;
+    }
+    type = (CommandType)(pData[12] & 0xF7);
+    speed = readU16(pData, 6);
+    return true;
+}
+
+bool StatusFrameDecoder::isValidFrame(const uint8_t *frame)
+{
+    if (frame[0] != FRAME_START_BYTE || frame[STATUS_FRAME_LENGTH - 1] != FRAME_END_BYTE)
+    {
+        return false;
+    }
+    uint8_t checksum = 0;
+    for (int i = 1; i < STATUS_FRAME_LENGTH - 2; ++i)
+    {
+        checksum ^= frame[i];
+    }
+    return checksum == frame[STATUS_FRAME_LENGTH - 2];
+}
+
+void StatusFrameDecoder::dropPartialUntilNextStart()
+{
+    // the buffered bytes after the bogus start byte may still contain the start of a real frame
+    size_t start = 1;
+    while (start < m_partialLength && m_partial[start] != FRAME_START_BYTE)
+    {
+        start++;
+    }
+    m_stats.resyncs++;
+    m_partialLength -= start;
+    memmove(m_partial, m_partial + start, m_partialLength);
+}
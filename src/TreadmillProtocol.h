@@ -0,0 +1,171 @@
+#pragma once
+#include <Arduino.h>
+
+#include "platform.h"
+
+// Outbound command frames written to CHARACTERISTIC_WRITE_UUID
+#define COMMAND_FRAME_LENGTH 23
+// Inbound status frames notified on CHARACTERISTIC_NOTIFY_STATE_UUID
+#define STATUS_FRAME_LENGTH 31
+
+#define FRAME_START_BYTE 0x6A
+#define FRAME_END_BYTE 0x43
+
+// Encoder/decoder for the pad protocol, kept free of any BLE dependency so it
+// can be built and benchmarked on the host (see env:native).
+class TreadmillProtocol
+{
+public:
+    enum CommandType
+    {
+        CMD_START_SET_SPEED = 4,
+        CMD_PAUSE = 2,
+        CMD_STOP = 0
+    };
+
+    // Generates a 23-byte command packet, outPacket must be at least COMMAND_FRAME_LENGTH bytes
+    static void makePacket(CommandType type, uint16_t speed, uint8_t *outPacket);
+
+    // Decodes a status notification into data, returns false if the frame is too short
+    static bool parseStatus(const uint8_t *pData, size_t length, TreadMillData &data);
+
+    // Treadmill side of the protocol, used by the simulator's virtual treadmill
+
+    // Generates a 31-byte status frame, outFrame must be at least STATUS_FRAME_LENGTH bytes
+    static void makeStatus(const TreadMillData &data, uint8_t *outFrame);
+
+    // Decodes a command packet, returns false if it is malformed or the checksum does not match
+    static bool parseCommand(const uint8_t *pData, size_t length, CommandType &type, uint16_t &speed);
+
+    static uint16_t readU16(const uint8_t *data, int offset)
+    {
+        return ((uint16_t)data[offset] << 8) | data[offset + 1];
+    }
+
+    static uint32_t readU32(const uint8_t *data, int offset)
+    {
+        return ((uint32_t)data[offset] << 24) |
+               ((uint32_t)data[offset + 1] << 16) |
+               ((uint32_t)data[offset + 2] << 8) |
+               ((uint32_t)data[offset + 3]);
+    }
+
+    static void writeU16(uint8_t *data, int offset, uint16_t value)
+    {
+        data[offset] = value >> 8;
+        data[offset + 1] = value & 0xFF;
+    }
+
+    static void writeU32(uint8_t *data, int offset, uint32_t value)
+    {
+        data[offset] = value >> 24;
+        data[offset + 1] = (value >> 16) & 0xFF;
+        data[offset + 2] = (value >> 8) & 0xFF;
+        data[offset + 3] = value & 0xFF;
+    }
+};
+
+struct FrameDecoderStats
+{
+    uint32_t frames = 0;           // valid frames emitted
+    uint32_t checksumFailures = 0; // candidate frames with a bad checksum or end byte
+    uint32_t resyncs = 0;          // times bytes had to be skipped to find a start byte
+    uint32_t partialFrames = 0;    // frames assembled from more than one notification
+};
+
+// Incremental decoder for the status notifications. Frames may arrive split
+// over several notifications or several frames in one notification. Complete
+// frames inside a notification are handed out in place without copying, only
+// the fragment at the end of a notification is buffered. Inbound frames mirror
+// the command layout: start byte, ..., XOR checksum over bytes 1..n-3, end byte.
+class StatusFrameDecoder
+{
+public:
+    // Calls onFrame(const uint8_t *frame) for every valid STATUS_FRAME_LENGTH byte frame
+    template <typename F>
+    void feed(const uint8_t *data, size_t length, F &&onFrame)
+    {
+        size_t pos = 0;
+        while (true)
+        {
+            if (m_partialLength > 0)
+            {
+                size_t needed = STATUS_FRAME_LENGTH - m_partialLength;
+                size_t take = length - pos < needed ? length - pos : needed;
+                memcpy(m_partial + m_partialLength, data + pos, take);
+                m_partialLength += take;
+                pos += take;
+                if (m_partialLength < STATUS_FRAME_LENGTH)
+                {
+                    return;
+                }
+                if (isValidFrame(m_partial))
+                {
+                    m_stats.frames++;
+                    m_stats.partialFrames++;
+                    onFrame(m_partial);
+                    m_partialLength = 0;
+                }
+                else
+                {
+                    m_stats.checksumFailures++;
+                    dropPartialUntilNextStart();
+                }
+                continue;
+            }
+
+            size_t start = pos;
+            while (start < length && data[start] != FRAME_START_BYTE)
+            {
+                start++;
+            }
+            if (start != pos)
+            {
+                m_stats.resyncs++;
+            }
+            pos = start;
+            if (pos >= length)
+            {
+                return;
+            }
+            if (length - pos < STATUS_FRAME_LENGTH)
+            {
+                // keep the fragment for the next notification
+                memcpy(m_partial, data + pos, length - pos);
+                m_partialLength = length - pos;
+                return;
+            }
+            if (isValidFrame(data + pos))
+            {
+                m_stats.frames++;
+                onFrame(data + pos);
+                pos += STATUS_FRAME_LENGTH;
+            }
+            else
+            {
+                m_stats.checksumFailures++;
+                pos++;
+            }
+        }
+    }
+
+    // Drops buffered fragments, e.g. after a reconnect
+    void reset()
+    {
+        m_partialLength = 0;
+    }
+
+    const FrameDecoderStats &getStats() const
+    {
+        return m_stats;
+    }
+
+    static bool isValidFrame(const uint8_t *frame);
+
+private:
+    void dropPartialUntilNextStart();
+
+    uint8_t m_partial[STATUS_FRAME_LENGTH];
+    size_t m_partialLength = 0;
+    FrameDecoderStats m_stats;
+};
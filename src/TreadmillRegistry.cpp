@@ -0,0 +1,66 @@
+#include "TreadmillRegistry.h"
+
+bool TreadmillRegistry::add(TreadmillHandler *handler)
+{
+    if (m_count >= TREADMILL_MAX_DEVICES)
+    {
+        log_e("No room for treadmill %s", handler->getAddress().toString().c_str());
+        return false;
+    }
+    m_handlers[m_count++] = handler;
+    return true;
+}
+
+void TreadmillRegistry::begin()
+{
+    if (m_senderTask == nullptr)
+    {
+        xTaskCreate(senderTask, "tmsend", 4096, this, 2, &m_senderTask);
+    }
+    for (size_t i = 0; i < m_count; ++i)
+    {
+        m_handlers[i]->setSenderTask(m_senderTask);
+    }
+}
+
+void TreadmillRegistry::senderTask(void *arg)
+{
+    TreadmillRegistry *self = static_cast<TreadmillRegistry *>(arg);
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        bool sent;
+        do
+        {
+            sent = false;
+            for (size_t i = 0; i < self->m_count; ++i)
+            {
+                sent |= self->m_handlers[i]->sendNextCommand();
+            }
+        } while (sent);
+    }
+}
+
+void TreadmillRegistry::handle()
+{
+    bool connectAttempted = false;
+    for (size_t i = 0; i < m_count; ++i)
+    {
+        size_t index = (m_nextConnect + i) % m_count;
+        if (m_handlers[index]->handle(!connectAttempted))
+        {
+            connectAttempted = true;
+            m_nextConnect = (index + 1) % m_count;
+        }
+    }
+}
+
+uint32_t TreadmillRegistry::getMsUntilNextTimer() const
+{
+    uint32_t next = UINT32_MAX;
+    for (size_t i = 0; i < m_count; ++i)
+    {
+        next = min(next, m_handlers[i]->getMsUntilNextTimer());
+    }
+    return next;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <Arduino.h>
+
+#include "platform.h"
+#include "TreadmillHandler.h"
+
+// The treadmills served by the bridge. Connects are blocking and NimBLE only
+// runs one at a time, so handle() lets at most one treadmill connect per call
+// and hands that turn round-robin. One sender task writes the commands of all
+// treadmills, one command per treadmill and round, so a burst of setpoints for
+// one pad does not hold back the others.
+class TreadmillRegistry
+{
+public:
+    // Call before begin(), false if TREADMILL_MAX_DEVICES are registered
+    bool add(TreadmillHandler *handler);
+
+    // Starts the sender task, call after the handlers were begun
+    void begin();
+
+    size_t getCount() const
+    {
+        return m_count;
+    }
+
+    TreadmillHandler &get(size_t index)
+    {
+        return *m_handlers[index];
+    }
+
+    // Runs handle() of every treadmill from the main loop
+    void handle();
+
+    // Earliest getMsUntilNextTimer() of the treadmills
+    uint32_t getMsUntilNextTimer() const;
+
+private:
+    static void senderTask(void *arg);
+
+    TreadmillHandler *m_handlers[TREADMILL_MAX_DEVICES] = {};
+    size_t m_count = 0;
+    // first treadmill offered the connect turn in the next handle()
+    size_t m_nextConnect = 0;
+    TaskHandle_t m_senderTask = nullptr;
+};
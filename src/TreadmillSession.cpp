@@ -0,0 +1,125 @@
+#include "TreadmillSession.h"
+#include "DeferredLog.h"
+
+void TreadmillSession::onNotification(const uint8_t *pData, size_t length)
+{
+    dlog_d("Notification received, length: %d", (int)length);
+    uint32_t receivedUs = micros();
+
+    // notifications may carry partial or several frames, the decoder reassembles them
+    bool queued = false;
+    m_frameDecoder.feed(pData, length, [this, &queued, receivedUs](const uint8_t *frame)
+                        {
+        TreadMillData data;
+        TreadmillProtocol::parseStatus(frame, STATUS_FRAME_LENGTH, data);
+        data.receivedUs = receivedUs;
+        m_parseLatency.record(micros() - receivedUs);
+        // runs in the transport task, publishing is left to handle() in the main loop
+        queued |= m_dataQueue.push(data); });
+
+    if (queued && m_onWakeup)
+    {
+        m_onWakeup();
+    }
+}
+
+bool TreadmillSession::queueCommand(TreadmillProtocol::CommandType type, uint16_t speed, unsigned long requestUs)
+{
+    if (m_commandQueue.push(type, speed, requestUs ? requestUs : micros()) == CommandQueue::FULL)
+    {
+        dlog_e("Command queue full, dropping command %d", type);
+        return false;
+    }
+    return true;
+}
+
+void TreadmillSession::sendQueuedCommands(TreadmillLink &link)
+{
+    while (sendNextCommand(link))
+    {
+    }
+}
+
+bool TreadmillSession::sendNextCommand(TreadmillLink &link)
+{
+    TreadmillCommand command;
+    if (!m_commandQueue.pop(command))
+    {
+        return false;
+    }
+    uint8_t packet[COMMAND_FRAME_LENGTH];
+    DefaultCommandFrames::make(command.type, command.speed, packet);
+    bool success = link.writeCommand(packet, sizeof(packet), m_writeWithResponse);
+
+    CommandKind kind = KIND_STOP;
+    if (command.isSpeedSetpoint())
+        kind = KIND_SPEED;
+    else if (command.type == TreadmillProtocol::CMD_START_SET_SPEED)
+        kind = KIND_START;
+    else if (command.type == TreadmillProtocol::CMD_PAUSE)
+        kind = KIND_PAUSE;
+
+    CommandLatency &latency = m_commandLatency[kind];
+    if (!success)
+    {
+        latency.failed++;
+        return true;
+    }
+    uint32_t latencyUs = micros() - command.enqueuedUs;
+    latency.count++;
+    latency.lastUs = latencyUs;
+    latency.totalUs += latencyUs;
+    m_commandLatencyHistogram.record(latencyUs);
+    if (latencyUs > latency.maxUs)
+    {
+        latency.maxUs = latencyUs;
+    }
+    dlog_d("Command %d acknowledged after %u us", command.type, latencyUs);
+    return true;
+}
+
+void TreadmillSession::handle()
+{
+    // drain frames queued by the notification callback
+    TreadMillData data;
+    while (m_dataQueue.pop(data))
+    {
+        m_lastData = data;
+        m_lastDataTimestamp = millis();
+        if (m_onDataUpdate)
+        {
+            m_onDataUpdate(data);
+        }
+    }
+
+    uint32_t overflows = m_dataQueue.getOverflows();
+    if (overflows != m_reportedOverflows)
+    {
+        log_w("Dropped %u treadmill frames, queue high water: %u", overflows - m_reportedOverflows, (unsigned)m_dataQueue.getHighWater());
+        m_reportedOverflows = overflows;
+    }
+
+    // Check for connection timeout and send state updates if needed
+    if (millis() - m_lastDataTimestamp > CONNECTION_TIMEOUT * 1000)
+    {
+        log_w("No data received from treadmill for %d seconds, marking as disconnected.", CONNECTION_TIMEOUT);
+        m_lastData.status = TreadMillData::DISCONNECTED;
+        m_lastData.receivedUs = micros();
+        m_lastDataTimestamp = millis(); // prevent repeated updates
+        if (m_onDataUpdate)
+        {
+            m_onDataUpdate(m_lastData);
+        }
+    }
+}
+
+uint32_t TreadmillSession::getMsUntilNextTimer() const
+{
+    if (!m_dataQueue.empty())
+    {
+        return 0;
+    }
+    unsigned long sinceData = millis() - m_lastDataTimestamp;
+    uint32_t timeoutMs = CONNECTION_TIMEOUT * 1000;
+    return sinceData > timeoutMs ? 0 : timeoutMs - sinceData + 1;
+}
@@ -0,0 +1,162 @@
+#pragma once
+#include <Arduino.h>
+
+#include "platform.h"
+#include "TreadmillProtocol.h"
+#include "TreadmillLink.h"
+#include "CommandFrames.h"
+#include "SpscRing.h"
+#include "CommandQueue.h"
+#include "LatencyHistogram.h"
+
+// enqueue-to-ack latency of one kind of command
+struct CommandLatency
+{
+    uint32_t count = 0;
+    uint32_t failed = 0;
+    uint32_t lastUs = 0;
+    uint32_t maxUs = 0;
+    uint64_t totalUs = 0;
+
+    uint32_t getAverageUs() const
+    {
+        return count ? totalUs / count : 0;
+    }
+};
+
+// Transport independent part of the treadmill connection: frame reassembly and
+// parsing, the hand-over of parsed frames to the main loop, the command queue
+// and the data timeout. Runs unchanged on the device and in the simulator.
+//
+// Threading: onNotification() is called from the transport task (NimBLE host),
+// sendQueuedCommands() and sendNextCommand() from the sender task, everything else from the main loop.
+class TreadmillSession
+{
+public:
+    enum CommandKind
+    {
+        KIND_SPEED = 0,
+        KIND_START,
+        KIND_PAUSE,
+        KIND_STOP,
+        KIND_COUNT
+    };
+
+    // Feeds raw notification bytes, frames may be split or batched
+    void onNotification(const uint8_t *data, size_t length);
+
+    // Drops buffered fragments, call when a new connection is set up
+    void resetDecoder()
+    {
+        m_frameDecoder.reset();
+    }
+
+    // Queues a command, returns false if the queue is full. requestUs is the
+    // micros() timestamp the request arrived at, 0 for now.
+    bool queueCommand(TreadmillProtocol::CommandType type, uint16_t speed, unsigned long requestUs);
+
+    // Writes all queued commands to the link and records their latency
+    void sendQueuedCommands(TreadmillLink &link);
+
+    // Writes the oldest queued command, false if there was none. Lets a sender
+    // shared by several treadmills take turns.
+    bool sendNextCommand(TreadmillLink &link);
+
+    // Use write-without-response if the link supports it
+    void setWriteWithResponse(const bool enable)
+    {
+        m_writeWithResponse = enable;
+    }
+
+    // Hands queued frames to the data callback and checks the data timeout
+    void handle();
+
+    // Time until handle() has to run again for queued frames or the data timeout
+    uint32_t getMsUntilNextTimer() const;
+
+    TreadMillData getLastData() const
+    {
+        return m_lastData;
+    }
+
+    // The callback is invoked from handle(), i.e. in the context of the main loop
+    void setCallback(std::function<void(const TreadMillData &)> callback)
+    {
+        m_onDataUpdate = callback;
+    }
+
+    // Invoked from the transport task whenever a frame was queued
+    void setWakeupCallback(std::function<void()> callback)
+    {
+        m_onWakeup = callback;
+    }
+
+    const CommandLatency &getCommandLatency(CommandKind kind) const
+    {
+        return m_commandLatency[kind];
+    }
+
+    void resetCommandLatency()
+    {
+        for (CommandLatency &latency : m_commandLatency)
+        {
+            latency = CommandLatency();
+        }
+        m_commandLatencyHistogram.reset();
+    }
+
+    const FrameDecoderStats &getFrameDecoderStats() const
+    {
+        return m_frameDecoder.getStats();
+    }
+
+    // notification arrival to parsed frame, recorded in the transport task
+    LatencyHistogram &getParseLatency()
+    {
+        return m_parseLatency;
+    }
+
+    // command request to treadmill ack, recorded in the sender task
+    LatencyHistogram &getCommandLatencyHistogram()
+    {
+        return m_commandLatencyHistogram;
+    }
+
+    const CommandQueue &getCommandQueue() const
+    {
+        return m_commandQueue;
+    }
+
+    // Frames dropped because the main loop did not drain the queue in time
+    uint32_t getQueueOverflows() const
+    {
+        return m_dataQueue.getOverflows();
+    }
+
+    size_t getQueueHighWater() const
+    {
+        return m_dataQueue.getHighWater();
+    }
+
+    static const uint8_t CONNECTION_TIMEOUT = 30;
+
+private:
+    long m_lastDataTimestamp = 0;
+    TreadMillData m_lastData;
+
+    CommandQueue m_commandQueue;
+    bool m_writeWithResponse = true;
+    CommandLatency m_commandLatency[KIND_COUNT];
+    LatencyHistogram m_commandLatencyHistogram;
+    LatencyHistogram m_parseLatency;
+
+    // only used from the transport task
+    StatusFrameDecoder m_frameDecoder;
+
+    // parsed frames handed over from the transport task to handle()
+    SpscRing<TreadMillData, 16> m_dataQueue;
+    uint32_t m_reportedOverflows = 0;
+
+    std::function<void(const TreadMillData &)> m_onDataUpdate = nullptr;
+    std::function<void()> m_onWakeup = nullptr;
+};
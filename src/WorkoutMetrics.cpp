@@ -0,0 +1,130 @@
+#include "WorkoutMetrics.h"
+
+WorkoutMetrics::WorkoutMetrics(uint32_t splitDistanceM)
+    : m_splitDistanceM(splitDistanceM > 0 ? splitDistanceM : 1000)
+{
+}
+
+void WorkoutMetrics::reset()
+{
+    m_snapshot = WorkoutMetricsSnapshot();
+    m_started = false;
+    m_distanceUm = 0;
+    m_checkpointCount = 0;
+    m_checkpointHead = 0;
+    m_splitTimed = false;
+}
+
+void WorkoutMetrics::addCheckpoint()
+{
+    m_checkpoints[m_checkpointHead] = {m_lastDurationMs, m_distanceUm, m_lastCalories};
+    m_checkpointHead = (m_checkpointHead + 1) % METRICS_CHECKPOINTS;
+    if (m_checkpointCount < METRICS_CHECKPOINTS)
+    {
+        m_checkpointCount++;
+    }
+}
+
+const WorkoutMetrics::Checkpoint &WorkoutMetrics::checkpointBefore(uint32_t windowMs) const
+{
+    // checkpoints are at least METRICS_CHECKPOINT_MS apart, so this is the
+    // window rounded up to the next checkpoint; the averages use the real span
+    size_t back = windowMs / METRICS_CHECKPOINT_MS;
+    if (back >= m_checkpointCount)
+    {
+        back = m_checkpointCount - 1;
+    }
+    return m_checkpoints[(m_checkpointHead + METRICS_CHECKPOINTS - 1 - back) % METRICS_CHECKPOINTS];
+}
+
+void WorkoutMetrics::updateSplits(const TreadMillData &data)
+{
+    while (data.distanceMilli >= m_nextSplitM)
+    {
+        // interpolate when the boundary was crossed between the two frames
+        uint32_t crossMs = data.durationMs;
+        if (data.distanceMilli > m_lastDistanceM && m_nextSplitM > m_lastDistanceM)
+        {
+            crossMs = m_lastDurationMs + (uint64_t)(m_nextSplitM - m_lastDistanceM) * (data.durationMs - m_lastDurationMs) /
+                                             (data.distanceMilli - m_lastDistanceM);
+        }
+        if (m_splitTimed)
+        {
+            uint32_t splitMs = crossMs - m_splitStartMs;
+            m_snapshot.splitCount++;
+            m_snapshot.lastSplitMs = splitMs;
+            if (m_snapshot.bestSplitMs == 0 || splitMs < m_snapshot.bestSplitMs)
+            {
+                m_snapshot.bestSplitMs = splitMs;
+            }
+        }
+        m_splitTimed = true;
+        m_splitStartMs = crossMs;
+        m_nextSplitM += m_splitDistanceM;
+    }
+}
+
+void WorkoutMetrics::onData(const TreadMillData &data)
+{
+    if (data.status == TreadMillData::DISCONNECTED)
+    {
+        return;
+    }
+    m_snapshot.paceSecPerKm = data.speedFeedbackMilli > 0 ? 3600000 / data.speedFeedbackMilli : 0;
+
+    if (!m_started || data.durationMs < m_lastDurationMs)
+    {
+        reset();
+        m_started = true;
+        m_lastDurationMs = data.durationMs;
+        m_lastDistanceM = data.distanceMilli;
+        m_lastSpeedMilli = data.speedFeedbackMilli;
+        m_lastCalories = data.calories;
+        m_splitStartMs = data.durationMs;
+        m_nextSplitM = (data.distanceMilli / m_splitDistanceM + 1) * m_splitDistanceM;
+        // a session joined midway only starts timing at the next boundary
+        m_splitTimed = data.distanceMilli == 0;
+        m_snapshot.windowSpeedMilli = data.speedFeedbackMilli;
+        addCheckpoint();
+        return;
+    }
+
+    uint32_t dtMs = data.durationMs - m_lastDurationMs;
+    if (dtMs == 0)
+    {
+        // the moving time did not advance, e.g. paused or a frame within the same tick
+        m_lastSpeedMilli = data.speedFeedbackMilli;
+        return;
+    }
+
+    // trapezoid of the belt speed, m/h * ms / 3.6 = µm
+    m_distanceUm += (uint64_t)(m_lastSpeedMilli + data.speedFeedbackMilli) * dtMs * 10 / 72;
+    updateSplits(data);
+    m_lastDurationMs = data.durationMs;
+    m_lastDistanceM = data.distanceMilli;
+    m_lastSpeedMilli = data.speedFeedbackMilli;
+    m_lastCalories = data.calories;
+
+    const Checkpoint &newest = m_checkpoints[(m_checkpointHead + METRICS_CHECKPOINTS - 1) % METRICS_CHECKPOINTS];
+    if (data.durationMs - newest.durationMs >= METRICS_CHECKPOINT_MS)
+    {
+        addCheckpoint();
+    }
+
+    const Checkpoint &speedFrom = checkpointBefore(METRICS_SPEED_WINDOW_MS);
+    uint32_t speedSpanMs = data.durationMs - speedFrom.durationMs;
+    if (speedSpanMs > 0)
+    {
+        // µm/ms * 3.6 = m/h
+        m_snapshot.windowSpeedMilli = (m_distanceUm - speedFrom.distanceUm) * 36 / ((uint64_t)speedSpanMs * 10);
+    }
+    m_snapshot.averageSpeedMilli = data.durationMs > 0 ? (uint64_t)data.distanceMilli * 3600000 / data.durationMs : 0;
+    m_snapshot.currentSplitMs = data.durationMs - m_splitStartMs;
+
+    const Checkpoint &caloriesFrom = checkpointBefore(METRICS_CALORIE_WINDOW_MS);
+    uint32_t calorieSpanMs = data.durationMs - caloriesFrom.durationMs;
+    if (calorieSpanMs >= METRICS_CALORIE_MIN_WINDOW_MS && data.calories >= caloriesFrom.calories)
+    {
+        m_snapshot.calorieRate = (uint64_t)(data.calories - caloriesFrom.calories) * 3600000 / calorieSpanMs;
+    }
+}
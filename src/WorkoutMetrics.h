@@ -0,0 +1,82 @@
+#pragma once
+#include <Arduino.h>
+
+#include "platform.h"
+
+// distance and calories are sampled every 5 s of moving time, 61 checkpoints cover 5 minutes
+#define METRICS_CHECKPOINT_MS 5000
+#define METRICS_CHECKPOINTS 61
+#define METRICS_SPEED_WINDOW_MS 60000
+// the treadmill counts whole kcal, the rate needs a longer window to settle
+#define METRICS_CALORIE_WINDOW_MS 300000
+#define METRICS_CALORIE_MIN_WINDOW_MS 30000
+
+struct WorkoutMetricsSnapshot
+{
+    uint32_t paceSecPerKm = 0;      // from the current belt speed, 0 while standing
+    uint32_t windowSpeedMilli = 0;  // km/h * 1000 over the last minute of moving time
+    uint32_t averageSpeedMilli = 0; // km/h * 1000 over the session
+    uint32_t splitCount = 0;        // completed splits
+    uint32_t lastSplitMs = 0;
+    uint32_t bestSplitMs = 0;
+    uint32_t currentSplitMs = 0; // moving time into the running split
+    uint32_t calorieRate = 0;    // kcal/h over the last 5 minutes
+};
+
+// Derives pace, averages, split times and the calorie rate from the status
+// frames with constant work per frame. Time is the moving time reported by the
+// treadmill (durationMs), so pauses neither dilute the averages nor count
+// towards a split. The window speed integrates the belt speed between frames,
+// which resolves far better than the whole metres of the distance counter.
+// A session starts when the duration counter goes backwards.
+class WorkoutMetrics
+{
+public:
+    explicit WorkoutMetrics(uint32_t splitDistanceM = 1000);
+
+    void onData(const TreadMillData &data);
+
+    void reset();
+
+    const WorkoutMetricsSnapshot &get() const
+    {
+        return m_snapshot;
+    }
+
+    uint32_t getSplitDistance() const
+    {
+        return m_splitDistanceM;
+    }
+
+private:
+    struct Checkpoint
+    {
+        uint32_t durationMs;
+        uint64_t distanceUm; // integrated belt speed
+        uint16_t calories;
+    };
+
+    void addCheckpoint();
+    // checkpoint about windowMs back, the oldest one early in a session
+    const Checkpoint &checkpointBefore(uint32_t windowMs) const;
+    void updateSplits(const TreadMillData &data);
+
+    uint32_t m_splitDistanceM;
+    WorkoutMetricsSnapshot m_snapshot;
+
+    bool m_started = false;
+    uint32_t m_lastDurationMs = 0;
+    uint32_t m_lastDistanceM = 0;
+    uint16_t m_lastSpeedMilli = 0;
+    uint16_t m_lastCalories = 0;
+    uint64_t m_distanceUm = 0;
+
+    Checkpoint m_checkpoints[METRICS_CHECKPOINTS];
+    size_t m_checkpointCount = 0;
+    size_t m_checkpointHead = 0; // next slot to write
+
+    uint32_t m_nextSplitM = 0;
+    uint32_t m_splitStartMs = 0;
+    // false while the first split of a session joined midway runs
+    bool m_splitTimed = false;
+};
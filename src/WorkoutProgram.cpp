@@ -0,0 +1,275 @@
+#include "WorkoutProgram.h"
+#include "CommandRouter.h"
+
+// splits "a:b[:c]" at the colons, trims through CommandPayload
+static size_t splitFields(const char *text, size_t length, CommandPayload *fields, size_t maxFields)
+{
+    size_t count = 0;
+    size_t start = 0;
+    for (size_t i = 0; i <= length; ++i)
+    {
+        if (i == length || text[i] == ':')
+        {
+            if (count == maxFields)
+            {
+                return maxFields + 1;
+            }
+            fields[count++] = CommandPayload((const uint8_t *)text + start, i - start);
+            start = i + 1;
+        }
+    }
+    return count;
+}
+
+bool WorkoutProgram::parse(const char *text, size_t length)
+{
+    m_count = 0;
+    size_t start = 0;
+    uint32_t totalMs = 0;
+    for (size_t i = 0; i <= length; ++i)
+    {
+        if (i < length && text[i] != ',')
+        {
+            continue;
+        }
+        CommandPayload fields[3] = {CommandPayload(nullptr, 0), CommandPayload(nullptr, 0), CommandPayload(nullptr, 0)};
+        size_t fieldCount = splitFields(text + start, i - start, fields, 3);
+        start = i + 1;
+
+        uint32_t speed, seconds, rampSeconds = 0;
+        if (m_count == WORKOUT_MAX_STEPS || fieldCount < 2 || fieldCount > 3 ||
+            !fields[0].parseMilli(speed) || !fields[1].parseUInt(seconds) ||
+            (fieldCount == 3 && !fields[2].parseUInt(rampSeconds)))
+        {
+            m_count = 0;
+            return false;
+        }
+        // speeds of 0.1 km/h and below stop the pad
+        if (speed <= 100 || speed > WORKOUT_MAX_SPEED_MILLI || seconds == 0 ||
+            seconds > WORKOUT_MAX_STEP_MS / 1000 || rampSeconds > seconds)
+        {
+            m_count = 0;
+            return false;
+        }
+
+        WorkoutStep &step = m_steps[m_count];
+        step.speedMilli = speed;
+        step.durationMs = seconds * 1000;
+        step.rampMs = m_count == 0 ? 0 : rampSeconds * 1000;
+        m_startMs[m_count] = totalMs;
+        totalMs += step.durationMs;
+        m_count++;
+    }
+    m_startMs[m_count] = totalMs;
+    return true;
+}
+
+size_t WorkoutProgram::stepAt(uint32_t elapsedMs) const
+{
+    for (size_t i = 0; i < m_count; ++i)
+    {
+        if (elapsedMs < m_startMs[i + 1])
+        {
+            return i;
+        }
+    }
+    return m_count;
+}
+
+uint16_t WorkoutProgram::speedAt(uint32_t elapsedMs) const
+{
+    size_t index = stepAt(elapsedMs);
+    if (index >= m_count)
+    {
+        return 0;
+    }
+    const WorkoutStep &step = m_steps[index];
+    uint32_t offsetMs = elapsedMs - m_startMs[index];
+    if (offsetMs >= step.rampMs)
+    {
+        return step.speedMilli;
+    }
+    int32_t from = m_steps[index - 1].speedMilli;
+    int32_t speed = from + (int32_t)(((int64_t)step.speedMilli - from) * offsetMs / step.rampMs);
+    return (speed + WORKOUT_SPEED_RESOLUTION_MILLI / 2) / WORKOUT_SPEED_RESOLUTION_MILLI * WORKOUT_SPEED_RESOLUTION_MILLI;
+}
+
+uint32_t WorkoutProgram::nextChangeMs(uint32_t elapsedMs) const
+{
+    size_t index = stepAt(elapsedMs);
+    if (index >= m_count)
+    {
+        return UINT32_MAX;
+    }
+    uint32_t startMs = m_startMs[index];
+    uint32_t rampEndMs = startMs + m_steps[index].rampMs;
+    if (elapsedMs < rampEndMs)
+    {
+        uint32_t tickMs = startMs + ((elapsedMs - startMs) / WORKOUT_RAMP_TICK_MS + 1) * WORKOUT_RAMP_TICK_MS;
+        return tickMs < rampEndMs ? tickMs : rampEndMs;
+    }
+    return m_startMs[index + 1];
+}
+
+bool WorkoutRunner::load(const char *text, size_t length)
+{
+    stop();
+    return m_program.parse(text, length);
+}
+
+bool WorkoutRunner::start()
+{
+    if (m_program.getStepCount() == 0)
+    {
+        return false;
+    }
+    m_step = 0;
+    m_targetSpeedMilli = 0;
+    m_nextChangeMs = 0;
+    m_elapsedAtResumeUs = 0;
+    m_lastDriftMs = 0;
+    setState(WorkoutStatus::WAITING);
+    return true;
+}
+
+void WorkoutRunner::stop()
+{
+    if (m_state != WorkoutStatus::IDLE)
+    {
+        setState(WorkoutStatus::IDLE);
+    }
+}
+
+void WorkoutRunner::setState(WorkoutStatus::State state)
+{
+    m_state = state;
+    m_version++;
+}
+
+uint64_t WorkoutRunner::elapsedUs(uint64_t nowUs) const
+{
+    if (m_state != WorkoutStatus::RUNNING)
+    {
+        return m_elapsedAtResumeUs;
+    }
+    return m_elapsedAtResumeUs + (nowUs - m_resumeUs);
+}
+
+bool WorkoutRunner::onData(const TreadMillData &data, uint64_t nowUs)
+{
+    if (data.durationMs != m_padDurationMs)
+    {
+        m_padDurationMs = data.durationMs;
+        m_padChangeUs = nowUs;
+    }
+
+    switch (m_state)
+    {
+    case WorkoutStatus::WAITING:
+        if (data.status != TreadMillData::RUNNING)
+        {
+            return false;
+        }
+        m_padStartMs = data.durationMs;
+        m_padChangeUs = nowUs;
+        m_resumeUs = nowUs;
+        setState(WorkoutStatus::RUNNING);
+        return true;
+    case WorkoutStatus::RUNNING:
+        if (data.status == TreadMillData::PAUSED)
+        {
+            m_elapsedAtResumeUs = elapsedUs(nowUs);
+            setState(WorkoutStatus::PAUSED);
+            return true;
+        }
+        break;
+    case WorkoutStatus::PAUSED:
+        if (data.status == TreadMillData::RUNNING)
+        {
+            m_resumeUs = nowUs;
+            setState(WorkoutStatus::RUNNING);
+            return true;
+        }
+        break;
+    default:
+        return false;
+    }
+    // stopped on the pad or the connection is gone
+    if (data.status == TreadMillData::STOPPED || data.status == TreadMillData::DISCONNECTED)
+    {
+        m_elapsedAtResumeUs = elapsedUs(nowUs);
+        setState(WorkoutStatus::IDLE);
+        return true;
+    }
+    return false;
+}
+
+uint64_t WorkoutRunner::getDeadlineUs() const
+{
+    if (m_state != WorkoutStatus::RUNNING || m_nextChangeMs == UINT32_MAX)
+    {
+        return UINT64_MAX;
+    }
+    uint64_t deadlineUs = (uint64_t)m_nextChangeMs * 1000;
+    return m_resumeUs + (deadlineUs > m_elapsedAtResumeUs ? deadlineUs - m_elapsedAtResumeUs : 0);
+}
+
+bool WorkoutRunner::onDeadline(uint64_t nowUs, uint16_t &speedMilli)
+{
+    if (m_state != WorkoutStatus::RUNNING)
+    {
+        return false;
+    }
+    uint64_t scheduledUs = (uint64_t)m_nextChangeMs * 1000;
+    uint64_t currentUs = elapsedUs(nowUs);
+    if (currentUs < scheduledUs)
+    {
+        // woken early, the caller arms the timer again
+        return false;
+    }
+
+    // the program is evaluated at the scheduled time, lateness goes to the stats
+    uint32_t programMs = m_nextChangeMs;
+    size_t step = m_program.stepAt(programMs);
+    if (step != m_step || programMs == 0)
+    {
+        uint64_t lateUs = currentUs - scheduledUs;
+        m_timerJitter.record(lateUs > UINT32_MAX ? UINT32_MAX : lateUs);
+        int64_t padMs = (int64_t)m_padDurationMs - m_padStartMs + (int64_t)(nowUs - m_padChangeUs) / 1000;
+        m_lastDriftMs = padMs - programMs;
+        m_drift.record((m_lastDriftMs < 0 ? -m_lastDriftMs : m_lastDriftMs) * 1000);
+        m_step = step;
+        m_version++;
+    }
+
+    m_nextChangeMs = m_program.nextChangeMs(programMs);
+    if (step >= m_program.getStepCount())
+    {
+        m_elapsedAtResumeUs = scheduledUs;
+        setState(WorkoutStatus::FINISHED);
+        speedMilli = 0;
+        return true;
+    }
+    uint16_t target = m_program.speedAt(programMs);
+    if (target == m_targetSpeedMilli)
+    {
+        return false;
+    }
+    m_targetSpeedMilli = target;
+    speedMilli = target;
+    return true;
+}
+
+WorkoutStatus WorkoutRunner::getStatus(uint64_t nowUs) const
+{
+    WorkoutStatus status;
+    status.state = m_state;
+    status.step = m_step;
+    status.stepCount = m_program.getStepCount();
+    status.elapsedMs = elapsedUs(nowUs) / 1000;
+    status.totalMs = m_program.getTotalMs();
+    status.targetSpeedMilli = m_state == WorkoutStatus::IDLE ? 0 : m_targetSpeedMilli;
+    status.lastDriftMs = m_lastDriftMs;
+    status.version = m_version;
+    return status;
+}
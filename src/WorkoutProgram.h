@@ -0,0 +1,166 @@
+#pragma once
+#include <Arduino.h>
+
+#include "platform.h"
+#include "LatencyHistogram.h"
+
+#define WORKOUT_MAX_STEPS 32
+#define WORKOUT_MAX_SPEED_MILLI 6000
+#define WORKOUT_MAX_STEP_MS (4UL * 3600 * 1000)
+// ramps move in steps of the pad's speed resolution, at most once per tick
+#define WORKOUT_SPEED_RESOLUTION_MILLI 100
+#define WORKOUT_RAMP_TICK_MS 1000
+
+struct WorkoutStep
+{
+    uint16_t speedMilli; // km/h * 1000
+    uint32_t durationMs;
+    uint32_t rampMs; // linear ramp from the previous speed at the start of the step
+};
+
+// A program uploaded as "<km/h>:<seconds>[:<ramp seconds>]" steps separated by
+// commas, e.g. "3:300, 5.5:120:30, 3:300". The first step has no ramp, the pad
+// starts at its own pace. Time is program time in ms, 0 at the start of the
+// first step.
+class WorkoutProgram
+{
+public:
+    // Replaces the program, an invalid text leaves it empty
+    bool parse(const char *text, size_t length);
+
+    void clear()
+    {
+        m_count = 0;
+    }
+
+    size_t getStepCount() const
+    {
+        return m_count;
+    }
+
+    const WorkoutStep &getStep(size_t index) const
+    {
+        return m_steps[index];
+    }
+
+    uint32_t getStartMs(size_t index) const
+    {
+        return m_startMs[index];
+    }
+
+    uint32_t getTotalMs() const
+    {
+        return m_count > 0 ? m_startMs[m_count] : 0;
+    }
+
+    // Step running at elapsedMs, getStepCount() once the program is over
+    size_t stepAt(uint32_t elapsedMs) const;
+
+    // Setpoint at elapsedMs, ramps are rounded to the speed resolution; 0 once the program is over
+    uint16_t speedAt(uint32_t elapsedMs) const;
+
+    // Next time after elapsedMs the setpoint may change, UINT32_MAX once the program is over
+    uint32_t nextChangeMs(uint32_t elapsedMs) const;
+
+private:
+    WorkoutStep m_steps[WORKOUT_MAX_STEPS];
+    uint32_t m_startMs[WORKOUT_MAX_STEPS + 1] = {};
+    size_t m_count = 0;
+};
+
+struct WorkoutStatus
+{
+    enum State
+    {
+        IDLE,     // no program or stopped
+        WAITING,  // started, the pad is not running yet
+        RUNNING,
+        PAUSED,   // the pad was paused, program time stands still
+        FINISHED,
+    };
+
+    State state = IDLE;
+    size_t step = 0;
+    size_t stepCount = 0;
+    uint32_t elapsedMs = 0;
+    uint32_t totalMs = 0;
+    uint16_t targetSpeedMilli = 0;
+    int32_t lastDriftMs = 0; // pad moving time minus program time at the last step start
+    uint32_t version = 0;    // changes with the state and the step
+};
+
+// Runs a WorkoutProgram against a µs clock. Program time starts with the first
+// frame that reports the pad running and stands still while it is paused, the
+// same way the moving time (durationMs) of the pad does. At every step start
+// the lateness of the deadline and the drift against the moving time of the
+// pad are recorded. Not thread safe, WorkoutScheduler serializes the timer and
+// the frames.
+class WorkoutRunner
+{
+public:
+    // Replaces the program and stops a running one
+    bool load(const char *text, size_t length);
+
+    // Waits for the pad to run, false without a program
+    bool start();
+
+    void stop();
+
+    // Follows the pad state. Returns true if the deadline changed.
+    bool onData(const TreadMillData &data, uint64_t nowUs);
+
+    // Time of the next setpoint change on the nowUs clock, UINT64_MAX if none
+    uint64_t getDeadlineUs() const;
+
+    // Call at the deadline. Returns true with the setpoint to send, 0 when the
+    // program is over and the pad should stop.
+    bool onDeadline(uint64_t nowUs, uint16_t &speedMilli);
+
+    WorkoutStatus getStatus(uint64_t nowUs) const;
+
+    const WorkoutProgram &getProgram() const
+    {
+        return m_program;
+    }
+
+    // how late the setpoint of a step start went out, µs
+    const LatencyHistogram &getTimerJitter() const
+    {
+        return m_timerJitter;
+    }
+
+    // absolute drift against the moving time of the pad at step starts, µs
+    const LatencyHistogram &getDrift() const
+    {
+        return m_drift;
+    }
+
+    void resetStats()
+    {
+        m_timerJitter.reset();
+        m_drift.reset();
+    }
+
+private:
+    uint64_t elapsedUs(uint64_t nowUs) const;
+    void setState(WorkoutStatus::State state);
+
+    WorkoutProgram m_program;
+    WorkoutStatus::State m_state = WorkoutStatus::IDLE;
+    size_t m_step = 0;
+    uint16_t m_targetSpeedMilli = 0;
+    uint32_t m_nextChangeMs = 0;
+    uint32_t m_version = 0;
+
+    uint64_t m_resumeUs = 0;        // clock when program time last started moving
+    uint64_t m_elapsedAtResumeUs = 0;
+
+    // moving time of the pad, extrapolated from the last change of the counter
+    uint32_t m_padStartMs = 0;
+    uint32_t m_padDurationMs = 0;
+    uint64_t m_padChangeUs = 0;
+    int32_t m_lastDriftMs = 0;
+
+    LatencyHistogram m_timerJitter;
+    LatencyHistogram m_drift;
+};
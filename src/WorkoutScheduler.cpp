@@ -0,0 +1,90 @@
+#include "WorkoutScheduler.h"
+
+void WorkoutScheduler::begin(SetpointHandler handler)
+{
+    m_handler = handler;
+    esp_timer_create_args_t args = {};
+    args.callback = onTimer;
+    args.arg = this;
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.name = "workout";
+    if (esp_timer_create(&args, &m_timer) != ESP_OK)
+    {
+        log_e("Failed to create the workout timer");
+    }
+}
+
+bool WorkoutScheduler::load(const char *text, size_t length)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    bool loaded = m_runner.load(text, length);
+    arm();
+    return loaded;
+}
+
+bool WorkoutScheduler::start()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_runner.start();
+}
+
+void WorkoutScheduler::stop()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_runner.stop();
+    arm();
+}
+
+void WorkoutScheduler::onData(const TreadMillData &data)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_runner.onData(data, esp_timer_get_time()))
+    {
+        arm();
+    }
+}
+
+WorkoutStatus WorkoutScheduler::getStatus()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_runner.getStatus(esp_timer_get_time());
+}
+
+void WorkoutScheduler::resetStats()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_runner.resetStats();
+}
+
+void WorkoutScheduler::arm()
+{
+    if (m_timer == nullptr)
+    {
+        return;
+    }
+    esp_timer_stop(m_timer);
+    uint64_t deadlineUs = m_runner.getDeadlineUs();
+    if (deadlineUs == UINT64_MAX)
+    {
+        return;
+    }
+    int64_t delayUs = (int64_t)deadlineUs - esp_timer_get_time();
+    esp_timer_start_once(m_timer, delayUs > 0 ? delayUs : 0);
+}
+
+void WorkoutScheduler::onTimer(void *arg)
+{
+    WorkoutScheduler *scheduler = (WorkoutScheduler *)arg;
+    uint16_t speed = 0;
+    bool send;
+    {
+        std::lock_guard<std::mutex> lock(scheduler->m_mutex);
+        send = scheduler->m_runner.onDeadline(esp_timer_get_time(), speed);
+        scheduler->arm();
+    }
+    // outside the lock, the handler queues a BLE command
+    if (send && scheduler->m_handler)
+    {
+        scheduler->m_handler(speed);
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <mutex>
+
+#include "WorkoutProgram.h"
+
+// Drives a WorkoutRunner from a one-shot esp_timer armed for the next setpoint
+// change. The timer task runs at a higher priority than the main loop, so
+// setpoints go out on time no matter how busy MQTT or WiFi are.
+class WorkoutScheduler
+{
+public:
+    // Called from the timer task with the new setpoint, 0 ends the program
+    typedef void (*SetpointHandler)(uint16_t speedMilli);
+
+    void begin(SetpointHandler handler);
+
+    bool load(const char *text, size_t length);
+    bool start();
+    void stop();
+
+    // Feed every frame, pauses and resumes the program with the pad
+    void onData(const TreadMillData &data);
+
+    WorkoutStatus getStatus();
+
+    // Read without the lock, the histograms tolerate a concurrent writer
+    const LatencyHistogram &getTimerJitter() const
+    {
+        return m_runner.getTimerJitter();
+    }
+
+    const LatencyHistogram &getDrift() const
+    {
+        return m_runner.getDrift();
+    }
+
+    void resetStats();
+
+private:
+    static void onTimer(void *arg);
+    // re-arms the timer for the runner's deadline, call with the lock held
+    void arm();
+
+    std::mutex m_mutex;
+    WorkoutRunner m_runner;
+    esp_timer_handle_t m_timer = nullptr;
+    SetpointHandler m_handler = nullptr;
+};
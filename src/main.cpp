@@ -10,6 +10,7 @@
 #include <ArduinoJson.h>
 #include <PubSubClient.h>
 #include <MqttDevice.h>
+#include <Preferences.h>
 
 // #include <WiFiUdp.h>
 #include <ArduinoOTA.h>
@@ -17,14 +18,68 @@
 #include "config.h"
 #include "platform.h"
 #include "TreadmillHandler.h"
+#include "TreadmillRegistry.h"
 #include "mqttview.h"
+#include "PubSubTransport.h"
+#include "PublishPolicy.h"
+#include "LoopEvents.h"
+#include "LoopProfiler.h"
+#include "ResourceMonitor.h"
+#include "SessionStore.h"
+#include "MqttOutbox.h"
+#include "LittleFsOutboxSpill.h"
+#include "TelemetryBatcher.h"
+#include "WorkoutMetrics.h"
+#include "WorkoutScheduler.h"
+#include "CommandRouter.h"
+#include "RoundTripProbe.h"
+#include "DeferredLog.h"
+#include "LogSinks.h"
+#include "MqttLogSink.h"
 
 const uint WATCHDOG_TIMEOUT_S = 300;
 const uint WIFI_DISCONNECT_FORCED_RESTART_S = 60;
+// upper bound for sleeping in loop(), keeps OTA and mqtt keep-alive serviced
+const uint32_t LOOP_MAX_SLEEP_MS = 1000;
+const uint32_t DISCOVERY_MAX_JITTER_MS = 2000;
+const uint32_t DIAGNOSTICS_PUBLISH_INTERVAL_MS = 60000;
+// a failing connect blocks for the socket timeout, keep the treadmill side serviced in between
+const uint32_t MQTT_RECONNECT_INTERVAL_MS = 5000;
+
+// announce all entities in a single device-level discovery message
+#ifndef HA_DEVICE_DISCOVERY
+#define HA_DEVICE_DISCOVERY false
+#endif
+
+// state encodings, the Home Assistant entities read the JSON state
+#ifndef STATE_FORMAT_JSON
+#define STATE_FORMAT_JSON true
+#endif
+// MessagePack state with integer keys on <client id>/state/msgpack
+#ifndef STATE_FORMAT_MSGPACK
+#define STATE_FORMAT_MSGPACK false
+#endif
+
+// further treadmills served by this bridge, "AA:BB:CC:11:22:33,..."
+#ifndef EXTRA_TARGET_ADDRESSES
+#define EXTRA_TARGET_ADDRESSES ""
+#endif
+
+// acknowledged command writes, false uses write-without-response where the
+// treadmill supports it
+#ifndef WRITE_WITH_RESPONSE
+#define WRITE_WITH_RESPONSE true
+#endif
+
+// wall clock for the session start times, UTC
+#ifndef NTP_SERVER
+#define NTP_SERVER "pool.ntp.org"
+#endif
 
 WiFiClient net;
 PubSubClient client(net);
-MqttView g_mqttView(&client);
+PubSubTransport g_mqttTransport(client);
+MqttView g_mqttView(&g_mqttTransport);
 
 bool g_wifiConnected = false;
 bool g_mqttConnected = false;
@@ -32,13 +87,232 @@ unsigned long g_lastWifiConnect = 0;
 
 String g_bssid = "";
 
+// the treadmill at TARGET_ADDRESS, the session history, telemetry and workout
+// programs follow this one
 TreadmillHandler treadmill;
+
+// a treadmill of the bridge and its Home Assistant device, the first channel
+// is treadmill on g_mqttView, the further ones get their own device id
+struct TreadmillChannel
+{
+  TreadmillHandler *handler = nullptr;
+  MqttView *view = nullptr;
+  PublishPolicy policy;
+  // pace, averages and splits, updated with every frame
+  WorkoutMetrics metrics;
+  // notification arrival to publishState() return, recorded in the main loop
+  LatencyHistogram publishLatency;
+  // policy counters at the last diagnostics publish
+  uint32_t lastFrames = 0;
+  uint32_t lastPublished = 0;
+  unsigned long lastThroughputMs = 0;
+  // link status version last published
+  uint32_t linkVersion = UINT32_MAX;
+};
+TreadmillChannel g_channels[TREADMILL_MAX_DEVICES];
+size_t g_channelCount = 0;
+// connects one treadmill at a time and sends the commands of all
+TreadmillRegistry g_treadmills;
+
+LoopEvents g_loopEvents;
+unsigned long g_lastDiagnosticsPublish = 0;
+// MQTT round trip over <client id>/ping, split by the BLE link mode at sending
+RoundTripProbe g_rttProbe;
+char g_pingTopic[64];
+// subscribed topics to handlers, also measures the dispatch latency
+CommandRouter g_commandRouter;
+
+// hot paths log through the deferred log, the sinks can be switched at runtime
+SerialLogSink g_serialLog;
+MqttLogSink g_mqttLog;
+UdpLogSink g_udpLog;
+// <client id>/log gets the lines, the sink levels are set on its sub topics
+char g_logTopic[64];
+char g_logSerialTopic[72];
+char g_logMqttTopic[72];
+char g_logUdpTopic[72];
+
+LoopProfiler g_loopProfiler;
+ResourceMonitor g_resourceMonitor;
+// survives a watchdog reset, tells which loop section hung
+RTC_NOINIT_ATTR uint8_t g_rtcLoopSection;
+// section of a watchdog reset before this boot, reported once
+const char *g_resetStall = nullptr;
+
+SessionStore g_sessionStore;
+SessionRecorder g_sessionRecorder(g_sessionStore);
+// <client id>/sessions, list and fetch commands are sub topics
+char g_sessionTopic[64];
+char g_sessionListTopic[72];
+char g_sessionFetchTopic[72];
+
+// state messages wait here while the broker is unreachable
+LittleFsOutboxSpill g_outboxSpill;
+MqttOutbox g_outbox;
+unsigned long g_lastMqttAttempt = 0;
+bool g_mqttAttempted = false;
+
+// every frame in binary batches on <client id>/telemetry, opt-in
+TelemetryBatcher g_telemetry;
+char g_telemetryTopic[64];
+char g_msgpackStateTopic[64];
+const char *TELEMETRY_NVS_NAMESPACE = "telemetry";
+
+// on-device interval programs, uploaded to <client id>/workout/program and
+// started or stopped on <client id>/workout/control; status on <client id>/workout
+WorkoutScheduler g_workout;
+char g_workoutTopic[64];
+char g_workoutProgramTopic[72];
+char g_workoutControlTopic[72];
+uint32_t g_workoutVersion = UINT32_MAX;
+
+void loadTelemetryConfig()
+{
+  TelemetryBatcher::Config config;
+  Preferences prefs;
+  if (prefs.begin(TELEMETRY_NVS_NAMESPACE, true))
+  {
+    config.enabled = prefs.getBool("enabled", config.enabled);
+    config.batchSize = prefs.getUChar("batch", config.batchSize);
+    config.flushIntervalMs = prefs.getULong("interval", config.flushIntervalMs);
+    prefs.end();
+  }
+  g_telemetry.setConfig(config);
+}
+
+// applies and persists a changed setting and reports it back to Home Assistant
+void updateTelemetryConfig(const TelemetryBatcher::Config &config)
+{
+  g_telemetry.setConfig(config);
+  const TelemetryBatcher::Config &applied = g_telemetry.getConfig();
+  Preferences prefs;
+  if (prefs.begin(TELEMETRY_NVS_NAMESPACE, false))
+  {
+    prefs.putBool("enabled", applied.enabled);
+    prefs.putUChar("batch", applied.batchSize);
+    prefs.putULong("interval", applied.flushIntervalMs);
+    prefs.end();
+  }
+  else
+  {
+    log_e("Failed to open NVS namespace %s", TELEMETRY_NVS_NAMESPACE);
+  }
+  g_mqttView.publishTelemetryConfig(applied);
+}
+
+void publishLatency(TreadmillChannel &channel)
+{
+  DeviceThroughput throughput;
+  throughput.frames = channel.policy.getFramesReceived() - channel.lastFrames;
+  throughput.published = channel.policy.getMessagesPublished() - channel.lastPublished;
+  throughput.intervalMs = millis() - channel.lastThroughputMs;
+  CommandLatency commands[TreadmillSession::KIND_COUNT];
+  for (int kind = 0; kind < TreadmillSession::KIND_COUNT; ++kind)
+  {
+    commands[kind] = channel.handler->getCommandLatency((TreadmillHandler::CommandKind)kind);
+  }
+  channel.view->publishLatency(channel.handler->getParseLatency(), channel.publishLatency,
+                               channel.handler->getCommandLatencyHistogram(), g_commandRouter.getDispatchLatency(),
+                               commands, throughput);
+}
+
+// rates cover one diagnostics interval
+void publishLatency()
+{
+  for (size_t i = 0; i < g_channelCount; ++i)
+  {
+    TreadmillChannel &channel = g_channels[i];
+    publishLatency(channel);
+    channel.lastFrames = channel.policy.getFramesReceived();
+    channel.lastPublished = channel.policy.getMessagesPublished();
+    channel.lastThroughputMs = millis();
+  }
+  g_lastDiagnosticsPublish = millis();
+}
+
+void publishLink(TreadmillChannel &channel)
+{
+  const LinkStatus &link = channel.handler->getLinkStatus();
+  channel.view->publishLink(link, channel.view == &g_mqttView ? &g_rttProbe : nullptr);
+  channel.linkVersion = link.version;
+}
+
+// the most active link of the treadmills, it takes the most airtime from WiFi
+LinkMode getBridgeLinkMode()
+{
+  LinkMode mode = LINK_DISCONNECTED;
+  for (size_t i = 0; i < g_channelCount; ++i)
+  {
+    LinkMode channelMode = g_channels[i].handler->getLinkStatus().mode;
+    if (channelMode == LINK_ACTIVE || (channelMode == LINK_IDLE && mode == LINK_DISCONNECTED))
+    {
+      mode = channelMode;
+    }
+  }
+  return mode;
+}
+
+void publishWorkoutStatus()
+{
+  static const char *const STATES[] = {"idle", "waiting", "running", "paused", "finished"};
+  WorkoutStatus status = g_workout.getStatus();
+  const LatencyHistogram &jitter = g_workout.getTimerJitter();
+  const LatencyHistogram &drift = g_workout.getDrift();
+  char payload[384];
+  snprintf(payload, sizeof(payload),
+           "{\"state\":\"%s\",\"step\":%u,\"steps\":%u,\"elapsed_s\":%u,\"total_s\":%u,\"target\":%u.%03u,"
+           "\"timer_jitter_us\":{\"p50\":%u,\"p99\":%u,\"max\":%u},"
+           "\"drift_ms\":{\"last\":%d,\"p50\":%u,\"p99\":%u,\"max\":%u,\"n\":%u}}",
+           STATES[status.state], status.step, status.stepCount, status.elapsedMs / 1000, status.totalMs / 1000,
+           status.targetSpeedMilli / 1000, status.targetSpeedMilli % 1000,
+           jitter.percentile(50), jitter.percentile(99), jitter.getMax(),
+           status.lastDriftMs, drift.percentile(50) / 1000, drift.percentile(99) / 1000, drift.getMax() / 1000, drift.getCount());
+  if (!g_mqttTransport.publish(g_workoutTopic, payload))
+  {
+    log_e("Failed to publish state to %s", g_workoutTopic);
+  }
+  g_workoutVersion = status.version;
+}
+
+void publishProfile()
+{
+  g_mqttView.publishProfile(g_loopProfiler, g_resourceMonitor.sample(), g_resetStall);
+  g_resetStall = nullptr;
+  // loop figures cover one diagnostics interval
+  g_loopProfiler.reset();
+}
+
+// ends the profiled part of the iteration and sleeps until an event or timeout
+void sleepLoop(uint32_t timeoutMs)
+{
+  g_loopProfiler.endIteration();
+  g_loopEvents.wait(timeoutMs);
+}
+
+void publishFullState(TreadmillChannel &channel)
+{
+  TreadMillData data = channel.handler->getLastData();
+  channel.view->publishState(data);
+  channel.policy.markPublished(data, millis());
+  channel.view->publishMetrics(channel.metrics.get());
+  channel.view->publishAutoReconnectSetting(channel.handler->getAutoReconnect());
+  if (channel.view == &g_mqttView)
+  {
+    g_mqttView.publishTelemetryConfig(g_telemetry.getConfig());
+  }
+}
 bool connectToMqtt()
 {
   if (client.connected())
   {
     return true;
   }
+  if (g_mqttAttempted && millis() - g_lastMqttAttempt < MQTT_RECONNECT_INTERVAL_MS)
+  {
+    return false;
+  }
+  g_mqttAttempted = true;
+  g_lastMqttAttempt = millis();
 
   log_i("Connecting to MQTT...");
   if (strlen(MQTT_USER) == 0)
@@ -56,17 +330,15 @@ bool connectToMqtt()
     }
   }
 
-  client.subscribe(g_mqttView.getSpeed().getCommandTopic(), 1);
-  client.subscribe(g_mqttView.getPauseButton().getCommandTopic(), 1);
-  client.subscribe(g_mqttView.getAutoReconnectSwitch().getCommandTopic(), 1);
+  g_loopEvents.watchSocket(net.fd());
 
-  client.subscribe(HOMEASSISTANT_STATUS_TOPIC);
-  client.subscribe(HOMEASSISTANT_STATUS_TOPIC_ALT);
+  g_commandRouter.subscribeAll(g_mqttTransport);
 
-  g_mqttView.publishAllConfigs();
-  delay(200); // give mqtt broker some time to process all config messages
-  g_mqttView.publishState(treadmill.getLastData());
-  g_mqttView.publishAutoReconnectSetting(treadmill.getAutoReconnect());
+  // the state follows once all configs are out, see handleDiscovery() in loop()
+  for (size_t i = 0; i < g_channelCount; ++i)
+  {
+    g_channels[i].view->publishAllConfigs();
+  }
 
   return true;
 }
@@ -76,83 +348,389 @@ bool connectToWifi()
   return WiFi.status() == WL_CONNECTED;
 }
 
-void callback(char *topic, byte *payload, unsigned int length)
+void onSpeedCommand(const CommandPayload &payload, unsigned long entryUs, void *context)
+{
+  TreadmillHandler &handler = *static_cast<TreadmillChannel *>(context)->handler;
+  uint32_t speed;
+  if (!payload.parseMilli(speed))
+  {
+    dlog_w("Invalid speed command");
+    return;
+  }
+  dlog_i("Setting speed to %u m/h", speed);
+  if (speed <= 100)
+  {
+    handler.stop(entryUs);
+    return;
+  }
+  if (speed > 6000)
+  {
+    speed = 6000;
+  }
+  handler.setSpeed(speed, entryUs);
+}
+
+void onPauseCommand(const CommandPayload &payload, unsigned long entryUs, void *context)
+{
+  TreadmillHandler &handler = *static_cast<TreadmillChannel *>(context)->handler;
+  if (!payload.equalsIgnoreCase("press"))
+  {
+    return;
+  }
+  dlog_i("Pause command received");
+  if (handler.getLastData().status == TreadMillData::RUNNING)
+    handler.pause(entryUs);
+  else if (handler.getLastData().status == TreadMillData::PAUSED)
+    handler.start(entryUs);
+}
+
+void onAutoReconnectCommand(const CommandPayload &payload, unsigned long entryUs, void *context)
+{
+  TreadmillChannel &channel = *static_cast<TreadmillChannel *>(context);
+  if (payload.equalsIgnoreCase(channel.view->getAutoReconnectSwitch().getOnState()))
+  {
+    dlog_i("Auto reconnect enabled");
+    channel.handler->setAutoReconnect(true);
+    channel.view->publishAutoReconnectSetting(true);
+  }
+  else if (payload.equalsIgnoreCase(channel.view->getAutoReconnectSwitch().getOffState()))
+  {
+    dlog_i("Auto reconnect disabled");
+    channel.handler->setAutoReconnect(false);
+    channel.view->publishAutoReconnectSetting(false);
+  }
+}
+
+void onLatencyReset(const CommandPayload &payload, unsigned long entryUs, void *context)
+{
+  TreadmillChannel &channel = *static_cast<TreadmillChannel *>(context);
+  log_i("Resetting latency statistics");
+  channel.handler->getParseLatency().reset();
+  channel.handler->resetCommandLatency();
+  channel.publishLatency.reset();
+  // the dispatch latency is shown on the first device only
+  if (channel.view == &g_mqttView)
+  {
+    g_commandRouter.getDispatchLatency().reset();
+    g_rttProbe.reset();
+  }
+  publishLatency(channel);
+  publishLink(channel);
+}
+
+void onPing(const CommandPayload &payload, unsigned long entryUs)
+{
+  g_rttProbe.onEcho(payload, entryUs);
+}
+
+void onTelemetrySwitch(const CommandPayload &payload, unsigned long entryUs)
+{
+  TelemetryBatcher::Config config = g_telemetry.getConfig();
+  if (payload.equalsIgnoreCase(g_mqttView.getTelemetrySwitch().getOnState()))
+  {
+    config.enabled = true;
+  }
+  else if (payload.equalsIgnoreCase(g_mqttView.getTelemetrySwitch().getOffState()))
+  {
+    config.enabled = false;
+  }
+  updateTelemetryConfig(config);
+}
+
+void onTelemetryBatchSize(const CommandPayload &payload, unsigned long entryUs)
+{
+  uint32_t batchSize;
+  if (!payload.parseUInt(batchSize))
+  {
+    return;
+  }
+  TelemetryBatcher::Config config = g_telemetry.getConfig();
+  config.batchSize = min(batchSize, (uint32_t)TELEMETRY_MAX_BATCH);
+  updateTelemetryConfig(config);
+}
+
+void onTelemetryInterval(const CommandPayload &payload, unsigned long entryUs)
+{
+  uint32_t interval;
+  if (!payload.parseUInt(interval))
+  {
+    return;
+  }
+  TelemetryBatcher::Config config = g_telemetry.getConfig();
+  config.flushIntervalMs = interval;
+  updateTelemetryConfig(config);
+}
+
+// runs in the esp_timer task, the command is queued for the BLE sender task
+void onWorkoutSetpoint(uint16_t speedMilli)
 {
-  log_i("Message arrived [%s]", topic);
-  for (unsigned int i = 0; i < length; i++)
+  if (speedMilli == 0)
+  {
+    treadmill.stop(micros());
+  }
+  else
   {
-    Serial.print((char)payload[i]);
+    treadmill.setSpeed(speedMilli, micros());
   }
-  Serial.println();
+  // the main loop publishes the new step
+  g_loopEvents.notify(LOOP_EVENT_WAKE);
+}
 
-  if (strcmp(topic, g_mqttView.getSpeed().getCommandTopic()) == 0)
+void onWorkoutProgram(const CommandPayload &payload, unsigned long entryUs)
+{
+  if (!g_workout.load((const char *)payload.getData(), payload.getLength()))
   {
-    float data = atof((char *)payload);
-    uint16_t speed = (uint16_t)(data * 1000);
-    log_i("Setting speed to %.2f km/h (%u)", data, speed);
+    dlog_w("Invalid workout program");
+  }
+  publishWorkoutStatus();
+}
 
-    if (speed <= 100)
+void onWorkoutControl(const CommandPayload &payload, unsigned long entryUs)
+{
+  if (payload.equalsIgnoreCase("start"))
+  {
+    if (!g_workout.start())
     {
-      treadmill.stop();
+      dlog_w("No workout program loaded");
       return;
     }
-    if (speed > 6000)
+    // the program starts with the first running frame
+    if (treadmill.getLastData().status != TreadMillData::RUNNING)
     {
-      speed = 6000;
+      treadmill.start(entryUs);
     }
-    treadmill.setSpeed(speed);
   }
-  else if (strcmp(topic, g_mqttView.getPauseButton().getCommandTopic()) == 0)
+  else if (payload.equalsIgnoreCase("stop"))
   {
-    String command = String((char *)payload).substring(0, length);
-    command.trim();
-    log_i("Pause command received: %s", command.c_str());
-    if (command.equalsIgnoreCase("press"))
+    g_workout.stop();
+  }
+  else if (payload.equalsIgnoreCase("reset"))
+  {
+    g_workout.resetStats();
+  }
+  publishWorkoutStatus();
+}
+
+void onSessionList(const CommandPayload &payload, unsigned long entryUs)
+{
+  g_sessionStore.publishList(g_mqttTransport, g_sessionTopic);
+}
+
+void onSessionFetch(const CommandPayload &payload, unsigned long entryUs)
+{
+  uint32_t index;
+  if (!payload.parseUInt(index))
+  {
+    dlog_w("Invalid session index");
+    return;
+  }
+  dlog_i("Fetching session %u", index);
+  g_sessionStore.startFetch(index);
+}
+
+// publish config when homeassistant comes online and needs the configuration again
+void onHomeAssistantStatus(const CommandPayload &payload, unsigned long entryUs)
+{
+  if (payload.equalsIgnoreCase("online"))
+  {
+    // spread the configs of many bridges after a Home Assistant restart
+    for (size_t i = 0; i < g_channelCount; ++i)
     {
-      if (treadmill.getLastData().status == TreadMillData::RUNNING)
-        treadmill.pause();
-      else if (treadmill.getLastData().status == TreadMillData::PAUSED)
-        treadmill.start();
+      g_channels[i].view->publishAllConfigs(random(0, DISCOVERY_MAX_JITTER_MS));
     }
   }
-  else if (strcmp(topic, g_mqttView.getAutoReconnectSwitch().getCommandTopic()) == 0)
+}
+
+void setLogLevel(LogSink *sink, const char *name, const CommandPayload &payload)
+{
+  uint8_t level;
+  if (!DeferredLog::parseLevel((const char *)payload.getData(), payload.getLength(), level))
+  {
+    dlog_w("Invalid log level");
+    return;
+  }
+  DeferredLog::instance().setSinkLevel(sink, level);
+  log_i("%s log level set to %u", name, level);
+}
+
+void onSerialLogLevel(const CommandPayload &payload, unsigned long entryUs)
+{
+  setLogLevel(&g_serialLog, "Serial", payload);
+}
+
+void onMqttLogLevel(const CommandPayload &payload, unsigned long entryUs)
+{
+  setLogLevel(&g_mqttLog, "MQTT", payload);
+}
+
+// "<ip>:<port>" sends debug output there, anything else switches it off
+void onUdpLogTarget(const CommandPayload &payload, unsigned long entryUs)
+{
+  char target[32];
+  size_t length = min(payload.getLength(), sizeof(target) - 1);
+  memcpy(target, payload.getData(), length);
+  target[length] = '\0';
+
+  char *separator = strchr(target, ':');
+  IPAddress address;
+  uint16_t port = separator ? atoi(separator + 1) : 0;
+  if (separator)
   {
-    String command = String((char *)payload).substring(0, length);
-    command.trim();
-    log_i("Auto Reconnect command received: %s", command.c_str());
-    if (command.equalsIgnoreCase(g_mqttView.getAutoReconnectSwitch().getOnState()))
+    *separator = '\0';
+  }
+  if (separator == nullptr || port == 0 || !address.fromString(target))
+  {
+    DeferredLog::instance().setSinkLevel(&g_udpLog, DEFERRED_LOG_OFF);
+    log_i("UDP log disabled");
+    return;
+  }
+  g_udpLog.setTarget(address, port);
+  DeferredLog::instance().setSinkLevel(&g_udpLog, CORE_DEBUG_LEVEL);
+  log_i("UDP log to %s:%u", target, port);
+}
+
+// topics must be composed before, the router keeps pointers to them
+void registerCommands()
+{
+  for (size_t i = 0; i < g_channelCount; ++i)
+  {
+    TreadmillChannel *channel = &g_channels[i];
+    g_commandRouter.add(channel->view->getSpeed().getCommandTopic(), onSpeedCommand, channel);
+    g_commandRouter.add(channel->view->getPauseButton().getCommandTopic(), onPauseCommand, channel);
+    g_commandRouter.add(channel->view->getAutoReconnectSwitch().getCommandTopic(), onAutoReconnectCommand, channel);
+    g_commandRouter.add(channel->view->getLatencyResetButton().getCommandTopic(), onLatencyReset, channel);
+  }
+  g_commandRouter.add(g_mqttView.getTelemetrySwitch().getCommandTopic(), onTelemetrySwitch);
+  g_commandRouter.add(g_mqttView.getTelemetryBatchSize().getCommandTopic(), onTelemetryBatchSize);
+  g_commandRouter.add(g_mqttView.getTelemetryInterval().getCommandTopic(), onTelemetryInterval);
+  g_commandRouter.add(g_sessionListTopic, onSessionList);
+  g_commandRouter.add(g_workoutProgramTopic, onWorkoutProgram);
+  g_commandRouter.add(g_workoutControlTopic, onWorkoutControl);
+  g_commandRouter.add(g_sessionFetchTopic, onSessionFetch);
+  g_commandRouter.add(g_logSerialTopic, onSerialLogLevel);
+  g_commandRouter.add(g_logMqttTopic, onMqttLogLevel);
+  g_commandRouter.add(g_logUdpTopic, onUdpLogTarget);
+  g_commandRouter.add(g_pingTopic, onPing, 0);
+  g_commandRouter.add(HOMEASSISTANT_STATUS_TOPIC, onHomeAssistantStatus, 0);
+  g_commandRouter.add(HOMEASSISTANT_STATUS_TOPIC_ALT, onHomeAssistantStatus, 0);
+}
+
+// every treadmill publishes to its own device, the first one also feeds the
+// session history, telemetry and the workout program
+void onTreadmillData(TreadmillChannel &channel, const TreadMillData &data)
+{
+  dlog_d("Speed: %u m/h, Distance: %u m %d", data.speedCmdMilli, data.distanceMilli, data.status);
+  if (channel.handler == &treadmill)
+  {
+    // full resolution goes to flash, the broker only gets what the policy lets through
+    time_t now = time(nullptr);
+    g_sessionRecorder.onData(data, millis(), now > 1600000000 ? now : 0);
+    g_telemetry.add(data, millis());
+    g_workout.onData(data);
+  }
+  channel.metrics.onData(data);
+  if (!channel.policy.shouldPublish(data, millis()))
+  {
+    return;
+  }
+  // queued states are not counted, their latency is the outage
+  if (channel.view->publishState(data))
+  {
+    channel.publishLatency.record(micros() - data.receivedUs);
+  }
+  channel.view->publishMetrics(channel.metrics.get());
+  dlog_d("Published %u of %u frames", channel.policy.getMessagesPublished(), channel.policy.getFramesReceived());
+}
+
+// TARGET_ADDRESS on the client id, every address of EXTRA_TARGET_ADDRESSES on
+// <client id>-<last three address bytes>
+void setupTreadmills()
+{
+  g_channels[0].handler = &treadmill;
+  g_channels[0].view = &g_mqttView;
+  g_channelCount = 1;
+  treadmill.begin(NimBLEAddress(std::string(TARGET_ADDRESS), BLE_ADDR_PUBLIC));
+
+  const char *extra = EXTRA_TARGET_ADDRESSES;
+  while (*extra != '\0')
+  {
+    const char *separator = strchr(extra, ',');
+    size_t length = separator ? separator - extra : strlen(extra);
+    std::string address(extra, length);
+    extra += separator ? length + 1 : length;
+    address.erase(0, address.find_first_not_of(' '));
+    address.erase(address.find_last_not_of(' ') + 1);
+    if (address.length() != 17)
     {
-      treadmill.setAutoReconnect(true);
-      g_mqttView.publishAutoReconnectSetting(true);
+      if (!address.empty())
+      {
+        log_e("Invalid treadmill address %s", address.c_str());
+      }
+      continue;
     }
-    else if (command.equalsIgnoreCase(g_mqttView.getAutoReconnectSwitch().getOffState()))
+    if (g_channelCount >= TREADMILL_MAX_DEVICES)
     {
-      treadmill.setAutoReconnect(false);
-      g_mqttView.publishAutoReconnectSetting(false);
+      log_e("Only %d treadmills per bridge, ignoring %s", TREADMILL_MAX_DEVICES, address.c_str());
+      break;
     }
+
+    char suffix[7];
+    snprintf(suffix, sizeof(suffix), "%c%c%c%c%c%c", tolower(address[9]), tolower(address[10]),
+             tolower(address[12]), tolower(address[13]), tolower(address[15]), tolower(address[16]));
+    char deviceId[48];
+    snprintf(deviceId, sizeof(deviceId), "%s-%s", composeClientID().c_str(), suffix);
+    char name[24];
+    snprintf(name, sizeof(name), "PaceKeeper %s", suffix);
+
+    TreadmillChannel &channel = g_channels[g_channelCount++];
+    channel.handler = new TreadmillHandler();
+    channel.view = new MqttView(&g_mqttTransport, deviceId, name, false);
+    channel.handler->begin(NimBLEAddress(address, BLE_ADDR_PUBLIC));
+    log_i("Treadmill %s on %s", address.c_str(), deviceId);
   }
 
-  // publish config when homeassistant comes online and needs the configuration again
-  else if (strcmp(topic, HOMEASSISTANT_STATUS_TOPIC) == 0 ||
-           strcmp(topic, HOMEASSISTANT_STATUS_TOPIC_ALT) == 0)
+  for (size_t i = 0; i < g_channelCount; ++i)
   {
-    if (strncmp((char *)payload, "online", length) == 0)
-    {
-      g_mqttView.publishAllConfigs();
-      delay(200); // give mqtt broker some time to process all config messages
-      g_mqttView.publishState(treadmill.getLastData());
-      g_mqttView.publishAutoReconnectSetting(treadmill.getAutoReconnect());
-    }
+    TreadmillChannel *channel = &g_channels[i];
+    channel->handler->setWriteWithResponse(WRITE_WITH_RESPONSE);
+    channel->handler->setWakeupCallback([]()
+                                        { g_loopEvents.notify(LOOP_EVENT_BLE_FRAME); });
+    channel->handler->setCallback([channel](const TreadMillData &data)
+                                  { onTreadmillData(*channel, data); });
+    g_treadmills.add(channel->handler);
   }
+  g_treadmills.begin();
+}
+
+void callback(char *topic, byte *payload, unsigned int length)
+{
+  g_commandRouter.dispatch(topic, payload, length, micros());
 }
 
 void setup()
 {
+  esp_reset_reason_t resetReason = esp_reset_reason();
+  if ((resetReason == ESP_RST_TASK_WDT || resetReason == ESP_RST_INT_WDT || resetReason == ESP_RST_WDT) &&
+      g_rtcLoopSection < SECTION_COUNT)
+  {
+    g_resetStall = loopSectionName((LoopSection)g_rtcLoopSection);
+  }
+  g_rtcLoopSection = SECTION_NONE;
+  g_loopProfiler.setSectionMarker(&g_rtcLoopSection);
+
   // initialize watchdog
   esp_task_wdt_init(WATCHDOG_TIMEOUT_S, true); // enable panic so ESP32 restarts
   esp_task_wdt_add(NULL);                      // add current thread to WDT watch
 
   Serial.begin(115200);
+  DeferredLog::instance().addSink(&g_serialLog, CORE_DEBUG_LEVEL);
+  DeferredLog::instance().addSink(&g_mqttLog, DEFERRED_LOG_OFF);
+  DeferredLog::instance().addSink(&g_udpLog, DEFERRED_LOG_OFF);
+  startDeferredLogTask();
+  if (g_resetStall != nullptr)
+  {
+    log_w("Restarted by the watchdog while in loop section %s", g_resetStall);
+  }
 
   WiFi.setHostname(composeClientID().c_str());
   WiFi.mode(WIFI_STA);
@@ -173,22 +751,50 @@ void setup()
   g_lastWifiConnect = millis();
   log_i("Connected to SSID: %s", DEFAULT_STA_WIFI_SSID);
   log_i("IP address: %s", WiFi.localIP().toString().c_str());
+  // SNTP keeps syncing in the background, sessions started before the first
+  // sync have no start time
+  configTime(0, 0, NTP_SERVER);
+
+  g_loopEvents.begin();
+  setupTreadmills();
 
   char configUrl[256];
   snprintf(configUrl, sizeof(configUrl), "http://%s/", WiFi.localIP().toString().c_str());
-  g_mqttView.getDevice().setConfigurationUrl(configUrl);
+  for (size_t i = 0; i < g_channelCount; ++i)
+  {
+    g_channels[i].view->getDevice().setConfigurationUrl(configUrl);
+    g_channels[i].view->buildDiscoveryCache(HA_DEVICE_DISCOVERY);
+  }
+
+  g_sessionStore.begin();
+  g_outboxSpill.begin();
+  g_outbox.begin(&g_mqttTransport, g_mqttView.getStateTopic(), &g_outboxSpill);
+  g_mqttView.setOutbox(&g_outbox);
+  snprintf(g_msgpackStateTopic, sizeof(g_msgpackStateTopic), "%s/state/msgpack", composeClientID().c_str());
+  g_mqttView.setStateFormats(STATE_FORMAT_JSON, STATE_FORMAT_MSGPACK ? g_msgpackStateTopic : nullptr);
+  snprintf(g_sessionTopic, sizeof(g_sessionTopic), "%s/sessions", composeClientID().c_str());
+  snprintf(g_sessionListTopic, sizeof(g_sessionListTopic), "%s/list", g_sessionTopic);
+  snprintf(g_sessionFetchTopic, sizeof(g_sessionFetchTopic), "%s/fetch", g_sessionTopic);
+  snprintf(g_telemetryTopic, sizeof(g_telemetryTopic), "%s/telemetry", composeClientID().c_str());
+  g_telemetry.begin(&g_mqttTransport, g_telemetryTopic);
+  snprintf(g_logTopic, sizeof(g_logTopic), "%s/log", composeClientID().c_str());
+  snprintf(g_logSerialTopic, sizeof(g_logSerialTopic), "%s/serial", g_logTopic);
+  snprintf(g_logMqttTopic, sizeof(g_logMqttTopic), "%s/mqtt", g_logTopic);
+  snprintf(g_logUdpTopic, sizeof(g_logUdpTopic), "%s/udp", g_logTopic);
+  g_mqttLog.begin(&g_mqttTransport, g_logTopic);
+  snprintf(g_workoutTopic, sizeof(g_workoutTopic), "%s/workout", composeClientID().c_str());
+  snprintf(g_workoutProgramTopic, sizeof(g_workoutProgramTopic), "%s/program", g_workoutTopic);
+  snprintf(g_workoutControlTopic, sizeof(g_workoutControlTopic), "%s/control", g_workoutTopic);
+  g_workout.begin(onWorkoutSetpoint);
+  snprintf(g_pingTopic, sizeof(g_pingTopic), "%s/ping", composeClientID().c_str());
+  g_rttProbe.begin(&g_mqttTransport, g_pingTopic);
+  loadTelemetryConfig();
+  registerCommands();
+
   client.setBufferSize(1024);
   client.setServer(MQTT_SERVER, MQTT_PORT);
   client.setCallback(callback);
 
-  NimBLEAddress targetAddress(std::string(TARGET_ADDRESS), BLE_ADDR_PUBLIC);
-  treadmill.begin(targetAddress);
-
-  treadmill.setCallback([](const TreadMillData &data)
-                        {
-    log_d("Speed: %.2f km/h, Distance: %.2f %d", data.speedCmd, data.distanceKm, data.status);
-    g_mqttView.publishState(data); });
-
   log_i("Starting BLE Client...");
   NimBLEDevice::init("PaceKeeper");
 
@@ -233,50 +839,119 @@ void loop()
 {
   // reset watchdog, important to be called once each loop.
   esp_task_wdt_reset();
+  g_loopProfiler.beginIteration();
 
+  // the broker being unreachable must not stop the treadmill side, state
+  // messages wait in the outbox meanwhile
+  g_loopProfiler.beginSection(SECTION_WIFI);
   bool wifiConnected = connectToWifi();
   if (!wifiConnected)
   {
-    if (g_wifiConnected)
-    {
-    }
     if (millis() - g_lastWifiConnect > WIFI_DISCONNECT_FORCED_RESTART_S * 1000)
     {
       log_w("Wifi could not connect in time, will force a restart");
+      g_outbox.spillAll();
+      g_sessionStore.sync();
       ESP.restart();
     }
     g_wifiConnected = false;
     g_mqttConnected = false;
-    delay(1000);
-    return;
+    g_loopEvents.watchSocket(-1);
   }
-  g_wifiConnected = true;
-  g_lastWifiConnect = millis();
+  else
+  {
+    g_wifiConnected = true;
+    g_lastWifiConnect = millis();
 
-  ArduinoOTA.handle();
+    g_loopProfiler.beginSection(SECTION_OTA);
+    ArduinoOTA.handle();
 
-  bool mqttConnected = connectToMqtt();
-  if (!mqttConnected)
-  {
-    if (g_mqttConnected)
+    g_loopProfiler.beginSection(SECTION_MQTT_CONNECT);
+    bool mqttConnected = connectToMqtt();
+    if (!mqttConnected)
     {
-      // we switched to disconnected
+      g_mqttConnected = false;
+      g_loopEvents.watchSocket(-1);
+    }
+    else
+    {
+      if (!g_mqttConnected)
+      {
+        // now we are successfully reconnected and publish our counters
+        g_bssid = WiFi.BSSIDstr();
+        // g_mqttView.publishDiagnostics(g_settings, g_bssid.c_str());
+      }
+      g_mqttConnected = true;
+
+      g_loopProfiler.beginSection(SECTION_MQTT_LOOP);
+      // loop() handles one packet, the rest of a segment waits in the
+      // WiFiClient buffer where select() does not see it
+      while (client.loop() && net.available())
+      {
+      }
+      g_loopEvents.socketServiced();
+
+      g_loopProfiler.beginSection(SECTION_DISCOVERY);
+      for (size_t i = 0; i < g_channelCount; ++i)
+      {
+        if (g_channels[i].view->handleDiscovery(millis()))
+        {
+          publishFullState(g_channels[i]);
+        }
+      }
+      g_sessionStore.handleFetch(g_mqttTransport, g_sessionTopic, millis());
     }
-    g_mqttConnected = false;
-    delay(1000);
-    return;
   }
-  if (!g_mqttConnected)
+
+  g_loopProfiler.beginSection(SECTION_TREADMILL);
+  g_treadmills.handle();
+  g_telemetry.handle(millis());
+
+  if (g_mqttConnected)
   {
-    // now we are successfully reconnected and publish our counters
-    g_bssid = WiFi.BSSIDstr();
-    // g_mqttView.publishDiagnostics(g_settings, g_bssid.c_str());
-  }
-  g_mqttConnected = true;
+    // the backlog goes out paced, before live messages
+    g_loopProfiler.beginSection(SECTION_OUTBOX);
+    g_outbox.service(millis());
+    g_mqttLog.flush();
+    if (g_workout.getStatus().version != g_workoutVersion)
+    {
+      publishWorkoutStatus();
+    }
+    for (size_t i = 0; i < g_channelCount; ++i)
+    {
+      if (g_channels[i].handler->getLinkStatus().version != g_channels[i].linkVersion)
+      {
+        publishLink(g_channels[i]);
+      }
+    }
+    g_rttProbe.handle(millis(), micros(), getBridgeLinkMode());
 
-  client.loop();
-  treadmill.handle();
+    if (millis() - g_lastDiagnosticsPublish > DIAGNOSTICS_PUBLISH_INTERVAL_MS)
+    {
+      g_loopProfiler.beginSection(SECTION_DIAGNOSTICS);
+      publishLatency();
+      publishProfile();
+      publishWorkoutStatus();
+      for (size_t i = 0; i < g_channelCount; ++i)
+      {
+        publishLink(g_channels[i]);
+        g_channels[i].view->publishPresence(g_channels[i].handler->getPresenceStats());
+      }
+    }
+  }
 
-  // Notifications are handled in the callback
-  delay(100);
+  // sleep until a BLE frame, mqtt data or the next treadmill, telemetry, discovery, fetch, outbox or round trip timer wakes us up
+  uint32_t sleepMs = min(g_treadmills.getMsUntilNextTimer(), LOOP_MAX_SLEEP_MS);
+  sleepMs = min(sleepMs, g_telemetry.getMsUntilFlush(millis()));
+  if (g_mqttConnected)
+  {
+    for (size_t i = 0; i < g_channelCount; ++i)
+    {
+      sleepMs = min(sleepMs, g_channels[i].view->getMsUntilDiscovery(millis()));
+    }
+    sleepMs = min(sleepMs, g_sessionStore.getMsUntilFetch(millis()));
+    sleepMs = min(sleepMs, g_outbox.getMsUntilService(millis()));
+    sleepMs = min(sleepMs, g_rttProbe.getMsUntilProbe(millis()));
+  }
+  sleepLoop(sleepMs);
 }
@@ -1,16 +1,85 @@
 #include <Arduino.h>
-#include <PubSubClient.h>
 #include <MqttDevice.h>
 #include "platform.h"
+#include "MqttTransport.h"
+#include "MqttOutbox.h"
+#include "TelemetryBatcher.h"
+#include "WorkoutMetrics.h"
+#include "StateSerializer.h"
+#include "DiscoveryCache.h"
+#include "LatencyHistogram.h"
+#include "TreadmillSession.h"
+#include "RoundTripProbe.h"
+#include "PresenceScanner.h"
+#include "LoopProfiler.h"
+#include "ResourceMonitor.h"
 #include "settings.h"
 #include "utils.h"
 
+// Latency paths published as diagnostics, the sensors of a path show
+// p50/p95/p99/max of its histogram in microseconds
+static const char *const LATENCY_PARSE_IDS[] = {"latency-parse-p50", "latency-parse-p95", "latency-parse-p99", "latency-parse-max"};
+static const char *const LATENCY_PARSE_NAMES[] = {"Parse Latency p50", "Parse Latency p95", "Parse Latency p99", "Parse Latency Max"};
+static const char *const LATENCY_PARSE_TEMPLATES[] = {"{{ value_json.parse.p50 }}", "{{ value_json.parse.p95 }}", "{{ value_json.parse.p99 }}", "{{ value_json.parse.max }}"};
+static const char *const LATENCY_PUBLISH_IDS[] = {"latency-publish-p50", "latency-publish-p95", "latency-publish-p99", "latency-publish-max"};
+static const char *const LATENCY_PUBLISH_NAMES[] = {"Publish Latency p50", "Publish Latency p95", "Publish Latency p99", "Publish Latency Max"};
+static const char *const LATENCY_PUBLISH_TEMPLATES[] = {"{{ value_json.publish.p50 }}", "{{ value_json.publish.p95 }}", "{{ value_json.publish.p99 }}", "{{ value_json.publish.max }}"};
+static const char *const LATENCY_COMMAND_IDS[] = {"latency-command-p50", "latency-command-p95", "latency-command-p99", "latency-command-max"};
+static const char *const LATENCY_COMMAND_NAMES[] = {"Command Latency p50", "Command Latency p95", "Command Latency p99", "Command Latency Max"};
+static const char *const LATENCY_COMMAND_TEMPLATES[] = {"{{ value_json.command.p50 }}", "{{ value_json.command.p95 }}", "{{ value_json.command.p99 }}", "{{ value_json.command.max }}"};
+static const char *const LATENCY_DISPATCH_IDS[] = {"latency-dispatch-p50", "latency-dispatch-p95", "latency-dispatch-p99", "latency-dispatch-max"};
+static const char *const LATENCY_DISPATCH_NAMES[] = {"Dispatch Latency p50", "Dispatch Latency p95", "Dispatch Latency p99", "Dispatch Latency Max"};
+static const char *const LATENCY_DISPATCH_TEMPLATES[] = {"{{ value_json.dispatch.p50 }}", "{{ value_json.dispatch.p95 }}", "{{ value_json.dispatch.p99 }}", "{{ value_json.dispatch.max }}"};
+
+struct LatencySensors
+{
+    LatencySensors(MqttDevice *device, const char *const ids[4], const char *const names[4])
+        : p50(device, ids[0], names[0]),
+          p95(device, ids[1], names[1]),
+          p99(device, ids[2], names[2]),
+          max(device, ids[3], names[3])
+    {
+    }
+
+    void configure(const char *stateTopic, const char *const templates[4])
+    {
+        MqttSensor *sensors[] = {&p50, &p95, &p99, &max};
+        for (int i = 0; i < 4; ++i)
+        {
+            sensors[i]->setCustomStateTopic(stateTopic);
+            sensors[i]->setEntityType(EntityCategory::DIAGNOSTIC);
+            sensors[i]->setUnit("µs");
+            sensors[i]->setStateClass(MqttSensor::StateClass::MEASUREMENT);
+            sensors[i]->setIcon("mdi:timer-outline");
+            sensors[i]->setValueTemplate(templates[i]);
+        }
+    }
+
+    MqttSensor p50;
+    MqttSensor p95;
+    MqttSensor p99;
+    MqttSensor max;
+};
+
+// Frames received and states published by one treadmill in a diagnostics interval
+struct DeviceThroughput
+{
+    uint32_t frames = 0;
+    uint32_t published = 0;
+    uint32_t intervalMs = 0;
+};
+
 class MqttView
 {
 public:
-    MqttView(PubSubClient *client)
-        : m_client(client),
-          m_device(composeClientID().c_str(), "PaceKeeper", SYSTEM_NAME, "maker_pt"),
+    // deviceId defaults to the client id. The further treadmills of a bridge
+    // get a view without bridgeEntities: telemetry, dispatch latency and the
+    // loop and resource profile are only announced once.
+    MqttView(MqttTransport *transport, const char *deviceId = nullptr, const char *name = "PaceKeeper", bool bridgeEntities = true)
+        : m_transport(transport),
+          m_deviceId(deviceId ? String(deviceId) : composeClientID()),
+          m_bridgeEntities(bridgeEntities),
+          m_device(m_deviceId.c_str(), name, SYSTEM_NAME, "maker_pt"),
           m_speed(&m_device, "speed", "Speed"),
           m_speedFeedback(&m_device, "speed-feedback", "Speed Feedback"),
           m_state(&m_device, "state", "State"),
@@ -19,12 +88,51 @@ public:
           m_calories(&m_device, "calories", "Calories"),
           m_steps(&m_device, "steps", "Steps"),
           m_pauseBtn(&m_device, "pause", "Pause"),
+          m_pace(&m_device, "pace", "Pace"),
+          m_windowSpeed(&m_device, "speed-1min", "Speed 1 min Average"),
+          m_averageSpeed(&m_device, "speed-average", "Average Speed"),
+          m_splits(&m_device, "splits", "Splits"),
+          m_lastSplit(&m_device, "split-last", "Last Split"),
+          m_bestSplit(&m_device, "split-best", "Best Split"),
+          m_calorieRate(&m_device, "calorie-rate", "Calorie Rate"),
 
           // Configuration Settings
           m_autoreconnectSwitch(&m_device, "auto-reconnect", "Auto Reconnect"),
+          m_telemetrySwitch(&m_device, "raw-telemetry", "Raw Telemetry"),
+          m_telemetryBatchSize(&m_device, "telemetry-batch", "Telemetry Batch Size"),
+          m_telemetryInterval(&m_device, "telemetry-interval", "Telemetry Flush Interval"),
           // Diagnostics Elements
           m_maxSpeed(&m_device, "max-speed", "Max Speed"),
-          m_firmware(&m_device, "firmware", "Firmware Version")
+          m_firmware(&m_device, "firmware", "Firmware Version"),
+          m_parseLatency(&m_device, LATENCY_PARSE_IDS, LATENCY_PARSE_NAMES),
+          m_publishLatency(&m_device, LATENCY_PUBLISH_IDS, LATENCY_PUBLISH_NAMES),
+          m_commandLatency(&m_device, LATENCY_COMMAND_IDS, LATENCY_COMMAND_NAMES),
+          m_dispatchLatency(&m_device, LATENCY_DISPATCH_IDS, LATENCY_DISPATCH_NAMES),
+          m_latencyResetBtn(&m_device, "latency-reset", "Reset Latency Stats"),
+          m_frameRate(&m_device, "frame-rate", "Frame Rate"),
+          m_publishRate(&m_device, "publish-rate", "Publish Rate"),
+          m_linkMode(&m_device, "link-mode", "BLE Link Mode"),
+          m_connInterval(&m_device, "conn-interval", "BLE Connection Interval"),
+          m_connLatency(&m_device, "conn-latency", "BLE Peripheral Latency"),
+          m_advertsSeen(&m_device, "adverts-seen", "BLE Advertisements Seen"),
+          m_connectAttempts(&m_device, "connect-attempts", "BLE Connect Attempts"),
+          m_connectFailures(&m_device, "connect-failures", "BLE Connect Failures"),
+          m_scanDutyCycle(&m_device, "scan-duty-cycle", "BLE Scan Duty Cycle"),
+          m_scanningPercent(&m_device, "scanning", "BLE Scanning"),
+          m_rttActiveP50(&m_device, "mqtt-rtt-active-p50", "MQTT Round Trip Active p50"),
+          m_rttActiveP99(&m_device, "mqtt-rtt-active-p99", "MQTT Round Trip Active p99"),
+          m_rttIdleP50(&m_device, "mqtt-rtt-idle-p50", "MQTT Round Trip Idle p50"),
+          m_rttIdleP99(&m_device, "mqtt-rtt-idle-p99", "MQTT Round Trip Idle p99"),
+          m_loopMax(&m_device, "loop-max", "Loop Max Time"),
+          m_loopStalls(&m_device, "loop-stalls", "Loop Stalls"),
+          m_lastStall(&m_device, "last-stall", "Last Stall"),
+          m_heapFree(&m_device, "heap-free", "Free Heap"),
+          m_heapMin(&m_device, "heap-min", "Min Free Heap"),
+          m_heapLargestBlock(&m_device, "heap-largest-block", "Largest Free Block"),
+          m_heapFragmentation(&m_device, "heap-fragmentation", "Heap Fragmentation"),
+          m_stackMin(&m_device, "stack-min", "Min Free Stack"),
+          m_outboxDepth(&m_device, "outbox-depth", "Outbox Depth"),
+          m_outboxDropped(&m_device, "outbox-dropped", "Outbox Dropped")
 
     {
 
@@ -70,12 +178,61 @@ public:
         m_steps.setIcon("mdi:shoe-print");
         m_steps.setValueTemplate("{{ value_json.steps }}");
 
+        // derived metrics share one state topic
+        const char *metricsTopic = m_pace.getStateTopic();
+        // seconds per km, Home Assistant shows durations as m:ss
+        m_pace.setUnit("s");
+        m_pace.setDeviceClass("duration");
+        m_pace.setStateClass(MqttSensor::StateClass::MEASUREMENT);
+        m_pace.setIcon("mdi:run-fast");
+        m_pace.setValueTemplate("{{ value_json.pace_s }}");
+        m_windowSpeed.setCustomStateTopic(metricsTopic);
+        m_windowSpeed.setUnit("km/h");
+        m_windowSpeed.setDeviceClass("speed");
+        m_windowSpeed.setStateClass(MqttSensor::StateClass::MEASUREMENT);
+        m_windowSpeed.setValueTemplate("{{ value_json.speed_1min }}");
+        m_averageSpeed.setCustomStateTopic(metricsTopic);
+        m_averageSpeed.setUnit("km/h");
+        m_averageSpeed.setDeviceClass("speed");
+        m_averageSpeed.setStateClass(MqttSensor::StateClass::MEASUREMENT);
+        m_averageSpeed.setValueTemplate("{{ value_json.speed_avg }}");
+        m_splits.setCustomStateTopic(metricsTopic);
+        m_splits.setIcon("mdi:flag-checkered");
+        m_splits.setValueTemplate("{{ value_json.splits }}");
+        m_lastSplit.setCustomStateTopic(metricsTopic);
+        m_lastSplit.setUnit("s");
+        m_lastSplit.setDeviceClass("duration");
+        m_lastSplit.setValueTemplate("{{ value_json.split_last_s }}");
+        m_bestSplit.setCustomStateTopic(metricsTopic);
+        m_bestSplit.setUnit("s");
+        m_bestSplit.setDeviceClass("duration");
+        m_bestSplit.setValueTemplate("{{ value_json.split_best_s }}");
+        m_calorieRate.setCustomStateTopic(metricsTopic);
+        m_calorieRate.setUnit("kcal/h");
+        m_calorieRate.setStateClass(MqttSensor::StateClass::MEASUREMENT);
+        m_calorieRate.setIcon("mdi:fire");
+        m_calorieRate.setValueTemplate("{{ value_json.kcal_h }}");
+
         m_state.setValueTemplate("{{ value_json.state }}");
         m_state.setIcon("mdi:state-machine");
 
         m_autoreconnectSwitch.setEntityType(EntityCategory::CONFIG);
         m_autoreconnectSwitch.setIcon("mdi:autorenew");
 
+        m_telemetrySwitch.setEntityType(EntityCategory::CONFIG);
+        m_telemetrySwitch.setIcon("mdi:chart-timeline-variant");
+        m_telemetryBatchSize.setEntityType(EntityCategory::CONFIG);
+        m_telemetryBatchSize.setMin(1.0f);
+        m_telemetryBatchSize.setMax(TELEMETRY_MAX_BATCH);
+        m_telemetryBatchSize.setStep(1.0f);
+        m_telemetryBatchSize.setIcon("mdi:package-variant");
+        m_telemetryInterval.setEntityType(EntityCategory::CONFIG);
+        m_telemetryInterval.setUnit("ms");
+        m_telemetryInterval.setMin(TELEMETRY_MIN_FLUSH_MS);
+        m_telemetryInterval.setMax(TELEMETRY_MAX_FLUSH_MS);
+        m_telemetryInterval.setStep(100.0f);
+        m_telemetryInterval.setIcon("mdi:timer-sync-outline");
+
         m_maxSpeed.setCustomStateTopic(m_state.getStateTopic());
         m_maxSpeed.setEntityType(EntityCategory::DIAGNOSTIC);
         m_maxSpeed.setUnit("km/h");
@@ -87,6 +244,112 @@ public:
         m_firmware.setValueTemplate("{{ value_json.fw }}");
         m_firmware.setIcon("mdi:chip");
 
+        const char *latencyTopic = m_parseLatency.p50.getStateTopic();
+        m_parseLatency.configure(latencyTopic, LATENCY_PARSE_TEMPLATES);
+        m_publishLatency.configure(latencyTopic, LATENCY_PUBLISH_TEMPLATES);
+        m_commandLatency.configure(latencyTopic, LATENCY_COMMAND_TEMPLATES);
+        m_dispatchLatency.configure(latencyTopic, LATENCY_DISPATCH_TEMPLATES);
+        m_latencyResetBtn.setEntityType(EntityCategory::DIAGNOSTIC);
+        m_latencyResetBtn.setIcon("mdi:timer-refresh-outline");
+        m_frameRate.setCustomStateTopic(latencyTopic);
+        m_frameRate.setEntityType(EntityCategory::DIAGNOSTIC);
+        m_frameRate.setUnit("Hz");
+        m_frameRate.setStateClass(MqttSensor::StateClass::MEASUREMENT);
+        m_frameRate.setIcon("mdi:swap-vertical");
+        m_frameRate.setValueTemplate("{{ value_json.throughput.frames_hz }}");
+        m_publishRate.setCustomStateTopic(latencyTopic);
+        m_publishRate.setEntityType(EntityCategory::DIAGNOSTIC);
+        m_publishRate.setUnit("Hz");
+        m_publishRate.setStateClass(MqttSensor::StateClass::MEASUREMENT);
+        m_publishRate.setIcon("mdi:upload-outline");
+        m_publishRate.setValueTemplate("{{ value_json.throughput.published_hz }}");
+
+        // connection parameters and the MQTT round trip by link mode share one state topic
+        const char *linkTopic = m_linkMode.getStateTopic();
+        MqttSensor *linkSensors[] = {&m_linkMode, &m_connInterval, &m_connLatency, &m_rttActiveP50, &m_rttActiveP99, &m_rttIdleP50, &m_rttIdleP99};
+        const char *const linkTemplates[] = {"{{ value_json.mode }}", "{{ value_json.interval_ms }}", "{{ value_json.latency }}",
+                                             "{{ value_json.rtt.active.p50 }}", "{{ value_json.rtt.active.p99 }}",
+                                             "{{ value_json.rtt.idle.p50 }}", "{{ value_json.rtt.idle.p99 }}"};
+        for (size_t i = 0; i < sizeof(linkSensors) / sizeof(linkSensors[0]); ++i)
+        {
+            linkSensors[i]->setCustomStateTopic(linkTopic);
+            linkSensors[i]->setEntityType(EntityCategory::DIAGNOSTIC);
+            linkSensors[i]->setValueTemplate(linkTemplates[i]);
+            if (i >= 3)
+            {
+                linkSensors[i]->setUnit("µs");
+                linkSensors[i]->setStateClass(MqttSensor::StateClass::MEASUREMENT);
+                linkSensors[i]->setIcon("mdi:swap-horizontal");
+            }
+        }
+        m_linkMode.setIcon("mdi:bluetooth-settings");
+        m_connInterval.setUnit("ms");
+        m_connInterval.setStateClass(MqttSensor::StateClass::MEASUREMENT);
+        m_connInterval.setIcon("mdi:bluetooth-connect");
+        m_connLatency.setStateClass(MqttSensor::StateClass::MEASUREMENT);
+        m_connLatency.setIcon("mdi:bluetooth-connect");
+
+        // presence scan and connect attempts share one state topic
+        const char *presenceTopic = m_advertsSeen.getStateTopic();
+        MqttSensor *presenceSensors[] = {&m_advertsSeen, &m_connectAttempts, &m_connectFailures, &m_scanDutyCycle, &m_scanningPercent};
+        const char *const presenceTemplates[] = {"{{ value_json.adverts }}", "{{ value_json.attempts }}", "{{ value_json.failures }}",
+                                                 "{{ value_json.duty_cycle }}", "{{ value_json.scanning }}"};
+        for (size_t i = 0; i < sizeof(presenceSensors) / sizeof(presenceSensors[0]); ++i)
+        {
+            presenceSensors[i]->setCustomStateTopic(presenceTopic);
+            presenceSensors[i]->setEntityType(EntityCategory::DIAGNOSTIC);
+            presenceSensors[i]->setValueTemplate(presenceTemplates[i]);
+            presenceSensors[i]->setIcon("mdi:radar");
+            // counters restart with the bridge
+            presenceSensors[i]->setStateClass(i < 3 ? MqttSensor::StateClass::TOTAL_INCREASING : MqttSensor::StateClass::MEASUREMENT);
+        }
+        m_scanDutyCycle.setUnit("%");
+        m_scanningPercent.setUnit("%");
+
+        // loop and resource profile share one state topic
+        const char *profileTopic = m_loopMax.getStateTopic();
+        MqttSensor *profileSensors[] = {&m_loopMax, &m_loopStalls, &m_lastStall, &m_heapFree, &m_heapMin, &m_heapLargestBlock, &m_heapFragmentation, &m_stackMin, &m_outboxDepth, &m_outboxDropped};
+        for (MqttSensor *sensor : profileSensors)
+        {
+            sensor->setCustomStateTopic(profileTopic);
+            sensor->setEntityType(EntityCategory::DIAGNOSTIC);
+        }
+        m_loopMax.setUnit("ms");
+        m_loopMax.setStateClass(MqttSensor::StateClass::MEASUREMENT);
+        m_loopMax.setIcon("mdi:timer-alert-outline");
+        m_loopMax.setValueTemplate("{{ value_json.loop_max_ms }}");
+        m_loopStalls.setStateClass(MqttSensor::StateClass::MEASUREMENT);
+        m_loopStalls.setIcon("mdi:car-brake-alert");
+        m_loopStalls.setValueTemplate("{{ value_json.stalls }}");
+        m_lastStall.setIcon("mdi:map-marker-alert-outline");
+        m_lastStall.setValueTemplate("{{ value_json.last_stall }}");
+        m_heapFree.setUnit("B");
+        m_heapFree.setStateClass(MqttSensor::StateClass::MEASUREMENT);
+        m_heapFree.setIcon("mdi:memory");
+        m_heapFree.setValueTemplate("{{ value_json.heap_free }}");
+        m_heapMin.setUnit("B");
+        m_heapMin.setStateClass(MqttSensor::StateClass::MEASUREMENT);
+        m_heapMin.setIcon("mdi:memory");
+        m_heapMin.setValueTemplate("{{ value_json.heap_min }}");
+        m_heapLargestBlock.setUnit("B");
+        m_heapLargestBlock.setStateClass(MqttSensor::StateClass::MEASUREMENT);
+        m_heapLargestBlock.setIcon("mdi:memory");
+        m_heapLargestBlock.setValueTemplate("{{ value_json.heap_largest }}");
+        m_heapFragmentation.setUnit("%");
+        m_heapFragmentation.setStateClass(MqttSensor::StateClass::MEASUREMENT);
+        m_heapFragmentation.setIcon("mdi:puzzle-outline");
+        m_heapFragmentation.setValueTemplate("{{ value_json.heap_frag }}");
+        m_stackMin.setUnit("B");
+        m_stackMin.setStateClass(MqttSensor::StateClass::MEASUREMENT);
+        m_stackMin.setIcon("mdi:layers-outline");
+        m_stackMin.setValueTemplate("{{ value_json.stack_min }}");
+        m_outboxDepth.setStateClass(MqttSensor::StateClass::MEASUREMENT);
+        m_outboxDepth.setIcon("mdi:tray-full");
+        m_outboxDepth.setValueTemplate("{{ value_json.outbox.depth }}");
+        m_outboxDropped.setStateClass(MqttSensor::StateClass::TOTAL_INCREASING);
+        m_outboxDropped.setIcon("mdi:tray-remove");
+        m_outboxDropped.setValueTemplate("{{ value_json.outbox.dropped }}");
+
         m_pauseBtn.setIcon("mdi:play-pause");
     }
 
@@ -110,28 +373,170 @@ public:
         return m_autoreconnectSwitch;
     }
 
-    void publishAllConfigs()
+    const MqttSwitch &getTelemetrySwitch() const
+    {
+        return m_telemetrySwitch;
+    }
+
+    const MqttNumber &getTelemetryBatchSize() const
+    {
+        return m_telemetryBatchSize;
+    }
+
+    const MqttNumber &getTelemetryInterval() const
+    {
+        return m_telemetryInterval;
+    }
+
+    const MqttButton &getLatencyResetButton() const
     {
-        // Controls
-        publishConfig(m_pauseBtn);
-        publishConfig(m_speed);
+        return m_latencyResetBtn;
+    }
 
-        // Sensors
-        publishConfig(m_speedFeedback);
-        publishConfig(m_state);
-        publishConfig(m_distance);
-        publishConfig(m_duration);
-        publishConfig(m_calories);
+    // Renders all discovery messages once, call after the device is fully
+    // configured (e.g. configuration url). With deviceDiscovery all entities are
+    // announced in a single device-level message.
+    void buildDiscoveryCache(bool deviceDiscovery)
+    {
+        MqttEntity *entities[] = {
+            // Controls
+            &m_pauseBtn,
+            &m_speed,
+
+            // Sensors
+            &m_speedFeedback,
+            &m_state,
+            &m_distance,
+            &m_duration,
+            &m_calories,
+            &m_pace,
+            &m_windowSpeed,
+            &m_averageSpeed,
+            &m_splits,
+            &m_lastSplit,
+            &m_bestSplit,
+            &m_calorieRate,
+
+            // TODO: steps are actually not implemented in this type of treadmill
+            // &m_steps,
+
+            // Configuration
+            &m_autoreconnectSwitch,
+
+            // Diagnostics
+            &m_maxSpeed,
+            &m_firmware,
+            &m_parseLatency.p50,
+            &m_parseLatency.p95,
+            &m_parseLatency.p99,
+            &m_parseLatency.max,
+            &m_publishLatency.p50,
+            &m_publishLatency.p95,
+            &m_publishLatency.p99,
+            &m_publishLatency.max,
+            &m_commandLatency.p50,
+            &m_commandLatency.p95,
+            &m_commandLatency.p99,
+            &m_commandLatency.max,
+            &m_latencyResetBtn,
+            &m_frameRate,
+            &m_publishRate,
+            &m_linkMode,
+            &m_connInterval,
+            &m_connLatency,
+            &m_advertsSeen,
+            &m_connectAttempts,
+            &m_connectFailures,
+            &m_scanDutyCycle,
+            &m_scanningPercent,
+        };
+        // announced by the first treadmill of the bridge only
+        MqttEntity *bridgeEntities[] = {
+            &m_telemetrySwitch,
+            &m_telemetryBatchSize,
+            &m_telemetryInterval,
+            &m_dispatchLatency.p50,
+            &m_dispatchLatency.p95,
+            &m_dispatchLatency.p99,
+            &m_dispatchLatency.max,
+            &m_rttActiveP50,
+            &m_rttActiveP99,
+            &m_rttIdleP50,
+            &m_rttIdleP99,
+            &m_loopMax,
+            &m_loopStalls,
+            &m_lastStall,
+            &m_heapFree,
+            &m_heapMin,
+            &m_heapLargestBlock,
+            &m_heapFragmentation,
+            &m_stackMin,
+            &m_outboxDepth,
+            &m_outboxDropped,
+        };
+        const size_t entityCount = sizeof(entities) / sizeof(entities[0]);
+        const size_t bridgeCount = sizeof(bridgeEntities) / sizeof(bridgeEntities[0]);
+        MqttEntity *selected[entityCount + bridgeCount];
+        memcpy(selected, entities, sizeof(entities));
+        size_t count = entityCount;
+        if (m_bridgeEntities)
+        {
+            memcpy(selected + count, bridgeEntities, sizeof(bridgeEntities));
+            count += bridgeCount;
+        }
+        if (!m_discovery.build(selected, count, m_deviceId.c_str(), deviceDiscovery))
+        {
+            log_e("Failed to build the discovery cache");
+        }
+    }
 
-        // TODO: steps are actually not implemented in this type of treadmill
-        // publishConfig(m_steps);
+    // Starts publishing the cached discovery messages, paced by handleDiscovery()
+    void publishAllConfigs(unsigned long delayMs = 0)
+    {
+        m_discoveryIndex = 0;
+        m_discoveryPending = true;
+        m_nextDiscoveryPublish = millis() + delayMs;
+    }
 
-        // Configuration
-        publishConfig(m_autoreconnectSwitch);
+    // Publishes the next discovery message when it is due. Returns true once,
+    // when all messages went out and the broker had time to process them, which
+    // is when the state should be republished.
+    bool handleDiscovery(unsigned long now)
+    {
+        if (!m_discoveryPending || (long)(now - m_nextDiscoveryPublish) < 0)
+        {
+            return false;
+        }
+        if (m_discoveryIndex >= m_discovery.getMessageCount())
+        {
+            m_discoveryPending = false;
+            return true;
+        }
 
-        // Diagnostics
-        publishConfig(m_maxSpeed);
-        publishConfig(m_firmware);
+        size_t index = m_discoveryIndex++;
+        const char *topic = m_discovery.getTopic(index);
+        size_t length = m_discovery.getPayloadLength(index);
+        // large device messages are streamed by the transport, no bigger client buffer needed
+        if (!m_transport->publish(topic, (const uint8_t *)m_discovery.getPayload(index), length, false))
+        {
+            log_e("Failed to publish config to %s", topic);
+        }
+
+        bool last = m_discoveryIndex >= m_discovery.getMessageCount();
+        // give mqtt broker some time to process all config messages
+        m_nextDiscoveryPublish = now + (last ? DISCOVERY_SETTLE_MS : DISCOVERY_PACE_MS);
+        return false;
+    }
+
+    // Time until handleDiscovery() has work to do
+    uint32_t getMsUntilDiscovery(unsigned long now) const
+    {
+        if (!m_discoveryPending)
+        {
+            return UINT32_MAX;
+        }
+        long remaining = (long)(m_nextDiscoveryPublish - now);
+        return remaining > 0 ? remaining : 0;
     }
 
     void publishAutoReconnectSetting(bool enabled)
@@ -146,47 +551,235 @@ public:
         }
     }
 
-    void publishState(TreadMillData data)
-    {
-        JsonDocument state;
-        state["speed_cmd"] = data.speedCmd;
-        state["speed_feedback"] = data.speedFeedback;
-        state["speed_max"] = data.speedMax;
-        state["distance_km"] = data.distanceKm;
-        state["duration_sec"] = data.durationSec;
-        state["calories"] = data.calories;
-        state["steps"] = data.steps;
-        state["fw"] = data.fwVersion;
-
-        switch (data.status)
-        {
-        case TreadMillData::COUNTDOWN:
-            state["state"] = "countdown";
-            break;
-        case TreadMillData::RUNNING:
-            state["state"] = "running";
-            break;
-        case TreadMillData::PAUSED:
-            state["state"] = "paused";
-            break;
-        case TreadMillData::STOPPED:
-            state["state"] = "stopped";
-            break;
-        case TreadMillData::DISCONNECTED:
-            state["state"] = "disconnected";
-            break;
-        default:
-            state["state"] = "unknown";
-            break;
-        }
-        String stateStr;
-        serializeJson(state, stateStr);
-        publishMqttState(m_state, stateStr.c_str());
+    void publishTelemetryConfig(const TelemetryBatcher::Config &config)
+    {
+        publishMqttState(m_telemetrySwitch, config.enabled ? m_telemetrySwitch.getOnState() : m_telemetrySwitch.getOffState());
+        char value[12];
+        snprintf(value, sizeof(value), "%u", config.batchSize);
+        publishMqttState(m_telemetryBatchSize, value);
+        snprintf(value, sizeof(value), "%u", config.flushIntervalMs);
+        publishMqttState(m_telemetryInterval, value);
+    }
+
+    const char *getStateTopic() const
+    {
+        return m_state.getStateTopic();
+    }
+
+    // State documents go through the outbox, so they survive broker outages
+    void setOutbox(MqttOutbox *outbox)
+    {
+        m_outbox = outbox;
+    }
+
+    // Selects the state encodings, msgpackTopic enables the MessagePack state
+    // on that topic. Without JSON the Home Assistant entities get no values.
+    void setStateFormats(bool json, const char *msgpackTopic)
+    {
+        m_publishJson = json;
+        m_msgpackTopic = msgpackTopic;
+    }
+
+    // Returns true if the state was published right away, false if it failed or waits in the outbox
+    bool publishState(const TreadMillData &data)
+    {
+        bool published = false;
+        // the binary state has no outbox, it is skipped while the broker is gone
+        if (m_msgpackTopic != nullptr && m_transport->connected())
+        {
+            uint8_t packed[STATE_MSGPACK_MAX_LENGTH];
+            size_t packedLength = serializeStateMsgPack(data, packed, sizeof(packed));
+            published = packedLength > 0 && m_transport->publish(m_msgpackTopic, packed, packedLength, false);
+            if (!published)
+            {
+                log_e("Failed to publish state to %s", m_msgpackTopic);
+            }
+        }
+        if (!m_publishJson)
+        {
+            return published;
+        }
+
+        char stateStr[STATE_JSON_MAX_LENGTH];
+        size_t length = serializeState(data, stateStr, sizeof(stateStr));
+        if (length == 0)
+        {
+            log_e("State document does not fit into %d bytes", STATE_JSON_MAX_LENGTH);
+            return false;
+        }
+        if (m_outbox)
+        {
+            return m_outbox->push(stateStr, length);
+        }
+        return publishMqttState(m_state, stateStr);
+    }
+
+    // Derived metrics are recomputed from the next frame, so they skip the outbox
+    // and are not published while the broker is gone
+    void publishMetrics(const WorkoutMetricsSnapshot &metrics)
+    {
+        if (!m_transport->connected())
+        {
+            return;
+        }
+        char payload[256];
+        snprintf(payload, sizeof(payload),
+                 "{\"pace_s\":%u,\"speed_1min\":%u.%03u,\"speed_avg\":%u.%03u,\"splits\":%u,"
+                 "\"split_last_s\":%u,\"split_best_s\":%u,\"split_current_s\":%u,\"kcal_h\":%u}",
+                 metrics.paceSecPerKm,
+                 metrics.windowSpeedMilli / 1000, metrics.windowSpeedMilli % 1000,
+                 metrics.averageSpeedMilli / 1000, metrics.averageSpeedMilli % 1000,
+                 metrics.splitCount, (metrics.lastSplitMs + 500) / 1000, (metrics.bestSplitMs + 500) / 1000,
+                 metrics.currentSplitMs / 1000, metrics.calorieRate);
+        publishMqttState(m_pace, payload);
+    }
+
+    // commands holds the enqueue-to-ack stats per TreadmillSession::CommandKind
+    void publishLatency(const LatencyHistogram &parse, const LatencyHistogram &publish, const LatencyHistogram &command, const LatencyHistogram &dispatch,
+                        const CommandLatency *commands, const DeviceThroughput &throughput)
+    {
+        const LatencyHistogram *histograms[] = {&parse, &publish, &command, &dispatch};
+        const char *names[] = {"parse", "publish", "command", "dispatch"};
+        const char *kindNames[TreadmillSession::KIND_COUNT] = {"speed", "start", "pause", "stop"};
+        char payload[1024];
+        size_t length = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            length += snprintf(payload + length, sizeof(payload) - length,
+                               "%s\"%s\":{\"p50\":%u,\"p95\":%u,\"p99\":%u,\"max\":%u,\"n\":%u}",
+                               i == 0 ? "{" : ",", names[i],
+                               histograms[i]->percentile(50), histograms[i]->percentile(95),
+                               histograms[i]->percentile(99), histograms[i]->getMax(), histograms[i]->getCount());
+        }
+        for (int kind = 0; kind < TreadmillSession::KIND_COUNT; ++kind)
+        {
+            const CommandLatency &latency = commands[kind];
+            length += snprintf(payload + length, sizeof(payload) - length,
+                               "%s\"%s\":{\"n\":%u,\"failed\":%u,\"last\":%u,\"avg\":%u,\"max\":%u}",
+                               kind == 0 ? ",\"commands\":{" : ",", kindNames[kind],
+                               latency.count, latency.failed, latency.lastUs, latency.getAverageUs(), latency.maxUs);
+        }
+        length += snprintf(payload + length, sizeof(payload) - length, "}");
+        // rates in mHz, shown with two decimals
+        uint32_t frameRate = throughput.intervalMs ? (uint64_t)throughput.frames * 1000000 / throughput.intervalMs : 0;
+        uint32_t publishRate = throughput.intervalMs ? (uint64_t)throughput.published * 1000000 / throughput.intervalMs : 0;
+        snprintf(payload + length, sizeof(payload) - length,
+                 ",\"throughput\":{\"frames\":%u,\"published\":%u,\"frames_hz\":%u.%02u,\"published_hz\":%u.%02u}}",
+                 throughput.frames, throughput.published, frameRate / 1000, frameRate % 1000 / 10,
+                 publishRate / 1000, publishRate % 1000 / 10);
+        publishMqttState(m_parseLatency.p50, payload);
+    }
+
+    // Presence scan and connect attempts of the treadmill, also while it is switched off
+    void publishPresence(const PresenceStats &stats)
+    {
+        char payload[160];
+        snprintf(payload, sizeof(payload),
+                 "{\"adverts\":%u,\"attempts\":%u,\"failures\":%u,\"duty_cycle\":%u,\"scanning\":%u}",
+                 stats.advertsSeen, stats.connectAttempts, stats.connectFailures, stats.configuredDutyCycle,
+                 stats.scanningPercent);
+        publishMqttState(m_advertsSeen, payload);
+    }
+
+    // Connection parameters the treadmill accepted; rtt adds the MQTT round
+    // trip by link mode on the device that shows the bridge diagnostics
+    void publishLink(const LinkStatus &link, const RoundTripProbe *rtt)
+    {
+        char payload[448];
+        // interval in hundredths of ms
+        uint32_t interval = link.interval * 125;
+        size_t length = snprintf(payload, sizeof(payload),
+                                 "{\"mode\":\"%s\",\"interval_ms\":%u.%02u,\"latency\":%u,\"timeout_ms\":%u,\"requests\":%u,\"rejected\":%u,\"timeouts\":%u",
+                                 linkModeName(link.mode), interval / 100, interval % 100, link.latency, link.timeout * 10,
+                                 link.requests, link.rejected, link.timeouts);
+        if (rtt != nullptr)
+        {
+            for (int mode = 0; mode < LINK_MODE_COUNT && length < sizeof(payload); ++mode)
+            {
+                const LatencyHistogram &histogram = rtt->getRoundTrip((LinkMode)mode);
+                length += snprintf(payload + length, sizeof(payload) - length,
+                                   "%s\"%s\":{\"p50\":%u,\"p99\":%u,\"max\":%u,\"n\":%u}",
+                                   mode == 0 ? ",\"rtt\":{" : ",", linkModeName((LinkMode)mode),
+                                   histogram.percentile(50), histogram.percentile(99), histogram.getMax(), histogram.getCount());
+            }
+            if (length < sizeof(payload))
+            {
+                length += snprintf(payload + length, sizeof(payload) - length, ",\"lost\":%u}", rtt->getLost());
+            }
+        }
+        if (length < sizeof(payload))
+        {
+            snprintf(payload + length, sizeof(payload) - length, "}");
+        }
+        publishMqttState(m_linkMode, payload);
+    }
+
+    // Publishes loop timing of the current window, heap and per task stack
+    // headroom. resetStall names the section a watchdog reset happened in, if any.
+    void publishProfile(const LoopProfiler &profiler, const ResourceSnapshot &resources, const char *resetStall)
+    {
+        char lastStall[48];
+        if (resetStall != nullptr)
+        {
+            snprintf(lastStall, sizeof(lastStall), "%s (watchdog reset)", resetStall);
+        }
+        else if (profiler.getStalls() > 0)
+        {
+            snprintf(lastStall, sizeof(lastStall), "%s (%u ms)", loopSectionName(profiler.getLastStallSection()), profiler.getLastStallUs() / 1000);
+        }
+        else
+        {
+            snprintf(lastStall, sizeof(lastStall), "none");
+        }
+
+        const TaskStackUsage *tightest = resources.getTightestStack();
+        char payload[704];
+        size_t length = snprintf(payload, sizeof(payload),
+                                 "{\"loop_max_ms\":%u,\"loop_avg_us\":%u,\"loops\":%u,\"stalls\":%u,\"last_stall\":\"%s\","
+                                 "\"heap_free\":%u,\"heap_min\":%u,\"heap_largest\":%u,\"heap_frag\":%u,\"psram_free\":%u,"
+                                 "\"stack_min\":%u,\"stack_min_task\":\"%s\",\"stacks\":{",
+                                 profiler.getMaxIterationUs() / 1000, profiler.getAverageIterationUs(), profiler.getIterations(),
+                                 profiler.getStalls(), lastStall,
+                                 resources.freeHeap, resources.minFreeHeap, resources.largestFreeBlock, resources.fragmentationPercent,
+                                 resources.freePsram,
+                                 tightest ? tightest->freeBytes : 0, tightest ? tightest->name : "");
+        bool first = true;
+        for (size_t i = 0; i < resources.taskCount && length < sizeof(payload); ++i)
+        {
+            if (resources.tasks[i].freeBytes == UINT32_MAX)
+            {
+                continue;
+            }
+            length += snprintf(payload + length, sizeof(payload) - length, "%s\"%s\":%u",
+                               first ? "" : ",", resources.tasks[i].name, resources.tasks[i].freeBytes);
+            first = false;
+        }
+        if (length < sizeof(payload))
+        {
+            length += snprintf(payload + length, sizeof(payload) - length, "}");
+        }
+        if (m_outbox && length < sizeof(payload))
+        {
+            const OutboxStats &outbox = m_outbox->getStats();
+            length += snprintf(payload + length, sizeof(payload) - length,
+                               ",\"outbox\":{\"depth\":%u,\"queued\":%u,\"replayed\":%u,\"spilled\":%u,\"overflows\":%u,\"dropped\":%u}",
+                               outbox.depth, outbox.queued, outbox.replayed, outbox.spilled, outbox.overflows, outbox.dropped);
+        }
+        if (length < sizeof(payload))
+        {
+            snprintf(payload + length, sizeof(payload) - length, "}");
+        }
+        publishMqttState(m_loopMax, payload);
     }
 
 private:
-    PubSubClient *m_client;
+    MqttTransport *m_transport;
+    MqttOutbox *m_outbox = nullptr;
+    bool m_publishJson = true;
+    const char *m_msgpackTopic = nullptr;
 
+    String m_deviceId;
+    bool m_bridgeEntities;
     MqttDevice m_device;
 
     // Controls
@@ -201,36 +794,69 @@ private:
     MqttSensor m_state;
 
     MqttSensor m_steps;
+    MqttSensor m_pace;
+    MqttSensor m_windowSpeed;
+    MqttSensor m_averageSpeed;
+    MqttSensor m_splits;
+    MqttSensor m_lastSplit;
+    MqttSensor m_bestSplit;
+    MqttSensor m_calorieRate;
 
     // Configuration
 
     MqttSwitch m_autoreconnectSwitch;
+    MqttSwitch m_telemetrySwitch;
+    MqttNumber m_telemetryBatchSize;
+    MqttNumber m_telemetryInterval;
 
     // Diagnostics
     MqttSensor m_maxSpeed;
     MqttSensor m_firmware;
-
-    void publishConfig(MqttEntity &entity)
-    {
-        String payload = entity.getHomeAssistantConfigPayload();
-        char topic[255];
-        entity.getHomeAssistantConfigTopic(topic, sizeof(topic));
-        if (!m_client->publish(topic, payload.c_str()))
-        {
-            log_e("Failed to publish config to %s", entity.getStateTopic());
-        }
-        entity.getHomeAssistantConfigTopicAlt(topic, sizeof(topic));
-        if (!m_client->publish(topic, payload.c_str()))
-        {
-            log_e("Failed to publish config to %s", entity.getStateTopic());
-        }
-    }
-
-    void publishMqttState(const MqttEntity &entity, const char *state)
+    LatencySensors m_parseLatency;
+    LatencySensors m_publishLatency;
+    LatencySensors m_commandLatency;
+    LatencySensors m_dispatchLatency;
+    MqttButton m_latencyResetBtn;
+    MqttSensor m_frameRate;
+    MqttSensor m_publishRate;
+    MqttSensor m_linkMode;
+    MqttSensor m_connInterval;
+    MqttSensor m_connLatency;
+    MqttSensor m_advertsSeen;
+    MqttSensor m_connectAttempts;
+    MqttSensor m_connectFailures;
+    MqttSensor m_scanDutyCycle;
+    MqttSensor m_scanningPercent;
+    MqttSensor m_rttActiveP50;
+    MqttSensor m_rttActiveP99;
+    MqttSensor m_rttIdleP50;
+    MqttSensor m_rttIdleP99;
+    MqttSensor m_loopMax;
+    MqttSensor m_loopStalls;
+    MqttSensor m_lastStall;
+    MqttSensor m_heapFree;
+    MqttSensor m_heapMin;
+    MqttSensor m_heapLargestBlock;
+    MqttSensor m_heapFragmentation;
+    MqttSensor m_stackMin;
+    MqttSensor m_outboxDepth;
+    MqttSensor m_outboxDropped;
+
+    DiscoveryCache m_discovery;
+    size_t m_discoveryIndex = 0;
+    bool m_discoveryPending = false;
+    unsigned long m_nextDiscoveryPublish = 0;
+
+    const uint32_t DISCOVERY_PACE_MS = 20;
+    const uint32_t DISCOVERY_SETTLE_MS = 200;
+
+    bool publishMqttState(const MqttEntity &entity, const char *state)
     {
-        if (!m_client->publish(entity.getStateTopic(), state))
+        if (!m_transport->publish(entity.getStateTopic(), state))
         {
             log_e("Failed to publish state to %s", entity.getStateTopic());
+            return false;
         }
+        return true;
     }
 };
\ No newline at end of file
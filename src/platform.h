@@ -19,6 +19,13 @@
 //  CHARACTERISTIC: 0000fba2-0000-1000-8000-00805f9b34fb [read,notify]
 #define CHARACTERISTIC_NOTIFY_STATE_UUID "0000fba2-0000-1000-8000-00805f9b34fb"
 
+// treadmills served by one bridge, bounded by the connections NimBLE is built for
+#ifdef CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+#define TREADMILL_MAX_DEVICES CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+#else
+#define TREADMILL_MAX_DEVICES 3
+#endif
+
 // Declare strings as extern to avoid multiple-definition linker errors
 extern const char* HOMEASSISTANT_STATUS_TOPIC;
 extern const char* HOMEASSISTANT_STATUS_TOPIC_ALT;
@@ -35,13 +42,15 @@ public:
         DISCONNECTED = 100, // Internal state, don't use for treadmill communication
     };
 
-    float speedCmd = 0.0;
-    float speedFeedback = 0.0;
-    float speedMax = 0.0;
-    float distanceKm = 0.0;
+    // all values are kept in the integer milli-units reported by the treadmill
+    uint16_t speedCmdMilli = 0;      // km/h * 1000
+    uint16_t speedFeedbackMilli = 0; // km/h * 1000
+    uint16_t speedMaxMilli = 0;      // km/h * 1000
+    uint32_t distanceMilli = 0;      // km * 1000
     uint16_t calories = 0;
     uint32_t steps = 0;
-    uint32_t durationSec = 0;
+    uint32_t durationMs = 0;
     uint8_t fwVersion = 0;
     Status status = DISCONNECTED; // default to DISCONNECTED when we start up
+    uint32_t receivedUs = 0;      // micros() when the notification arrived, for latency tracking
 };
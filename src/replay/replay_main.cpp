@@ -0,0 +1,160 @@
+// Replays a notification trace (experiment/experiment.py --capture) through
+// the frame decoder, parser, publish policy and state serializer. The state
+// messages that would be published go to stdout or --out, one per line with
+// the trace time in ms, so two firmware versions can be diffed on real data.
+//   pio run -e replay && .pio/build/replay/program session.pktr --speed=max
+#include <Arduino.h>
+#include <string>
+#include <vector>
+
+#include "TraceFormat.h"
+#include "TreadmillProtocol.h"
+#include "TreadmillSession.h"
+#include "PublishPolicy.h"
+#include "StateSerializer.h"
+#include "WorkoutMetrics.h"
+
+static void printUsage()
+{
+    fprintf(stderr, "usage: program <trace> [--speed=max|N] [--out=file] [--publish-all]\n");
+}
+
+static bool readFile(const char *path, std::vector<uint8_t> &content)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+    {
+        return false;
+    }
+    uint8_t buffer[4096];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        content.insert(content.end(), buffer, buffer + read);
+    }
+    fclose(file);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    const char *tracePath = nullptr;
+    const char *outPath = nullptr;
+    double speed = 0; // 0 replays as fast as possible
+    bool publishAll = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strncmp(argv[i], "--speed=", 8) == 0)
+            speed = strcmp(argv[i] + 8, "max") == 0 ? 0 : atof(argv[i] + 8);
+        else if (strncmp(argv[i], "--out=", 6) == 0)
+            outPath = argv[i] + 6;
+        else if (strcmp(argv[i], "--publish-all") == 0)
+            publishAll = true;
+        else if (argv[i][0] != '-' && tracePath == nullptr)
+            tracePath = argv[i];
+        else
+        {
+            printUsage();
+            return 1;
+        }
+    }
+    if (tracePath == nullptr)
+    {
+        printUsage();
+        return 1;
+    }
+
+    std::vector<uint8_t> trace;
+    if (!readFile(tracePath, trace))
+    {
+        fprintf(stderr, "Cannot read %s\n", tracePath);
+        return 1;
+    }
+    TraceReader reader(trace.data(), trace.size());
+    if (!reader.isValid())
+    {
+        fprintf(stderr, "%s is not a version %d trace\n", tracePath, TRACE_VERSION);
+        return 1;
+    }
+    FILE *out = outPath ? fopen(outPath, "w") : stdout;
+    if (!out)
+    {
+        fprintf(stderr, "Cannot write %s\n", outPath);
+        return 1;
+    }
+
+    StatusFrameDecoder decoder;
+    PublishPolicy policy;
+    WorkoutMetrics metrics;
+    uint32_t notifications = 0;
+    uint32_t otherRecords = 0;
+    uint32_t messages = 0;
+    uint64_t lastFrameUs = 0;
+    uint64_t traceEndUs = 0;
+    char state[STATE_JSON_MAX_LENGTH];
+
+    // the policy and the data timeout run on trace time, so the output does not depend on the replay speed
+    auto publish = [&](const TreadMillData &data, uint64_t timeUs)
+    {
+        unsigned long nowMs = timeUs / 1000;
+        if (!publishAll && !policy.shouldPublish(data, nowMs))
+        {
+            return;
+        }
+        if (serializeState(data, state, sizeof(state)) > 0)
+        {
+            fprintf(out, "%lu\t%s\n", nowMs, state);
+            messages++;
+        }
+    };
+
+    auto wallStart = std::chrono::steady_clock::now();
+    TreadMillData lastData;
+    TraceRecord record;
+    while (reader.next(record))
+    {
+        traceEndUs = record.timeUs;
+        if (speed > 0)
+        {
+            std::this_thread::sleep_until(wallStart + std::chrono::microseconds((uint64_t)(record.timeUs / speed)));
+        }
+        if (record.channel != TRACE_CHANNEL_STATE)
+        {
+            otherRecords++;
+            continue;
+        }
+        notifications++;
+
+        uint64_t timeoutUs = (uint64_t)TreadmillSession::CONNECTION_TIMEOUT * 1000000;
+        if (lastFrameUs && record.timeUs - lastFrameUs > timeoutUs)
+        {
+            lastData.status = TreadMillData::DISCONNECTED;
+            publish(lastData, lastFrameUs + timeoutUs);
+        }
+        decoder.feed(record.data, record.length, [&](const uint8_t *frame)
+                     {
+            TreadmillProtocol::parseStatus(frame, STATUS_FRAME_LENGTH, lastData);
+            lastFrameUs = record.timeUs;
+            metrics.onData(lastData);
+            publish(lastData, record.timeUs); });
+    }
+    double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    if (outPath)
+    {
+        fclose(out);
+    }
+
+    const FrameDecoderStats &stats = decoder.getStats();
+    fprintf(stderr, "Trace:   %.1f s, %u notifications, %u records on other channels%s\n",
+            traceEndUs / 1e6, notifications, otherRecords, reader.isTruncated() ? ", truncated" : "");
+    fprintf(stderr, "Decoder: %u frames, %u checksum failures, %u resyncs, %u reassembled\n",
+            stats.frames, stats.checksumFailures, stats.resyncs, stats.partialFrames);
+    fprintf(stderr, "Output:  %u state messages\n", messages);
+    const WorkoutMetricsSnapshot &snapshot = metrics.get();
+    fprintf(stderr, "Metrics: %u.%03u km/h average, %u splits of %u m, best %u s, last %u s\n",
+            snapshot.averageSpeedMilli / 1000, snapshot.averageSpeedMilli % 1000, snapshot.splitCount,
+            metrics.getSplitDistance(), snapshot.bestSplitMs / 1000, snapshot.lastSplitMs / 1000);
+    fprintf(stderr, "Replay:  %.3f s wall time, %.0f frames/s, %.1fx real time\n",
+            wallSeconds, wallSeconds > 0 ? stats.frames / wallSeconds : 0, wallSeconds > 0 ? traceEndUs / 1e6 / wallSeconds : 0);
+    return 0;
+}
@@ -0,0 +1,123 @@
+#include "LoopbackBroker.h"
+
+bool LoopbackBroker::connect()
+{
+    delay(m_config.connectDelayMs);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_connected = true;
+    m_connectedAt = millis();
+    m_stats.connects++;
+    return true;
+}
+
+void LoopbackBroker::disconnect()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_connected)
+    {
+        m_stats.disconnects++;
+    }
+    m_connected = false;
+    // clean session, the client has to subscribe again
+    m_subscriptions.clear();
+}
+
+bool LoopbackBroker::connected()
+{
+    bool expired;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        expired = m_connected && m_config.disconnectEveryMs && millis() - m_connectedAt > m_config.disconnectEveryMs;
+    }
+    if (expired)
+    {
+        disconnect();
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_connected;
+}
+
+bool LoopbackBroker::publish(const char *topic, const uint8_t *payload, size_t length, bool retained)
+{
+    if (!connected())
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.publishFailures++;
+        return false;
+    }
+    if (m_config.publishDelayUs)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(m_config.publishDelayUs));
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_lastPayloads[topic].assign((const char *)payload, length);
+    m_stats.published++;
+    m_stats.publishedBytes += length;
+    return true;
+}
+
+bool LoopbackBroker::subscribe(const char *topic, uint8_t qos)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_connected)
+    {
+        return false;
+    }
+    m_subscriptions.insert(topic);
+    return true;
+}
+
+bool LoopbackBroker::loop()
+{
+    if (!connected())
+    {
+        return false;
+    }
+    while (true)
+    {
+        std::pair<std::string, std::string> message;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_inbound.empty())
+            {
+                break;
+            }
+            message = m_inbound.front();
+            m_inbound.pop_front();
+            if (m_subscriptions.count(message.first) == 0)
+            {
+                continue;
+            }
+            m_stats.delivered++;
+        }
+        if (m_onMessage)
+        {
+            m_onMessage(message.first.c_str(), (const uint8_t *)message.second.data(), message.second.size());
+        }
+    }
+    return true;
+}
+
+void LoopbackBroker::inject(const char *topic, const char *payload)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_inbound.emplace_back(topic, payload);
+}
+
+bool LoopbackBroker::getLastPayload(const char *topic, std::string &payload)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_lastPayloads.find(topic);
+    if (it == m_lastPayloads.end())
+    {
+        return false;
+    }
+    payload = it->second;
+    return true;
+}
+
+LoopbackBrokerStats LoopbackBroker::getStats()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
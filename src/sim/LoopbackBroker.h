@@ -0,0 +1,72 @@
+#pragma once
+#include <Arduino.h>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+
+#include "MqttTransport.h"
+
+struct LoopbackBrokerConfig
+{
+    uint32_t publishDelayUs = 0;    // time a publish blocks, models a slow broker or a full tcp window
+    uint32_t connectDelayMs = 20;   // time connect() blocks
+    uint32_t disconnectEveryMs = 0; // drops the connection periodically, 0 never
+};
+
+struct LoopbackBrokerStats
+{
+    uint32_t published = 0;
+    uint64_t publishedBytes = 0;
+    uint32_t publishFailures = 0;
+    uint32_t delivered = 0;
+    uint32_t connects = 0;
+    uint32_t disconnects = 0;
+};
+
+// In-process mqtt broker stand-in for the simulator. Keeps the last payload of
+// every topic, hands injected messages to the subscriber in loop() and can be
+// made slow or flaky to test the bridge under broker trouble.
+class LoopbackBroker : public MqttTransport
+{
+public:
+    explicit LoopbackBroker(const LoopbackBrokerConfig &config)
+        : m_config(config)
+    {
+    }
+
+    bool connect();
+    void disconnect();
+
+    bool connected() override;
+    bool publish(const char *topic, const uint8_t *payload, size_t length, bool retained) override;
+    using MqttTransport::publish;
+    bool subscribe(const char *topic, uint8_t qos = 0) override;
+    bool loop() override;
+
+    // Called from loop() for messages on subscribed topics
+    void setCallback(std::function<void(const char *, const uint8_t *, size_t)> callback)
+    {
+        m_onMessage = callback;
+    }
+
+    // Queues a message from another client, safe to call from any thread
+    void inject(const char *topic, const char *payload);
+
+    // Last payload published to topic
+    bool getLastPayload(const char *topic, std::string &payload);
+
+    LoopbackBrokerStats getStats();
+
+private:
+    LoopbackBrokerConfig m_config;
+    std::mutex m_mutex;
+    bool m_connected = false;
+    unsigned long m_connectedAt = 0;
+    std::set<std::string> m_subscriptions;
+    std::map<std::string, std::string> m_lastPayloads;
+    std::deque<std::pair<std::string, std::string>> m_inbound;
+    LoopbackBrokerStats m_stats;
+    std::function<void(const char *, const uint8_t *, size_t)> m_onMessage = nullptr;
+};
@@ -0,0 +1,197 @@
+#include "VirtualTreadmill.h"
+
+#include <vector>
+
+VirtualTreadmill::VirtualTreadmill(const VirtualTreadmillConfig &config)
+    : m_config(config)
+{
+    m_state.status = TreadMillData::STOPPED;
+    m_state.speedMaxMilli = config.speedMaxMilli;
+    m_state.fwVersion = config.fwVersion;
+}
+
+VirtualTreadmill::~VirtualTreadmill()
+{
+    end();
+}
+
+void VirtualTreadmill::begin()
+{
+    if (m_running)
+    {
+        return;
+    }
+    m_running = true;
+    m_thread = std::thread(&VirtualTreadmill::run, this);
+}
+
+void VirtualTreadmill::end()
+{
+    m_running = false;
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+}
+
+bool VirtualTreadmill::writeCommand(const uint8_t *data, size_t length, bool withResponse)
+{
+    if (!m_connected)
+    {
+        return false;
+    }
+    // the ack takes a connection event or two, write without response only waits for the tx buffer
+    std::this_thread::sleep_for(std::chrono::microseconds(withResponse ? m_config.writeLatencyUs : m_config.writeLatencyUs / 10));
+
+    TreadmillProtocol::CommandType type;
+    uint16_t speed;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!TreadmillProtocol::parseCommand(data, length, type, speed))
+    {
+        m_stats.commandsRejected++;
+        return false;
+    }
+    m_stats.commandsReceived++;
+
+    switch (type)
+    {
+    case TreadmillProtocol::CMD_START_SET_SPEED:
+        if (speed > 0)
+        {
+            m_state.speedCmdMilli = speed > m_config.speedMaxMilli ? m_config.speedMaxMilli : speed;
+            if (m_state.status != TreadMillData::COUNTDOWN)
+            {
+                m_state.status = TreadMillData::RUNNING;
+            }
+        }
+        else if (m_state.status == TreadMillData::PAUSED)
+        {
+            m_state.status = TreadMillData::RUNNING;
+            m_state.speedCmdMilli = m_resumeSpeed;
+        }
+        else if (m_state.status == TreadMillData::STOPPED)
+        {
+            // a new session starts after the countdown
+            m_state.status = TreadMillData::COUNTDOWN;
+            m_state.speedCmdMilli = START_SPEED;
+            m_countdownMs = COUNTDOWN_MS;
+            m_distance = 0;
+            m_state.distanceMilli = 0;
+            m_state.steps = 0;
+            m_state.calories = 0;
+            m_state.durationMs = 0;
+        }
+        break;
+    case TreadmillProtocol::CMD_PAUSE:
+        if (m_state.status == TreadMillData::RUNNING)
+        {
+            m_resumeSpeed = m_state.speedCmdMilli;
+            m_state.status = TreadMillData::PAUSED;
+        }
+        break;
+    case TreadmillProtocol::CMD_STOP:
+        m_state.status = TreadMillData::STOPPED;
+        m_state.speedCmdMilli = 0;
+        break;
+    }
+    return true;
+}
+
+TreadMillData VirtualTreadmill::getState()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_state;
+}
+
+VirtualTreadmillStats VirtualTreadmill::getStats()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+void VirtualTreadmill::step(uint32_t elapsedMs)
+{
+    if (m_state.status == TreadMillData::COUNTDOWN)
+    {
+        if (m_countdownMs > elapsedMs)
+        {
+            m_countdownMs -= elapsedMs;
+            return;
+        }
+        m_state.status = TreadMillData::RUNNING;
+    }
+
+    uint16_t target = m_state.status == TreadMillData::RUNNING ? m_state.speedCmdMilli : 0;
+    uint32_t ramp = (uint32_t)m_config.accelMilliPerSec * elapsedMs / 1000;
+    if (m_state.speedFeedbackMilli < target)
+    {
+        m_state.speedFeedbackMilli = m_state.speedFeedbackMilli + ramp > target ? target : m_state.speedFeedbackMilli + ramp;
+    }
+    else if (m_state.speedFeedbackMilli > target)
+    {
+        m_state.speedFeedbackMilli = m_state.speedFeedbackMilli < target + ramp ? target : m_state.speedFeedbackMilli - ramp;
+    }
+
+    if (m_state.status == TreadMillData::RUNNING)
+    {
+        m_state.durationMs += elapsedMs;
+    }
+    // speed is in m/h
+    m_distance += (double)m_state.speedFeedbackMilli * elapsedMs / 3600000.0;
+    m_state.distanceMilli = (uint32_t)m_distance;
+    m_state.steps = (uint32_t)(m_distance / 0.7);
+    m_state.calories = (uint16_t)(m_distance * 0.05);
+}
+
+void VirtualTreadmill::run()
+{
+    std::vector<uint8_t> notification;
+    unsigned long last = millis();
+    auto next = std::chrono::steady_clock::now();
+    while (m_running)
+    {
+        next += std::chrono::milliseconds(m_config.frameIntervalMs);
+        std::this_thread::sleep_until(next);
+
+        uint8_t frame[STATUS_FRAME_LENGTH];
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            unsigned long now = millis();
+            step(now - last);
+            last = now;
+            TreadmillProtocol::makeStatus(m_state, frame);
+            if (m_config.corruptEvery && (m_stats.framesSent + 1) % m_config.corruptEvery == 0)
+            {
+                frame[STATUS_FRAME_LENGTH - 2] ^= 0xFF;
+                m_stats.framesCorrupted++;
+            }
+            m_stats.framesSent++;
+        }
+        if (!m_connected)
+        {
+            notification.clear();
+            continue;
+        }
+        notification.insert(notification.end(), frame, frame + STATUS_FRAME_LENGTH);
+        if (notification.size() >= m_config.framesPerNotification * STATUS_FRAME_LENGTH)
+        {
+            notifyFrames(notification.data(), notification.size());
+            notification.clear();
+        }
+    }
+}
+
+void VirtualTreadmill::notifyFrames(const uint8_t *data, size_t length)
+{
+    size_t chunk = m_config.fragmentSize ? m_config.fragmentSize : length;
+    for (size_t offset = 0; offset < length; offset += chunk)
+    {
+        size_t size = length - offset < chunk ? length - offset : chunk;
+        if (m_onNotify)
+        {
+            m_onNotify(data + offset, size);
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.notificationsSent++;
+    }
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <Arduino.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include "platform.h"
+#include "TreadmillLink.h"
+#include "TreadmillProtocol.h"
+
+struct VirtualTreadmillConfig
+{
+    uint32_t frameIntervalMs = 200;    // one status frame per interval
+    uint32_t framesPerNotification = 1; // batches several frames into one notification
+    size_t fragmentSize = 0;            // splits notifications into chunks of this size, 0 keeps them whole
+    uint32_t corruptEvery = 0;          // breaks the checksum of every nth frame, 0 never
+    uint16_t accelMilliPerSec = 500;    // speed ramp in m/h per second
+    uint32_t writeLatencyUs = 30000;    // until a write with response is acknowledged
+    uint16_t speedMaxMilli = 6000;
+    uint8_t fwVersion = 1;
+};
+
+struct VirtualTreadmillStats
+{
+    uint32_t framesSent = 0;
+    uint32_t notificationsSent = 0;
+    uint32_t framesCorrupted = 0;
+    uint32_t commandsReceived = 0;
+    uint32_t commandsRejected = 0;
+};
+
+// Stand-in for the pad: reacts to the real command frames, ramps its speed,
+// integrates distance/steps/calories and notifies 31-byte status frames from
+// its own thread, like the NimBLE host task does on the device.
+class VirtualTreadmill : public TreadmillLink
+{
+public:
+    explicit VirtualTreadmill(const VirtualTreadmillConfig &config);
+    ~VirtualTreadmill();
+
+    // Receives the notification bytes, called from the treadmill thread
+    void setNotifyCallback(std::function<void(const uint8_t *, size_t)> callback)
+    {
+        m_onNotify = callback;
+    }
+
+    void begin();
+    void end();
+
+    // Simulates the link going down or coming back
+    void setConnected(bool connected)
+    {
+        m_connected = connected;
+    }
+
+    bool isConnected() const override
+    {
+        return m_connected;
+    }
+
+    bool writeCommand(const uint8_t *data, size_t length, bool withResponse) override;
+
+    TreadMillData getState();
+    VirtualTreadmillStats getStats();
+
+private:
+    void run();
+    void step(uint32_t elapsedMs);
+    void notifyFrames(const uint8_t *data, size_t length);
+
+    VirtualTreadmillConfig m_config;
+    std::function<void(const uint8_t *, size_t)> m_onNotify = nullptr;
+
+    std::mutex m_mutex;
+    std::thread m_thread;
+    std::atomic<bool> m_running{false};
+    std::atomic<bool> m_connected{true};
+
+    TreadMillData m_state;
+    double m_distance = 0; // m, the frame only carries whole meters
+    uint32_t m_countdownMs = 0;
+    uint16_t m_resumeSpeed = 0;
+    VirtualTreadmillStats m_stats;
+
+    static const uint32_t COUNTDOWN_MS = 3000;
+    static const uint16_t START_SPEED = 1000;
+};
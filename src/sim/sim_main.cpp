@@ -0,0 +1,250 @@
+// Runs the bridge as a Linux process: the portable treadmill session, publish
+// policy and state serializer against a virtual treadmill and an in-process
+// broker. Build and run with
+//   pio run -e sim && .pio/build/sim/program --duration=60 --rate=20
+#include <Arduino.h>
+#include <condition_variable>
+#include <random>
+#include <string>
+
+#include "TreadmillSession.h"
+#include "PublishPolicy.h"
+#include "StateSerializer.h"
+#include "LatencyHistogram.h"
+#include "LoopProfiler.h"
+#include "DeferredLog.h"
+#include "VirtualTreadmill.h"
+#include "LoopbackBroker.h"
+
+static const char *STATE_TOPIC = "pacekeeper-sim/state";
+static const char *SPEED_TOPIC = "pacekeeper-sim/speed/set";
+static const uint32_t LOOP_MAX_SLEEP_MS = 1000;
+
+struct SimOptions
+{
+    uint32_t durationS = 30;
+    uint32_t commandsPerMinute = 30;
+    bool publishAll = false; // bypass the publish policy
+};
+
+// condition variable version of LoopEvents
+class SimEvents
+{
+public:
+    void notify()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending = true;
+        m_cv.notify_one();
+    }
+
+    void wait(uint32_t timeoutMs)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this]()
+                      { return m_pending; });
+        m_pending = false;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_pending = false;
+};
+
+static bool parseOption(const char *arg, const char *name, uint32_t &value)
+{
+    size_t length = strlen(name);
+    if (strncmp(arg, name, length) != 0 || arg[length] != '=')
+    {
+        return false;
+    }
+    value = strtoul(arg + length + 1, nullptr, 10);
+    return true;
+}
+
+static void printUsage()
+{
+    printf("usage: program [--duration=s] [--rate=1..1000 frames/s] [--batch=frames] [--fragment=bytes]\n"
+           "               [--corrupt-every=n] [--write-latency=us] [--commands=per min]\n"
+           "               [--broker-delay=us] [--reconnect-every=ms] [--publish-all=0|1]\n");
+}
+
+static void printLatency(const char *name, const LatencyHistogram &histogram)
+{
+    printf("  %-8s n=%-7u p50=%-7u p95=%-7u p99=%-7u max=%u us\n", name, histogram.getCount(),
+           histogram.percentile(50), histogram.percentile(95), histogram.percentile(99), histogram.getMax());
+}
+
+class StdoutLogSink : public LogSink
+{
+public:
+    void write(uint8_t, const char *line, size_t length) override
+    {
+        printf("%s\n", line);
+    }
+};
+
+int main(int argc, char **argv)
+{
+    SimOptions options;
+    VirtualTreadmillConfig treadmillConfig;
+    LoopbackBrokerConfig brokerConfig;
+    for (int i = 1; i < argc; ++i)
+    {
+        uint32_t rate = 0;
+        uint32_t fragment = 0;
+        uint32_t publishAll = 0;
+        // the frame clock ticks in whole milliseconds
+        if (parseOption(argv[i], "--rate", rate) && rate > 0 && rate <= 1000)
+            treadmillConfig.frameIntervalMs = 1000 / rate;
+        else if (parseOption(argv[i], "--fragment", fragment))
+            treadmillConfig.fragmentSize = fragment;
+        else if (parseOption(argv[i], "--publish-all", publishAll))
+            options.publishAll = publishAll != 0;
+        else if (!parseOption(argv[i], "--duration", options.durationS) &&
+                 !parseOption(argv[i], "--batch", treadmillConfig.framesPerNotification) &&
+                 !parseOption(argv[i], "--corrupt-every", treadmillConfig.corruptEvery) &&
+                 !parseOption(argv[i], "--write-latency", treadmillConfig.writeLatencyUs) &&
+                 !parseOption(argv[i], "--commands", options.commandsPerMinute) &&
+                 !parseOption(argv[i], "--broker-delay", brokerConfig.publishDelayUs) &&
+                 !parseOption(argv[i], "--reconnect-every", brokerConfig.disconnectEveryMs))
+        {
+            printUsage();
+            return 1;
+        }
+    }
+    if (treadmillConfig.framesPerNotification == 0)
+    {
+        treadmillConfig.framesPerNotification = 1;
+    }
+
+    StdoutLogSink stdoutLog;
+    DeferredLog::instance().addSink(&stdoutLog, CORE_DEBUG_LEVEL);
+
+    SimEvents events;
+    TreadmillSession session;
+    VirtualTreadmill treadmill(treadmillConfig);
+    LoopbackBroker broker(brokerConfig);
+    PublishPolicy policy;
+    LatencyHistogram publishLatency;
+    LoopProfiler profiler;
+
+    // the virtual treadmill thread plays the NimBLE host task
+    treadmill.setNotifyCallback([&session](const uint8_t *data, size_t length)
+                                { session.onNotification(data, length); });
+    session.setWakeupCallback([&events]()
+                              { events.notify(); });
+
+    session.setCallback([&](const TreadMillData &data)
+                        {
+        if (!options.publishAll && !policy.shouldPublish(data, millis()))
+        {
+            return;
+        }
+        char state[STATE_JSON_MAX_LENGTH];
+        size_t length = serializeState(data, state, sizeof(state));
+        if (length > 0 && broker.publish(STATE_TOPIC, (const uint8_t *)state, length, false))
+        {
+            publishLatency.record(micros() - data.receivedUs);
+        } });
+
+    // sender task
+    std::atomic<bool> running{true};
+    SimEvents commandEvents;
+    std::thread sender([&]()
+                       {
+        while (running)
+        {
+            commandEvents.wait(LOOP_MAX_SLEEP_MS);
+            session.sendQueuedCommands(treadmill);
+        } });
+
+    broker.setCallback([&](const char *topic, const uint8_t *payload, size_t length)
+                       {
+        unsigned long entryUs = micros();
+        if (strcmp(topic, SPEED_TOPIC) != 0)
+        {
+            return;
+        }
+        std::string value((const char *)payload, length);
+        uint16_t speed = (uint16_t)(atof(value.c_str()) * 1000);
+        TreadmillProtocol::CommandType type = speed <= 100 ? TreadmillProtocol::CMD_STOP : TreadmillProtocol::CMD_START_SET_SPEED;
+        if (session.queueCommand(type, speed > 6000 ? 6000 : speed, entryUs))
+        {
+            commandEvents.notify();
+        } });
+
+    // Home Assistant side, moves the speed slider around
+    std::thread controller([&]()
+                           {
+        std::mt19937 random(1);
+        std::uniform_int_distribution<int> speeds(10, 60);
+        uint32_t intervalMs = options.commandsPerMinute ? 60000 / options.commandsPerMinute : 0;
+        while (running && intervalMs)
+        {
+            char payload[8];
+            snprintf(payload, sizeof(payload), "%.1f", speeds(random) / 10.0);
+            broker.inject(SPEED_TOPIC, payload);
+            events.notify();
+            for (uint32_t slept = 0; running && slept < intervalMs; slept += 10)
+            {
+                delay(10);
+            }
+        } });
+
+    printf("Simulating %u s, %u frames/s, %u frames per notification, fragments of %u bytes, broker delay %u us\n",
+           options.durationS, 1000 / treadmillConfig.frameIntervalMs, treadmillConfig.framesPerNotification,
+           (unsigned)treadmillConfig.fragmentSize, brokerConfig.publishDelayUs);
+    treadmill.begin();
+
+    unsigned long startMs = millis();
+    while (millis() - startMs < options.durationS * 1000)
+    {
+        profiler.beginIteration();
+        profiler.beginSection(SECTION_MQTT_CONNECT);
+        if (!broker.connected())
+        {
+            broker.connect();
+            broker.subscribe(SPEED_TOPIC);
+            policy.invalidate();
+        }
+        profiler.beginSection(SECTION_MQTT_LOOP);
+        broker.loop();
+        profiler.beginSection(SECTION_TREADMILL);
+        session.handle();
+        profiler.endIteration();
+        DeferredLog::instance().drain();
+
+        events.wait(std::min(session.getMsUntilNextTimer(), LOOP_MAX_SLEEP_MS));
+    }
+
+    running = false;
+    commandEvents.notify();
+    controller.join();
+    sender.join();
+    treadmill.end();
+    DeferredLog::instance().drain();
+
+    float seconds = (millis() - startMs) / 1000.0f;
+    VirtualTreadmillStats treadmillStats = treadmill.getStats();
+    FrameDecoderStats decoderStats = session.getFrameDecoderStats();
+    LoopbackBrokerStats brokerStats = broker.getStats();
+    printf("\nTreadmill: %u frames (%u corrupted) in %u notifications, %u commands received, %u rejected\n",
+           treadmillStats.framesSent, treadmillStats.framesCorrupted, treadmillStats.notificationsSent,
+           treadmillStats.commandsReceived, treadmillStats.commandsRejected);
+    printf("Decoder:   %u frames, %u checksum failures, %u resyncs, %u reassembled, %u queue overflows (high water %u)\n",
+           decoderStats.frames, decoderStats.checksumFailures, decoderStats.resyncs, decoderStats.partialFrames,
+           session.getQueueOverflows(), (unsigned)session.getQueueHighWater());
+    printf("Broker:    %u publishes (%.1f/s, %llu bytes), %u failed, %u commands delivered, %u connects, %u disconnects\n",
+           brokerStats.published, brokerStats.published / seconds, (unsigned long long)brokerStats.publishedBytes,
+           brokerStats.publishFailures, brokerStats.delivered, brokerStats.connects, brokerStats.disconnects);
+    printf("Commands:  %u coalesced, %u dropped\n", session.getCommandQueue().getCoalesced(), session.getCommandQueue().getDropped());
+    printf("Loop:      %u iterations, avg %u us, max %u us, %u stalls\n", profiler.getIterations(),
+           profiler.getAverageIterationUs(), profiler.getMaxIterationUs(), profiler.getStalls());
+    printf("Latency:\n");
+    printLatency("parse", session.getParseLatency());
+    printLatency("publish", publishLatency);
+    printLatency("command", session.getCommandLatencyHistogram());
+    return 0;
+}
@@ -0,0 +1,50 @@
+#pragma once
+// Minimal Arduino shim so the portable parts of the firmware (protocol codec,
+// state serializer, ...) can be compiled for env:native on the host.
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <functional>
+#include <thread>
+
+typedef uint8_t byte;
+
+inline unsigned long micros()
+{
+    using namespace std::chrono;
+    static const steady_clock::time_point start = steady_clock::now();
+    return (unsigned long)duration_cast<microseconds>(steady_clock::now() - start).count();
+}
+
+inline unsigned long millis()
+{
+    return micros() / 1000;
+}
+
+inline void delay(unsigned long ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+// Log levels follow CORE_DEBUG_LEVEL of the esp32 core, default to errors only
+// so benchmarks are not dominated by printf
+#ifndef CORE_DEBUG_LEVEL
+#define CORE_DEBUG_LEVEL 1
+#endif
+
+#define SHIM_LOG(level, letter, format, ...)                              \
+    do                                                                    \
+    {                                                                     \
+        if (CORE_DEBUG_LEVEL >= level)                                    \
+            printf("[" letter "] " format "\n", ##__VA_ARGS__);          \
+    } while (0)
+
+#define log_e(format, ...) SHIM_LOG(1, "E", format, ##__VA_ARGS__)
+#define log_w(format, ...) SHIM_LOG(2, "W", format, ##__VA_ARGS__)
+#define log_i(format, ...) SHIM_LOG(3, "I", format, ##__VA_ARGS__)
+#define log_d(format, ...) SHIM_LOG(4, "D", format, ##__VA_ARGS__)
+#define log_v(format, ...) SHIM_LOG(5, "V", format, ##__VA_ARGS__)
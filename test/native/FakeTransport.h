@@ -0,0 +1,42 @@
+#pragma once
+// Recording MqttTransport shared by the native test suites. Publishes fail
+// while up is false, like a broker that went away.
+#include <string>
+#include <vector>
+
+#include "MqttTransport.h"
+
+class FakeTransport : public MqttTransport
+{
+public:
+    bool connected() override
+    {
+        return up;
+    }
+
+    bool publish(const char *topic, const uint8_t *payload, size_t length, bool retained) override
+    {
+        if (!up)
+        {
+            return false;
+        }
+        messages.push_back(std::string((const char *)payload, length));
+        return true;
+    }
+
+    // recorded as "<topic>@<qos>"
+    bool subscribe(const char *topic, uint8_t qos) override
+    {
+        subscriptions.push_back(std::string(topic) + "@" + std::to_string(qos));
+        return true;
+    }
+
+    bool loop() override
+    {
+        return up;
+    }
+
+    bool up = true;
+    std::vector<std::string> messages;
+    std::vector<std::string> subscriptions;
+};
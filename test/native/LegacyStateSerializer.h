@@ -0,0 +1,28 @@
+#pragma once
+// The former JsonDocument based state serializer working on float km/h and km
+// values, kept as reference for the output equivalence test and as baseline in
+// the benchmark suite.
+#include <ArduinoJson.h>
+
+#include "StateSerializer.h"
+
+inline size_t serializeStateArduinoJson(const TreadMillData &data, char *buffer, size_t size)
+{
+    // same conversion notifyCallback used to do
+    float speedCmd = (float)data.speedCmdMilli / 1000.0;
+    float speedFeedback = (float)data.speedFeedbackMilli / 1000.0;
+    float speedMax = (float)data.speedMaxMilli / 1000.0;
+    float distanceKm = (float)data.distanceMilli / 1000.0;
+
+    JsonDocument state;
+    state["speed_cmd"] = speedCmd;
+    state["speed_feedback"] = speedFeedback;
+    state["speed_max"] = speedMax;
+    state["distance_km"] = distanceKm;
+    state["duration_sec"] = data.durationMs / 1000;
+    state["calories"] = data.calories;
+    state["steps"] = data.steps;
+    state["fw"] = data.fwVersion;
+    state["state"] = stateToString(data.status);
+    return serializeJson(state, buffer, size);
+}
@@ -0,0 +1,57 @@
+#pragma once
+// Builds synthetic 31-byte status notifications as sent by the pad, shared by
+// the native test suites.
+#include <Arduino.h>
+
+#include "TreadmillProtocol.h"
+
+struct StatusFrameFields
+{
+    uint16_t speedFeedback = 0; // m/h
+    uint16_t speedCmd = 0;      // m/h
+    uint32_t distance = 0;      // m
+    uint32_t steps = 0;
+    uint16_t calories = 0;
+    uint32_t durationMs = 0;
+    uint8_t fwVersion = 0;
+    uint8_t flags = 0;
+    uint16_t speedMax = 0; // m/h
+};
+
+inline void putU16(uint8_t *frame, int offset, uint16_t value)
+{
+    frame[offset] = value >> 8;
+    frame[offset + 1] = value & 0xFF;
+}
+
+inline void putU32(uint8_t *frame, int offset, uint32_t value)
+{
+    frame[offset] = value >> 24;
+    frame[offset + 1] = (value >> 16) & 0xFF;
+    frame[offset + 2] = (value >> 8) & 0xFF;
+    frame[offset + 3] = value & 0xFF;
+}
+
+inline void buildStatusFrame(const StatusFrameFields &fields, uint8_t *frame)
+{
+    memset(frame, 0, STATUS_FRAME_LENGTH);
+    frame[0] = FRAME_START_BYTE;
+    frame[1] = STATUS_FRAME_LENGTH;
+    putU16(frame, 3, fields.speedFeedback);
+    putU16(frame, 5, fields.speedCmd);
+    putU32(frame, 7, fields.distance);
+    putU32(frame, 14, fields.steps);
+    putU16(frame, 18, fields.calories);
+    putU32(frame, 20, fields.durationMs);
+    frame[25] = fields.fwVersion;
+    frame[26] = fields.flags;
+    putU16(frame, 27, fields.speedMax);
+
+    uint8_t checksum = 0;
+    for (int i = 1; i < STATUS_FRAME_LENGTH - 2; ++i)
+    {
+        checksum ^= frame[i];
+    }
+    frame[STATUS_FRAME_LENGTH - 2] = checksum;
+    frame[STATUS_FRAME_LENGTH - 1] = FRAME_END_BYTE;
+}
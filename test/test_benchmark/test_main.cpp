@@ -0,0 +1,221 @@
+// Microbenchmarks for the hot path between BLE notification and MQTT publish.
+// Each benchmark reports ns/frame and fails when it crosses its threshold; the
+// thresholds are deliberately generous and can be tightened per machine via
+// build_flags in env:native.
+#include <unity.h>
+
+#include "TreadmillProtocol.h"
+#include "CommandFrames.h"
+#include "StateSerializer.h"
+#include "StatusFrameBuilder.h"
+#include "LegacyStateSerializer.h"
+#include "CommandRouter.h"
+
+#ifndef BENCH_ITERATIONS
+#define BENCH_ITERATIONS 200000
+#endif
+#ifndef BENCH_MAX_NS_ENCODE
+#define BENCH_MAX_NS_ENCODE 500
+#endif
+#ifndef BENCH_MAX_NS_DECODE
+#define BENCH_MAX_NS_DECODE 500
+#endif
+#ifndef BENCH_MAX_NS_SERIALIZE
+#define BENCH_MAX_NS_SERIALIZE 1000
+#endif
+#ifndef BENCH_MAX_NS_DISPATCH
+#define BENCH_MAX_NS_DISPATCH 500
+#endif
+
+// keeps the optimizer from discarding the benchmarked work
+static volatile uint32_t g_sink = 0;
+
+template <typename F>
+static double measureNsPerOp(F &&op)
+{
+    // warm up caches and branch predictors
+    for (int i = 0; i < BENCH_ITERATIONS / 10; ++i)
+    {
+        op(i);
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < BENCH_ITERATIONS; ++i)
+    {
+        op(i);
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / BENCH_ITERATIONS;
+}
+
+static void report(const char *name, double nsPerOp, double limit)
+{
+    char message[128];
+    snprintf(message, sizeof(message), "%s: %.1f ns/frame (limit %.0f)", name, nsPerOp, limit);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_TRUE_MESSAGE(nsPerOp < limit, message);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_bench_encode()
+{
+    uint8_t packet[COMMAND_FRAME_LENGTH];
+    double ns = measureNsPerOp([&](int i)
+                               {
+        TreadmillProtocol::makePacket(TreadmillProtocol::CMD_START_SET_SPEED, i % 6000, packet);
+        g_sink += packet[21]; });
+    report("encode", ns, BENCH_MAX_NS_ENCODE);
+}
+
+void test_bench_encode_precomputed()
+{
+    uint8_t packet[COMMAND_FRAME_LENGTH];
+    double ns = measureNsPerOp([&](int i)
+                               {
+        DefaultCommandFrames::make(TreadmillProtocol::CMD_START_SET_SPEED, i % 6000, packet);
+        g_sink += packet[21]; });
+    report("encode (precomputed)", ns, BENCH_MAX_NS_ENCODE);
+}
+
+void test_bench_decode()
+{
+    StatusFrameFields fields;
+    fields.speedFeedback = 3200;
+    fields.speedCmd = 3500;
+    fields.distance = 1234;
+    fields.durationMs = 754000;
+    fields.flags = 8;
+    fields.speedMax = 6000;
+    uint8_t frame[STATUS_FRAME_LENGTH];
+    buildStatusFrame(fields, frame);
+
+    TreadMillData data;
+    double ns = measureNsPerOp([&](int i)
+                               {
+        frame[4] = i & 0xFF;
+        TreadmillProtocol::parseStatus(frame, sizeof(frame), data);
+        g_sink += data.durationMs; });
+    report("decode", ns, BENCH_MAX_NS_DECODE);
+}
+
+static TreadMillData benchmarkState()
+{
+    TreadMillData data;
+    data.speedCmdMilli = 3500;
+    data.speedMaxMilli = 6000;
+    data.calories = 87;
+    data.fwVersion = 12;
+    data.status = TreadMillData::RUNNING;
+    return data;
+}
+
+void test_bench_serialize()
+{
+    TreadMillData data = benchmarkState();
+    char buffer[STATE_JSON_MAX_LENGTH];
+    double ns = measureNsPerOp([&](int i)
+                               {
+        data.speedFeedbackMilli = i % 6000;
+        data.distanceMilli = i;
+        data.durationMs = i * 1000;
+        g_sink += serializeState(data, buffer, sizeof(buffer)); });
+    report("serialize", ns, BENCH_MAX_NS_SERIALIZE);
+}
+
+// Former JsonDocument + float path, reported for comparison only
+void test_bench_serialize_arduinojson()
+{
+    TreadMillData data = benchmarkState();
+    char buffer[STATE_JSON_MAX_LENGTH];
+    double ns = measureNsPerOp([&](int i)
+                               {
+        data.speedFeedbackMilli = i % 6000;
+        data.distanceMilli = i;
+        data.durationMs = i * 1000;
+        g_sink += serializeStateArduinoJson(data, buffer, sizeof(buffer)); });
+    char message[96];
+    snprintf(message, sizeof(message), "serialize (ArduinoJson): %.1f ns/frame", ns);
+    TEST_MESSAGE(message);
+}
+
+void test_bench_serialize_msgpack()
+{
+    TreadMillData data = benchmarkState();
+    uint8_t buffer[STATE_MSGPACK_MAX_LENGTH];
+    double ns = measureNsPerOp([&](int i)
+                               {
+        data.speedFeedbackMilli = i % 6000;
+        data.distanceMilli = i;
+        data.durationMs = i * 1000;
+        g_sink += serializeStateMsgPack(data, buffer, sizeof(buffer)); });
+    report("serialize (MessagePack)", ns, BENCH_MAX_NS_SERIALIZE);
+}
+
+// Payload sizes of both state encodings over a 30 minute walk
+void test_state_size_json_vs_msgpack()
+{
+    TreadMillData data = benchmarkState();
+    char json[STATE_JSON_MAX_LENGTH];
+    uint8_t msgpack[STATE_MSGPACK_MAX_LENGTH];
+    size_t jsonBytes = 0;
+    size_t msgpackBytes = 0;
+    size_t samples = 0;
+    for (uint32_t second = 0; second < 1800; ++second)
+    {
+        data.speedFeedbackMilli = 3500 - second % 7;
+        data.distanceMilli = second * 35 / 36;
+        data.durationMs = second * 1000;
+        data.calories = second / 20;
+        jsonBytes += serializeState(data, json, sizeof(json));
+        msgpackBytes += serializeStateMsgPack(data, msgpack, sizeof(msgpack));
+        samples++;
+    }
+    char message[128];
+    snprintf(message, sizeof(message), "state size: JSON %.1f B, MessagePack %.1f B per message",
+             (double)jsonBytes / samples, (double)msgpackBytes / samples);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_TRUE(msgpackBytes * 3 < jsonBytes);
+}
+
+static void benchHandler(const CommandPayload &payload, unsigned long entryUs)
+{
+    uint32_t value = 0;
+    payload.parseMilli(value);
+    g_sink += value;
+}
+
+// Lookup and payload parsing for the topics the bridge subscribes to
+void test_bench_dispatch()
+{
+    static char topics[11][64];
+    CommandRouter router;
+    for (int i = 0; i < 11; ++i)
+    {
+        snprintf(topics[i], sizeof(topics[i]), "homeassistant/number/pacekeeper_a0b1c2d3e4f5/entity-%d/cmd", i);
+        router.add(topics[i], benchHandler);
+    }
+    const uint8_t payload[] = "3.5";
+    double ns = measureNsPerOp([&](int i)
+                               { router.dispatch(topics[i % 11], payload, 3, 0); });
+    report("dispatch", ns, BENCH_MAX_NS_DISPATCH);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_bench_encode);
+    RUN_TEST(test_bench_encode_precomputed);
+    RUN_TEST(test_bench_decode);
+    RUN_TEST(test_bench_serialize);
+    RUN_TEST(test_bench_serialize_arduinojson);
+    RUN_TEST(test_bench_serialize_msgpack);
+    RUN_TEST(test_state_size_json_vs_msgpack);
+    RUN_TEST(test_bench_dispatch);
+    return UNITY_END();
+}
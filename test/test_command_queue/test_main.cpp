@@ -0,0 +1,82 @@
+#include <unity.h>
+
+#include "CommandQueue.h"
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_speed_setpoints_coalesce()
+{
+    CommandQueue queue;
+    for (uint16_t speed = 1000; speed <= 3000; speed += 100)
+    {
+        queue.push(TreadmillProtocol::CMD_START_SET_SPEED, speed, speed);
+    }
+    TEST_ASSERT_EQUAL(1, queue.size());
+    TEST_ASSERT_EQUAL_UINT32(20, queue.getCoalesced());
+
+    TreadmillCommand command;
+    TEST_ASSERT_TRUE(queue.pop(command));
+    TEST_ASSERT_EQUAL_UINT16(3000, command.speed);
+    TEST_ASSERT_EQUAL_UINT32(3000, command.enqueuedUs);
+    TEST_ASSERT_FALSE(queue.pop(command));
+}
+
+void test_control_commands_keep_order()
+{
+    CommandQueue queue;
+    queue.push(TreadmillProtocol::CMD_START_SET_SPEED, 0, 0); // start
+    queue.push(TreadmillProtocol::CMD_START_SET_SPEED, 2000, 1);
+    queue.push(TreadmillProtocol::CMD_START_SET_SPEED, 2500, 2);
+    queue.push(TreadmillProtocol::CMD_PAUSE, 0, 3);
+    queue.push(TreadmillProtocol::CMD_START_SET_SPEED, 3000, 4);
+    queue.push(TreadmillProtocol::CMD_START_SET_SPEED, 3500, 5);
+    queue.push(TreadmillProtocol::CMD_STOP, 0, 6);
+
+    const TreadmillProtocol::CommandType types[] = {
+        TreadmillProtocol::CMD_START_SET_SPEED,
+        TreadmillProtocol::CMD_START_SET_SPEED,
+        TreadmillProtocol::CMD_PAUSE,
+        TreadmillProtocol::CMD_START_SET_SPEED,
+        TreadmillProtocol::CMD_STOP};
+    const uint16_t speeds[] = {0, 2500, 0, 3500, 0};
+
+    TreadmillCommand command;
+    for (size_t i = 0; i < 5; ++i)
+    {
+        TEST_ASSERT_TRUE(queue.pop(command));
+        TEST_ASSERT_EQUAL(types[i], command.type);
+        TEST_ASSERT_EQUAL_UINT16(speeds[i], command.speed);
+    }
+    TEST_ASSERT_FALSE(queue.pop(command));
+}
+
+void test_full_queue_drops()
+{
+    CommandQueue queue;
+    for (int i = 0; i < COMMAND_QUEUE_SIZE; ++i)
+    {
+        TEST_ASSERT_EQUAL(CommandQueue::QUEUED, queue.push(TreadmillProtocol::CMD_PAUSE, 0, i));
+    }
+    TEST_ASSERT_EQUAL(CommandQueue::FULL, queue.push(TreadmillProtocol::CMD_STOP, 0, 0));
+    TEST_ASSERT_EQUAL_UINT32(1, queue.getDropped());
+    // wrap around after popping
+    TreadmillCommand command;
+    TEST_ASSERT_TRUE(queue.pop(command));
+    TEST_ASSERT_EQUAL(CommandQueue::QUEUED, queue.push(TreadmillProtocol::CMD_STOP, 0, 0));
+    TEST_ASSERT_EQUAL(COMMAND_QUEUE_SIZE, queue.size());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_speed_setpoints_coalesce);
+    RUN_TEST(test_control_commands_keep_order);
+    RUN_TEST(test_full_queue_drops);
+    return UNITY_END();
+}
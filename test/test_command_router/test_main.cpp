@@ -0,0 +1,152 @@
+#include <unity.h>
+#include <string>
+#include <vector>
+
+#include "CommandRouter.h"
+#include "FakeTransport.h"
+
+static int g_calls[4];
+static uint32_t g_lastValue;
+
+static void handlerA(const CommandPayload &payload, unsigned long entryUs)
+{
+    g_calls[0]++;
+    payload.parseMilli(g_lastValue);
+}
+
+static void handlerB(const CommandPayload &payload, unsigned long entryUs)
+{
+    g_calls[1]++;
+}
+
+static void contextHandler(const CommandPayload &payload, unsigned long entryUs, void *context)
+{
+    (*(int *)context)++;
+}
+
+static bool payloadMilli(const char *text, uint32_t &value)
+{
+    return CommandPayload((const uint8_t *)text, strlen(text)).parseMilli(value);
+}
+
+static bool payloadUInt(const char *text, uint32_t &value)
+{
+    return CommandPayload((const uint8_t *)text, strlen(text)).parseUInt(value);
+}
+
+void setUp()
+{
+    memset(g_calls, 0, sizeof(g_calls));
+    g_lastValue = 0;
+}
+
+void tearDown()
+{
+}
+
+void test_dispatches_to_registered_handler()
+{
+    CommandRouter router;
+    TEST_ASSERT_TRUE(router.add("pk/speed/set", handlerA));
+    TEST_ASSERT_TRUE(router.add("homeassistant/status", handlerB, 0));
+    TEST_ASSERT_FALSE(router.add("pk/speed/set", handlerB));
+
+    // not terminated after the payload
+    const char buffer[] = "3.5garbage";
+    TEST_ASSERT_TRUE(router.dispatch("pk/speed/set", (const uint8_t *)buffer, 3, micros()));
+    TEST_ASSERT_EQUAL(1, g_calls[0]);
+    TEST_ASSERT_EQUAL_UINT32(3500, g_lastValue);
+    TEST_ASSERT_TRUE(router.dispatch("homeassistant/status", (const uint8_t *)"online", 6, micros()));
+    TEST_ASSERT_EQUAL(1, g_calls[1]);
+
+    TEST_ASSERT_FALSE(router.dispatch("pk/speed", (const uint8_t *)"1", 1, micros()));
+    TEST_ASSERT_EQUAL_UINT32(1, router.getUnknownTopics());
+    TEST_ASSERT_EQUAL_UINT32(2, router.getDispatchLatency().getCount());
+
+    FakeTransport transport;
+    TEST_ASSERT_TRUE(router.subscribeAll(transport));
+    TEST_ASSERT_EQUAL(2, transport.subscriptions.size());
+    TEST_ASSERT_EQUAL_STRING("pk/speed/set@1", transport.subscriptions[0].c_str());
+    TEST_ASSERT_EQUAL_STRING("homeassistant/status@0", transport.subscriptions[1].c_str());
+}
+
+void test_context_handlers()
+{
+    // one handler for the same command of two treadmills
+    int first = 0, second = 0;
+    CommandRouter router;
+    TEST_ASSERT_TRUE(router.add("pk/speed/set", contextHandler, &first));
+    TEST_ASSERT_TRUE(router.add("pk-a1b2c3/speed/set", contextHandler, &second));
+    TEST_ASSERT_TRUE(router.add("pk/pause/set", handlerB));
+
+    TEST_ASSERT_TRUE(router.dispatch("pk-a1b2c3/speed/set", (const uint8_t *)"2", 1, micros()));
+    TEST_ASSERT_TRUE(router.dispatch("pk-a1b2c3/speed/set", (const uint8_t *)"2", 1, micros()));
+    TEST_ASSERT_TRUE(router.dispatch("pk/speed/set", (const uint8_t *)"2", 1, micros()));
+    TEST_ASSERT_TRUE(router.dispatch("pk/pause/set", (const uint8_t *)"press", 5, micros()));
+    TEST_ASSERT_EQUAL(1, first);
+    TEST_ASSERT_EQUAL(2, second);
+    TEST_ASSERT_EQUAL(1, g_calls[1]);
+}
+
+void test_full_table_has_no_collisions()
+{
+    static char topics[COMMAND_ROUTER_MAX_ROUTES][48];
+    CommandRouter router;
+    for (int i = 0; i < COMMAND_ROUTER_MAX_ROUTES; ++i)
+    {
+        snprintf(topics[i], sizeof(topics[i]), "homeassistant/number/pacekeeper_%d/cmd", i);
+        TEST_ASSERT_TRUE(router.add(topics[i], (i % 2) ? handlerB : handlerA));
+    }
+    TEST_ASSERT_FALSE(router.add("one/too/many", handlerA));
+    TEST_ASSERT_EQUAL(COMMAND_ROUTER_MAX_ROUTES, router.getRouteCount());
+
+    for (int i = 0; i < COMMAND_ROUTER_MAX_ROUTES; ++i)
+    {
+        TEST_ASSERT_TRUE(router.dispatch(topics[i], (const uint8_t *)"1", 1, micros()));
+    }
+    TEST_ASSERT_EQUAL(COMMAND_ROUTER_MAX_ROUTES / 2, g_calls[0]);
+    TEST_ASSERT_EQUAL(COMMAND_ROUTER_MAX_ROUTES / 2, g_calls[1]);
+    TEST_ASSERT_EQUAL_UINT32(0, router.getUnknownTopics());
+}
+
+void test_payload_parsing()
+{
+    uint32_t value = 0;
+    TEST_ASSERT_TRUE(payloadMilli("3.5", value));
+    TEST_ASSERT_EQUAL_UINT32(3500, value);
+    TEST_ASSERT_TRUE(payloadMilli(" 6 \r\n", value));
+    TEST_ASSERT_EQUAL_UINT32(6000, value);
+    TEST_ASSERT_TRUE(payloadMilli("0.1239", value));
+    TEST_ASSERT_EQUAL_UINT32(123, value);
+    TEST_ASSERT_TRUE(payloadMilli(".5", value));
+    TEST_ASSERT_EQUAL_UINT32(500, value);
+    TEST_ASSERT_FALSE(payloadMilli("", value));
+    TEST_ASSERT_FALSE(payloadMilli(".", value));
+    TEST_ASSERT_FALSE(payloadMilli("-1", value));
+    TEST_ASSERT_FALSE(payloadMilli("3.5km", value));
+    TEST_ASSERT_FALSE(payloadMilli("99999999", value));
+
+    TEST_ASSERT_TRUE(payloadUInt("32", value));
+    TEST_ASSERT_EQUAL_UINT32(32, value);
+    TEST_ASSERT_TRUE(payloadUInt("2000.0", value));
+    TEST_ASSERT_EQUAL_UINT32(2000, value);
+    TEST_ASSERT_TRUE(payloadUInt("4294967295", value));
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, value);
+    TEST_ASSERT_FALSE(payloadUInt("4294967296", value));
+    TEST_ASSERT_FALSE(payloadUInt("x", value));
+
+    CommandPayload press((const uint8_t *)" PRESS\n", 7);
+    TEST_ASSERT_TRUE(press.equalsIgnoreCase("press"));
+    TEST_ASSERT_FALSE(press.equalsIgnoreCase("pres"));
+    TEST_ASSERT_FALSE(press.equalsIgnoreCase("pressed"));
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_dispatches_to_registered_handler);
+    RUN_TEST(test_context_handlers);
+    RUN_TEST(test_full_table_has_no_collisions);
+    RUN_TEST(test_payload_parsing);
+    return UNITY_END();
+}
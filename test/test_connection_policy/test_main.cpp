@@ -0,0 +1,148 @@
+#include <unity.h>
+
+#include "ConnectionPolicy.h"
+
+// the pad sends a frame every 250 ms
+static void feed(ConnectionPolicy &policy, TreadMillData::Status status, unsigned long &now, unsigned long durationMs)
+{
+    for (unsigned long end = now + durationMs; now < end; now += 250)
+    {
+        policy.onStatus(status, now);
+    }
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_relaxed_after_the_pad_stopped()
+{
+    ConnectionPolicy policy;
+    ConnParams request;
+    unsigned long now = 1000;
+    TEST_ASSERT_FALSE(policy.poll(now, request));
+
+    policy.onConnected(24, 0, 600, now);
+    TEST_ASSERT_EQUAL(LINK_ACTIVE, policy.getStatus().mode);
+    feed(policy, TreadMillData::RUNNING, now, 60000);
+    TEST_ASSERT_FALSE(policy.poll(now, request));
+
+    feed(policy, TreadMillData::STOPPED, now, CONN_RELAX_DELAY_MS - 500);
+    TEST_ASSERT_FALSE(policy.poll(now, request));
+    feed(policy, TreadMillData::STOPPED, now, 1000);
+    TEST_ASSERT_TRUE(policy.poll(now, request));
+    TEST_ASSERT_EQUAL_UINT16(ConnectionPolicy::IDLE.maxInterval, request.maxInterval);
+    TEST_ASSERT_EQUAL_UINT16(4, request.latency);
+    // one request at a time
+    TEST_ASSERT_FALSE(policy.poll(now, request));
+
+    policy.onUpdate(true, 96, 4, 600);
+    const LinkStatus &status = policy.getStatus();
+    TEST_ASSERT_EQUAL(LINK_IDLE, status.mode);
+    TEST_ASSERT_EQUAL_UINT16(96, status.interval);
+    TEST_ASSERT_EQUAL_UINT32(1, status.requests);
+    TEST_ASSERT_EQUAL_UINT32(0, status.rejected);
+    feed(policy, TreadMillData::STOPPED, now, 60000);
+    TEST_ASSERT_FALSE(policy.poll(now, request));
+}
+
+void test_tightened_right_away()
+{
+    ConnectionPolicy policy;
+    ConnParams request;
+    unsigned long now = 0;
+    policy.onConnected(24, 0, 600, now);
+    // a pad that is stopped at connect relaxes after the delay
+    feed(policy, TreadMillData::STOPPED, now, CONN_RELAX_DELAY_MS + 250);
+    TEST_ASSERT_TRUE(policy.poll(now, request));
+    policy.onUpdate(true, 100, 4, 600);
+
+    // the countdown and a command tighten the link without waiting
+    policy.onStatus(TreadMillData::COUNTDOWN, now);
+    TEST_ASSERT_TRUE(policy.poll(now, request));
+    TEST_ASSERT_EQUAL_UINT16(ConnectionPolicy::ACTIVE.minInterval, request.minInterval);
+    TEST_ASSERT_EQUAL_UINT16(0, request.latency);
+    policy.onUpdate(true, 12, 0, 600);
+    TEST_ASSERT_EQUAL(LINK_ACTIVE, policy.getStatus().mode);
+
+    feed(policy, TreadMillData::STOPPED, now, CONN_RELAX_DELAY_MS + 250);
+    TEST_ASSERT_TRUE(policy.poll(now, request));
+    policy.onUpdate(true, 100, 4, 600);
+    policy.onCommand(now);
+    TEST_ASSERT_TRUE(policy.poll(now, request));
+    TEST_ASSERT_EQUAL_UINT32(4, policy.getStatus().requests);
+}
+
+void test_rejected_requests_are_not_repeated()
+{
+    ConnectionPolicy policy;
+    ConnParams request;
+    unsigned long now = 0;
+    policy.onConnected(24, 0, 600, now);
+    feed(policy, TreadMillData::PAUSED, now, CONN_RELAX_DELAY_MS + 250);
+    TEST_ASSERT_TRUE(policy.poll(now, request));
+    policy.onUpdate(false, 24, 0, 600);
+    TEST_ASSERT_EQUAL(LINK_ACTIVE, policy.getStatus().mode);
+    TEST_ASSERT_EQUAL_UINT32(1, policy.getStatus().rejected);
+    feed(policy, TreadMillData::PAUSED, now, 60000);
+    TEST_ASSERT_FALSE(policy.poll(now, request));
+
+    // the link already runs active, running again needs no request
+    policy.onStatus(TreadMillData::RUNNING, now);
+    TEST_ASSERT_FALSE(policy.poll(now, request));
+    // the next stop tries again, the stack refuses and the controller never answers
+    feed(policy, TreadMillData::STOPPED, now, CONN_RELAX_DELAY_MS + 250);
+    TEST_ASSERT_TRUE(policy.poll(now, request));
+    policy.onRequestFailed();
+    TEST_ASSERT_EQUAL_UINT32(2, policy.getStatus().rejected);
+    feed(policy, TreadMillData::STOPPED, now, 60000);
+    TEST_ASSERT_FALSE(policy.poll(now, request));
+    // a command in between makes it worth another try
+    policy.onCommand(now);
+    TEST_ASSERT_FALSE(policy.poll(now, request));
+    feed(policy, TreadMillData::STOPPED, now, CONN_RELAX_DELAY_MS + 250);
+    TEST_ASSERT_TRUE(policy.poll(now, request));
+}
+
+void test_update_timeout_and_disconnect()
+{
+    ConnectionPolicy policy;
+    ConnParams request;
+    unsigned long now = 0;
+    policy.onConnected(24, 0, 600, now);
+    feed(policy, TreadMillData::STOPPED, now, CONN_RELAX_DELAY_MS + 250);
+    TEST_ASSERT_TRUE(policy.poll(now, request));
+    now += CONN_UPDATE_TIMEOUT_MS;
+    // given up, the wanted mode did not change so it is not requested again
+    TEST_ASSERT_FALSE(policy.poll(now, request));
+    TEST_ASSERT_EQUAL_UINT32(1, policy.getStatus().timeouts);
+    TEST_ASSERT_EQUAL_UINT32(0, policy.getStatus().rejected);
+
+    // the late answer still applies and is not counted again
+    policy.onUpdate(true, 40, 2, 500);
+    TEST_ASSERT_EQUAL_UINT32(0, policy.getStatus().rejected);
+    TEST_ASSERT_EQUAL(LINK_IDLE, policy.getStatus().mode);
+    TEST_ASSERT_EQUAL_UINT16(500, policy.getStatus().timeout);
+
+    uint32_t version = policy.getStatus().version;
+    policy.onDisconnected();
+    TEST_ASSERT_EQUAL(LINK_DISCONNECTED, policy.getStatus().mode);
+    TEST_ASSERT_NOT_EQUAL(version, policy.getStatus().version);
+    policy.onStatus(TreadMillData::RUNNING, now);
+    TEST_ASSERT_FALSE(policy.poll(now, request));
+    TEST_ASSERT_EQUAL_STRING("disconnected", linkModeName(policy.getStatus().mode));
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_relaxed_after_the_pad_stopped);
+    RUN_TEST(test_tightened_right_away);
+    RUN_TEST(test_rejected_requests_are_not_repeated);
+    RUN_TEST(test_update_timeout_and_disconnect);
+    return UNITY_END();
+}
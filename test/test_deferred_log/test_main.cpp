@@ -0,0 +1,203 @@
+#include <unity.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "DeferredLog.h"
+#include "MqttLogSink.h"
+#include "FakeTransport.h"
+
+class CaptureSink : public LogSink
+{
+public:
+    void write(uint8_t level, const char *line, size_t length) override
+    {
+        lines.push_back(std::string(line, length));
+    }
+
+    std::vector<std::string> lines;
+};
+
+// strips the "[<ms>][<level>] " prefix
+static std::string message(const std::string &line)
+{
+    size_t start = line.find("] ");
+    return start == std::string::npos ? line : line.substr(start + 2);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_records_are_formatted_when_drained()
+{
+    static DeferredLog log;
+    CaptureSink sink;
+    log.addSink(&sink, 3);
+    TEST_ASSERT_TRUE(log.isEnabled(3));
+    TEST_ASSERT_FALSE(log.isEnabled(4));
+
+    log.record(3, "speed %u, state %s, delta %d", 3500u, "running", -12);
+    log.record(1, "no arguments");
+    TEST_ASSERT_EQUAL(0, sink.lines.size());
+
+    TEST_ASSERT_EQUAL(2, log.drain());
+    TEST_ASSERT_EQUAL(2, sink.lines.size());
+    TEST_ASSERT_EQUAL_STRING("speed 3500, state running, delta -12", message(sink.lines[0]).c_str());
+    TEST_ASSERT_EQUAL_STRING("[I]", sink.lines[0].substr(8, 3).c_str());
+    TEST_ASSERT_EQUAL_STRING("no arguments", message(sink.lines[1]).c_str());
+    TEST_ASSERT_EQUAL(0, log.drain());
+}
+
+void test_sink_levels_filter_records()
+{
+    static DeferredLog log;
+    CaptureSink errors;
+    CaptureSink verbose;
+    log.addSink(&errors, 1);
+    log.addSink(&verbose, DEFERRED_LOG_OFF);
+    TEST_ASSERT_FALSE(log.isEnabled(2));
+
+    log.setSinkLevel(&verbose, 5);
+    TEST_ASSERT_TRUE(log.isEnabled(5));
+    TEST_ASSERT_EQUAL_UINT8(5, log.getSinkLevel(&verbose));
+    log.record(1, "error");
+    log.record(4, "debug");
+    log.drain();
+    TEST_ASSERT_EQUAL(1, errors.lines.size());
+    TEST_ASSERT_EQUAL(2, verbose.lines.size());
+
+    log.setSinkLevel(&verbose, DEFERRED_LOG_OFF);
+    TEST_ASSERT_FALSE(log.isEnabled(4));
+}
+
+void test_full_ring_drops_without_blocking()
+{
+    static DeferredLog log;
+    CaptureSink sink;
+    log.addSink(&sink, 5);
+    for (int i = 0; i < DEFERRED_LOG_RING_SIZE + 10; ++i)
+    {
+        log.record(4, "line %d", i);
+    }
+    TEST_ASSERT_EQUAL_UINT32(DEFERRED_LOG_RING_SIZE, log.getRecorded());
+    TEST_ASSERT_EQUAL_UINT32(10, log.getDropped());
+    TEST_ASSERT_EQUAL(DEFERRED_LOG_RING_SIZE, log.drain());
+    TEST_ASSERT_EQUAL_STRING("line 0", message(sink.lines.front()).c_str());
+}
+
+void test_concurrent_producers()
+{
+    static DeferredLog log;
+    CaptureSink sink;
+    log.addSink(&sink, 5);
+    const int producers = 4;
+    const int perProducer = 5000;
+    std::atomic<bool> done{false};
+    std::vector<int> next(producers, 0);
+    size_t drained = 0;
+    bool ordered = true;
+
+    std::thread consumer([&]()
+                         {
+        while (true)
+        {
+            bool finished = done.load();
+            drained += log.drain();
+            for (const std::string &line : sink.lines)
+            {
+                int producer, index;
+                if (sscanf(message(line).c_str(), "p%d %d", &producer, &index) == 2)
+                {
+                    // per producer order is kept, lost lines leave gaps
+                    ordered &= index >= next[producer];
+                    next[producer] = index + 1;
+                }
+            }
+            sink.lines.clear();
+            if (finished)
+            {
+                break;
+            }
+        } });
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p)
+    {
+        threads.emplace_back([p]()
+                             {
+            for (int i = 0; i < perProducer; ++i)
+            {
+                log.record(4, "p%d %d", p, i);
+            } });
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    done = true;
+    consumer.join();
+
+    TEST_ASSERT_TRUE(ordered);
+    TEST_ASSERT_EQUAL_UINT32(producers * perProducer, log.getRecorded() + log.getDropped());
+    TEST_ASSERT_EQUAL(log.getRecorded(), drained);
+}
+
+void test_parse_level()
+{
+    uint8_t level = 0;
+    TEST_ASSERT_TRUE(DeferredLog::parseLevel("debug", 5, level));
+    TEST_ASSERT_EQUAL_UINT8(4, level);
+    TEST_ASSERT_TRUE(DeferredLog::parseLevel("OFF", 3, level));
+    TEST_ASSERT_EQUAL_UINT8(0, level);
+    TEST_ASSERT_TRUE(DeferredLog::parseLevel("2", 1, level));
+    TEST_ASSERT_EQUAL_UINT8(2, level);
+    TEST_ASSERT_FALSE(DeferredLog::parseLevel("6", 1, level));
+    TEST_ASSERT_FALSE(DeferredLog::parseLevel("debugx", 6, level));
+}
+
+void test_mqtt_sink_joins_lines()
+{
+    FakeTransport transport;
+    MqttLogSink sink;
+    sink.begin(&transport, "pk/log");
+    sink.write(3, "first", 5);
+    sink.write(3, "second", 6);
+    TEST_ASSERT_TRUE(sink.hasPending());
+    sink.flush();
+    TEST_ASSERT_EQUAL(1, transport.messages.size());
+    TEST_ASSERT_EQUAL_STRING("first\nsecond", transport.messages[0].c_str());
+
+    char line[DEFERRED_LOG_LINE_MAX];
+    memset(line, 'x', sizeof(line));
+    for (int i = 0; i < MQTT_LOG_LINES + 2; ++i)
+    {
+        sink.write(4, line, sizeof(line) - 1);
+    }
+    TEST_ASSERT_EQUAL_UINT32(2, sink.getDropped());
+    sink.flush();
+    size_t total = 0;
+    for (size_t i = 1; i < transport.messages.size(); ++i)
+    {
+        TEST_ASSERT_TRUE(transport.messages[i].size() <= MQTT_LOG_MESSAGE_MAX);
+        total += transport.messages[i].size() + 1;
+    }
+    TEST_ASSERT_EQUAL(MQTT_LOG_LINES * DEFERRED_LOG_LINE_MAX, total);
+    TEST_ASSERT_FALSE(sink.hasPending());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_records_are_formatted_when_drained);
+    RUN_TEST(test_sink_levels_filter_records);
+    RUN_TEST(test_full_ring_drops_without_blocking);
+    RUN_TEST(test_concurrent_producers);
+    RUN_TEST(test_parse_level);
+    RUN_TEST(test_mqtt_sink_joins_lines);
+    return UNITY_END();
+}
@@ -0,0 +1,135 @@
+#include <unity.h>
+#include <vector>
+
+#include "TreadmillProtocol.h"
+#include "StatusFrameBuilder.h"
+
+static std::vector<uint32_t> g_durations;
+
+static void collect(const uint8_t *frame)
+{
+    TreadMillData data;
+    TEST_ASSERT_TRUE(TreadmillProtocol::parseStatus(frame, STATUS_FRAME_LENGTH, data));
+    g_durations.push_back(data.durationMs);
+}
+
+// Builds a capture of count consecutive frames with increasing durations
+static std::vector<uint8_t> capture(size_t count)
+{
+    std::vector<uint8_t> bytes;
+    for (size_t i = 0; i < count; ++i)
+    {
+        StatusFrameFields fields;
+        fields.speedFeedback = 2000;
+        fields.durationMs = (i + 1) * 1000;
+        fields.flags = 8;
+        uint8_t frame[STATUS_FRAME_LENGTH];
+        buildStatusFrame(fields, frame);
+        bytes.insert(bytes.end(), frame, frame + STATUS_FRAME_LENGTH);
+    }
+    return bytes;
+}
+
+static void assertDurations(size_t count)
+{
+    TEST_ASSERT_EQUAL(count, g_durations.size());
+    for (size_t i = 0; i < count; ++i)
+    {
+        TEST_ASSERT_EQUAL_UINT32((i + 1) * 1000, g_durations[i]);
+    }
+}
+
+void setUp()
+{
+    g_durations.clear();
+}
+
+void tearDown()
+{
+}
+
+void test_single_frames()
+{
+    StatusFrameDecoder decoder;
+    std::vector<uint8_t> bytes = capture(3);
+    for (size_t i = 0; i < 3; ++i)
+    {
+        decoder.feed(bytes.data() + i * STATUS_FRAME_LENGTH, STATUS_FRAME_LENGTH, collect);
+    }
+    assertDurations(3);
+    TEST_ASSERT_EQUAL_UINT32(0, decoder.getStats().partialFrames);
+    TEST_ASSERT_EQUAL_UINT32(0, decoder.getStats().resyncs);
+}
+
+void test_merged_frames()
+{
+    StatusFrameDecoder decoder;
+    std::vector<uint8_t> bytes = capture(4);
+    decoder.feed(bytes.data(), bytes.size(), collect);
+    assertDurations(4);
+    TEST_ASSERT_EQUAL_UINT32(4, decoder.getStats().frames);
+}
+
+void test_split_at_every_offset()
+{
+    std::vector<uint8_t> bytes = capture(2);
+    for (size_t split = 1; split < bytes.size(); ++split)
+    {
+        g_durations.clear();
+        StatusFrameDecoder decoder;
+        decoder.feed(bytes.data(), split, collect);
+        decoder.feed(bytes.data() + split, bytes.size() - split, collect);
+        assertDurations(2);
+    }
+}
+
+void test_byte_by_byte()
+{
+    StatusFrameDecoder decoder;
+    std::vector<uint8_t> bytes = capture(3);
+    for (uint8_t byte : bytes)
+    {
+        decoder.feed(&byte, 1, collect);
+    }
+    assertDurations(3);
+    TEST_ASSERT_EQUAL_UINT32(3, decoder.getStats().partialFrames);
+}
+
+void test_resync_after_garbage()
+{
+    StatusFrameDecoder decoder;
+    std::vector<uint8_t> bytes = capture(2);
+    // garbage in front and a truncated frame in between
+    const uint8_t garbage[] = {0x00, 0x11, 0x22};
+    bytes.insert(bytes.begin(), garbage, garbage + sizeof(garbage));
+    bytes.insert(bytes.begin() + sizeof(garbage) + STATUS_FRAME_LENGTH, {FRAME_START_BYTE, 0x1F, 0x00, 0x05});
+
+    decoder.feed(bytes.data(), 20, collect);
+    decoder.feed(bytes.data() + 20, bytes.size() - 20, collect);
+    assertDurations(2);
+    TEST_ASSERT_GREATER_OR_EQUAL(1, decoder.getStats().resyncs);
+    TEST_ASSERT_GREATER_OR_EQUAL(1, decoder.getStats().checksumFailures);
+}
+
+void test_checksum_failure_is_dropped()
+{
+    StatusFrameDecoder decoder;
+    std::vector<uint8_t> bytes = capture(2);
+    bytes[10] ^= 0x01; // corrupt the first frame
+    decoder.feed(bytes.data(), bytes.size(), collect);
+    TEST_ASSERT_EQUAL(1, g_durations.size());
+    TEST_ASSERT_EQUAL_UINT32(2000, g_durations[0]);
+    TEST_ASSERT_EQUAL_UINT32(1, decoder.getStats().checksumFailures);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_single_frames);
+    RUN_TEST(test_merged_frames);
+    RUN_TEST(test_split_at_every_offset);
+    RUN_TEST(test_byte_by_byte);
+    RUN_TEST(test_resync_after_garbage);
+    RUN_TEST(test_checksum_failure_is_dropped);
+    return UNITY_END();
+}
@@ -0,0 +1,73 @@
+#include <unity.h>
+
+#include "LatencyHistogram.h"
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_bucket_bounds_cover_values()
+{
+    const uint32_t values[] = {0, 1, 3, 4, 5, 7, 8, 100, 1000, 65535, 65536, 123456789, UINT32_MAX};
+    for (uint32_t value : values)
+    {
+        int index = LatencyHistogram::bucketIndex(value);
+        TEST_ASSERT_TRUE(index < LatencyHistogram::BUCKETS);
+        TEST_ASSERT_TRUE(value <= LatencyHistogram::bucketUpperBound(index));
+        if (index > 0)
+        {
+            TEST_ASSERT_TRUE(value > LatencyHistogram::bucketUpperBound(index - 1));
+        }
+    }
+}
+
+void test_percentiles()
+{
+    LatencyHistogram histogram;
+    for (uint32_t us = 1; us <= 1000; ++us)
+    {
+        histogram.record(us);
+    }
+    TEST_ASSERT_EQUAL_UINT32(1000, histogram.getCount());
+    TEST_ASSERT_EQUAL_UINT32(1000, histogram.getMax());
+    // within the 25% bucket resolution
+    TEST_ASSERT_UINT32_WITHIN(125, 500, histogram.percentile(50));
+    TEST_ASSERT_UINT32_WITHIN(240, 950, histogram.percentile(95));
+    TEST_ASSERT_TRUE(histogram.percentile(50) >= 500);
+    TEST_ASSERT_EQUAL_UINT32(1000, histogram.percentile(100));
+}
+
+void test_outlier_only_in_max()
+{
+    LatencyHistogram histogram;
+    for (int i = 0; i < 999; ++i)
+    {
+        histogram.record(200);
+    }
+    histogram.record(5000000);
+    TEST_ASSERT_TRUE(histogram.percentile(99) < 256);
+    TEST_ASSERT_EQUAL_UINT32(5000000, histogram.getMax());
+}
+
+void test_reset()
+{
+    LatencyHistogram histogram;
+    histogram.record(42);
+    histogram.reset();
+    TEST_ASSERT_EQUAL_UINT32(0, histogram.getCount());
+    TEST_ASSERT_EQUAL_UINT32(0, histogram.percentile(50));
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_bucket_bounds_cover_values);
+    RUN_TEST(test_percentiles);
+    RUN_TEST(test_outlier_only_in_max);
+    RUN_TEST(test_reset);
+    return UNITY_END();
+}
@@ -0,0 +1,71 @@
+#include <unity.h>
+
+#include "LoopProfiler.h"
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_iteration_without_stall()
+{
+    LoopProfiler profiler(100000);
+    profiler.beginIteration();
+    {
+        ProfileScope scope(profiler, SECTION_MQTT_LOOP);
+        delay(2);
+    }
+    profiler.endIteration();
+
+    TEST_ASSERT_EQUAL_UINT32(1, profiler.getIterations());
+    TEST_ASSERT_EQUAL_UINT32(0, profiler.getStalls());
+    TEST_ASSERT_TRUE(profiler.getSectionStats(SECTION_MQTT_LOOP).maxUs >= 2000);
+    TEST_ASSERT_TRUE(profiler.getMaxIterationUs() >= profiler.getSectionStats(SECTION_MQTT_LOOP).maxUs);
+}
+
+void test_stall_is_attributed_to_slowest_section()
+{
+    LoopProfiler profiler(20000);
+    volatile uint8_t marker = SECTION_NONE;
+    profiler.setSectionMarker(&marker);
+
+    profiler.beginIteration();
+    profiler.beginSection(SECTION_WIFI);
+    delay(2);
+    profiler.beginSection(SECTION_MQTT_CONNECT);
+    TEST_ASSERT_EQUAL(SECTION_MQTT_CONNECT, marker);
+    delay(30);
+    profiler.beginSection(SECTION_TREADMILL);
+    delay(1);
+    profiler.endIteration();
+
+    TEST_ASSERT_EQUAL(SECTION_NONE, marker);
+    TEST_ASSERT_EQUAL_UINT32(1, profiler.getStalls());
+    TEST_ASSERT_EQUAL(SECTION_MQTT_CONNECT, profiler.getLastStallSection());
+    TEST_ASSERT_EQUAL_UINT32(1, profiler.getSectionStats(SECTION_MQTT_CONNECT).stalls);
+    TEST_ASSERT_TRUE(profiler.getLastStallUs() >= 33000);
+    TEST_ASSERT_EQUAL_STRING("mqtt_connect", loopSectionName(profiler.getLastStallSection()));
+}
+
+void test_reset()
+{
+    LoopProfiler profiler(0);
+    profiler.beginIteration();
+    profiler.endIteration();
+    TEST_ASSERT_EQUAL_UINT32(1, profiler.getStalls());
+    profiler.reset();
+    TEST_ASSERT_EQUAL_UINT32(0, profiler.getStalls());
+    TEST_ASSERT_EQUAL_UINT32(0, profiler.getIterations());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_iteration_without_stall);
+    RUN_TEST(test_stall_is_attributed_to_slowest_section);
+    RUN_TEST(test_reset);
+    return UNITY_END();
+}
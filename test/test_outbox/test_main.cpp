@@ -0,0 +1,165 @@
+#include <unity.h>
+#include <string>
+#include <vector>
+
+#include "MqttOutbox.h"
+#include "FakeTransport.h"
+
+static void pushState(MqttOutbox &outbox, int value)
+{
+    char payload[32];
+    int length = snprintf(payload, sizeof(payload), "{\"v\":%d}", value);
+    outbox.push(payload, length);
+}
+
+// replays everything queued, returns the time it took
+static unsigned long drain(MqttOutbox &outbox, unsigned long now)
+{
+    unsigned long start = now;
+    while (outbox.getMsUntilService(now) != UINT32_MAX)
+    {
+        now += outbox.getMsUntilService(now);
+        outbox.service(now);
+    }
+    return now - start;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_live_messages_get_sequence_numbers()
+{
+    FakeTransport transport;
+    MqttOutbox outbox;
+    outbox.begin(&transport, "state");
+    pushState(outbox, 1);
+    pushState(outbox, 2);
+    TEST_ASSERT_EQUAL(2, transport.messages.size());
+    TEST_ASSERT_EQUAL_STRING("{\"v\":1,\"seq\":1}", transport.messages[0].c_str());
+    TEST_ASSERT_EQUAL_STRING("{\"v\":2,\"seq\":2}", transport.messages[1].c_str());
+    TEST_ASSERT_EQUAL_UINT32(0, outbox.getStats().queued);
+    TEST_ASSERT_EQUAL(UINT32_MAX, outbox.getMsUntilService(0));
+}
+
+void test_backlog_is_replayed_in_order_before_live()
+{
+    FakeTransport transport;
+    MqttOutbox outbox;
+    outbox.begin(&transport, "state");
+    transport.up = false;
+    for (int i = 0; i < 5; ++i)
+    {
+        pushState(outbox, i);
+    }
+    TEST_ASSERT_EQUAL_UINT32(5, outbox.getStats().depth);
+    outbox.service(0);
+    TEST_ASSERT_EQUAL(0, transport.messages.size());
+
+    transport.up = true;
+    outbox.service(1000);
+    TEST_ASSERT_EQUAL(1, transport.messages.size());
+    // a live message waits behind the backlog
+    pushState(outbox, 99);
+    TEST_ASSERT_EQUAL(1, transport.messages.size());
+    unsigned long took = drain(outbox, 1000);
+    TEST_ASSERT_EQUAL_UINT32(5 * MqttOutbox::REPLAY_PACE_MS, took);
+
+    TEST_ASSERT_EQUAL(6, transport.messages.size());
+    for (int i = 0; i < 5; ++i)
+    {
+        char expected[32];
+        snprintf(expected, sizeof(expected), "{\"v\":%d,\"seq\":%d}", i, i + 1);
+        TEST_ASSERT_EQUAL_STRING(expected, transport.messages[i].c_str());
+    }
+    TEST_ASSERT_EQUAL_STRING("{\"v\":99,\"seq\":6}", transport.messages[5].c_str());
+    TEST_ASSERT_EQUAL_UINT32(6, outbox.getStats().replayed);
+    TEST_ASSERT_EQUAL_UINT32(0, outbox.getStats().depth);
+}
+
+void test_overflow_spills_to_flash_and_keeps_order()
+{
+    FakeTransport transport;
+    MemoryOutboxSpill spill(1000);
+    MqttOutbox outbox;
+    outbox.begin(&transport, "state", &spill);
+    transport.up = false;
+    const int count = OUTBOX_RAM_MESSAGES * 3;
+    for (int i = 0; i < count; ++i)
+    {
+        pushState(outbox, i);
+    }
+    TEST_ASSERT_TRUE(outbox.getStats().spilled > 0);
+    TEST_ASSERT_TRUE(outbox.getStats().overflows > 0);
+    TEST_ASSERT_EQUAL_UINT32(0, outbox.getStats().dropped);
+    TEST_ASSERT_EQUAL_UINT32(count, outbox.getStats().depth);
+
+    transport.up = true;
+    drain(outbox, 0);
+    TEST_ASSERT_EQUAL(count, transport.messages.size());
+    for (int i = 0; i < count; ++i)
+    {
+        char expected[32];
+        snprintf(expected, sizeof(expected), "{\"v\":%d,\"seq\":%d}", i, i + 1);
+        TEST_ASSERT_EQUAL_STRING(expected, transport.messages[i].c_str());
+    }
+}
+
+void test_drops_oldest_without_flash()
+{
+    FakeTransport transport;
+    MqttOutbox outbox;
+    outbox.begin(&transport, "state");
+    transport.up = false;
+    for (int i = 0; i < OUTBOX_RAM_MESSAGES + 3; ++i)
+    {
+        pushState(outbox, i);
+    }
+    TEST_ASSERT_EQUAL_UINT32(3, outbox.getStats().dropped);
+    TEST_ASSERT_EQUAL_UINT32(OUTBOX_RAM_MESSAGES, outbox.getStats().depth);
+    transport.up = true;
+    drain(outbox, 0);
+    TEST_ASSERT_EQUAL_STRING("{\"v\":3,\"seq\":4}", transport.messages[0].c_str());
+}
+
+void test_sequence_continues_after_spilled_messages()
+{
+    FakeTransport transport;
+    MemoryOutboxSpill spill(1000);
+    {
+        MqttOutbox outbox;
+        outbox.begin(&transport, "state", &spill);
+        transport.up = false;
+        for (int i = 0; i < 5; ++i)
+        {
+            pushState(outbox, i);
+        }
+        outbox.spillAll();
+    }
+    // the spill outlives the restart, the new outbox must not reuse its numbers
+    MqttOutbox outbox;
+    outbox.begin(&transport, "state", &spill);
+    TEST_ASSERT_EQUAL_UINT32(6, outbox.getNextSeq());
+    TEST_ASSERT_EQUAL_UINT32(5, outbox.getStats().depth);
+    transport.up = true;
+    pushState(outbox, 99);
+    drain(outbox, 0);
+    TEST_ASSERT_EQUAL(6, transport.messages.size());
+    TEST_ASSERT_EQUAL_STRING("{\"v\":4,\"seq\":5}", transport.messages[4].c_str());
+    TEST_ASSERT_EQUAL_STRING("{\"v\":99,\"seq\":6}", transport.messages[5].c_str());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_live_messages_get_sequence_numbers);
+    RUN_TEST(test_backlog_is_replayed_in_order_before_live);
+    RUN_TEST(test_overflow_spills_to_flash_and_keeps_order);
+    RUN_TEST(test_drops_oldest_without_flash);
+    RUN_TEST(test_sequence_continues_after_spilled_messages);
+    return UNITY_END();
+}
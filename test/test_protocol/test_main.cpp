@@ -0,0 +1,281 @@
+#include <unity.h>
+
+#include "TreadmillProtocol.h"
+#include "CommandFrames.h"
+#include "StateSerializer.h"
+#include "StatusFrameBuilder.h"
+#include "LegacyStateSerializer.h"
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_make_packet_set_speed()
+{
+    // set speed to 2.5 km/h with the default weight and user id
+    const uint8_t expected[COMMAND_FRAME_LENGTH] = {
+        0x6A, 0x17, 0x00, 0x00, 0x00, 0x00, 0x09, 0xC4, 0x05, 0x00, 0x50, 0x00,
+        0x04, 0x00, 0x00, 0x00, 0x0D, 0xBA, 0x9D, 0x76, 0xEF, 0x38, 0x43};
+    uint8_t packet[COMMAND_FRAME_LENGTH];
+    TreadmillProtocol::makePacket(TreadmillProtocol::CMD_START_SET_SPEED, 2500, packet);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, packet, COMMAND_FRAME_LENGTH);
+}
+
+void test_make_packet_stop_and_pause()
+{
+    uint8_t packet[COMMAND_FRAME_LENGTH];
+    TreadmillProtocol::makePacket(TreadmillProtocol::CMD_STOP, 0, packet);
+    TEST_ASSERT_EQUAL_HEX8(FRAME_START_BYTE, packet[0]);
+    TEST_ASSERT_EQUAL_HEX8(1, packet[8]);
+    TEST_ASSERT_EQUAL_HEX8(TreadmillProtocol::CMD_STOP, packet[12]);
+
+    TreadmillProtocol::makePacket(TreadmillProtocol::CMD_PAUSE, 0, packet);
+    TEST_ASSERT_EQUAL_HEX8(TreadmillProtocol::CMD_PAUSE, packet[12]);
+}
+
+void test_command_frames_match_encoder()
+{
+    uint8_t expected[COMMAND_FRAME_LENGTH];
+    uint8_t packet[COMMAND_FRAME_LENGTH];
+    const TreadmillProtocol::CommandType types[] = {
+        TreadmillProtocol::CMD_START_SET_SPEED, TreadmillProtocol::CMD_PAUSE, TreadmillProtocol::CMD_STOP};
+    for (TreadmillProtocol::CommandType type : types)
+    {
+        TreadmillProtocol::makePacket(type, 0, expected);
+        DefaultCommandFrames::make(type, 0, packet);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, packet, COMMAND_FRAME_LENGTH);
+    }
+    // every speed up to the max speed the pad reports
+    for (uint16_t speed = 0; speed <= 6000; ++speed)
+    {
+        TreadmillProtocol::makePacket(TreadmillProtocol::CMD_START_SET_SPEED, speed, expected);
+        DefaultCommandFrames::make(TreadmillProtocol::CMD_START_SET_SPEED, speed, packet);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, packet, COMMAND_FRAME_LENGTH);
+    }
+}
+
+void test_command_frames_custom_model()
+{
+    typedef CommandFrames<0x0102030405060708ULL, 95> OtherModelFrames;
+    uint8_t packet[COMMAND_FRAME_LENGTH];
+    for (uint16_t speed = 1; speed <= 6000; speed += 37)
+    {
+        CommandFrame expected = OtherModelFrames::build(TreadmillProtocol::CMD_START_SET_SPEED, speed);
+        OtherModelFrames::makeSpeed(speed, packet);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(expected.bytes, packet, COMMAND_FRAME_LENGTH);
+    }
+    TEST_ASSERT_EQUAL_HEX8(95, OtherModelFrames::STOP.bytes[10]);
+    TEST_ASSERT_EQUAL_HEX8(0x08, OtherModelFrames::STOP.bytes[20]);
+}
+
+void test_parse_status_running()
+{
+    StatusFrameFields fields;
+    fields.speedFeedback = 3200;
+    fields.speedCmd = 3500;
+    fields.distance = 1234;
+    fields.calories = 87;
+    fields.durationMs = 754000;
+    fields.fwVersion = 12;
+    fields.flags = 8;
+    fields.speedMax = 6000;
+    uint8_t frame[STATUS_FRAME_LENGTH];
+    buildStatusFrame(fields, frame);
+
+    TreadMillData data;
+    TEST_ASSERT_TRUE(TreadmillProtocol::parseStatus(frame, sizeof(frame), data));
+    TEST_ASSERT_EQUAL_UINT16(3200, data.speedFeedbackMilli);
+    TEST_ASSERT_EQUAL_UINT16(3500, data.speedCmdMilli);
+    TEST_ASSERT_EQUAL_UINT32(1234, data.distanceMilli);
+    TEST_ASSERT_EQUAL_UINT16(6000, data.speedMaxMilli);
+    TEST_ASSERT_EQUAL_UINT16(87, data.calories);
+    TEST_ASSERT_EQUAL_UINT32(754000, data.durationMs);
+    TEST_ASSERT_EQUAL_UINT8(12, data.fwVersion);
+    TEST_ASSERT_EQUAL(TreadMillData::RUNNING, data.status);
+}
+
+void test_parse_status_states()
+{
+    const uint8_t flags[] = {24, 8, 16, 0};
+    const TreadMillData::Status expected[] = {
+        TreadMillData::COUNTDOWN, TreadMillData::RUNNING, TreadMillData::PAUSED, TreadMillData::STOPPED};
+    for (size_t i = 0; i < sizeof(flags); ++i)
+    {
+        StatusFrameFields fields;
+        fields.flags = flags[i] | 128; // unit bit must not influence the state
+        uint8_t frame[STATUS_FRAME_LENGTH];
+        buildStatusFrame(fields, frame);
+        TreadMillData data;
+        TEST_ASSERT_TRUE(TreadmillProtocol::parseStatus(frame, sizeof(frame), data));
+        TEST_ASSERT_EQUAL(expected[i], data.status);
+    }
+}
+
+void test_parse_status_too_short()
+{
+    uint8_t frame[STATUS_FRAME_LENGTH];
+    buildStatusFrame(StatusFrameFields(), frame);
+    TreadMillData data;
+    TEST_ASSERT_FALSE(TreadmillProtocol::parseStatus(frame, STATUS_FRAME_LENGTH - 1, data));
+}
+
+void test_make_status_round_trip()
+{
+    TreadMillData data;
+    data.speedFeedbackMilli = 2800;
+    data.speedCmdMilli = 3000;
+    data.speedMaxMilli = 6000;
+    data.distanceMilli = 4321;
+    data.steps = 5555;
+    data.calories = 123;
+    data.durationMs = 1800000;
+    data.fwVersion = 7;
+    data.status = TreadMillData::PAUSED;
+    uint8_t frame[STATUS_FRAME_LENGTH];
+    TreadmillProtocol::makeStatus(data, frame);
+    TEST_ASSERT_TRUE(StatusFrameDecoder::isValidFrame(frame));
+
+    TreadMillData parsed;
+    TEST_ASSERT_TRUE(TreadmillProtocol::parseStatus(frame, sizeof(frame), parsed));
+    TEST_ASSERT_EQUAL_UINT16(2800, parsed.speedFeedbackMilli);
+    TEST_ASSERT_EQUAL_UINT16(3000, parsed.speedCmdMilli);
+    TEST_ASSERT_EQUAL_UINT16(6000, parsed.speedMaxMilli);
+    TEST_ASSERT_EQUAL_UINT32(4321, parsed.distanceMilli);
+    TEST_ASSERT_EQUAL_UINT32(5555, parsed.steps);
+    TEST_ASSERT_EQUAL_UINT16(123, parsed.calories);
+    TEST_ASSERT_EQUAL_UINT32(1800000, parsed.durationMs);
+    TEST_ASSERT_EQUAL_UINT8(7, parsed.fwVersion);
+    TEST_ASSERT_EQUAL(TreadMillData::PAUSED, parsed.status);
+}
+
+void test_parse_command()
+{
+    uint8_t packet[COMMAND_FRAME_LENGTH];
+    TreadmillProtocol::makePacket(TreadmillProtocol::CMD_START_SET_SPEED, 4200, packet);
+    TreadmillProtocol::CommandType type;
+    uint16_t speed;
+    TEST_ASSERT_TRUE(TreadmillProtocol::parseCommand(packet, sizeof(packet), type, speed));
+    TEST_ASSERT_EQUAL(TreadmillProtocol::CMD_START_SET_SPEED, type);
+    TEST_ASSERT_EQUAL_UINT16(4200, speed);
+
+    TreadmillProtocol::makePacket(TreadmillProtocol::CMD_PAUSE, 0, packet);
+    TEST_ASSERT_TRUE(TreadmillProtocol::parseCommand(packet, sizeof(packet), type, speed));
+    TEST_ASSERT_EQUAL(TreadmillProtocol::CMD_PAUSE, type);
+
+    packet[7] ^= 0x01;
+    TEST_ASSERT_FALSE(TreadmillProtocol::parseCommand(packet, sizeof(packet), type, speed));
+}
+
+void test_serialize_state()
+{
+    TreadMillData data;
+    data.speedCmdMilli = 3500;
+    data.speedFeedbackMilli = 3500;
+    data.speedMaxMilli = 6000;
+    data.distanceMilli = 1250;
+    data.durationMs = 754999;
+    data.calories = 87;
+    data.steps = 0;
+    data.fwVersion = 12;
+    data.status = TreadMillData::RUNNING;
+
+    char buffer[STATE_JSON_MAX_LENGTH];
+    size_t length = serializeState(data, buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL_STRING(
+        "{\"speed_cmd\":3.5,\"speed_feedback\":3.5,\"speed_max\":6,\"distance_km\":1.25,"
+        "\"duration_sec\":754,\"calories\":87,\"steps\":0,\"fw\":12,\"state\":\"running\"}",
+        buffer);
+    TEST_ASSERT_EQUAL(strlen(buffer), length);
+}
+
+void test_serialize_state_matches_arduinojson()
+{
+    TreadMillData data;
+    data.calories = 87;
+    data.fwVersion = 12;
+    char buffer[STATE_JSON_MAX_LENGTH];
+    char reference[STATE_JSON_MAX_LENGTH];
+    for (uint32_t milli = 0; milli <= 12000; milli += 7)
+    {
+        data.speedCmdMilli = milli % 6001;
+        data.speedFeedbackMilli = (milli * 3) % 6001;
+        data.speedMaxMilli = 6000 - milli % 6001;
+        data.distanceMilli = milli * 13;
+        data.durationMs = milli * 100;
+        data.status = (TreadMillData::Status)(milli % 4);
+        serializeState(data, buffer, sizeof(buffer));
+        serializeStateArduinoJson(data, reference, sizeof(reference));
+        TEST_ASSERT_EQUAL_STRING(reference, buffer);
+    }
+}
+
+void test_serialize_state_buffer_too_small()
+{
+    TreadMillData data;
+    char buffer[16];
+    TEST_ASSERT_EQUAL(0, serializeState(data, buffer, sizeof(buffer)));
+}
+
+void test_serialize_state_msgpack()
+{
+    TreadMillData data;
+    data.speedCmdMilli = 3500;
+    data.speedFeedbackMilli = 100;
+    data.speedMaxMilli = 6000;
+    data.distanceMilli = 1250;
+    data.durationMs = 754999;
+    data.calories = 87;
+    data.steps = 200;
+    data.fwVersion = 12;
+    data.status = TreadMillData::RUNNING;
+
+    uint8_t buffer[STATE_MSGPACK_MAX_LENGTH];
+    size_t length = serializeStateMsgPack(data, buffer, sizeof(buffer));
+    const uint8_t expected[] = {
+        0x89,
+        0x00, 0x01,
+        0x01, 0xcd, 0x0d, 0xac,
+        0x02, 0x64,
+        0x03, 0xcd, 0x17, 0x70,
+        0x04, 0xcd, 0x04, 0xe2,
+        0x05, 0xce, 0x00, 0x0b, 0x85, 0x37,
+        0x06, 0x57,
+        0x07, 0xcc, 0xc8,
+        0x08, 0x0c};
+    TEST_ASSERT_EQUAL(sizeof(expected), length);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, buffer, sizeof(expected));
+}
+
+void test_serialize_state_msgpack_buffer_too_small()
+{
+    TreadMillData data;
+    data.durationMs = 754999;
+    uint8_t buffer[STATE_MSGPACK_MAX_LENGTH];
+    size_t length = serializeStateMsgPack(data, buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL(0, serializeStateMsgPack(data, buffer, length - 1));
+    TEST_ASSERT_EQUAL(length, serializeStateMsgPack(data, buffer, length));
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_make_packet_set_speed);
+    RUN_TEST(test_make_packet_stop_and_pause);
+    RUN_TEST(test_command_frames_match_encoder);
+    RUN_TEST(test_command_frames_custom_model);
+    RUN_TEST(test_parse_status_running);
+    RUN_TEST(test_parse_status_states);
+    RUN_TEST(test_parse_status_too_short);
+    RUN_TEST(test_make_status_round_trip);
+    RUN_TEST(test_parse_command);
+    RUN_TEST(test_serialize_state);
+    RUN_TEST(test_serialize_state_matches_arduinojson);
+    RUN_TEST(test_serialize_state_buffer_too_small);
+    RUN_TEST(test_serialize_state_msgpack);
+    RUN_TEST(test_serialize_state_msgpack_buffer_too_small);
+    return UNITY_END();
+}
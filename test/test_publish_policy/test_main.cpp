@@ -0,0 +1,93 @@
+#include <unity.h>
+
+#include "PublishPolicy.h"
+
+static TreadMillData runningFrame(uint16_t speed, uint32_t distance, uint32_t durationSec)
+{
+    TreadMillData data;
+    data.status = TreadMillData::RUNNING;
+    data.speedCmdMilli = speed;
+    data.speedFeedbackMilli = speed;
+    data.speedMaxMilli = 6000;
+    data.distanceMilli = distance;
+    data.durationMs = durationSec * 1000;
+    return data;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_first_frame_is_published()
+{
+    PublishPolicy policy;
+    TEST_ASSERT_TRUE(policy.shouldPublish(runningFrame(3000, 0, 0), 0));
+}
+
+void test_idle_frames_are_suppressed_until_heartbeat()
+{
+    PublishPolicy policy;
+    TreadMillData stopped;
+    stopped.status = TreadMillData::STOPPED;
+
+    TEST_ASSERT_TRUE(policy.shouldPublish(stopped, 0));
+    for (unsigned long now = 100; now < policy.getConfig().heartbeatMs; now += 100)
+    {
+        TEST_ASSERT_FALSE(policy.shouldPublish(stopped, now));
+    }
+    TEST_ASSERT_TRUE(policy.shouldPublish(stopped, policy.getConfig().heartbeatMs));
+    TEST_ASSERT_EQUAL_UINT32(2, policy.getMessagesPublished());
+    TEST_ASSERT_EQUAL_UINT32(601, policy.getFramesReceived());
+}
+
+void test_status_change_bypasses_rate_limit()
+{
+    PublishPolicy policy;
+    TreadMillData data = runningFrame(3000, 1000, 100);
+    TEST_ASSERT_TRUE(policy.shouldPublish(data, 1000));
+    data.status = TreadMillData::PAUSED;
+    TEST_ASSERT_TRUE(policy.shouldPublish(data, 1001));
+}
+
+void test_deadband_and_rate_limit()
+{
+    PublishPolicy policy;
+    TEST_ASSERT_TRUE(policy.shouldPublish(runningFrame(3000, 1000, 100), 0));
+
+    // below every deadband
+    TEST_ASSERT_FALSE(policy.shouldPublish(runningFrame(3000, 1005, 102), 2000));
+    // speed beyond the deadband and the rate limit interval passed
+    TEST_ASSERT_TRUE(policy.shouldPublish(runningFrame(3500, 1005, 102), 2500));
+    // speed changed back but within the rate limit of the last publish
+    TEST_ASSERT_FALSE(policy.shouldPublish(runningFrame(3000, 1005, 103), 2600));
+    // the pending change is published once the interval passed
+    TEST_ASSERT_TRUE(policy.shouldPublish(runningFrame(3000, 1005, 103), 3500));
+    // duration deadband
+    TEST_ASSERT_FALSE(policy.shouldPublish(runningFrame(3000, 1005, 107), 5000));
+    TEST_ASSERT_TRUE(policy.shouldPublish(runningFrame(3000, 1005, 108), 6000));
+}
+
+void test_invalidate_forces_publish()
+{
+    PublishPolicy policy;
+    TreadMillData data = runningFrame(3000, 1000, 100);
+    TEST_ASSERT_TRUE(policy.shouldPublish(data, 0));
+    TEST_ASSERT_FALSE(policy.shouldPublish(data, 10));
+    policy.invalidate();
+    TEST_ASSERT_TRUE(policy.shouldPublish(data, 20));
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_first_frame_is_published);
+    RUN_TEST(test_idle_frames_are_suppressed_until_heartbeat);
+    RUN_TEST(test_status_change_bypasses_rate_limit);
+    RUN_TEST(test_deadband_and_rate_limit);
+    RUN_TEST(test_invalidate_forces_publish);
+    return UNITY_END();
+}
@@ -0,0 +1,82 @@
+#include <unity.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "RoundTripProbe.h"
+#include "FakeTransport.h"
+
+static void echo(RoundTripProbe &probe, const std::string &message, unsigned long entryUs)
+{
+    probe.onEcho(CommandPayload((const uint8_t *)message.data(), message.size()), entryUs);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_round_trip_per_link_mode()
+{
+    FakeTransport transport;
+    RoundTripProbe probe;
+    probe.begin(&transport, "bridge/ping");
+    TEST_ASSERT_EQUAL_UINT32(0, probe.getMsUntilProbe(0));
+
+    probe.handle(1000, 1000000, LINK_ACTIVE);
+    TEST_ASSERT_EQUAL(1, transport.messages.size());
+    TEST_ASSERT_EQUAL_UINT32(RTT_PROBE_INTERVAL_MS - 100, probe.getMsUntilProbe(1100));
+    probe.handle(1100, 1100000, LINK_ACTIVE);
+    TEST_ASSERT_EQUAL(1, transport.messages.size());
+    echo(probe, transport.messages.back(), 1042000);
+    // a duplicate is not counted twice
+    echo(probe, transport.messages.back(), 1050000);
+
+    probe.handle(1000 + RTT_PROBE_INTERVAL_MS, 6000000, LINK_IDLE);
+    echo(probe, transport.messages.back(), 6012000);
+
+    TEST_ASSERT_EQUAL_UINT32(1, probe.getRoundTrip(LINK_ACTIVE).getCount());
+    TEST_ASSERT_EQUAL_UINT32(42000, probe.getRoundTrip(LINK_ACTIVE).getMax());
+    TEST_ASSERT_EQUAL_UINT32(1, probe.getRoundTrip(LINK_IDLE).getCount());
+    TEST_ASSERT_EQUAL_UINT32(12000, probe.getRoundTrip(LINK_IDLE).getMax());
+    TEST_ASSERT_EQUAL_UINT32(0, probe.getRoundTrip(LINK_DISCONNECTED).getCount());
+}
+
+void test_lost_and_late_probes()
+{
+    FakeTransport transport;
+    RoundTripProbe probe;
+    probe.begin(&transport, "bridge/ping");
+    probe.handle(0, 0, LINK_ACTIVE);
+    std::string first = transport.messages.back();
+    probe.handle(RTT_PROBE_INTERVAL_MS, RTT_PROBE_INTERVAL_MS * 1000UL, LINK_ACTIVE);
+    TEST_ASSERT_EQUAL_UINT32(1, probe.getLost());
+    // the first probe arrives after the second was sent
+    echo(probe, first, RTT_PROBE_INTERVAL_MS * 1000UL + 10);
+    echo(probe, "garbage", RTT_PROBE_INTERVAL_MS * 1000UL + 20);
+    TEST_ASSERT_EQUAL_UINT32(0, probe.getRoundTrip(LINK_ACTIVE).getCount());
+    echo(probe, transport.messages.back(), RTT_PROBE_INTERVAL_MS * 1000UL + 30);
+    TEST_ASSERT_EQUAL_UINT32(1, probe.getRoundTrip(LINK_ACTIVE).getCount());
+
+    // a probe that could not be published is not lost
+    transport.up = false;
+    probe.handle(2 * RTT_PROBE_INTERVAL_MS, 0, LINK_ACTIVE);
+    transport.up = true;
+    probe.handle(3 * RTT_PROBE_INTERVAL_MS, 0, LINK_ACTIVE);
+    TEST_ASSERT_EQUAL_UINT32(1, probe.getLost());
+
+    probe.reset();
+    TEST_ASSERT_EQUAL_UINT32(0, probe.getLost());
+    TEST_ASSERT_EQUAL_UINT32(0, probe.getRoundTrip(LINK_ACTIVE).getCount());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip_per_link_mode);
+    RUN_TEST(test_lost_and_late_probes);
+    return UNITY_END();
+}
@@ -0,0 +1,149 @@
+#include <unity.h>
+#include <vector>
+
+#include "SessionLog.h"
+
+class MemoryStorage : public SessionStorage
+{
+public:
+    bool beginSession() override
+    {
+        sessions.push_back(std::vector<uint8_t>());
+        open = true;
+        return true;
+    }
+
+    bool append(const uint8_t *data, size_t length) override
+    {
+        writes.push_back(length);
+        sessions.back().insert(sessions.back().end(), data, data + length);
+        return true;
+    }
+
+    void endSession() override
+    {
+        open = false;
+    }
+
+    bool open = false;
+    std::vector<std::vector<uint8_t>> sessions;
+    std::vector<size_t> writes;
+};
+
+static TreadMillData runningSample(uint32_t i)
+{
+    TreadMillData data;
+    data.status = TreadMillData::RUNNING;
+    data.speedCmdMilli = 3500;
+    data.speedFeedbackMilli = 3500 - (i % 3) * 10;
+    data.distanceMilli = i;
+    data.steps = i * 10 / 7;
+    data.calories = i / 20;
+    data.durationMs = i * 1000;
+    data.fwVersion = 9;
+    return data;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_encoder_round_trip()
+{
+    uint8_t buffer[SESSION_HEADER_LENGTH + 10 * SESSION_RECORD_MAX_LENGTH];
+    size_t length = SessionEncoder::writeHeader(9, 1760000000, buffer);
+    SessionEncoder encoder;
+    for (uint32_t i = 0; i < 10; ++i)
+    {
+        SessionSample sample;
+        sample.timeMs = i * 200;
+        sample.data = runningSample(i);
+        length += encoder.encode(sample, buffer + length);
+    }
+    // constant walking stays small
+    TEST_ASSERT_TRUE(length - SESSION_HEADER_LENGTH < 10 * 12);
+
+    SessionDecoder decoder(buffer, length);
+    TEST_ASSERT_TRUE(decoder.isValid());
+    TEST_ASSERT_EQUAL_UINT8(9, decoder.getFwVersion());
+    TEST_ASSERT_EQUAL_UINT32(1760000000, decoder.getStartUnixTime());
+    SessionSample sample;
+    for (uint32_t i = 0; i < 10; ++i)
+    {
+        TEST_ASSERT_TRUE(decoder.next(sample));
+        TreadMillData expected = runningSample(i);
+        TEST_ASSERT_EQUAL_UINT32(i * 200, sample.timeMs);
+        TEST_ASSERT_EQUAL(TreadMillData::RUNNING, sample.data.status);
+        TEST_ASSERT_EQUAL_UINT16(expected.speedFeedbackMilli, sample.data.speedFeedbackMilli);
+        TEST_ASSERT_EQUAL_UINT16(expected.speedCmdMilli, sample.data.speedCmdMilli);
+        TEST_ASSERT_EQUAL_UINT32(expected.distanceMilli, sample.data.distanceMilli);
+        TEST_ASSERT_EQUAL_UINT32(expected.steps, sample.data.steps);
+        TEST_ASSERT_EQUAL_UINT16(expected.calories, sample.data.calories);
+        TEST_ASSERT_EQUAL_UINT32(expected.durationMs, sample.data.durationMs);
+    }
+    TEST_ASSERT_FALSE(decoder.next(sample));
+}
+
+void test_recorder_writes_records_and_closes_on_stop()
+{
+    MemoryStorage storage;
+    SessionRecorder recorder(storage);
+    TreadMillData stopped;
+    stopped.status = TreadMillData::STOPPED;
+    recorder.onData(stopped, 0);
+    TEST_ASSERT_FALSE(recorder.isRecording());
+
+    const uint32_t samples = 500;
+    for (uint32_t i = 0; i < samples; ++i)
+    {
+        recorder.onData(runningSample(i), 1000 + i * 200);
+    }
+    TEST_ASSERT_TRUE(recorder.isRecording());
+    TreadMillData paused = runningSample(samples);
+    paused.status = TreadMillData::PAUSED;
+    recorder.onData(paused, 200000);
+    recorder.onData(paused, 200200);
+    recorder.onData(stopped, 201000);
+    TEST_ASSERT_FALSE(recorder.isRecording());
+    TEST_ASSERT_FALSE(storage.open);
+
+    // the header, then one append per record, the storage does the batching
+    TEST_ASSERT_EQUAL(samples + 2, storage.writes.size());
+    TEST_ASSERT_EQUAL(SESSION_HEADER_LENGTH, storage.writes[0]);
+    for (size_t i = 1; i < storage.writes.size(); ++i)
+    {
+        TEST_ASSERT_TRUE(storage.writes[i] <= SESSION_RECORD_MAX_LENGTH);
+    }
+
+    const std::vector<uint8_t> &session = storage.sessions[0];
+    TEST_ASSERT_EQUAL(session.size(), recorder.getStats().bytesWritten);
+    SessionDecoder decoder(session.data(), session.size());
+    SessionSample sample;
+    uint32_t count = 0;
+    SessionSample last;
+    while (decoder.next(sample))
+    {
+        last = sample;
+        count++;
+    }
+    // the pause is recorded once
+    TEST_ASSERT_EQUAL_UINT32(samples + 1, count);
+    TEST_ASSERT_EQUAL(TreadMillData::PAUSED, last.data.status);
+    TEST_ASSERT_EQUAL_UINT32(199000, last.timeMs);
+
+    // the next run opens a new session
+    recorder.onData(runningSample(0), 300000);
+    TEST_ASSERT_EQUAL(2, storage.sessions.size());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_encoder_round_trip);
+    RUN_TEST(test_recorder_writes_records_and_closes_on_stop);
+    return UNITY_END();
+}
@@ -0,0 +1,111 @@
+#include <unity.h>
+#include <Arduino.h>
+#include <atomic>
+#include <thread>
+
+#include "SpscRing.h"
+#include "platform.h"
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_push_pop_order()
+{
+    SpscRing<uint32_t, 4> ring;
+    TEST_ASSERT_TRUE(ring.empty());
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        TEST_ASSERT_TRUE(ring.push(i));
+    }
+    uint32_t value;
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        TEST_ASSERT_TRUE(ring.pop(value));
+        TEST_ASSERT_EQUAL_UINT32(i, value);
+    }
+    TEST_ASSERT_FALSE(ring.pop(value));
+}
+
+void test_overflow_and_high_water()
+{
+    SpscRing<uint32_t, 4> ring;
+    for (uint32_t i = 0; i < 6; ++i)
+    {
+        ring.push(i);
+    }
+    TEST_ASSERT_EQUAL_UINT32(2, ring.getOverflows());
+    TEST_ASSERT_EQUAL(4, ring.getHighWater());
+
+    // the oldest elements are kept, the newest are dropped
+    uint32_t value;
+    TEST_ASSERT_TRUE(ring.pop(value));
+    TEST_ASSERT_EQUAL_UINT32(0, value);
+    TEST_ASSERT_TRUE(ring.push(100));
+    TEST_ASSERT_EQUAL(4, ring.size());
+}
+
+// Hammers the producer from a second thread while the consumer drains with
+// pauses, every element must either arrive in order or be counted as overflow.
+void test_stress_producer()
+{
+    static SpscRing<TreadMillData, 16> ring;
+    const uint32_t count = 2000000;
+    std::atomic<bool> done{false};
+
+    std::thread producer([&]()
+                         {
+        TreadMillData data;
+        for (uint32_t i = 1; i <= count; ++i)
+        {
+            data.steps = i;
+            data.durationMs = i * 3;
+            ring.push(data);
+            if ((i & 0xFF) == 0)
+            {
+                std::this_thread::yield();
+            }
+        }
+        done = true; });
+
+    uint32_t received = 0;
+    uint32_t lastSeq = 0;
+    TreadMillData data;
+    while (!done || !ring.empty())
+    {
+        if (!ring.pop(data))
+        {
+            continue;
+        }
+        TEST_ASSERT_TRUE(data.steps > lastSeq);
+        TEST_ASSERT_EQUAL_UINT32(data.steps * 3, data.durationMs);
+        lastSeq = data.steps;
+        received++;
+        if ((received & 0xFFF) == 0)
+        {
+            // simulate a slow publish so the ring runs full
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+    producer.join();
+
+    char message[96];
+    snprintf(message, sizeof(message), "received %u, overflows %u, high water %u",
+             received, ring.getOverflows(), (unsigned)ring.getHighWater());
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL_UINT32(count, received + ring.getOverflows());
+    TEST_ASSERT_TRUE(ring.getHighWater() <= ring.capacity());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_push_pop_order);
+    RUN_TEST(test_overflow_and_high_water);
+    RUN_TEST(test_stress_producer);
+    return UNITY_END();
+}
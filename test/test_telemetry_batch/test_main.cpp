@@ -0,0 +1,141 @@
+#include <unity.h>
+#include <string>
+#include <vector>
+
+#include "TelemetryBatcher.h"
+#include "FakeTransport.h"
+
+static TreadMillData makeFrame(uint32_t receivedUs, uint32_t distance)
+{
+    TreadMillData data;
+    data.speedFeedbackMilli = 3200;
+    data.speedCmdMilli = 3500;
+    data.distanceMilli = distance;
+    data.steps = distance * 2;
+    data.calories = 12;
+    data.durationMs = 61000;
+    data.status = TreadMillData::RUNNING;
+    data.receivedUs = receivedUs;
+    return data;
+}
+
+static TelemetryBatcher::Config enabledConfig(uint8_t batchSize, uint32_t flushIntervalMs)
+{
+    TelemetryBatcher::Config config;
+    config.enabled = true;
+    config.batchSize = batchSize;
+    config.flushIntervalMs = flushIntervalMs;
+    return config;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_disabled_by_default()
+{
+    FakeTransport transport;
+    TelemetryBatcher batcher;
+    batcher.begin(&transport, "raw");
+    batcher.add(makeFrame(0, 1), 0);
+    batcher.flush();
+    TEST_ASSERT_EQUAL(0, transport.messages.size());
+    TEST_ASSERT_EQUAL_UINT32(0, batcher.getStats().samples);
+}
+
+void test_flushes_on_count_and_round_trips()
+{
+    FakeTransport transport;
+    TelemetryBatcher batcher;
+    batcher.begin(&transport, "raw");
+    batcher.setConfig(enabledConfig(4, 10000));
+
+    // 5 frames at 200 ms, the fifth starts the next batch
+    for (uint32_t i = 0; i < 5; ++i)
+    {
+        batcher.add(makeFrame(1000000 + i * 200000, 100 + i), i * 200);
+    }
+    TEST_ASSERT_EQUAL(1, transport.messages.size());
+    TEST_ASSERT_EQUAL(1, batcher.getPendingSamples());
+
+    const std::string &batch = transport.messages[0];
+    TEST_ASSERT_EQUAL(TELEMETRY_HEADER_LENGTH + 4 * TELEMETRY_SAMPLE_LENGTH, batch.size());
+    const uint8_t *bytes = (const uint8_t *)batch.data();
+    TEST_ASSERT_EQUAL_UINT8(TELEMETRY_VERSION, bytes[0]);
+    TEST_ASSERT_EQUAL_UINT8(4, bytes[1]);
+    for (size_t i = 0; i < 4; ++i)
+    {
+        uint32_t offsetUs;
+        TreadMillData data;
+        TEST_ASSERT_TRUE(TelemetryBatcher::decodeSample(bytes, batch.size(), i, offsetUs, data));
+        TreadMillData expected = makeFrame(1000000 + i * 200000, 100 + i);
+        TEST_ASSERT_EQUAL_UINT32(i * 200000, offsetUs);
+        TEST_ASSERT_EQUAL_UINT32(expected.receivedUs, data.receivedUs);
+        TEST_ASSERT_EQUAL_UINT16(expected.speedFeedbackMilli, data.speedFeedbackMilli);
+        TEST_ASSERT_EQUAL_UINT16(expected.speedCmdMilli, data.speedCmdMilli);
+        TEST_ASSERT_EQUAL_UINT32(expected.distanceMilli, data.distanceMilli);
+        TEST_ASSERT_EQUAL_UINT32(expected.steps, data.steps);
+        TEST_ASSERT_EQUAL_UINT16(expected.calories, data.calories);
+        TEST_ASSERT_EQUAL_UINT32(expected.durationMs, data.durationMs);
+        TEST_ASSERT_EQUAL(expected.status, data.status);
+    }
+    uint32_t offsetUs;
+    TreadMillData data;
+    TEST_ASSERT_FALSE(TelemetryBatcher::decodeSample(bytes, batch.size(), 4, offsetUs, data));
+}
+
+void test_flushes_on_age()
+{
+    FakeTransport transport;
+    TelemetryBatcher batcher;
+    batcher.begin(&transport, "raw");
+    batcher.setConfig(enabledConfig(32, 1000));
+    TEST_ASSERT_EQUAL(UINT32_MAX, batcher.getMsUntilFlush(0));
+
+    batcher.add(makeFrame(0, 1), 5000);
+    batcher.add(makeFrame(300000, 2), 5300);
+    TEST_ASSERT_EQUAL_UINT32(700, batcher.getMsUntilFlush(5300));
+    batcher.handle(5999);
+    TEST_ASSERT_EQUAL(0, transport.messages.size());
+    batcher.handle(6000);
+    TEST_ASSERT_EQUAL(1, transport.messages.size());
+    TEST_ASSERT_EQUAL_UINT8(2, (uint8_t)transport.messages[0][1]);
+    TEST_ASSERT_EQUAL(UINT32_MAX, batcher.getMsUntilFlush(6000));
+}
+
+void test_config_is_clamped_and_drops_are_counted()
+{
+    FakeTransport transport;
+    TelemetryBatcher batcher;
+    batcher.begin(&transport, "raw");
+    batcher.setConfig(enabledConfig(0, 5));
+    TEST_ASSERT_EQUAL_UINT8(1, batcher.getConfig().batchSize);
+    TEST_ASSERT_EQUAL_UINT32(TELEMETRY_MIN_FLUSH_MS, batcher.getConfig().flushIntervalMs);
+    batcher.setConfig(enabledConfig(200, 100000));
+    TEST_ASSERT_EQUAL_UINT8(TELEMETRY_MAX_BATCH, batcher.getConfig().batchSize);
+    TEST_ASSERT_EQUAL_UINT32(TELEMETRY_MAX_FLUSH_MS, batcher.getConfig().flushIntervalMs);
+
+    transport.up = false;
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        batcher.add(makeFrame(i, i), i);
+    }
+    // a config change publishes what was collected with the old settings
+    batcher.setConfig(enabledConfig(8, 1000));
+    TEST_ASSERT_EQUAL_UINT32(3, batcher.getStats().dropped);
+    TEST_ASSERT_EQUAL(0, batcher.getPendingSamples());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_disabled_by_default);
+    RUN_TEST(test_flushes_on_count_and_round_trips);
+    RUN_TEST(test_flushes_on_age);
+    RUN_TEST(test_config_is_clamped_and_drops_are_counted);
+    return UNITY_END();
+}
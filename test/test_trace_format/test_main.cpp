@@ -0,0 +1,95 @@
+#include <unity.h>
+
+#include "TraceFormat.h"
+#include "StatusFrameBuilder.h"
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_varint_round_trip()
+{
+    const uint64_t values[] = {0, 1, 127, 128, 300, 16383, 16384, 200000, 0xFFFFFFFFULL, 0xFFFFFFFFFFFFFFFFULL};
+    const size_t lengths[] = {1, 1, 1, 2, 2, 2, 3, 3, 5, 10};
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i)
+    {
+        uint8_t buffer[TRACE_VARINT_MAX_LENGTH];
+        size_t length = encodeVarint(values[i], buffer);
+        TEST_ASSERT_EQUAL(lengths[i], length);
+        size_t pos = 0;
+        uint64_t decoded;
+        TEST_ASSERT_TRUE(decodeVarint(buffer, length, pos, decoded));
+        TEST_ASSERT_EQUAL(length, pos);
+        TEST_ASSERT_TRUE(values[i] == decoded);
+    }
+    uint8_t unterminated[] = {0x80, 0x80};
+    size_t pos = 0;
+    uint64_t value;
+    TEST_ASSERT_FALSE(decodeVarint(unterminated, sizeof(unterminated), pos, value));
+}
+
+void test_trace_round_trip()
+{
+    uint8_t frame[STATUS_FRAME_LENGTH];
+    buildStatusFrame(StatusFrameFields(), frame);
+    uint8_t trace[256];
+    TraceWriter writer;
+    size_t length = TraceWriter::writeHeader(trace);
+    length += writer.writeRecord(1000, TRACE_CHANNEL_STATE, frame, sizeof(frame), trace + length, sizeof(trace) - length);
+    length += writer.writeRecord(201000, TRACE_CHANNEL_NOTIFY1, frame, 5, trace + length, sizeof(trace) - length);
+    // a status frame 200 ms after the previous one takes 36 bytes
+    size_t before = length;
+    length += writer.writeRecord(401000, TRACE_CHANNEL_STATE, frame, sizeof(frame), trace + length, sizeof(trace) - length);
+    TEST_ASSERT_EQUAL(36, length - before);
+
+    TraceReader reader(trace, length);
+    TEST_ASSERT_TRUE(reader.isValid());
+    TraceRecord record;
+    TEST_ASSERT_TRUE(reader.next(record));
+    TEST_ASSERT_TRUE(record.timeUs == 1000);
+    TEST_ASSERT_EQUAL(TRACE_CHANNEL_STATE, record.channel);
+    TEST_ASSERT_EQUAL(STATUS_FRAME_LENGTH, record.length);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(frame, record.data, STATUS_FRAME_LENGTH);
+    TEST_ASSERT_TRUE(reader.next(record));
+    TEST_ASSERT_TRUE(record.timeUs == 201000);
+    TEST_ASSERT_EQUAL(TRACE_CHANNEL_NOTIFY1, record.channel);
+    TEST_ASSERT_EQUAL(5, record.length);
+    TEST_ASSERT_TRUE(reader.next(record));
+    TEST_ASSERT_TRUE(record.timeUs == 401000);
+    TEST_ASSERT_FALSE(reader.next(record));
+    TEST_ASSERT_FALSE(reader.isTruncated());
+}
+
+void test_truncated_and_invalid_traces()
+{
+    uint8_t frame[STATUS_FRAME_LENGTH];
+    buildStatusFrame(StatusFrameFields(), frame);
+    uint8_t trace[64];
+    TraceWriter writer;
+    size_t length = TraceWriter::writeHeader(trace);
+    length += writer.writeRecord(0, TRACE_CHANNEL_STATE, frame, sizeof(frame), trace + length, sizeof(trace) - length);
+    TEST_ASSERT_EQUAL(0, writer.writeRecord(1, TRACE_CHANNEL_STATE, frame, sizeof(frame), trace + length, sizeof(trace) - length));
+
+    TraceReader truncated(trace, length - 1);
+    TraceRecord record;
+    TEST_ASSERT_FALSE(truncated.next(record));
+    TEST_ASSERT_TRUE(truncated.isTruncated());
+
+    trace[4] = TRACE_VERSION + 1;
+    TraceReader otherVersion(trace, length);
+    TEST_ASSERT_FALSE(otherVersion.isValid());
+    TEST_ASSERT_FALSE(otherVersion.next(record));
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_varint_round_trip);
+    RUN_TEST(test_trace_round_trip);
+    RUN_TEST(test_truncated_and_invalid_traces);
+    return UNITY_END();
+}
@@ -0,0 +1,132 @@
+#include <unity.h>
+#include <vector>
+
+#include "TreadmillSession.h"
+#include "StatusFrameBuilder.h"
+
+// records written frames instead of sending them over BLE
+class RecordingLink : public TreadmillLink
+{
+public:
+    bool isConnected() const override
+    {
+        return connected;
+    }
+
+    bool writeCommand(const uint8_t *data, size_t length, bool withResponse) override
+    {
+        if (!connected)
+        {
+            return false;
+        }
+        frames.push_back(std::vector<uint8_t>(data, data + length));
+        lastWithResponse = withResponse;
+        return true;
+    }
+
+    bool connected = true;
+    bool lastWithResponse = false;
+    std::vector<std::vector<uint8_t>> frames;
+};
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_notification_reaches_callback()
+{
+    TreadmillSession session;
+    int wakeups = 0;
+    std::vector<TreadMillData> received;
+    session.setWakeupCallback([&wakeups]()
+                              { wakeups++; });
+    session.setCallback([&received](const TreadMillData &data)
+                        { received.push_back(data); });
+
+    StatusFrameFields fields;
+    fields.speedFeedback = 2500;
+    fields.flags = 8;
+    uint8_t frame[STATUS_FRAME_LENGTH];
+    buildStatusFrame(fields, frame);
+
+    // split over two notifications
+    session.onNotification(frame, 10);
+    TEST_ASSERT_EQUAL(0, wakeups);
+    session.onNotification(frame + 10, STATUS_FRAME_LENGTH - 10);
+    TEST_ASSERT_EQUAL(1, wakeups);
+    TEST_ASSERT_EQUAL_UINT32(0, session.getMsUntilNextTimer());
+
+    session.handle();
+    TEST_ASSERT_EQUAL(1, received.size());
+    TEST_ASSERT_EQUAL_UINT16(2500, received[0].speedFeedbackMilli);
+    TEST_ASSERT_EQUAL(TreadMillData::RUNNING, session.getLastData().status);
+    TEST_ASSERT_EQUAL_UINT32(1, session.getParseLatency().getCount());
+    TEST_ASSERT_TRUE(session.getMsUntilNextTimer() > 0);
+}
+
+void test_commands_are_written_to_link()
+{
+    TreadmillSession session;
+    RecordingLink link;
+    TEST_ASSERT_TRUE(session.queueCommand(TreadmillProtocol::CMD_START_SET_SPEED, 3000, 0));
+    TEST_ASSERT_TRUE(session.queueCommand(TreadmillProtocol::CMD_PAUSE, 0, 0));
+    session.setWriteWithResponse(false);
+    session.sendQueuedCommands(link);
+
+    TEST_ASSERT_EQUAL(2, link.frames.size());
+    TEST_ASSERT_FALSE(link.lastWithResponse);
+    uint8_t expected[COMMAND_FRAME_LENGTH];
+    TreadmillProtocol::makePacket(TreadmillProtocol::CMD_START_SET_SPEED, 3000, expected);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, link.frames[0].data(), COMMAND_FRAME_LENGTH);
+    TEST_ASSERT_EQUAL_UINT32(1, session.getCommandLatency(TreadmillSession::KIND_SPEED).count);
+    TEST_ASSERT_EQUAL_UINT32(1, session.getCommandLatency(TreadmillSession::KIND_PAUSE).count);
+    TEST_ASSERT_EQUAL_UINT32(2, session.getCommandLatencyHistogram().getCount());
+}
+
+void test_failed_writes_are_counted()
+{
+    TreadmillSession session;
+    RecordingLink link;
+    link.connected = false;
+    session.queueCommand(TreadmillProtocol::CMD_STOP, 0, 0);
+    session.sendQueuedCommands(link);
+    TEST_ASSERT_EQUAL_UINT32(1, session.getCommandLatency(TreadmillSession::KIND_STOP).failed);
+    TEST_ASSERT_EQUAL_UINT32(0, session.getCommandLatencyHistogram().getCount());
+    TEST_ASSERT_EQUAL(0, session.getCommandQueue().size());
+    session.resetCommandLatency();
+    TEST_ASSERT_EQUAL_UINT32(0, session.getCommandLatency(TreadmillSession::KIND_STOP).failed);
+}
+
+void test_sessions_take_turns()
+{
+    // a sender shared by two treadmills writes one command of each per round
+    TreadmillSession first, second;
+    RecordingLink firstLink, secondLink;
+    first.queueCommand(TreadmillProtocol::CMD_STOP, 0, 0);
+    first.queueCommand(TreadmillProtocol::CMD_PAUSE, 0, 0);
+    second.queueCommand(TreadmillProtocol::CMD_STOP, 0, 0);
+
+    TEST_ASSERT_TRUE(first.sendNextCommand(firstLink));
+    TEST_ASSERT_TRUE(second.sendNextCommand(secondLink));
+    TEST_ASSERT_EQUAL(1, firstLink.frames.size());
+    TEST_ASSERT_EQUAL(1, secondLink.frames.size());
+    TEST_ASSERT_TRUE(first.sendNextCommand(firstLink));
+    TEST_ASSERT_FALSE(second.sendNextCommand(secondLink));
+    TEST_ASSERT_FALSE(first.sendNextCommand(firstLink));
+    TEST_ASSERT_EQUAL(2, firstLink.frames.size());
+    TEST_ASSERT_EQUAL_UINT32(1, first.getCommandLatency(TreadmillSession::KIND_PAUSE).count);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_notification_reaches_callback);
+    RUN_TEST(test_commands_are_written_to_link);
+    RUN_TEST(test_failed_writes_are_counted);
+    RUN_TEST(test_sessions_take_turns);
+    return UNITY_END();
+}
@@ -0,0 +1,153 @@
+#include <unity.h>
+
+#include "StatusFrameBuilder.h"
+#include "WorkoutMetrics.h"
+
+static const uint8_t FLAGS_RUNNING = 8;
+static const uint8_t FLAGS_PAUSED = 16;
+
+// Walks a virtual pad and feeds its status frames through the parser, the
+// counters are truncated like the real ones
+class Walk
+{
+public:
+    explicit Walk(WorkoutMetrics &metrics, uint32_t startDistanceM = 0)
+        : m_metrics(metrics), m_distanceUm((uint64_t)startDistanceM * 1000000)
+    {
+    }
+
+    // advances the moving time in 250 ms frames, kcalPerHour drives the calorie counter
+    void walk(uint16_t speedMilli, uint32_t durationMs, uint32_t kcalPerHour = 180)
+    {
+        for (uint32_t elapsed = 0; elapsed < durationMs; elapsed += 250)
+        {
+            m_durationMs += 250;
+            m_distanceUm += (uint64_t)speedMilli * 250 * 10 / 36;
+            m_calorieMs += kcalPerHour * 250;
+            send(speedMilli, FLAGS_RUNNING);
+        }
+    }
+
+    // paused frames keep the counters
+    void pause(uint32_t frames)
+    {
+        for (uint32_t i = 0; i < frames; ++i)
+        {
+            send(0, FLAGS_PAUSED);
+        }
+    }
+
+private:
+    void send(uint16_t speedMilli, uint8_t flags)
+    {
+        StatusFrameFields fields;
+        fields.speedFeedback = speedMilli;
+        fields.speedCmd = speedMilli;
+        fields.distance = m_distanceUm / 1000000;
+        fields.calories = m_calorieMs / 3600000;
+        fields.durationMs = m_durationMs;
+        fields.flags = flags;
+        uint8_t frame[STATUS_FRAME_LENGTH];
+        buildStatusFrame(fields, frame);
+        TreadMillData data;
+        TEST_ASSERT_TRUE(TreadmillProtocol::parseStatus(frame, sizeof(frame), data));
+        m_metrics.onData(data);
+    }
+
+    WorkoutMetrics &m_metrics;
+    uint32_t m_durationMs = 0;
+    uint64_t m_distanceUm;
+    uint64_t m_calorieMs = 0; // kcal/h * ms
+};
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_constant_speed()
+{
+    WorkoutMetrics metrics;
+    Walk walk(metrics);
+    walk.walk(6000, 21 * 60000);
+
+    const WorkoutMetricsSnapshot &snapshot = metrics.get();
+    TEST_ASSERT_EQUAL_UINT32(600, snapshot.paceSecPerKm);
+    TEST_ASSERT_UINT32_WITHIN(2, 6000, snapshot.windowSpeedMilli);
+    TEST_ASSERT_UINT32_WITHIN(5, 6000, snapshot.averageSpeedMilli);
+    TEST_ASSERT_EQUAL_UINT32(2, snapshot.splitCount);
+    TEST_ASSERT_UINT32_WITHIN(250, 600000, snapshot.lastSplitMs);
+    TEST_ASSERT_UINT32_WITHIN(250, 60000, snapshot.currentSplitMs);
+    // one kcal of the counter is 12 kcal/h over 5 minutes
+    TEST_ASSERT_UINT32_WITHIN(12, 180, snapshot.calorieRate);
+}
+
+void test_window_follows_speed_change()
+{
+    WorkoutMetrics metrics;
+    Walk walk(metrics);
+    walk.walk(3000, 5 * 60000);
+    TEST_ASSERT_UINT32_WITHIN(2, 3000, metrics.get().windowSpeedMilli);
+
+    walk.walk(6000, 30000);
+    // half of the last minute at each speed, the counter alone only moves 50 m in that time
+    TEST_ASSERT_UINT32_WITHIN(300, 4500, metrics.get().windowSpeedMilli);
+    TEST_ASSERT_EQUAL_UINT32(600, metrics.get().paceSecPerKm);
+
+    walk.walk(6000, 40000);
+    TEST_ASSERT_UINT32_WITHIN(2, 6000, metrics.get().windowSpeedMilli);
+    TEST_ASSERT_UINT32_WITHIN(10, 3567, metrics.get().averageSpeedMilli);
+}
+
+void test_splits_skip_pauses()
+{
+    WorkoutMetrics metrics;
+    Walk walk(metrics);
+    walk.walk(6000, 500000);
+    walk.pause(400);
+    TEST_ASSERT_EQUAL_UINT32(0, metrics.get().paceSecPerKm);
+    // 1000 m after 600 s at 6 km/h, then 1000 m in 300 s at 12 km/h
+    walk.walk(6000, 100000);
+    walk.walk(12000, 310000);
+
+    const WorkoutMetricsSnapshot &snapshot = metrics.get();
+    TEST_ASSERT_EQUAL_UINT32(2, snapshot.splitCount);
+    TEST_ASSERT_UINT32_WITHIN(250, 300000, snapshot.lastSplitMs);
+    TEST_ASSERT_UINT32_WITHIN(250, 300000, snapshot.bestSplitMs);
+    TEST_ASSERT_UINT32_WITHIN(10, 8043, snapshot.averageSpeedMilli);
+}
+
+void test_session_joined_midway_and_restart()
+{
+    WorkoutMetrics metrics(500);
+    Walk joined(metrics, 250);
+    joined.walk(6000, 60000);
+    // the first boundary at 500 m only starts the timing
+    TEST_ASSERT_EQUAL_UINT32(0, metrics.get().splitCount);
+    TEST_ASSERT_UINT32_WITHIN(10, 180, metrics.get().calorieRate);
+    joined.walk(6000, 400000);
+    TEST_ASSERT_EQUAL_UINT32(1, metrics.get().splitCount);
+    TEST_ASSERT_UINT32_WITHIN(250, 300000, metrics.get().lastSplitMs);
+
+    // the duration counter going backwards starts a new session
+    Walk next(metrics);
+    next.walk(6000, 20000);
+    TEST_ASSERT_EQUAL_UINT32(0, metrics.get().splitCount);
+    TEST_ASSERT_EQUAL_UINT32(0, metrics.get().lastSplitMs);
+    // not enough data for a calorie rate yet
+    TEST_ASSERT_EQUAL_UINT32(0, metrics.get().calorieRate);
+    TEST_ASSERT_UINT32_WITHIN(2, 6000, metrics.get().windowSpeedMilli);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_constant_speed);
+    RUN_TEST(test_window_follows_speed_change);
+    RUN_TEST(test_splits_skip_pauses);
+    RUN_TEST(test_session_joined_midway_and_restart);
+    return UNITY_END();
+}
@@ -0,0 +1,185 @@
+#include <unity.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "WorkoutProgram.h"
+
+static bool parse(WorkoutProgram &program, const char *text)
+{
+    return program.parse(text, strlen(text));
+}
+
+// Virtual pad sending a frame every 250 ms, the runner's deadlines are served
+// latenessUs late in between. padRatePercent skews the moving time of the pad.
+class PadSimulation
+{
+public:
+    PadSimulation(WorkoutRunner &runner, uint32_t latenessUs = 300, uint32_t padRatePercent = 100)
+        : m_runner(runner), m_latenessUs(latenessUs), m_padRatePercent(padRatePercent)
+    {
+    }
+
+    void run(TreadMillData::Status status, uint32_t durationMs)
+    {
+        for (uint32_t elapsed = 0; elapsed < durationMs; elapsed += 250)
+        {
+            m_nowUs += 250000;
+            while (m_runner.getDeadlineUs() <= m_nowUs)
+            {
+                uint16_t speed;
+                if (m_runner.onDeadline(m_runner.getDeadlineUs() + m_latenessUs, speed))
+                {
+                    setpoints.push_back(speed);
+                }
+            }
+            if (status == TreadMillData::RUNNING)
+            {
+                m_padMovingMs += 250;
+            }
+            TreadMillData data;
+            data.status = status;
+            data.durationMs = m_padMovingMs * m_padRatePercent / 100;
+            m_runner.onData(data, m_nowUs);
+        }
+    }
+
+    uint64_t getNowUs() const
+    {
+        return m_nowUs;
+    }
+
+    std::vector<uint16_t> setpoints;
+
+private:
+    WorkoutRunner &m_runner;
+    uint32_t m_latenessUs;
+    uint32_t m_padRatePercent;
+    uint64_t m_nowUs = 1000000;
+    uint32_t m_padMovingMs = 0;
+};
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_parse_program()
+{
+    WorkoutProgram program;
+    TEST_ASSERT_TRUE(parse(program, "3:300, 5.5:120:30 ,3:300"));
+    TEST_ASSERT_EQUAL(3, program.getStepCount());
+    TEST_ASSERT_EQUAL_UINT16(5500, program.getStep(1).speedMilli);
+    TEST_ASSERT_EQUAL_UINT32(120000, program.getStep(1).durationMs);
+    TEST_ASSERT_EQUAL_UINT32(30000, program.getStep(1).rampMs);
+    TEST_ASSERT_EQUAL_UINT32(0, program.getStep(0).rampMs);
+    TEST_ASSERT_EQUAL_UINT32(420000, program.getStartMs(2));
+    TEST_ASSERT_EQUAL_UINT32(720000, program.getTotalMs());
+
+    const char *invalid[] = {"", "3", "7:10", "0.1:10", "3:0", "3:10:20", "abc:10", "3:10,", "3:10:1:1"};
+    for (const char *text : invalid)
+    {
+        TEST_ASSERT_FALSE_MESSAGE(parse(program, text), text);
+        TEST_ASSERT_EQUAL(0, program.getStepCount());
+    }
+
+    std::string tooLong;
+    for (int i = 0; i <= WORKOUT_MAX_STEPS; ++i)
+    {
+        tooLong += i == 0 ? "3:10" : ",3:10";
+    }
+    TEST_ASSERT_FALSE(parse(program, tooLong.c_str()));
+}
+
+void test_ramp_setpoints()
+{
+    WorkoutProgram program;
+    TEST_ASSERT_TRUE(parse(program, "2:60,4:60:20"));
+    TEST_ASSERT_EQUAL_UINT16(2000, program.speedAt(0));
+    TEST_ASSERT_EQUAL_UINT16(2000, program.speedAt(60000));
+    TEST_ASSERT_EQUAL_UINT16(2500, program.speedAt(65000));
+    TEST_ASSERT_EQUAL_UINT16(4000, program.speedAt(79900));
+    TEST_ASSERT_EQUAL_UINT16(4000, program.speedAt(80000));
+    TEST_ASSERT_EQUAL_UINT16(0, program.speedAt(120000));
+
+    TEST_ASSERT_EQUAL_UINT32(60000, program.nextChangeMs(0));
+    TEST_ASSERT_EQUAL_UINT32(61000, program.nextChangeMs(60000));
+    TEST_ASSERT_EQUAL_UINT32(80000, program.nextChangeMs(79500));
+    TEST_ASSERT_EQUAL_UINT32(120000, program.nextChangeMs(80000));
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, program.nextChangeMs(120000));
+}
+
+void test_runner_follows_the_program()
+{
+    WorkoutRunner runner;
+    TEST_ASSERT_FALSE(runner.start());
+    TEST_ASSERT_TRUE(runner.load("2:60,4:60:20", 12));
+    TEST_ASSERT_TRUE(runner.start());
+
+    PadSimulation pad(runner);
+    // program time starts with the pad running, not with the countdown
+    pad.run(TreadMillData::COUNTDOWN, 3000);
+    TEST_ASSERT_EQUAL(WorkoutStatus::WAITING, runner.getStatus(pad.getNowUs()).state);
+    TEST_ASSERT_TRUE(pad.setpoints.empty());
+
+    pad.run(TreadMillData::RUNNING, 130000);
+    WorkoutStatus status = runner.getStatus(pad.getNowUs());
+    TEST_ASSERT_EQUAL(WorkoutStatus::FINISHED, status.state);
+    TEST_ASSERT_EQUAL_UINT32(120000, status.elapsedMs);
+
+    // 2.0, a ramp of 0.1 km/h steps once per second to 4.0, then the stop
+    TEST_ASSERT_EQUAL(1 + 20 + 1, pad.setpoints.size());
+    TEST_ASSERT_EQUAL_UINT16(2000, pad.setpoints.front());
+    TEST_ASSERT_EQUAL_UINT16(2100, pad.setpoints[1]);
+    TEST_ASSERT_EQUAL_UINT16(4000, pad.setpoints[20]);
+    TEST_ASSERT_EQUAL_UINT16(0, pad.setpoints.back());
+
+    // step starts and the end, each served 300 µs late
+    TEST_ASSERT_EQUAL_UINT32(3, runner.getTimerJitter().getCount());
+    TEST_ASSERT_EQUAL_UINT32(300, runner.getTimerJitter().getMax());
+    TEST_ASSERT_TRUE(runner.getDrift().getMax() <= 1000);
+}
+
+void test_pause_and_drift()
+{
+    WorkoutRunner runner;
+    TEST_ASSERT_TRUE(runner.load("3:60,4:60", 9));
+    TEST_ASSERT_TRUE(runner.start());
+    // the moving time of this pad runs 1% slow
+    PadSimulation pad(runner, 0, 99);
+
+    pad.run(TreadMillData::RUNNING, 30000);
+    pad.run(TreadMillData::PAUSED, 10000);
+    TEST_ASSERT_EQUAL(WorkoutStatus::PAUSED, runner.getStatus(pad.getNowUs()).state);
+    TEST_ASSERT_EQUAL(UINT64_MAX, runner.getDeadlineUs());
+    TEST_ASSERT_UINT32_WITHIN(250, 30000, runner.getStatus(pad.getNowUs()).elapsedMs);
+
+    // the pause does not count, the second step starts after 60 s of moving time
+    pad.run(TreadMillData::RUNNING, 29000);
+    TEST_ASSERT_EQUAL(1, pad.setpoints.size());
+    pad.run(TreadMillData::RUNNING, 2000);
+    TEST_ASSERT_EQUAL(2, pad.setpoints.size());
+    TEST_ASSERT_EQUAL_UINT16(4000, pad.setpoints.back());
+    WorkoutStatus status = runner.getStatus(pad.getNowUs());
+    TEST_ASSERT_EQUAL(1, status.step);
+    TEST_ASSERT_INT32_WITHIN(260, -600, status.lastDriftMs);
+
+    // stopping the pad ends the program without a setpoint
+    pad.run(TreadMillData::STOPPED, 1000);
+    TEST_ASSERT_EQUAL(WorkoutStatus::IDLE, runner.getStatus(pad.getNowUs()).state);
+    TEST_ASSERT_EQUAL(UINT64_MAX, runner.getDeadlineUs());
+    TEST_ASSERT_EQUAL(2, pad.setpoints.size());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_parse_program);
+    RUN_TEST(test_ramp_setpoints);
+    RUN_TEST(test_runner_follows_the_program);
+    RUN_TEST(test_pause_and_drift);
+    return UNITY_END();
+}